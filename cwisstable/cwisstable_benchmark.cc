@@ -14,7 +14,12 @@
 
 // absl::raw_hash_set's benchmarks modified to run over cwisstable.
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <deque>
+#include <mutex>
 #include <numeric>
 #include <random>
 #include <utility>
@@ -23,6 +28,7 @@
 #include "absl/strings/str_format.h"
 #include "benchmark/benchmark.h"
 #include "cwisstable.h"
+#include "cwisstable/internal/debug.h"
 #include "cwisstable/internal/test_helpers.h"
 
 namespace cwisstable {
@@ -64,9 +70,9 @@ void BM_CacheInSteadyState(benchmark::State& state) {
   while (StringTable_size(&t) < state.range(0)) {
     std::string k = gen(rng);
     std::string v = gen(rng);
-    auto [it, inserted] = StringTable_deferred_insert(&t, &k);
-    if (inserted) {
-      auto* ptr = StringTable_Iter_get(&it);
+    auto ins = StringTable_deferred_insert(&t, &k);
+    if (ins.inserted) {
+      auto* ptr = StringTable_Iter_get(&ins.iter);
       new (&ptr->key) std::string(std::move(k));
       new (&ptr->val) std::string(std::move(v));
       keys.push_back(ptr->key);
@@ -98,9 +104,9 @@ void BM_CacheInSteadyState(benchmark::State& state) {
     while (true) {
       std::string k = gen(rng);
       std::string v = gen(rng);
-      auto [it, inserted] = StringTable_deferred_insert(&t, &k);
-      if (inserted) {
-        auto* ptr = StringTable_Iter_get(&it);
+      auto ins = StringTable_deferred_insert(&t, &k);
+      if (ins.inserted) {
+        auto* ptr = StringTable_Iter_get(&ins.iter);
         new (&ptr->key) std::string(std::move(k));
         new (&ptr->val) std::string(std::move(v));
         keys.push_back(ptr->key);
@@ -144,9 +150,9 @@ void BM_EndComparison(benchmark::State& state) {
   while (StringTable_size(&t) < state.range(0)) {
     std::string k = gen(rng);
     std::string v = gen(rng);
-    auto [it, inserted] = StringTable_deferred_insert(&t, &k);
-    if (inserted) {
-      auto* ptr = StringTable_Iter_get(&it);
+    auto ins = StringTable_deferred_insert(&t, &k);
+    if (ins.inserted) {
+      auto* ptr = StringTable_Iter_get(&ins.iter);
       new (&ptr->key) std::string(std::move(k));
       new (&ptr->val) std::string(std::move(v));
     }
@@ -253,6 +259,20 @@ void BM_ReserveStringTable(benchmark::State& state) {
 }
 BENCHMARK(BM_ReserveStringTable)->Range(128, 4096);
 
+// Reserves room for many elements but inserts only a few, like a pre-sized
+// table at startup. With `CWISS_ZERO_EMPTY_CTRL`, most of the backing array is
+// never written to.
+void BM_ReserveLargeIntTable(benchmark::State& state) {
+  size_t reserve_size = state.range(0);
+  for (auto _ : state) {
+    auto t = IntTable_new(reserve_size);
+    for (int64_t i = 0; i < 64; ++i) Insert(t, i);
+    DoNotOptimize(t);
+    IntTable_destroy(&t);
+  }
+}
+BENCHMARK(BM_ReserveLargeIntTable)->Range(1 << 16, 1 << 24);
+
 // Like std::iota, except that ctrl_t doesn't support operator++.
 template <typename CtrlIter>
 void Iota(CtrlIter begin, CtrlIter end, int value) {
@@ -338,6 +358,1133 @@ void BM_DropDeletes(benchmark::State& state) {
 }
 BENCHMARK(BM_DropDeletes);
 
+// Squashes the tombstones of a table of `state.range(0)` elements, which
+// rehashes every element in place.
+void BM_DropDeletesWithoutResize(benchmark::State& state) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  std::mt19937_64 rng(0);
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    int64_t k = static_cast<int64_t>(rng());
+    IntTable_insert(&t, &k);
+  }
+  // Erasing leaves tombstones wherever a group was ever full. The rehash drops
+  // them all, so every iteration puts back and erases the same keys again.
+  auto make_tombstones = [&] {
+    rng.seed(0);
+    for (int64_t i = 0; i < state.range(0); i += 8) {
+      int64_t k = static_cast<int64_t>(rng());
+      IntTable_insert(&t, &k);
+      IntTable_erase(&t, &k);
+      for (int j = 1; j < 8; ++j) rng();
+    }
+  };
+  const size_t capacity = IntTable_capacity(&t);
+  make_tombstones();
+
+  for (auto _ : state) {
+    CWISS_RawTable_DropDeletesWithoutResize(IntTable_policy(), &t.set_);
+    DoNotOptimize(t.set_.ctrl_);
+
+    state.PauseTiming();
+    make_tombstones();
+    state.ResumeTiming();
+  }
+  if (IntTable_capacity(&t) != capacity) {
+    state.SkipWithError("rebuilding the tombstones grew the table");
+  }
+  state.SetItemsProcessed(state.iterations() * IntTable_size(&t));
+}
+BENCHMARK(BM_DropDeletesWithoutResize)
+    ->Arg(1000000)
+    ->Arg(10000000)
+    ->Arg(100000000)
+    ->Unit(benchmark::kMillisecond);
+
+CWISS_DECLARE_FLAT_HASHMAP(FlatU32Map, uint32_t, uint32_t);
+CWISS_DECLARE_INT_HASHMAP(IntU32Map, uint32_t, uint32_t);
+CWISS_DECLARE_FLAT_HASHMAP(FlatU64PtrMap, uint64_t, void*);
+CWISS_DECLARE_INT_HASHMAP(IntU64PtrMap, uint64_t, void*);
+
+// Looks up an even mix of present and absent random keys in a map with
+// `state.range(0)` elements.
+template <typename K, typename Map, typename Insert, typename Contains>
+void FindHitAndMiss(benchmark::State& state, Map* m, Insert insert,
+                    Contains contains) {
+  std::mt19937_64 rng(0);
+  std::vector<K> keys;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    keys.push_back(static_cast<K>(rng()));
+    insert(m, keys.back());
+  }
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    keys.push_back(static_cast<K>(rng()));
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    DoNotOptimize(contains(m, keys[i]));
+    if (++i == keys.size()) i = 0;
+  }
+}
+
+void BM_FindU32_Flat(benchmark::State& state) {
+  auto m = FlatU32Map_new(0);
+  absl::Cleanup c_ = [&] { FlatU32Map_destroy(&m); };
+  FindHitAndMiss<uint32_t>(
+      state, &m,
+      [](FlatU32Map* t, uint32_t k) {
+        FlatU32Map_Entry e = {k, k};
+        FlatU32Map_insert(t, &e);
+      },
+      [](FlatU32Map* t, uint32_t k) { return FlatU32Map_contains(t, &k); });
+}
+BENCHMARK(BM_FindU32_Flat)->Range(1 << 4, 1 << 20);
+
+void BM_FindU32_Int(benchmark::State& state) {
+  auto m = IntU32Map_new(0);
+  absl::Cleanup c_ = [&] { IntU32Map_destroy(&m); };
+  FindHitAndMiss<uint32_t>(
+      state, &m,
+      [](IntU32Map* t, uint32_t k) { IntU32Map_insert(t, &k, &k); },
+      [](IntU32Map* t, uint32_t k) { return IntU32Map_contains(t, &k); });
+}
+BENCHMARK(BM_FindU32_Int)->Range(1 << 4, 1 << 20);
+
+void BM_FindU64Ptr_Flat(benchmark::State& state) {
+  auto m = FlatU64PtrMap_new(0);
+  absl::Cleanup c_ = [&] { FlatU64PtrMap_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](FlatU64PtrMap* t, uint64_t k) {
+        FlatU64PtrMap_Entry e = {k, nullptr};
+        FlatU64PtrMap_insert(t, &e);
+      },
+      [](FlatU64PtrMap* t, uint64_t k) {
+        return FlatU64PtrMap_contains(t, &k);
+      });
+}
+BENCHMARK(BM_FindU64Ptr_Flat)->Range(1 << 4, 1 << 20);
+
+void BM_FindU64Ptr_Int(benchmark::State& state) {
+  auto m = IntU64PtrMap_new(0);
+  absl::Cleanup c_ = [&] { IntU64PtrMap_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](IntU64PtrMap* t, uint64_t k) {
+        void* v = nullptr;
+        IntU64PtrMap_insert(t, &k, &v);
+      },
+      [](IntU64PtrMap* t, uint64_t k) {
+        return IntU64PtrMap_contains(t, &k);
+      });
+}
+BENCHMARK(BM_FindU64Ptr_Int)->Range(1 << 4, 1 << 20);
+
+CWISS_DECLARE_FLAT_HASHSET(FlatU64Set, uint64_t);
+
+// The plainest lookup there is: a flat set of integers with the default
+// policy, nothing enabled on it. Any cost that optional features add to
+// lookups in tables that do not use them shows up here first.
+void BM_FindU64_FlatSet(benchmark::State& state) {
+  auto s = FlatU64Set_new(0);
+  absl::Cleanup c_ = [&] { FlatU64Set_destroy(&s); };
+  FindHitAndMiss<uint64_t>(
+      state, &s, [](FlatU64Set* t, uint64_t k) { FlatU64Set_insert(t, &k); },
+      [](FlatU64Set* t, uint64_t k) { return FlatU64Set_contains(t, &k); });
+}
+BENCHMARK(BM_FindU64_FlatSet)->Range(1 << 4, 1 << 20);
+
+struct Record {
+  uint64_t fields[32];
+};
+CWISS_DECLARE_NODE_HASHMAP(NodeRecordMap, uint64_t, Record);
+
+// Each candidate's key lives in its own heap node, which lookups prefetch.
+void BM_FindRecord_Node(benchmark::State& state) {
+  auto m = NodeRecordMap_new(0);
+  absl::Cleanup c_ = [&] { NodeRecordMap_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](NodeRecordMap* t, uint64_t k) {
+        NodeRecordMap_Entry e = {k, {}};
+        NodeRecordMap_insert(t, &e);
+      },
+      [](NodeRecordMap* t, uint64_t k) {
+        return NodeRecordMap_contains(t, &k);
+      });
+}
+BENCHMARK(BM_FindRecord_Node)->Range(1 << 4, 1 << 20);
+
+CWISS_DECLARE_NODE_HASHMAP(NodeU64Map, uint64_t, uint64_t);
+CWISS_DECLARE_ARENA_HASHMAP(ArenaU64Map, uint64_t, uint64_t);
+
+// Reports the bytes of backing array (control bytes and slots) per element.
+void ReportArrayBytes(benchmark::State& state, const CWISS_RawTable& t,
+                      size_t slot_size) {
+  size_t bytes = CWISS_AllocSize(t.capacity_, slot_size, slot_size);
+  state.counters["array_bytes_per_elem"] =
+      static_cast<double>(bytes) / static_cast<double>(t.size_);
+}
+
+void BM_FindU64_Node(benchmark::State& state) {
+  auto m = NodeU64Map_new(0);
+  absl::Cleanup c_ = [&] { NodeU64Map_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](NodeU64Map* t, uint64_t k) {
+        NodeU64Map_Entry e = {k, k};
+        NodeU64Map_insert(t, &e);
+      },
+      [](NodeU64Map* t, uint64_t k) { return NodeU64Map_contains(t, &k); });
+  ReportArrayBytes(state, m.set_, sizeof(void*));
+}
+BENCHMARK(BM_FindU64_Node)->Range(1 << 4, 1 << 20);
+
+void BM_FindU64_Arena(benchmark::State& state) {
+  auto m = ArenaU64Map_new(0);
+  absl::Cleanup c_ = [&] { ArenaU64Map_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](ArenaU64Map* t, uint64_t k) {
+        ArenaU64Map_Entry e = {k, k};
+        ArenaU64Map_insert(t, &e);
+      },
+      [](ArenaU64Map* t, uint64_t k) { return ArenaU64Map_contains(t, &k); });
+  ReportArrayBytes(state, m.set_.set_, sizeof(uint32_t));
+}
+BENCHMARK(BM_FindU64_Arena)->Range(1 << 4, 1 << 20);
+
+template <typename Map, typename New, typename Insert, typename Destroy>
+void InsertU64(benchmark::State& state, New new_map, Insert insert,
+               Destroy destroy) {
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(state.range(0));
+  for (auto& k : keys) k = rng();
+  for (auto _ : state) {
+    Map m = new_map();
+    for (uint64_t k : keys) insert(&m, k);
+    DoNotOptimize(m);
+    destroy(&m);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_InsertU64_Node(benchmark::State& state) {
+  InsertU64<NodeU64Map>(
+      state, [] { return NodeU64Map_new(0); },
+      [](NodeU64Map* t, uint64_t k) {
+        NodeU64Map_Entry e = {k, k};
+        NodeU64Map_insert(t, &e);
+      },
+      NodeU64Map_destroy);
+}
+BENCHMARK(BM_InsertU64_Node)->Range(1 << 10, 1 << 20);
+
+void BM_InsertU64_Arena(benchmark::State& state) {
+  InsertU64<ArenaU64Map>(
+      state, [] { return ArenaU64Map_new(0); },
+      [](ArenaU64Map* t, uint64_t k) {
+        ArenaU64Map_Entry e = {k, k};
+        ArenaU64Map_insert(t, &e);
+      },
+      ArenaU64Map_destroy);
+}
+BENCHMARK(BM_InsertU64_Arena)->Range(1 << 10, 1 << 20);
+
+CWISS_DECLARE_FLAT_HASHMAP(FlatU64Map, uint64_t, uint64_t);
+
+// Builds a table with `2^state.range(0) - 1` slots, filled to
+// `state.range(1)` percent of them with random keys, and then times summing
+// every value in it, the way serializing the table would read them.
+template <typename Map, typename Entry, typename New, typename Insert,
+          typename Destroy, typename Sum>
+void IterateU64(benchmark::State& state, New new_map, Insert insert,
+                Destroy destroy, Sum sum) {
+  size_t capacity = (size_t{1} << state.range(0)) - 1;
+  size_t n = capacity * state.range(1) / 100;
+  Map m = new_map(CWISS_CapacityToGrowth(capacity));
+  absl::Cleanup c_ = [&] { destroy(&m); };
+  std::mt19937_64 rng(0);
+  for (size_t i = 0; i < n; ++i) {
+    Entry e = {rng(), i};
+    insert(&m, &e);
+  }
+
+  for (auto _ : state) {
+    DoNotOptimize(sum(&m));
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_IterateU64_Flat(benchmark::State& state) {
+  IterateU64<FlatU64Map, FlatU64Map_Entry>(
+      state, FlatU64Map_new, FlatU64Map_insert, FlatU64Map_destroy,
+      [](const FlatU64Map* m) {
+        uint64_t sum = 0;
+        for (auto it = FlatU64Map_citer(m); FlatU64Map_CIter_get(&it);
+             FlatU64Map_CIter_next(&it)) {
+          sum += FlatU64Map_CIter_get(&it)->val;
+        }
+        return sum;
+      });
+}
+BENCHMARK(BM_IterateU64_Flat)->ArgsProduct({{10, 16, 20, 24}, {25, 50, 87}});
+
+void BM_IterateU64_Node(benchmark::State& state) {
+  IterateU64<NodeU64Map, NodeU64Map_Entry>(
+      state, NodeU64Map_new, NodeU64Map_insert, NodeU64Map_destroy,
+      [](const NodeU64Map* m) {
+        uint64_t sum = 0;
+        for (auto it = NodeU64Map_citer(m); NodeU64Map_CIter_get(&it);
+             NodeU64Map_CIter_next(&it)) {
+          sum += NodeU64Map_CIter_get(&it)->val;
+        }
+        return sum;
+      });
+}
+BENCHMARK(BM_IterateU64_Node)->ArgsProduct({{10, 16, 20, 24}, {25, 50, 87}});
+
+void BM_IterateU64_NodePrefetching(benchmark::State& state) {
+  IterateU64<NodeU64Map, NodeU64Map_Entry>(
+      state, NodeU64Map_new, NodeU64Map_insert, NodeU64Map_destroy,
+      [](const NodeU64Map* m) {
+        uint64_t sum = 0;
+        for (auto it = NodeU64Map_citer_prefetching(m);
+             NodeU64Map_CIter_get(&it); NodeU64Map_CIter_next(&it)) {
+          sum += NodeU64Map_CIter_get(&it)->val;
+        }
+        return sum;
+      });
+}
+BENCHMARK(BM_IterateU64_NodePrefetching)
+    ->ArgsProduct({{10, 16, 20, 24}, {25, 50, 87}});
+
+struct Login {
+  uint64_t id;
+  uint64_t name;
+};
+CWISS_DECLARE_NODE_HASHMAP(NodeLoginMap, uint64_t, Login);
+CWISS_DECLARE_FLAT_HASHMAP(FlatLoginPtrMap, uint64_t, Login*);
+
+CWISS_DECLARE_INDEX(kLoginById, Login, uint64_t, id, true);
+CWISS_DECLARE_INDEX(kLoginByName, Login, uint64_t, name, true);
+CWISS_DECLARE_MULTI_INDEX(Logins, Login, &kLoginById, &kLoginByName);
+CWISS_DECLARE_MULTI_INDEX_LOOKUP(Logins, name, uint64_t, 1);
+
+// Inserts `state.range(0)` records findable by two keys, then erases them all
+// through the second key.
+template <typename Insert, typename Erase>
+void InsertEraseLogins(benchmark::State& state, Insert insert, Erase erase) {
+  std::mt19937_64 rng(0);
+  std::vector<Login> logins(state.range(0));
+  for (auto& l : logins) l = {rng(), rng()};
+  for (auto _ : state) {
+    for (const auto& l : logins) insert(l);
+    for (const auto& l : logins) erase(l.name);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The usual workaround: the records live in a map by id, and a second map by
+// name points into it.
+void BM_InsertEraseLogins_TwoMaps(benchmark::State& state) {
+  auto by_id = NodeLoginMap_new(0);
+  auto by_name = FlatLoginPtrMap_new(0);
+  absl::Cleanup c_ = [&] {
+    NodeLoginMap_destroy(&by_id);
+    FlatLoginPtrMap_destroy(&by_name);
+  };
+  InsertEraseLogins(
+      state,
+      [&](const Login& l) {
+        NodeLoginMap_Entry e = {l.id, l};
+        auto res = NodeLoginMap_insert(&by_id, &e);
+        FlatLoginPtrMap_Entry p = {l.name,
+                                   &NodeLoginMap_Iter_get(&res.iter)->val};
+        FlatLoginPtrMap_insert(&by_name, &p);
+      },
+      [&](uint64_t name) {
+        auto it = FlatLoginPtrMap_find(&by_name, &name);
+        uint64_t id = FlatLoginPtrMap_Iter_get(&it)->val->id;
+        FlatLoginPtrMap_erase_at(it);
+        NodeLoginMap_erase(&by_id, &id);
+      });
+}
+BENCHMARK(BM_InsertEraseLogins_TwoMaps)->Range(1 << 10, 1 << 18);
+
+void BM_InsertEraseLogins_MultiIndex(benchmark::State& state) {
+  auto t = Logins_new(0);
+  absl::Cleanup c_ = [&] { Logins_destroy(&t); };
+  InsertEraseLogins(
+      state, [&](const Login& l) { Logins_insert(&t, &l); },
+      [&](uint64_t name) { Logins_erase_by_name(&t, &name); });
+}
+BENCHMARK(BM_InsertEraseLogins_MultiIndex)->Range(1 << 10, 1 << 18);
+
+struct Blob {
+  uint64_t fields[8];
+};
+CWISS_DECLARE_FLAT_HASHMAP(FlatBlobMap, uint64_t, Blob);
+CWISS_DECLARE_SPARSE_HASHMAP(SparseBlobMap, uint64_t, Blob);
+
+// A power-of-two element count leaves the table just over half full.
+void BM_FindBlob_Flat(benchmark::State& state) {
+  auto m = FlatBlobMap_new(0);
+  absl::Cleanup c_ = [&] { FlatBlobMap_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](FlatBlobMap* t, uint64_t k) {
+        FlatBlobMap_Entry e = {k, {}};
+        FlatBlobMap_insert(t, &e);
+      },
+      [](FlatBlobMap* t, uint64_t k) { return FlatBlobMap_contains(t, &k); });
+  ReportArrayBytes(state, m.set_, sizeof(FlatBlobMap_Entry));
+}
+BENCHMARK(BM_FindBlob_Flat)->Range(1 << 10, 1 << 20);
+
+void BM_FindBlob_Sparse(benchmark::State& state) {
+  auto m = SparseBlobMap_new(0);
+  absl::Cleanup c_ = [&] { SparseBlobMap_destroy(&m); };
+  FindHitAndMiss<uint64_t>(
+      state, &m,
+      [](SparseBlobMap* t, uint64_t k) {
+        SparseBlobMap_Entry e = {k, {}};
+        SparseBlobMap_insert(t, &e);
+      },
+      [](SparseBlobMap* t, uint64_t k) {
+        return SparseBlobMap_contains(t, &k);
+      });
+  size_t bytes = CWISS_SparseTable_AllocSize(m.set_.capacity_) +
+                 m.set_.size_ * sizeof(SparseBlobMap_Entry);
+  state.counters["array_bytes_per_elem"] =
+      static_cast<double>(bytes) / static_cast<double>(m.set_.size_);
+}
+BENCHMARK(BM_FindBlob_Sparse)->Range(1 << 10, 1 << 20);
+
+void BM_InsertBlob_Flat(benchmark::State& state) {
+  InsertU64<FlatBlobMap>(
+      state, [] { return FlatBlobMap_new(0); },
+      [](FlatBlobMap* t, uint64_t k) {
+        FlatBlobMap_Entry e = {k, {}};
+        FlatBlobMap_insert(t, &e);
+      },
+      FlatBlobMap_destroy);
+}
+BENCHMARK(BM_InsertBlob_Flat)->Range(1 << 10, 1 << 20);
+
+void BM_InsertBlob_Sparse(benchmark::State& state) {
+  InsertU64<SparseBlobMap>(
+      state, [] { return SparseBlobMap_new(0); },
+      [](SparseBlobMap* t, uint64_t k) {
+        SparseBlobMap_Entry e = {k, {}};
+        SparseBlobMap_insert(t, &e);
+      },
+      SparseBlobMap_destroy);
+}
+BENCHMARK(BM_InsertBlob_Sparse)->Range(1 << 10, 1 << 20);
+
+// Models route lookups: 80% of lookups go to 100 hot keys out of 2^16, all
+// sharing a long prefix so that equality is expensive. Hashes are precomputed
+// and passed to the hinted API.
+void BM_FindHotStrings(benchmark::State& state) {
+  auto t = StringTable_new(0);
+  absl::Cleanup c_ = [&] { StringTable_destroy(&t); };
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < (1 << 16); ++i) {
+    std::string k = absl::StrFormat("/api/v1/routes/%0100d", i);
+    auto ins = StringTable_deferred_insert(&t, &k);
+    auto* ptr = StringTable_Iter_get(&ins.iter);
+    new (&ptr->key) std::string(k);
+    new (&ptr->val) std::string();
+    keys.push_back(std::move(k));
+  }
+
+  std::mt19937_64 rng(0);
+  std::vector<std::pair<const std::string*, size_t>> lookups;
+  for (int i = 0; i < 4096; ++i) {
+    size_t k = rng() % 5 != 0 ? rng() % 100 : rng() % keys.size();
+    lookups.emplace_back(&keys[k], HashStdString{}(keys[k]));
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    auto it = StringTable_find_hinted(&t, lookups[i].first, lookups[i].second);
+    DoNotOptimize(StringTable_Iter_get(&it));
+    if (++i == lookups.size()) i = 0;
+  }
+}
+BENCHMARK(BM_FindHotStrings);
+
+CWISS_DECLARE_FLAT_SET_POLICY(kOneChoicePolicy, int64_t,
+                              (key_two_choice, false));
+CWISS_DECLARE_HASHSET_WITH(OneChoiceTable, int64_t, kOneChoicePolicy);
+CWISS_DECLARE_FLAT_SET_POLICY(kTwoChoicePolicy, int64_t,
+                              (key_two_choice, true));
+CWISS_DECLARE_HASHSET_WITH(TwoChoiceTable, int64_t, kTwoChoicePolicy);
+
+// Looks up present keys in a table of `2^state.range(0) - 1` slots filled to
+// maximum load, where probe sequences are longest. The counters give the
+// histogram of probe lengths: `probes_N` elements need N probes.
+template <typename Table, typename Insert, typename Contains>
+void FindAtMaxLoad(benchmark::State& state, const CWISS_Policy* policy,
+                   Table* t, Insert insert, Contains contains) {
+  size_t capacity = (size_t{1} << state.range(0)) - 1;
+  std::mt19937_64 rng(0);
+  std::vector<int64_t> keys;
+  for (size_t i = 0; i < CWISS_CapacityToGrowth(capacity); ++i) {
+    keys.push_back(static_cast<int64_t>(rng()));
+    insert(t, keys.back());
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+
+  auto probes = internal::GetHashtableDebugNumProbesHistogram(policy, &t->set_);
+  for (size_t n = 0; n < probes.size(); ++n) {
+    state.counters[absl::StrFormat("probes_%zu", n)] = probes[n];
+  }
+  state.counters["mean_probes"] =
+      internal::GetHashtableDebugProbeSummary(policy, &t->set_).mean;
+
+  size_t i = 0;
+  for (auto _ : state) {
+    DoNotOptimize(contains(t, keys[i]));
+    if (++i == keys.size()) i = 0;
+  }
+}
+
+void BM_FindAtMaxLoad_OneChoice(benchmark::State& state) {
+  auto t = OneChoiceTable_new((size_t{1} << state.range(0)) - 1);
+  absl::Cleanup c_ = [&] { OneChoiceTable_destroy(&t); };
+  FindAtMaxLoad(
+      state, OneChoiceTable_policy(), &t,
+      [](OneChoiceTable* t, int64_t k) { OneChoiceTable_insert(t, &k); },
+      [](OneChoiceTable* t, int64_t k) {
+        return OneChoiceTable_contains(t, &k);
+      });
+}
+BENCHMARK(BM_FindAtMaxLoad_OneChoice)->DenseRange(12, 20, 4);
+
+void BM_FindAtMaxLoad_TwoChoice(benchmark::State& state) {
+  auto t = TwoChoiceTable_new((size_t{1} << state.range(0)) - 1);
+  absl::Cleanup c_ = [&] { TwoChoiceTable_destroy(&t); };
+  FindAtMaxLoad(
+      state, TwoChoiceTable_policy(), &t,
+      [](TwoChoiceTable* t, int64_t k) { TwoChoiceTable_insert(t, &k); },
+      [](TwoChoiceTable* t, int64_t k) {
+        return TwoChoiceTable_contains(t, &k);
+      });
+}
+BENCHMARK(BM_FindAtMaxLoad_TwoChoice)->DenseRange(12, 20, 4);
+
+CWISS_DECLARE_SHARDED(ShardedIntTable, IntTable);
+
+// Models ingest workers that each look up batches of 1000 random keys, half of
+// them present, in a shared table, either one key at a time or as a batch.
+constexpr size_t kShardedBatch = 1000;
+ShardedIntTable sharded_table;
+
+template <typename Lookup>
+void ShardedFind(benchmark::State& state, Lookup lookup) {
+  if (state.thread_index() == 0) {
+    sharded_table = ShardedIntTable_new(16, 0);
+    for (int64_t i = 0; i < (1 << 20); ++i) {
+      int64_t k = i * 2;
+      ShardedIntTable_insert(&sharded_table, &k);
+    }
+  }
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::vector<int64_t>> batches(64);
+  for (auto& batch : batches) {
+    for (size_t i = 0; i < kShardedBatch; ++i) {
+      batch.push_back(rng() % (1 << 21));
+    }
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    DoNotOptimize(lookup(batches[i]));
+    if (++i == batches.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations() * kShardedBatch);
+  if (state.thread_index() == 0) ShardedIntTable_destroy(&sharded_table);
+}
+
+void BM_ShardedFind_PerKey(benchmark::State& state) {
+  ShardedFind(state, [](const std::vector<int64_t>& keys) {
+    size_t found = 0;
+    for (int64_t k : keys) {
+      found += ShardedIntTable_contains(&sharded_table, &k);
+    }
+    return found;
+  });
+}
+BENCHMARK(BM_ShardedFind_PerKey)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_ShardedFind_Batch(benchmark::State& state) {
+  ShardedFind(state, [](const std::vector<int64_t>& keys) {
+    return ShardedIntTable_find_batch(&sharded_table, keys.data(), keys.size(),
+                                      nullptr, nullptr, nullptr);
+  });
+}
+BENCHMARK(BM_ShardedFind_Batch)->ThreadRange(1, 8)->UseRealTime();
+
+template <size_t kWords>
+struct Words {
+  uint64_t words[kWords];
+};
+CWISS_DECLARE_FLAT_HASHMAP(Words8Map, uint64_t, Words<1>);
+CWISS_DECLARE_FLAT_HASHMAP(Words256Map, uint64_t, Words<31>);
+
+// Models a daily purge: fill a table with 200K entries, erase `range(0)`
+// percent of them at random, and time handing the empty slot pages back.
+// `released_frac` is the fraction of the slot array released.
+template <typename Entry, typename NewMap, typename Insert, typename Erase,
+          typename Release, typename Destroy>
+void ReleaseUnused(benchmark::State& state, NewMap new_map, Insert insert,
+                   Erase erase, Release release, Destroy destroy) {
+  constexpr uint64_t kEntries = 200000;
+  double released = 0;
+  size_t slot_bytes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto m = new_map(0);
+    std::mt19937_64 rng(0);
+    for (uint64_t i = 0; i < kEntries; ++i) {
+      Entry e = {i, {}};
+      insert(&m, &e);
+    }
+    for (uint64_t i = 0; i < kEntries; ++i) {
+      if (rng() % 100 < static_cast<uint64_t>(state.range(0))) erase(&m, &i);
+    }
+    slot_bytes = m.set_.capacity_ * sizeof(Entry);
+    state.ResumeTiming();
+
+    released = release(&m);
+
+    state.PauseTiming();
+    destroy(&m);
+    state.ResumeTiming();
+  }
+  state.counters["released_frac"] = released / slot_bytes;
+}
+
+void BM_ReleaseUnused_8(benchmark::State& state) {
+  ReleaseUnused<Words8Map_Entry>(state, Words8Map_new, Words8Map_insert,
+                                 Words8Map_erase, Words8Map_release_unused,
+                                 Words8Map_destroy);
+}
+BENCHMARK(BM_ReleaseUnused_8)->Arg(80)->Arg(99);
+
+void BM_ReleaseUnused_256(benchmark::State& state) {
+  ReleaseUnused<Words256Map_Entry>(
+      state, Words256Map_new, Words256Map_insert, Words256Map_erase,
+      Words256Map_release_unused, Words256Map_destroy);
+}
+BENCHMARK(BM_ReleaseUnused_256)->Arg(80)->Arg(95);
+
+CWISS_DECLARE_FROZEN_COUNTERS(U64Counters, FlatU64Map);
+
+// Models request handlers that each bump batches of 1000 counters, out of a
+// fixed set of 1024 (metric names, route ids and the like), in a shared map.
+constexpr size_t kCounterKeys = 1024;
+constexpr size_t kCounterBatch = 1000;
+
+template <typename Bump>
+void BumpCounters(benchmark::State& state, Bump bump) {
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::vector<uint64_t>> batches(64);
+  for (auto& batch : batches) {
+    for (size_t i = 0; i < kCounterBatch; ++i) {
+      batch.push_back(rng() % kCounterKeys * 0x9e3779b97f4a7c15);
+    }
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    for (uint64_t k : batches[i]) bump(k);
+    if (++i == batches.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations() * kCounterBatch);
+}
+
+FlatU64Map NewCounterKeys() {
+  auto t = FlatU64Map_new(kCounterKeys);
+  for (uint64_t i = 0; i < kCounterKeys; ++i) {
+    FlatU64Map_Entry e = {i * 0x9e3779b97f4a7c15, 0};
+    FlatU64Map_insert(&t, &e);
+  }
+  return t;
+}
+
+std::mutex counters_mu;
+FlatU64Map locked_counters;
+
+void BM_BumpCounters_Mutex(benchmark::State& state) {
+  if (state.thread_index() == 0) locked_counters = NewCounterKeys();
+  BumpCounters(state, [](uint64_t k) {
+    std::lock_guard<std::mutex> lock(counters_mu);
+    auto it = FlatU64Map_find(&locked_counters, &k);
+    ++FlatU64Map_Iter_get(&it)->val;
+  });
+  if (state.thread_index() == 0) FlatU64Map_destroy(&locked_counters);
+}
+BENCHMARK(BM_BumpCounters_Mutex)->ThreadRange(1, 8)->UseRealTime();
+
+U64Counters frozen_counters;
+
+void FrozenCounters(benchmark::State& state, bool padded) {
+  if (state.thread_index() == 0) {
+    auto keys = NewCounterKeys();
+    frozen_counters = U64Counters_new(&keys, padded);
+    FlatU64Map_destroy(&keys);
+  }
+  BumpCounters(state, [](uint64_t k) {
+    U64Counters_add(&frozen_counters, &k, 1);
+  });
+  if (state.thread_index() == 0) U64Counters_destroy(&frozen_counters);
+}
+
+void BM_BumpCounters_Frozen(benchmark::State& state) {
+  FrozenCounters(state, false);
+}
+BENCHMARK(BM_BumpCounters_Frozen)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_BumpCounters_FrozenPadded(benchmark::State& state) {
+  FrozenCounters(state, true);
+}
+BENCHMARK(BM_BumpCounters_FrozenPadded)->ThreadRange(1, 8)->UseRealTime();
+
+// Composite keys whose fields are hashed one at a time, as a custom policy
+// would have to, since padding makes it unsafe to hash the struct bytewise.
+struct RouteKey {
+  uint32_t service;
+  uint16_t method;
+  uint8_t version;
+  uint64_t tenant;
+};
+
+struct PacketKey {
+  uint8_t proto, tos, ttl, flags;
+  uint16_t src_port, dst_port;
+  uint32_t src_ip, dst_ip;
+};
+
+// Hashes 1024 random keys. If `kChained`, each key is chosen by the previous
+// hash, which measures latency, as a lookup that probes with the hash sees it;
+// otherwise the hashes are independent, which measures throughput.
+//
+// Each benchmark is a template over `kChained`, so that each instantiation
+// passes its own lambda and the hash is inlined into its single caller.
+template <typename Key>
+std::vector<Key> RandomKeys() {
+  std::mt19937_64 rng(0);
+  std::vector<Key> keys(1024);
+  for (auto& k : keys) {
+    uint64_t bits[2] = {rng(), rng()};
+    memcpy(&k, bits, sizeof(k));
+  }
+  return keys;
+}
+
+template <typename Key, bool kChained, typename Hash>
+void HashKeys(benchmark::State& state, Hash hash) {
+  std::vector<Key> keys = RandomKeys<Key>();
+  if (kChained) {
+    size_t i = 0;
+    for (auto _ : state) {
+      for (size_t n = 0; n < keys.size(); ++n) i = hash(keys[i]) & 1023;
+    }
+    DoNotOptimize(i);
+  } else {
+    for (auto _ : state) {
+      for (const auto& k : keys) DoNotOptimize(hash(k));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template <bool kChained>
+void BM_HashPacket_Absl(benchmark::State& state) {
+  HashKeys<PacketKey, kChained>(state, [](const PacketKey& k) {
+    CWISS_AbslHash_State h = CWISS_AbslHash_kInit;
+    CWISS_AbslHash_Write(&h, &k.proto, sizeof(k.proto));
+    CWISS_AbslHash_Write(&h, &k.tos, sizeof(k.tos));
+    CWISS_AbslHash_Write(&h, &k.ttl, sizeof(k.ttl));
+    CWISS_AbslHash_Write(&h, &k.flags, sizeof(k.flags));
+    CWISS_AbslHash_Write(&h, &k.src_port, sizeof(k.src_port));
+    CWISS_AbslHash_Write(&h, &k.dst_port, sizeof(k.dst_port));
+    CWISS_AbslHash_Write(&h, &k.src_ip, sizeof(k.src_ip));
+    CWISS_AbslHash_Write(&h, &k.dst_ip, sizeof(k.dst_ip));
+    return CWISS_AbslHash_Finish(h);
+  });
+}
+BENCHMARK_TEMPLATE(BM_HashPacket_Absl, false);
+BENCHMARK_TEMPLATE(BM_HashPacket_Absl, true);
+
+template <bool kChained>
+void BM_HashPacket_Buffered(benchmark::State& state) {
+  HashKeys<PacketKey, kChained>(state, [](const PacketKey& k) {
+    CWISS_BufferedHash_State h = CWISS_BufferedHash_kInit;
+    CWISS_BufferedHash_Write(&h, &k.proto, sizeof(k.proto));
+    CWISS_BufferedHash_Write(&h, &k.tos, sizeof(k.tos));
+    CWISS_BufferedHash_Write(&h, &k.ttl, sizeof(k.ttl));
+    CWISS_BufferedHash_Write(&h, &k.flags, sizeof(k.flags));
+    CWISS_BufferedHash_Write(&h, &k.src_port, sizeof(k.src_port));
+    CWISS_BufferedHash_Write(&h, &k.dst_port, sizeof(k.dst_port));
+    CWISS_BufferedHash_Write(&h, &k.src_ip, sizeof(k.src_ip));
+    CWISS_BufferedHash_Write(&h, &k.dst_ip, sizeof(k.dst_ip));
+    return CWISS_BufferedHash_Finish(h);
+  });
+}
+BENCHMARK_TEMPLATE(BM_HashPacket_Buffered, false);
+BENCHMARK_TEMPLATE(BM_HashPacket_Buffered, true);
+
+template <bool kChained>
+void BM_HashRoute_Absl(benchmark::State& state) {
+  HashKeys<RouteKey, kChained>(state, [](const RouteKey& k) {
+    CWISS_AbslHash_State h = CWISS_AbslHash_kInit;
+    CWISS_AbslHash_Write(&h, &k.service, sizeof(k.service));
+    CWISS_AbslHash_Write(&h, &k.method, sizeof(k.method));
+    CWISS_AbslHash_Write(&h, &k.version, sizeof(k.version));
+    CWISS_AbslHash_Write(&h, &k.tenant, sizeof(k.tenant));
+    return CWISS_AbslHash_Finish(h);
+  });
+}
+BENCHMARK_TEMPLATE(BM_HashRoute_Absl, false);
+BENCHMARK_TEMPLATE(BM_HashRoute_Absl, true);
+
+template <bool kChained>
+void BM_HashRoute_Buffered(benchmark::State& state) {
+  HashKeys<RouteKey, kChained>(state, [](const RouteKey& k) {
+    CWISS_BufferedHash_State h = CWISS_BufferedHash_kInit;
+    CWISS_BufferedHash_Write(&h, &k.service, sizeof(k.service));
+    CWISS_BufferedHash_Write(&h, &k.method, sizeof(k.method));
+    CWISS_BufferedHash_Write(&h, &k.version, sizeof(k.version));
+    CWISS_BufferedHash_Write(&h, &k.tenant, sizeof(k.tenant));
+    return CWISS_BufferedHash_Finish(h);
+  });
+}
+BENCHMARK_TEMPLATE(BM_HashRoute_Buffered, false);
+BENCHMARK_TEMPLATE(BM_HashRoute_Buffered, true);
+
+void SetFlag(void* ctx) { *static_cast<bool*>(ctx) = true; }
+
+// Inserts 2^state.range(0) keys in requests of 256 insertions each, and
+// reports the slowest request in `max_request_us`, taking the best of all runs
+// to filter out preemption. With `grow_when_idle`, the table is grown between
+// requests, as an event loop would in its idle time, once an insertion has
+// brought it to a low watermark of an eighth of its capacity; otherwise,
+// requests that hit a full table grow it themselves.
+void InsertInRequests(benchmark::State& state, bool grow_when_idle) {
+  constexpr size_t kRequest = 256;
+  const size_t n = size_t{1} << state.range(0);
+  std::vector<uint64_t> keys(n);
+  std::mt19937_64 rng(0);
+  for (uint64_t& k : keys) k = rng();
+
+  double best_max_request = INFINITY;
+  for (auto _ : state) {
+    double max_request = 0;
+    auto t = FlatU64Map_new(0);
+    FlatU64Map_reserve(&t, kRequest);
+    bool due = false;
+    if (grow_when_idle) {
+      FlatU64Map_watch_growth(&t, FlatU64Map_capacity(&t) / 8, SetFlag, &due);
+    }
+    for (size_t i = 0; i < n; i += kRequest) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t j = i; j < i + kRequest; ++j) {
+        FlatU64Map_Entry e = {keys[j], j};
+        FlatU64Map_insert(&t, &e);
+      }
+      std::chrono::duration<double> took =
+          std::chrono::steady_clock::now() - start;
+      max_request = std::max(max_request, took.count());
+
+      if (due) {
+        due = false;
+        FlatU64Map_reserve(&t, 2 * FlatU64Map_size(&t) + kRequest);
+        FlatU64Map_watch_growth(&t, FlatU64Map_capacity(&t) / 8, SetFlag,
+                                &due);
+      }
+    }
+    DoNotOptimize(t);
+    FlatU64Map_destroy(&t);
+    best_max_request = std::min(best_max_request, max_request);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.counters["max_request_us"] = best_max_request * 1e6;
+}
+
+void BM_InsertInRequests_Inline(benchmark::State& state) {
+  InsertInRequests(state, false);
+}
+BENCHMARK(BM_InsertInRequests_Inline)->Arg(16)->Arg(20);
+
+void BM_InsertInRequests_GrowWhenIdle(benchmark::State& state) {
+  InsertInRequests(state, true);
+}
+BENCHMARK(BM_InsertInRequests_GrowWhenIdle)->Arg(16)->Arg(20);
+
+// Application benchmarks.
+//
+// These model whole workloads rather than single operations, and only use the
+// public policy and declaration macros, as an application would. Inputs come
+// from fixed seeds, so every run sees the same keys in the same order. Each
+// table allocates through a counting allocator: `peak_bytes` is the most
+// memory the tables held at once, and `bytes_per_key` is that divided by the
+// number of distinct keys.
+
+size_t app_live_bytes = 0;
+size_t app_peak_bytes = 0;
+
+void* CountingAlloc(size_t size, size_t align) {
+  app_live_bytes += size;
+  app_peak_bytes = std::max(app_peak_bytes, app_live_bytes);
+  return CWISS_DefaultMalloc(size, align);
+}
+
+void CountingFree(void* array, size_t size, size_t align) {
+  app_live_bytes -= size;
+  CWISS_DefaultFree(array, size, align);
+}
+
+void ReportMemory(benchmark::State& state, size_t keys) {
+  state.counters["peak_bytes"] = app_peak_bytes;
+  state.counters["bytes_per_key"] =
+      static_cast<double>(app_peak_bytes) / std::max<size_t>(keys, 1);
+}
+
+// Draws ranks in `[0, n)` with probability proportional to `1 / (rank + 1)^s`.
+//
+// This does not use `<random>` distributions, whose output is not specified
+// by the standard, so that every standard library sees the same stream.
+class Zipf {
+ public:
+  Zipf(size_t n, double s) : cdf_(n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      sum += std::pow(static_cast<double>(i + 1), -s);
+      cdf_[i] = sum;
+    }
+    for (double& c : cdf_) c /= sum;
+  }
+
+  size_t operator()(std::mt19937_64& rng) const {
+    double u = static_cast<double>(rng() >> 11) * 0x1p-53;
+    auto it = std::upper_bound(cdf_.begin(), cdf_.end(), u);
+    return std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1);
+  }
+
+ private:
+  std::vector<double> cdf_;
+};
+
+// A word in a text: a view of bytes owned by the vocabulary.
+struct Word {
+  const char* ptr;
+  size_t len;
+};
+
+size_t WordHash(const void* val) {
+  const Word* w = static_cast<const Word*>(val);
+  CWISS_AbslHash_State state = CWISS_AbslHash_kInit;
+  CWISS_AbslHash_Write(&state, w->ptr, w->len);
+  CWISS_AbslHash_Write(&state, &w->len, sizeof(w->len));
+  return CWISS_AbslHash_Finish(state);
+}
+
+bool WordEq(const void* a, const void* b) {
+  const Word* x = static_cast<const Word*>(a);
+  const Word* y = static_cast<const Word*>(b);
+  return x->len == y->len && memcmp(x->ptr, y->ptr, x->len) == 0;
+}
+
+CWISS_DECLARE_FLAT_MAP_POLICY(kWordCountPolicy, Word, uint64_t,
+                              (key_hash, WordHash), (key_eq, WordEq),
+                              (alloc_alloc, CountingAlloc),
+                              (alloc_free, CountingFree));
+CWISS_DECLARE_HASHMAP_WITH(WordCountMap, Word, uint64_t, kWordCountPolicy);
+
+// Counts the words of a text of `state.range(0)` tokens, drawn with Zipf's
+// law (s = 1) from a vocabulary of `state.range(1)` words of 3 to 12
+// lowercase letters, as a word-frequency pass over natural language would.
+void BM_App_WordCount(benchmark::State& state) {
+  std::mt19937_64 rng(0);
+  std::vector<std::string> vocab(state.range(1));
+  for (auto& s : vocab) {
+    s.resize(3 + rng() % 10);
+    for (char& c : s) c = 'a' + rng() % 26;
+  }
+  Zipf zipf(vocab.size(), 1.0);
+  std::vector<Word> text(state.range(0));
+  for (Word& w : text) {
+    const std::string& s = vocab[zipf(rng)];
+    w = {s.data(), s.size()};
+  }
+
+  size_t distinct = 0;
+  for (auto _ : state) {
+    app_peak_bytes = app_live_bytes;
+    auto t = WordCountMap_new(0);
+    for (const Word& w : text) {
+      auto res = WordCountMap_deferred_insert(&t, &w);
+      auto* e = WordCountMap_Iter_get(&res.iter);
+      if (res.inserted) *e = {w, 0};
+      ++e->val;
+    }
+    distinct = WordCountMap_size(&t);
+    WordCountMap_destroy(&t);
+  }
+  state.SetItemsProcessed(state.iterations() * text.size());
+  state.counters["distinct"] = distinct;
+  ReportMemory(state, distinct);
+}
+BENCHMARK(BM_App_WordCount)
+    ->Args({1 << 20, 1 << 14})
+    ->Args({1 << 20, 1 << 17});
+
+CWISS_DECLARE_FLAT_SET_POLICY(kAppU64SetPolicy, uint64_t,
+                              (alloc_alloc, CountingAlloc),
+                              (alloc_free, CountingFree));
+CWISS_DECLARE_HASHSET_WITH(AppU64Set, uint64_t, kAppU64SetPolicy);
+
+CWISS_DECLARE_FLAT_MAP_POLICY(kAppU64MapPolicy, uint64_t, uint64_t,
+                              (alloc_alloc, CountingAlloc),
+                              (alloc_free, CountingFree));
+CWISS_DECLARE_HASHMAP_WITH(AppU64Map, uint64_t, uint64_t, kAppU64MapPolicy);
+
+// Scrambles `x` into an id that shares no structure with its neighbours, as
+// ids minted by another system would.
+uint64_t ScrambleId(uint64_t x) {
+  x ^= x >> 31;
+  x *= 0x9e3779b97f4a7c15;
+  x ^= x >> 29;
+  return x;
+}
+
+// Deduplicates a stream of `state.range(0)` ids drawn uniformly from a
+// universe of `state.range(1)` ids, keeping the ones seen for the first time.
+void BM_App_Dedup(benchmark::State& state) {
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> stream(state.range(0));
+  for (uint64_t& id : stream) id = ScrambleId(rng() % state.range(1));
+
+  size_t unique = 0;
+  for (auto _ : state) {
+    app_peak_bytes = app_live_bytes;
+    auto t = AppU64Set_new(0);
+    unique = 0;
+    for (uint64_t id : stream) {
+      unique += AppU64Set_insert(&t, &id).inserted;
+    }
+    DoNotOptimize(unique);
+    AppU64Set_destroy(&t);
+  }
+  state.SetItemsProcessed(state.iterations() * stream.size());
+  state.counters["unique_frac"] = static_cast<double>(unique) / stream.size();
+  ReportMemory(state, unique);
+}
+BENCHMARK(BM_App_Dedup)->Args({1 << 20, 1 << 18})->Args({1 << 20, 1 << 22});
+
+// Joins a probe side of `state.range(1)` rows against a build side of
+// `state.range(0)` rows with unique keys, summing the payloads of matching
+// rows. Nine probe rows in ten find a match. As in a database's hash join, the
+// build side's cardinality is known, so the table is reserved up front.
+void BM_App_HashJoin(benchmark::State& state) {
+  std::mt19937_64 rng(0);
+  std::vector<AppU64Map_Entry> build(state.range(0));
+  for (size_t i = 0; i < build.size(); ++i) {
+    build[i] = {ScrambleId(i), rng()};
+  }
+  std::vector<uint64_t> probe(state.range(1));
+  for (uint64_t& k : probe) {
+    uint64_t i = rng() % build.size();
+    k = rng() % 10 == 0 ? ScrambleId(build.size() + i) : build[i].key;
+  }
+
+  for (auto _ : state) {
+    app_peak_bytes = app_live_bytes;
+    auto t = AppU64Map_new(build.size());
+    for (const auto& row : build) AppU64Map_insert(&t, &row);
+    uint64_t sum = 0;
+    for (uint64_t k : probe) {
+      auto it = AppU64Map_find(&t, &k);
+      if (auto* e = AppU64Map_Iter_get(&it)) sum += e->val;
+    }
+    DoNotOptimize(sum);
+    AppU64Map_destroy(&t);
+  }
+  state.SetItemsProcessed(state.iterations() * (build.size() + probe.size()));
+  ReportMemory(state, build.size());
+}
+BENCHMARK(BM_App_HashJoin)
+    ->Args({1 << 12, 1 << 20})
+    ->Args({1 << 18, 1 << 20})
+    ->Args({1 << 21, 1 << 21});
+
+// Runs `state.range(1)` requests through an LRU cache of `state.range(0)`
+// entries. Requests follow Zipf's law (s = 0.9) over 2^20 keys, which gives
+// hit ratios in the range web and storage caches see.
+//
+// The table maps each cached key to its node in an intrusive recency list kept
+// in parallel arrays; a miss on a full cache evicts the list's tail.
+void BM_App_Lru(benchmark::State& state) {
+  const uint32_t capacity = state.range(0);
+  std::mt19937_64 rng(0);
+  Zipf zipf(1 << 20, 0.9);
+  std::vector<uint64_t> requests(state.range(1));
+  for (uint64_t& k : requests) k = ScrambleId(zipf(rng));
+
+  constexpr uint32_t kNil = ~uint32_t{0};
+  std::vector<uint64_t> keys(capacity);
+  std::vector<uint32_t> prev(capacity), next(capacity);
+  size_t hits = 0;
+  for (auto _ : state) {
+    app_peak_bytes = app_live_bytes;
+    auto t = AppU64Map_new(capacity);
+    uint32_t head = kNil, tail = kNil, used = 0;
+    auto unlink = [&](uint32_t n) {
+      (prev[n] == kNil ? head : next[prev[n]]) = next[n];
+      (next[n] == kNil ? tail : prev[next[n]]) = prev[n];
+    };
+    auto push_front = [&](uint32_t n) {
+      prev[n] = kNil;
+      next[n] = head;
+      (head == kNil ? tail : prev[head]) = n;
+      head = n;
+    };
+
+    hits = 0;
+    for (uint64_t k : requests) {
+      auto res = AppU64Map_deferred_insert(&t, &k);
+      auto* e = AppU64Map_Iter_get(&res.iter);
+      if (!res.inserted) {
+        ++hits;
+        unlink(e->val);
+        push_front(e->val);
+        continue;
+      }
+
+      uint32_t n = used < capacity ? used++ : tail;
+      *e = {k, n};
+      if (n == tail) {
+        unlink(n);
+        // Erasing does not move other elements, so `e` stays valid.
+        AppU64Map_erase(&t, &keys[n]);
+      }
+      keys[n] = k;
+      push_front(n);
+    }
+    DoNotOptimize(hits);
+    AppU64Map_destroy(&t);
+  }
+  state.SetItemsProcessed(state.iterations() * requests.size());
+  state.counters["hit_ratio"] = static_cast<double>(hits) / requests.size();
+  ReportMemory(state, capacity);
+}
+BENCHMARK(BM_App_Lru)->Args({1 << 14, 1 << 20})->Args({1 << 17, 1 << 20});
+
 }  // namespace
 }  // namespace cwisstable
 
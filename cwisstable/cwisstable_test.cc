@@ -18,12 +18,17 @@
 
 #include "cwisstable.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <deque>
 #include <memory>
 #include <string>
+#include <random>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "cwisstable/internal/debug.h"
@@ -190,7 +195,7 @@ TEST(BitMask, LeadingTrailing) {
 
 std::vector<uint32_t> GroupMatch(const CWISS_ControlByte* group, CWISS_h2_t h) {
   auto g = CWISS_Group_new(group);
-  return MaskBits(CWISS_Group_Match(&g, h));
+  return MaskBits(CWISS_Group_Match(&g, CWISS_H2(h)));
 }
 
 std::vector<uint32_t> GroupMatchEmpty(const CWISS_ControlByte* group) {
@@ -203,13 +208,21 @@ std::vector<uint32_t> GroupMatchEmptyOrDeleted(const CWISS_ControlByte* group) {
   return MaskBits(CWISS_Group_MatchEmptyOrDeleted(&g));
 }
 
+std::vector<uint32_t> GroupMatchFull(const CWISS_ControlByte* group) {
+  auto g = CWISS_Group_new(group);
+  return MaskBits(CWISS_Group_MatchFull(&g));
+}
+
 TEST(Group, EmptyGroup) {
   for (CWISS_h2_t h = 0; h != 128; ++h) {
     EXPECT_THAT(GroupMatch(CWISS_EmptyGroup(), h), IsEmpty());
   }
 }
 
-CWISS_ControlByte Control(int i) { return static_cast<CWISS_ControlByte>(i); }
+// Returns the control byte of a full slot whose hash has `i` as its low bits.
+CWISS_ControlByte Control(int i) {
+  return static_cast<CWISS_ControlByte>(CWISS_H2(i));
+}
 
 TEST(Group, Match) {
   if (CWISS_Group_kWidth == 16) {
@@ -274,6 +287,26 @@ TEST(Group, MatchEmptyOrDeleted) {
   }
 }
 
+TEST(Group, MatchFull) {
+  if (CWISS_Group_kWidth == 16) {
+    CWISS_ControlByte group[] = {
+        CWISS_kEmpty, Control(1), CWISS_kDeleted,  Control(3),
+        CWISS_kEmpty, Control(5), CWISS_kSentinel, Control(7),
+        Control(7),   Control(5), Control(3),      Control(1),
+        Control(1),   Control(1), Control(1),      Control(1)};
+    EXPECT_THAT(GroupMatchFull(group),
+                ElementsAre(1, 3, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+  } else if (CWISS_Group_kWidth == 8) {
+    CWISS_ControlByte group[] = {CWISS_kEmpty,    Control(1), Control(2),
+                                 CWISS_kDeleted,  Control(2), Control(1),
+                                 CWISS_kSentinel, Control(1)};
+    EXPECT_THAT(GroupMatchFull(group), ElementsAre(1, 2, 4, 5, 7));
+  } else {
+    FAIL() << "No test coverage for CWISS_Group_kWidth == "
+           << CWISS_Group_kWidth;
+  }
+}
+
 TEST(Batch, DropDeletes) {
   constexpr size_t kCapacity = 63;
   constexpr size_t kGroupWidth = CWISS_Group_kWidth;
@@ -628,6 +661,39 @@ TEST(Table, RehashWithNoResize) {
   }
 }
 
+// The in-place rehash borrows an empty slot as scratch space. Elements that
+// collide can be pushed past it, and must stay findable once it is returned.
+TEST(Table, DropDeletesInsideCollisionChain) {
+  auto t = Modulo1000HashTable_new(0);
+  absl::Cleanup c_ = [&] { Modulo1000HashTable_destroy(&t); };
+
+  std::vector<int> keys;
+  for (size_t i = 0; i < MaxDensitySize(CWISS_Group_kWidth * 8); ++i) {
+    keys.push_back(i * 1000);
+    Insert(t, keys.back());
+  }
+  for (size_t i = 0; i < keys.size(); i += 4) {
+    EXPECT_TRUE(Erase(t, keys[i])) << keys[i];
+  }
+
+  const size_t capacity = Modulo1000HashTable_capacity(&t);
+  CWISS_RawTable_DropDeletesWithoutResize(Modulo1000HashTable_policy(),
+                                          &t.set_);
+  EXPECT_EQ(Modulo1000HashTable_capacity(&t), capacity);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(Find(t, keys[i]) != nullptr, i % 4 != 0) << keys[i];
+  }
+
+  // If the scratch slot became a tombstone, it is not available for growth.
+  size_t deleted = 0;
+  for (size_t i = 0; i < capacity; ++i) {
+    deleted += CWISS_IsDeleted(t.set_.ctrl_[i]);
+  }
+  EXPECT_EQ(Modulo1000HashTable_growth_left(&t),
+            CWISS_CapacityToGrowth(capacity) -
+                Modulo1000HashTable_size(&t) - deleted);
+}
+
 TEST(Table, InsertEraseStressTest) {
   auto t = IntTable_new(0);
   absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
@@ -826,6 +892,107 @@ TEST(Table, Clear) {
   EXPECT_FALSE(Find(t, 0));
 }
 
+struct Tracked {
+  int64_t value;
+  std::shared_ptr<int> token;
+
+  bool operator==(const Tracked& that) const { return value == that.value; }
+};
+struct HashTracked {
+  size_t operator()(const Tracked& t) {
+    return DefaultHash<int64_t>{}(t.value);
+  }
+};
+CWISS_DECLARE_HASHSET_WITH(TrackedTable, Tracked,
+                           (FlatPolicy<Tracked, HashTracked>()));
+
+TEST(Table, DestroyDeferred) {
+  auto token = std::make_shared<int>(0);
+  std::vector<CWISS_DetachedTable> queue;
+  auto enqueue = [](CWISS_DetachedTable detached, void* ctx) {
+    static_cast<std::vector<CWISS_DetachedTable>*>(ctx)->push_back(detached);
+  };
+
+  auto t = TrackedTable_new(0);
+  absl::Cleanup c_ = [&] { TrackedTable_destroy(&t); };
+  TrackedTable_destroy_deferred(&t, enqueue, &queue);
+  EXPECT_THAT(queue, IsEmpty());
+
+  for (int64_t i = 0; i < 1000; ++i) {
+    Tracked v = {i, token};
+    TrackedTable_insert(&t, &v);
+  }
+  EXPECT_EQ(token.use_count(), 1001);
+
+  TrackedTable_destroy_deferred(&t, enqueue, &queue);
+  ASSERT_EQ(queue.size(), 1);
+  EXPECT_TRUE(TrackedTable_empty(&t));
+  EXPECT_EQ(TrackedTable_capacity(&t), 0);
+  EXPECT_EQ(token.use_count(), 1001);
+
+  // The table is immediately reusable.
+  Tracked v = {0, token};
+  EXPECT_TRUE(TrackedTable_insert(&t, &v).inserted);
+  v.token.reset();
+  EXPECT_EQ(token.use_count(), 1002);
+
+  int calls = 0;
+  while (!CWISS_DetachedTable_reap(&queue[0], 100)) {
+    ++calls;
+    EXPECT_GT(token.use_count(), 2);
+  }
+  EXPECT_GT(calls, 5);
+  EXPECT_EQ(token.use_count(), 2);
+  EXPECT_TRUE(CWISS_DetachedTable_reap(&queue[0], 100));
+}
+
+TEST(Table, DestroyDeferredDropsTracking) {
+  std::vector<CWISS_DetachedTable> queue;
+  auto enqueue = [](CWISS_DetachedTable detached, void* ctx) {
+    static_cast<std::vector<CWISS_DetachedTable>*>(ctx)->push_back(detached);
+  };
+
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  IntTable_reserve(&t, 16);
+  Insert(t, 1);
+  IntTable_enable_dirty_tracking(&t);
+  IntTable_enable_hit_counting(&t);
+  IntTable_set_inline_growth(&t, false);
+
+  IntTable_destroy_deferred(&t, enqueue, &queue);
+  ASSERT_EQ(queue.size(), 1);
+  while (!CWISS_DetachedTable_reap(&queue[0], 100)) {
+  }
+
+  // Like a fresh table, it is free to grow again.
+  EXPECT_EQ(t.set_.ext_, nullptr);
+  EXPECT_TRUE(Insert(t, 2).second);
+}
+
+TEST(Table, OptInFeaturesShareOneAllocation) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  EXPECT_EQ(t.set_.ext_, nullptr);
+
+  IntTable_enable_dirty_tracking(&t);
+  IntTable_enable_hit_counting(&t);
+  IntTable_watch_growth(&t, 2, nullptr, nullptr);
+  ASSERT_NE(t.set_.ext_, nullptr);
+
+  // The state stays until the last feature is turned off.
+  IntTable_disable_dirty_tracking(&t);
+  IntTable_disable_hit_counting(&t);
+  EXPECT_NE(t.set_.ext_, nullptr);
+  IntTable_unwatch_growth(&t);
+  EXPECT_EQ(t.set_.ext_, nullptr);
+
+  IntTable_set_inline_growth(&t, false);
+  EXPECT_NE(t.set_.ext_, nullptr);
+  IntTable_set_inline_growth(&t, true);
+  EXPECT_EQ(t.set_.ext_, nullptr);
+}
+
 TEST(Table, Rehash) {
   auto t = IntTable_new(0);
   absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
@@ -980,6 +1147,37 @@ TEST(Iterator, Iterates) {
   EXPECT_THAT(Collect(t), UnorderedElementsAre(3, 4, 5));
 }
 
+CWISS_DECLARE_NODE_HASHMAP(NodeIntMap, int64_t, int64_t);
+
+TEST(Iterator, PrefetchingVisitsTheSameElements) {
+  // Sizes around multiples of the group width exercise the cloned control
+  // bytes past the sentinel.
+  for (int64_t n : {0, 1, 7, 14, 15, 16, 17, 100, 1000}) {
+    SCOPED_TRACE(n);
+    auto t = NodeIntMap_new(0);
+    absl::Cleanup c_ = [&] { NodeIntMap_destroy(&t); };
+    for (int64_t i = 0; i < n; ++i) {
+      NodeIntMap_Entry e = {i, i * i};
+      NodeIntMap_insert(&t, &e);
+    }
+    for (int64_t i = 0; i < n; i += 3) NodeIntMap_erase(&t, &i);
+
+    std::vector<int64_t> want, got;
+    for (auto it = NodeIntMap_citer(&t); NodeIntMap_CIter_get(&it);
+         NodeIntMap_CIter_next(&it)) {
+      want.push_back(NodeIntMap_CIter_get(&it)->key);
+    }
+    for (auto it = NodeIntMap_citer_prefetching(&t); NodeIntMap_CIter_get(&it);
+         NodeIntMap_CIter_next(&it)) {
+      auto* e = NodeIntMap_CIter_get(&it);
+      EXPECT_EQ(e->val, e->key * e->key);
+      got.push_back(e->key);
+    }
+    EXPECT_EQ(got, want);
+    EXPECT_EQ(got.size(), NodeIntMap_size(&t));
+  }
+}
+
 // TEST(Table, Merge) {
 //   StringTable t1, t2;
 //   t1.emplace("0", "-0");
@@ -1233,5 +1431,1581 @@ TEST(Table, AlignOne) {
     EXPECT_EQ(verifier.count(u), 1);
   }
 }
+
+size_t zeroed_allocs = 0;
+void* CountingCalloc(size_t size, size_t align) {
+  ++zeroed_allocs;
+  return CWISS_DefaultCalloc(size, align);
+}
+
+CWISS_DECLARE_FLAT_SET_POLICY(kZeroedPolicy, int64_t,
+                              (alloc_zeroed, CountingCalloc));
+CWISS_DECLARE_HASHSET_WITH(ZeroedTable, int64_t, kZeroedPolicy);
+TABLE_HELPERS(ZeroedTable);
+
+TEST(Table, ZeroedBackingArray) {
+  zeroed_allocs = 0;
+  auto t = ZeroedTable_new(0);
+  absl::Cleanup c_ = [&] { ZeroedTable_destroy(&t); };
+  for (int64_t i = 0; i < 10000; ++i) Insert(t, i);
+  for (int64_t i = 0; i < 10000; i += 2) Erase(t, i);
+  for (int64_t i = 0; i < 10000; ++i) {
+    EXPECT_EQ(Find(t, i) != nullptr, i % 2 == 1) << i;
+  }
+
+  // Zeroed memory is only of use if it reads as empty control bytes.
+  EXPECT_EQ(zeroed_allocs != 0, CWISS_ZERO_EMPTY_CTRL != 0);
+}
+
+size_t CountDirty(const IntTable& t) {
+  size_t n = 0;
+  size_t cursor = 0;
+  CWISS_DirtyGroup g;
+  while (IntTable_next_dirty_group(&t, &cursor, &g)) {
+    ++n;
+  }
+  return n;
+}
+
+TEST(DirtyTracking, OnlyWrittenGroupsAreDirty) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  for (int64_t i = 0; i < 500; ++i) Insert(t, i);
+
+  // Without tracking, every group is reported.
+  size_t groups = CWISS_NumGroups(IntTable_capacity(&t));
+  EXPECT_EQ(CountDirty(t), groups);
+
+  // Enabling tracking forces a full snapshot.
+  IntTable_enable_dirty_tracking(&t);
+  EXPECT_EQ(CountDirty(t), groups);
+  IntTable_clear_dirty(&t);
+  EXPECT_EQ(CountDirty(t), 0);
+
+  Insert(t, 1000);
+  EXPECT_EQ(CountDirty(t), 1);
+  Erase(t, 1000);
+  EXPECT_EQ(CountDirty(t), 1);
+  IntTable_clear_dirty(&t);
+
+  // Mutating lookups mark their element; non-mutating ones do not.
+  int64_t k = 7;
+  auto cit = IntTable_cfind(&t, &k);
+  ASSERT_NE(IntTable_CIter_get(&cit), nullptr);
+  EXPECT_EQ(CountDirty(t), 0);
+  EXPECT_NE(Find(t, 7), nullptr);
+  EXPECT_EQ(CountDirty(t), 1);
+  IntTable_clear_dirty(&t);
+
+  // Growth invalidates everything.
+  IntTable_reserve(&t, 10000);
+  EXPECT_EQ(CountDirty(t), CWISS_NumGroups(IntTable_capacity(&t)));
+  IntTable_clear_dirty(&t);
+  IntTable_disable_dirty_tracking(&t);
+  EXPECT_EQ(CountDirty(t), CWISS_NumGroups(IntTable_capacity(&t)));
+}
+
+TEST(DirtyTracking, ApplyDeltas) {
+  auto src = IntTable_new(0);
+  absl::Cleanup c1_ = [&] { IntTable_destroy(&src); };
+  auto image = IntTable_new(0);
+  absl::Cleanup c2_ = [&] { IntTable_destroy(&image); };
+  IntTable_enable_dirty_tracking(&src);
+
+  std::unordered_set<int64_t> expected;
+  size_t last_groups = 0;
+  auto checkpoint = [&] {
+    IntTable_begin_apply(&image, IntTable_capacity(&src));
+    size_t cursor = 0;
+    CWISS_DirtyGroup g;
+    last_groups = 0;
+    while (IntTable_next_dirty_group(&src, &cursor, &g)) {
+      IntTable_apply_dirty_group(&image, &g);
+      ++last_groups;
+    }
+    IntTable_clear_dirty(&src);
+
+    EXPECT_EQ(IntTable_size(&image), expected.size());
+    EXPECT_THAT(Collect(image), testing::UnorderedElementsAreArray(
+                                    expected.begin(), expected.end()));
+
+    // The image can be turned into a real table.
+    auto copy = IntTable_dup(&image);
+    absl::Cleanup c3_ = [&] { IntTable_destroy(&copy); };
+    for (int64_t v : expected) {
+      EXPECT_TRUE(IntTable_contains(&copy, &v)) << v;
+    }
+  };
+
+  for (int64_t i = 0; i < 100; ++i) {
+    Insert(src, i);
+    expected.insert(i);
+  }
+  IntTable_reserve(&src, 1000);
+  checkpoint();
+  EXPECT_EQ(last_groups, CWISS_NumGroups(IntTable_capacity(&src)));
+
+  for (int64_t i = 0; i < 10; ++i) {
+    Erase(src, i);
+    expected.erase(i);
+  }
+  for (int64_t i = 1000; i < 1005; ++i) {
+    Insert(src, i);
+    expected.insert(i);
+  }
+  checkpoint();
+  EXPECT_LE(last_groups, 15);
+
+  checkpoint();
+  EXPECT_EQ(last_groups, 0);
+
+  for (int64_t i = 2000; i < 4000; ++i) {
+    Insert(src, i);
+    expected.insert(i);
+  }
+  checkpoint();
+  EXPECT_EQ(last_groups, CWISS_NumGroups(IntTable_capacity(&src)));
+}
+
+TEST(Table, RandomEmpty) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  uint64_t rng = 0;
+  auto it = IntTable_random(&t, &rng);
+  EXPECT_EQ(IntTable_Iter_get(&it), nullptr);
+
+  IntTable_reserve(&t, 100);
+  it = IntTable_random(&t, &rng);
+  EXPECT_EQ(IntTable_Iter_get(&it), nullptr);
+}
+
+TEST(Table, RandomIsUniform) {
+  // Cover both small tables, whose only group includes cloned control bytes,
+  // and multi-group ones.
+  for (int64_t n : {1, 3, 7, 20, 300}) {
+    auto t = IntTable_new(0);
+    absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+    for (int64_t i = 0; i < n; ++i) Insert(t, i);
+
+    constexpr int kSamplesPerElement = 1000;
+    std::vector<int> hits(n);
+    uint64_t rng = 42;
+    for (int64_t i = 0; i < n * kSamplesPerElement; ++i) {
+      auto it = IntTable_crandom(&t, &rng);
+      const int64_t* v = IntTable_CIter_get(&it);
+      ASSERT_NE(v, nullptr);
+      ASSERT_GE(*v, 0);
+      ASSERT_LT(*v, n);
+      ++hits[*v];
+    }
+    // Each count is roughly Binomial(n * 1000, 1 / n); stay well clear of
+    // six standard deviations.
+    for (int64_t i = 0; i < n; ++i) {
+      EXPECT_GT(hits[i], kSamplesPerElement * 3 / 4) << n << " " << i;
+      EXPECT_LT(hits[i], kSamplesPerElement * 5 / 4) << n << " " << i;
+    }
+  }
+}
+
+TEST(Table, RandomAfterMassErase) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  for (int64_t i = 0; i < 10000; ++i) Insert(t, i);
+  for (int64_t i = 0; i < 10000; ++i) {
+    if (i % 1000 != 0) Erase(t, i);
+  }
+
+  std::unordered_set<int64_t> seen;
+  uint64_t rng = 1;
+  for (int i = 0; i < 1000; ++i) {
+    auto it = IntTable_random(&t, &rng);
+    int64_t* v = IntTable_Iter_get(&it);
+    ASSERT_NE(v, nullptr);
+    EXPECT_EQ(*v % 1000, 0) << *v;
+    seen.insert(*v);
+  }
+  EXPECT_EQ(seen.size(), 10);
+}
+
+struct Payload {
+  int64_t data[31];
+};
+CWISS_DECLARE_FLAT_HASHMAP(BigMap, int64_t, Payload);
+
+TEST(Table, ReleaseUnused) {
+  auto t = BigMap_new(0);
+  absl::Cleanup c_ = [&] { BigMap_destroy(&t); };
+  auto insert = [&](int64_t i) {
+    BigMap_Entry e = {i, {}};
+    e.val.data[30] = i * 3;
+    EXPECT_TRUE(BigMap_insert(&t, &e).inserted) << i;
+  };
+  for (int64_t i = 0; i < 10000; ++i) insert(i);
+  for (int64_t i = 0; i < 10000; ++i) {
+    if (i % 20 != 0) BigMap_erase(&t, &i);
+  }
+
+  size_t capacity = BigMap_capacity(&t);
+  size_t growth_left = t.set_.growth_left_;
+  size_t released = BigMap_release_unused(&t);
+#if CWISS_HAVE_MADVISE
+  EXPECT_GT(released, capacity * sizeof(BigMap_Entry) / 4);
+  EXPECT_EQ(released % sysconf(_SC_PAGESIZE), 0);
+#else
+  EXPECT_EQ(released, 0);
+#endif
+  EXPECT_GE(t.set_.growth_left_, growth_left);
+  EXPECT_EQ(BigMap_capacity(&t), capacity);
+  EXPECT_EQ(BigMap_size(&t), 500);
+
+  // The remaining elements are untouched, and the erased ones can be put back.
+  for (int64_t i = 0; i < 10000; i += 20) {
+    auto it = BigMap_cfind(&t, &i);
+    ASSERT_NE(BigMap_CIter_get(&it), nullptr) << i;
+    EXPECT_EQ(BigMap_CIter_get(&it)->val.data[30], i * 3);
+  }
+  for (int64_t i = 0; i < 10000; ++i) {
+    if (i % 20 != 0) insert(i);
+  }
+  EXPECT_EQ(BigMap_capacity(&t), capacity);
+  for (int64_t i = 0; i < 10000; ++i) {
+    auto it = BigMap_cfind(&t, &i);
+    ASSERT_NE(BigMap_CIter_get(&it), nullptr) << i;
+    EXPECT_EQ(BigMap_CIter_get(&it)->val.data[30], i * 3);
+  }
+  EXPECT_EQ(BigMap_release_unused(&t), 0);
+}
+
+TEST(Table, ReleaseUnusedEmpty) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  EXPECT_EQ(IntTable_release_unused(&t), 0);
+  Insert(t, 1);
+  Erase(t, 1);
+  EXPECT_EQ(IntTable_release_unused_pages(&t, 1 << 21), 0);
+  EXPECT_TRUE(IntTable_empty(&t));
+}
+
+TEST(IntGroup, Match) {
+  uint32_t keys32[CWISS_IntTable_kWidth] = {1, 2, 3, 1, 0xffffffff, 5, 1, 7};
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys32, 4, 1), 0b01001001);
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys32, 4, 0xffffffff),
+            0b00010000);
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys32, 4, 4), 0);
+
+  // The halves of a 64-bit key must both match.
+  uint64_t keys64[CWISS_IntTable_kWidth] = {
+      1, uint64_t{1} << 32, 3, 1, ~uint64_t{0}, (uint64_t{1} << 32) | 1, 1, 7};
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys64, 8, 1), 0b01001001);
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys64, 8, uint64_t{1} << 32),
+            0b00000010);
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys64, 8, ~uint64_t{0}),
+            0b00010000);
+  EXPECT_EQ(CWISS_IntGroup_Match((const char*)keys64, 8, 4), 0);
+}
+
+CWISS_DECLARE_INT_HASHMAP(U32Map, uint32_t, uint32_t);
+CWISS_DECLARE_INT_HASHMAP(U64PtrMap, uint64_t, void*);
+CWISS_DECLARE_INT_HASHSET(I32Set, int32_t);
+
+TEST(IntTable, Smoke) {
+  auto t = U32Map_new(0);
+  absl::Cleanup c_ = [&] { U32Map_destroy(&t); };
+  EXPECT_TRUE(U32Map_empty(&t));
+
+  uint32_t k = 42, v = 1;
+  auto it = U32Map_find(&t, &k);
+  EXPECT_EQ(U32Map_Iter_key(&it), nullptr);
+
+  auto res = U32Map_insert(&t, &k, &v);
+  EXPECT_TRUE(res.inserted);
+  EXPECT_EQ(*U32Map_Iter_key(&res.iter), 42);
+  EXPECT_EQ(*U32Map_Iter_val(&res.iter), 1);
+
+  v = 2;
+  res = U32Map_insert(&t, &k, &v);
+  EXPECT_FALSE(res.inserted);
+  EXPECT_EQ(*U32Map_Iter_val(&res.iter), 1);
+  *U32Map_Iter_val(&res.iter) = 2;
+
+  auto cit = U32Map_cfind(&t, &k);
+  ASSERT_NE(U32Map_CIter_key(&cit), nullptr);
+  EXPECT_EQ(*U32Map_CIter_val(&cit), 2);
+  EXPECT_EQ(U32Map_size(&t), 1);
+
+  EXPECT_TRUE(U32Map_erase(&t, &k));
+  EXPECT_FALSE(U32Map_erase(&t, &k));
+  EXPECT_FALSE(U32Map_contains(&t, &k));
+  EXPECT_TRUE(U32Map_empty(&t));
+}
+
+TEST(IntTable, NegativeKeys) {
+  auto t = I32Set_new(0);
+  absl::Cleanup c_ = [&] { I32Set_destroy(&t); };
+  for (int32_t i = -100; i < 100; ++i) {
+    EXPECT_TRUE(I32Set_insert(&t, &i).inserted);
+  }
+  for (int32_t i = -100; i < 100; ++i) {
+    auto it = I32Set_find(&t, &i);
+    ASSERT_NE(I32Set_Iter_get(&it), nullptr) << i;
+    EXPECT_EQ(*I32Set_Iter_get(&it), i);
+  }
+  int32_t k = 100;
+  EXPECT_FALSE(I32Set_contains(&t, &k));
+}
+
+TEST(IntTable, StressAgainstStdMap) {
+  auto t = U64PtrMap_new(0);
+  absl::Cleanup c_ = [&] { U64PtrMap_destroy(&t); };
+  std::unordered_map<uint64_t, void*> expected;
+
+  // A small key space forces plenty of collisions, tombstones, and
+  // rehashes-in-place.
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t k = rng() % 2000 * 0x100000001;
+    void* v = reinterpret_cast<void*>(rng());
+    if (rng() % 3 == 0) {
+      EXPECT_EQ(U64PtrMap_erase(&t, &k), expected.erase(k) == 1);
+    } else {
+      auto res = U64PtrMap_insert(&t, &k, &v);
+      auto [it, inserted] = expected.emplace(k, v);
+      EXPECT_EQ(res.inserted, inserted);
+      EXPECT_EQ(*U64PtrMap_Iter_val(&res.iter), it->second);
+    }
+  }
+
+  EXPECT_EQ(U64PtrMap_size(&t), expected.size());
+  size_t count = 0;
+  for (auto it = U64PtrMap_citer(&t); U64PtrMap_CIter_key(&it);
+       U64PtrMap_CIter_next(&it)) {
+    auto e = expected.find(*U64PtrMap_CIter_key(&it));
+    ASSERT_NE(e, expected.end());
+    EXPECT_EQ(*U64PtrMap_CIter_val(&it), e->second);
+    ++count;
+  }
+  EXPECT_EQ(count, expected.size());
+
+  auto copy = U64PtrMap_dup(&t);
+  absl::Cleanup c2_ = [&] { U64PtrMap_destroy(&copy); };
+  for (const auto& [k, v] : expected) {
+    auto it = U64PtrMap_cfind(&copy, &k);
+    ASSERT_NE(U64PtrMap_CIter_key(&it), nullptr);
+    EXPECT_EQ(*U64PtrMap_CIter_val(&it), v);
+  }
+
+  U64PtrMap_clear(&t);
+  EXPECT_TRUE(U64PtrMap_empty(&t));
+  for (const auto& [k, v] : expected) {
+    EXPECT_FALSE(U64PtrMap_contains(&t, &k));
+  }
+}
+
+TEST(IntTable, EraseWhileIterating) {
+  auto t = U32Map_new(0);
+  absl::Cleanup c_ = [&] { U32Map_destroy(&t); };
+  for (uint32_t i = 0; i < 1000; ++i) U32Map_insert(&t, &i, &i);
+  U32Map_reserve(&t, 5000);
+  EXPECT_GE(U32Map_capacity(&t), 5000);
+
+  for (auto it = U32Map_iter(&t); U32Map_Iter_key(&it); U32Map_Iter_next(&it)) {
+    if (*U32Map_Iter_key(&it) % 2 == 0) U32Map_erase_at(it);
+  }
+  EXPECT_EQ(U32Map_size(&t), 500);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(U32Map_contains(&t, &i), i % 2 == 1) << i;
+  }
+
+  U32Map_rehash(&t, 0);
+  EXPECT_LT(U32Map_capacity(&t), 5000);
+  EXPECT_EQ(U32Map_size(&t), 500);
+}
+
+#if CWISS_HAVE_MMAP
+CWISS_DECLARE_MAPPED_HASHMAP(MappedMap, uint64_t, uint64_t);
+CWISS_DECLARE_MAPPED_HASHMAP(MappedNarrowMap, uint32_t, uint64_t);
+
+std::string MappedPath(const char* name) {
+  std::string path = testing::TempDir() + "/" + name;
+  unlink(path.c_str());
+  return path;
+}
+
+TEST(MappedTable, PersistsAcrossReopen) {
+  std::string path = MappedPath("persists");
+  MappedMap m;
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 0), CWISS_kMappedOk);
+  for (uint64_t i = 0; i < 10000; ++i) {
+    uint64_t v = i * 3;
+    auto res = MappedMap_insert(&m, &i, &v);
+    ASSERT_NE(res.val, nullptr);
+    EXPECT_TRUE(res.inserted);
+  }
+  for (uint64_t i = 0; i < 10000; i += 2) {
+    EXPECT_TRUE(MappedMap_erase(&m, &i));
+  }
+  size_t capacity = MappedMap_capacity(&m);
+  EXPECT_TRUE(MappedMap_flush(&m));
+  MappedMap_close(&m);
+
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 0), CWISS_kMappedOk);
+  absl::Cleanup c_ = [&] { MappedMap_close(&m); };
+  EXPECT_EQ(MappedMap_size(&m), 5000);
+  EXPECT_EQ(MappedMap_capacity(&m), capacity);
+  for (uint64_t i = 0; i < 10000; ++i) {
+    uint64_t* v = MappedMap_find(&m, &i);
+    if (i % 2 == 0) {
+      EXPECT_EQ(v, nullptr) << i;
+    } else {
+      ASSERT_NE(v, nullptr) << i;
+      EXPECT_EQ(*v, i * 3);
+    }
+  }
+
+  size_t count = 0;
+  auto it = MappedMap_iter(&m);
+  for (auto* e = MappedMap_Iter_get(&it); e != nullptr;
+       e = MappedMap_Iter_next(&it)) {
+    EXPECT_EQ(e->key % 2, 1);
+    EXPECT_EQ(e->val, e->key * 3);
+    ++count;
+  }
+  EXPECT_EQ(count, 5000);
+}
+
+TEST(MappedTable, DetectsUnflushedWrites) {
+  std::string path = MappedPath("unflushed");
+  MappedMap m;
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 100), CWISS_kMappedOk);
+  uint64_t k = 1, v = 2;
+  MappedMap_insert(&m, &k, &v);
+  MappedMap_close(&m);
+  EXPECT_EQ(MappedMap_open(&m, path.c_str(), 100), CWISS_kMappedUnclean);
+
+  // Growth commits a complete, flushed file, even if the old one was not.
+  path = MappedPath("grown");
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 0), CWISS_kMappedOk);
+  for (k = 0; k < 10; ++k) MappedMap_insert(&m, &k, &v);
+  size_t capacity = MappedMap_capacity(&m);
+  ASSERT_TRUE(CWISS_MappedTable_Resize(&MappedMap_kPolicy, &m.set_,
+                                       capacity * 2 + 1));
+  // Simulate a crash.
+  CWISS_MappedTable_Unmap(&m.set_);
+  free(m.set_.path_);
+
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 0), CWISS_kMappedOk);
+  EXPECT_EQ(MappedMap_capacity(&m), capacity * 2 + 1);
+  EXPECT_EQ(MappedMap_size(&m), 10);
+  for (k = 0; k < 10; ++k) EXPECT_TRUE(MappedMap_contains(&m, &k));
+  MappedMap_close(&m);
+}
+
+TEST(MappedTable, RecoversUncleanFile) {
+  std::string path = MappedPath("recover");
+  MappedMap m;
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 100), CWISS_kMappedOk);
+  for (uint64_t k = 1; k <= 50; ++k) {
+    uint64_t v = k * 7;
+    MappedMap_insert(&m, &k, &v);
+  }
+  for (uint64_t k = 1; k <= 50; k += 5) MappedMap_erase(&m, &k);
+  // Leave the header stale, as a crash between two writes might.
+  m.set_.header_->size = 1000;
+  m.set_.header_->growth_left = 0;
+  MappedMap_close(&m);
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 100), CWISS_kMappedUnclean);
+
+  ASSERT_EQ(MappedMap_recover(&m, path.c_str(), 100), CWISS_kMappedOk);
+  EXPECT_EQ(MappedMap_size(&m), 40);
+  for (uint64_t k = 1; k <= 50; ++k) {
+    uint64_t* v = MappedMap_find(&m, &k);
+    if (k % 5 == 1) {
+      EXPECT_EQ(v, nullptr) << k;
+    } else {
+      ASSERT_NE(v, nullptr) << k;
+      EXPECT_EQ(*v, k * 7);
+    }
+  }
+  uint64_t k = 51, v = 0;
+  EXPECT_TRUE(MappedMap_insert(&m, &k, &v).inserted);
+  MappedMap_close(&m);
+
+  // The insertion made the file unclean again; recovering keeps it.
+  ASSERT_EQ(MappedMap_recover(&m, path.c_str(), 100), CWISS_kMappedOk);
+  EXPECT_EQ(MappedMap_size(&m), 41);
+  MappedMap_close(&m);
+}
+
+TEST(MappedTable, CorruptFileWithNoEmptySlot) {
+  std::string path = MappedPath("corrupt");
+  MappedMap m;
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 100), CWISS_kMappedOk);
+  absl::Cleanup c_ = [&] { MappedMap_close(&m); };
+  uint64_t k = 1, v = 2;
+  auto* slot = reinterpret_cast<char*>(MappedMap_insert(&m, &k, &v).val) -
+               MappedMap_kPolicy.val_offset;
+  size_t capacity = MappedMap_capacity(&m);
+  CWISS_ControlByte full =
+      m.set_.ctrl_[(slot - m.set_.slots_) / MappedMap_kPolicy.slot_size];
+  for (size_t i = 0; i < capacity; ++i) {
+    CWISS_SetCtrl(i, full, capacity, m.set_.ctrl_, m.set_.slots_,
+                  MappedMap_kPolicy.slot_size);
+  }
+
+  // Neither lookups nor insertions probe forever.
+  k = 12345;
+  EXPECT_EQ(MappedMap_find(&m, &k), nullptr);
+  EXPECT_EQ(MappedMap_insert(&m, &k, &v).val, nullptr);
+}
+
+TEST(MappedTable, RejectsOtherTypes) {
+  std::string path = MappedPath("types");
+  MappedMap m;
+  ASSERT_EQ(MappedMap_open(&m, path.c_str(), 0), CWISS_kMappedOk);
+  EXPECT_TRUE(MappedMap_flush(&m));
+  MappedMap_close(&m);
+
+  MappedNarrowMap n;
+  EXPECT_EQ(MappedNarrowMap_open(&n, path.c_str(), 0), CWISS_kMappedBadFormat);
+  FILE* f = fopen(path.c_str(), "w");
+  fputs("not a table", f);
+  fclose(f);
+  EXPECT_EQ(MappedMap_open(&m, path.c_str(), 0), CWISS_kMappedBadFormat);
+}
+#endif  // CWISS_HAVE_MMAP
+
+CWISS_DECLARE_SHARDED(ShardedIntTable, IntTable);
+
+TEST(ShardedTable, PerKey) {
+  auto t = ShardedIntTable_new(5, 0);
+  absl::Cleanup c_ = [&] { ShardedIntTable_destroy(&t); };
+  EXPECT_EQ(t.set_.shard_bits_, 3);
+  for (size_t i = 0; i < 8; ++i) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(
+                  CWISS_ShardedTable_shard(&t.set_, i)) %
+                  CWISS_ShardedTable_kCacheLine,
+              0);
+  }
+
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(ShardedIntTable_insert(&t, &i));
+    EXPECT_FALSE(ShardedIntTable_insert(&t, &i));
+  }
+  EXPECT_EQ(ShardedIntTable_size(&t), 1000);
+
+  int64_t k = 42;
+  int64_t seen = -1;
+  EXPECT_TRUE(ShardedIntTable_find(
+      &t, &k,
+      [](void* ctx, size_t i, int64_t* elem) {
+        EXPECT_EQ(i, 0);
+        ASSERT_NE(elem, nullptr);
+        *static_cast<int64_t*>(ctx) = *elem;
+      },
+      &seen));
+  EXPECT_EQ(seen, 42);
+
+  EXPECT_TRUE(ShardedIntTable_erase(&t, &k));
+  EXPECT_FALSE(ShardedIntTable_erase(&t, &k));
+  EXPECT_FALSE(ShardedIntTable_contains(&t, &k));
+  EXPECT_EQ(ShardedIntTable_size(&t), 999);
+}
+
+TEST(ShardedTable, Batch) {
+  auto t = ShardedIntTable_new(16, 0);
+  absl::Cleanup c_ = [&] { ShardedIntTable_destroy(&t); };
+
+  std::vector<int64_t> vals;
+  for (int64_t i = 0; i < 1000; ++i) vals.push_back(i);
+  vals.push_back(7);  // A duplicate within the batch.
+  bool inserted[1001];
+  EXPECT_EQ(
+      ShardedIntTable_insert_batch(&t, vals.data(), vals.size(), inserted),
+      1000);
+  for (int i = 0; i < 1000; ++i) EXPECT_TRUE(inserted[i]) << i;
+  EXPECT_FALSE(inserted[1000]);
+  EXPECT_EQ(ShardedIntTable_size(&t), 1000);
+
+  std::vector<int64_t> keys;
+  for (int64_t i = 500; i < 1500; ++i) keys.push_back(i);
+  bool found[1000];
+  std::vector<int64_t> seen(keys.size(), -1);
+  EXPECT_EQ(ShardedIntTable_find_batch(
+                &t, keys.data(), keys.size(), found,
+                [](void* ctx, size_t i, int64_t* elem) {
+                  auto& seen = *static_cast<std::vector<int64_t>*>(ctx);
+                  if (elem) seen[i] = *elem;
+                },
+                &seen),
+            500);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(found[i], keys[i] < 1000) << i;
+    EXPECT_EQ(seen[i], keys[i] < 1000 ? keys[i] : -1) << i;
+  }
+
+  EXPECT_EQ(ShardedIntTable_erase_batch(&t, keys.data(), keys.size()), 500);
+  EXPECT_EQ(ShardedIntTable_size(&t), 500);
+  EXPECT_EQ(ShardedIntTable_find_batch(&t, keys.data(), keys.size(), nullptr,
+                                       nullptr, nullptr),
+            0);
+  EXPECT_EQ(ShardedIntTable_insert_batch(&t, nullptr, 0, nullptr), 0);
+}
+
+TEST(ShardedTable, Concurrent) {
+  auto t = ShardedIntTable_new(8, 0);
+  absl::Cleanup c_ = [&] { ShardedIntTable_destroy(&t); };
+
+  constexpr int kThreads = 4;
+  constexpr int64_t kPerThread = 20000;
+  std::vector<std::thread> threads;
+  for (int n = 0; n < kThreads; ++n) {
+    threads.emplace_back([&t, n] {
+      std::vector<int64_t> batch;
+      for (int64_t i = 0; i < kPerThread; ++i) {
+        int64_t k = n * kPerThread + i;
+        if (i % 2 == 0) {
+          ShardedIntTable_insert(&t, &k);
+        } else {
+          batch.push_back(k);
+        }
+        if (batch.size() == 1000) {
+          ShardedIntTable_insert_batch(&t, batch.data(), batch.size(), nullptr);
+          EXPECT_EQ(ShardedIntTable_find_batch(&t, batch.data(), batch.size(),
+                                               nullptr, nullptr, nullptr),
+                    batch.size());
+          batch.clear();
+        }
+      }
+      ShardedIntTable_insert_batch(&t, batch.data(), batch.size(), nullptr);
+    });
+  }
+  for (auto& th : threads) th.join();
+  EXPECT_EQ(ShardedIntTable_size(&t), kThreads * kPerThread);
+}
+
+TEST(ShardedTable, OversubscribedSingleShard) {
+  // More threads than cores on one lock: holders get preempted, and waiters
+  // must yield to them rather than spin out their time slices.
+  auto t = ShardedIntTable_new(1, 0);
+  absl::Cleanup c_ = [&] { ShardedIntTable_destroy(&t); };
+
+  const int threads_count =
+      4 * static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  constexpr int64_t kPerThread = 2000;
+  std::vector<std::thread> threads;
+  for (int n = 0; n < threads_count; ++n) {
+    threads.emplace_back([&t, n] {
+      for (int64_t i = 0; i < kPerThread; ++i) {
+        int64_t k = n * kPerThread + i;
+        ShardedIntTable_insert(&t, &k);
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+  EXPECT_EQ(ShardedIntTable_size(&t), threads_count * kPerThread);
+}
+
+CWISS_DECLARE_FROZEN_COUNTERS(IntCounters, IntTable);
+CWISS_DECLARE_FROZEN_COUNTERS(StringCounters, StringTable);
+
+TEST(FrozenCounters, Basic) {
+  for (bool padded : {false, true}) {
+    auto keys = IntTable_new(0);
+    for (int64_t i = 0; i < 100; ++i) IntTable_insert(&keys, &i);
+    auto t = IntCounters_new(&keys, padded);
+    absl::Cleanup c_ = [&] {
+      IntCounters_destroy(&t);
+      IntTable_destroy(&keys);
+    };
+    EXPECT_TRUE(IntTable_empty(&keys));
+    EXPECT_EQ(IntCounters_size(&t), 100);
+
+    for (int64_t i = 0; i < 100; ++i) {
+      EXPECT_TRUE(IntCounters_add(&t, &i, i)) << i;
+      EXPECT_TRUE(IntCounters_add(&t, &i, i)) << i;
+    }
+    int64_t k = 100;
+    EXPECT_FALSE(IntCounters_add(&t, &k, 1));
+    EXPECT_EQ(IntCounters_find(&t, &k), nullptr);
+
+    k = 7;
+    CWISS_Counter* c = IntCounters_find(&t, &k);
+    ASSERT_NE(c, nullptr);
+    EXPECT_EQ(CWISS_Counter_load(c), 14);
+    if (padded) {
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(c) % CWISS_FrozenTable_kCacheLine,
+                0);
+    }
+    EXPECT_EQ(CWISS_Counter_add(c, -4), 14);
+    int64_t expected = 0;
+    EXPECT_FALSE(CWISS_Counter_compare_exchange(c, &expected, 1));
+    EXPECT_EQ(expected, 10);
+    EXPECT_TRUE(CWISS_Counter_compare_exchange(c, &expected, 1));
+    CWISS_Counter_store(c, 14);
+
+    int64_t visited = 0;
+    auto it = IntCounters_citer(&t);
+    for (const int64_t* p = IntTable_CIter_get(&it); p != nullptr;
+         p = IntTable_CIter_next(&it)) {
+      EXPECT_EQ(CWISS_Counter_load(IntCounters_counter_at(&t, &it)), 2 * *p);
+      ++visited;
+    }
+    EXPECT_EQ(visited, 100);
+  }
+}
+
+TEST(FrozenCounters, Empty) {
+  auto keys = StringTable_new(0);
+  auto t = StringCounters_new(&keys, false);
+  absl::Cleanup c_ = [&] { StringCounters_destroy(&t); };
+  EXPECT_EQ(StringCounters_size(&t), 0);
+  std::string k = "foo";
+  EXPECT_EQ(StringCounters_find(&t, &k), nullptr);
+}
+
+TEST(FrozenCounters, Concurrent) {
+  std::vector<std::string> names;
+  for (int i = 0; i < 64; ++i) names.push_back("metric_" + std::to_string(i));
+  std::string max_name = "max";
+
+  auto keys = StringTable_new(0);
+  for (auto& name : names) StringTable_insert(&keys, &name);
+  StringTable_insert(&keys, &max_name);
+  auto t = StringCounters_new(&keys, true);
+  absl::Cleanup c_ = [&] {
+    StringCounters_destroy(&t);
+    StringTable_destroy(&keys);
+  };
+
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 20000;
+  std::vector<std::thread> threads;
+  for (int n = 0; n < kThreads; ++n) {
+    threads.emplace_back([&, n] {
+      CWISS_Counter* max = StringCounters_find(&t, &max_name);
+      for (int i = 0; i < kPerThread; ++i) {
+        EXPECT_TRUE(StringCounters_add(&t, &names[(i + n) % 64], 1));
+        int64_t cur = CWISS_Counter_load(max);
+        while (cur < i && !CWISS_Counter_compare_exchange(max, &cur, i)) {
+        }
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  int64_t total = 0;
+  auto it = StringCounters_citer(&t);
+  for (auto* p = StringTable_CIter_get(&it); p != nullptr;
+       p = StringTable_CIter_next(&it)) {
+    if (*p == max_name) continue;
+    total += CWISS_Counter_load(StringCounters_counter_at(&t, &it));
+  }
+  EXPECT_EQ(total, kThreads * kPerThread);
+  EXPECT_EQ(CWISS_Counter_load(StringCounters_find(&t, &max_name)),
+            kPerThread - 1);
+}
+
+size_t BufferedHash(const std::string& bytes, size_t split) {
+  CWISS_BufferedHash_State state = CWISS_BufferedHash_kInit;
+  for (size_t i = 0; i < bytes.size(); i += split) {
+    CWISS_BufferedHash_Write(&state, bytes.data() + i,
+                             std::min(split, bytes.size() - i));
+  }
+  return CWISS_BufferedHash_Finish(state);
+}
+
+TEST(BufferedHash, IndependentOfSplit) {
+  std::string bytes;
+  for (int i = 0; i < 100; ++i) {
+    bytes.push_back(static_cast<char>(i * 37));
+    size_t h = BufferedHash(bytes, bytes.size());
+    for (size_t split : {1, 2, 3, 7, 15, 16, 17}) {
+      EXPECT_EQ(BufferedHash(bytes, split), h) << i << " " << split;
+    }
+  }
+}
+
+TEST(BufferedHash, DistinguishesLengths) {
+  // Prefixes of a run of zeros, and of a block that ends in its own length,
+  // must all hash differently, as must the empty string.
+  std::string zeros(64, '\0');
+  std::string tagged(16, 'x');
+  tagged[15] = 15;
+  std::unordered_set<size_t> hashes;
+  for (size_t len = 0; len <= zeros.size(); ++len) {
+    EXPECT_TRUE(hashes.insert(BufferedHash(zeros.substr(0, len), 16)).second)
+        << len;
+  }
+  EXPECT_NE(BufferedHash(tagged, 16), BufferedHash(tagged.substr(0, 15), 16));
+  EXPECT_NE(BufferedHash("ab", 1), BufferedHash("ba", 1));
+}
+
+struct Route {
+  uint32_t service;
+  uint16_t method;
+  uint8_t version;
+  uint64_t tenant;
+};
+
+size_t HashRoute(const Route& r) {
+  CWISS_BufferedHash_State state = CWISS_BufferedHash_kInit;
+  CWISS_BufferedHash_Write(&state, &r.service, sizeof(r.service));
+  CWISS_BufferedHash_Write(&state, &r.method, sizeof(r.method));
+  CWISS_BufferedHash_Write(&state, &r.version, sizeof(r.version));
+  CWISS_BufferedHash_Write(&state, &r.tenant, sizeof(r.tenant));
+  return CWISS_BufferedHash_Finish(state);
+}
+
+TEST(BufferedHash, CompositeKeysSpread) {
+  // Keys that differ in a single field should land in different buckets about
+  // as often as random hashes would.
+  std::unordered_set<size_t> buckets;
+  constexpr size_t kKeys = 4096;
+  for (uint32_t i = 0; i < kKeys; ++i) {
+    Route r = {i % 16, static_cast<uint16_t>(i / 16 % 16),
+               static_cast<uint8_t>(i / 256), 42};
+    buckets.insert(HashRoute(r) >> 7 & (kKeys * 4 - 1));
+  }
+  // The expected number of distinct buckets is about 3624.
+  EXPECT_GT(buckets.size(), 3500);
+}
+
+TEST(BufferedHash, FullBlockKeysSpread) {
+  // As above, for keys that fill a whole block, which `Finish()` does not
+  // mix as a partial one.
+  std::unordered_set<size_t> buckets;
+  constexpr size_t kKeys = 4096;
+  for (uint32_t i = 0; i < kKeys; ++i) {
+    uint32_t fields[4] = {i % 16, i / 16 % 16, i / 256, 42};
+    CWISS_BufferedHash_State state = CWISS_BufferedHash_kInit;
+    for (uint32_t field : fields) {
+      CWISS_BufferedHash_Write(&state, &field, sizeof(field));
+    }
+    buckets.insert(CWISS_BufferedHash_Finish(state) >> 7 & (kKeys * 4 - 1));
+  }
+  EXPECT_GT(buckets.size(), 3500);
+}
+
+CWISS_DECLARE_FINGERPRINT_SET(Fp32Set, uint32_t);
+CWISS_DECLARE_FINGERPRINT_SET(Fp64Set, uint64_t);
+
+TEST(FingerprintSet, Fingerprint64IsStable) {
+  // Fingerprints are meant to be persisted, so they must not change.
+  EXPECT_EQ(CWISS_Fingerprint64("", 0), CWISS_Fingerprint64("", 0));
+  EXPECT_EQ(CWISS_Fingerprint64("hello", 5), CWISS_Fingerprint64("hello", 5));
+  EXPECT_NE(CWISS_Fingerprint64("hello", 5), CWISS_Fingerprint64("hellp", 5));
+  EXPECT_EQ(Fp64Set_fingerprint("hello", 5), CWISS_Fingerprint64("hello", 5));
+}
+
+TEST(FingerprintSet, InsertAndGrow) {
+  auto t = Fp64Set_new(0);
+  absl::Cleanup c_ = [&] { Fp64Set_destroy(&t); };
+  for (int i = 0; i < 10000; ++i) {
+    std::string s = "key" + std::to_string(i);
+    EXPECT_TRUE(Fp64Set_insert_bytes(&t, s.data(), s.size()));
+    EXPECT_FALSE(Fp64Set_insert_bytes(&t, s.data(), s.size()));
+  }
+  EXPECT_EQ(Fp64Set_size(&t), 10000);
+  for (int i = 0; i < 10000; ++i) {
+    std::string s = "key" + std::to_string(i);
+    EXPECT_TRUE(Fp64Set_contains_bytes(&t, s.data(), s.size())) << s;
+  }
+  for (int i = 0; i < 10000; ++i) {
+    std::string s = "absent" + std::to_string(i);
+    EXPECT_FALSE(Fp64Set_contains_bytes(&t, s.data(), s.size())) << s;
+  }
+}
+
+TEST(FingerprintSet, FalsePositiveRate) {
+  auto t = Fp32Set_new(0);
+  absl::Cleanup c_ = [&] { Fp32Set_destroy(&t); };
+  constexpr int kN = 100000;
+  for (int i = 0; i < kN; ++i) {
+    Fp32Set_insert_bytes(&t, &i, sizeof(i));
+  }
+  double rate = Fp32Set_false_positive_rate(&t);
+  EXPECT_NEAR(rate, Fp32Set_size(&t) / 4294967296.0, 1e-12);
+
+  // With 1M queries, we expect about 23 false positives.
+  constexpr int kQueries = 1000000;
+  int fps = 0;
+  for (int i = kN; i < kN + kQueries; ++i) {
+    fps += Fp32Set_contains_bytes(&t, &i, sizeof(i));
+  }
+  EXPECT_LT(fps, 4 * rate * kQueries);
+}
+
+CWISS_DECLARE_FLAT_HASHSET_EXTERN(ExternIntSet, int64_t);
+CWISS_DEFINE_HASHSET(ExternIntSet);
+CWISS_DECLARE_NODE_HASHMAP_EXTERN(ExternNodeMap, int64_t, int64_t);
+CWISS_DEFINE_HASHMAP(ExternNodeMap);
+
+TEST(Extern, Set) {
+  auto t = ExternIntSet_new(0);
+  absl::Cleanup c_ = [&] { ExternIntSet_destroy(&t); };
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(ExternIntSet_insert(&t, &i).inserted);
+    EXPECT_FALSE(ExternIntSet_insert(&t, &i).inserted);
+  }
+  EXPECT_EQ(ExternIntSet_size(&t), 1000);
+
+  auto u = ExternIntSet_dup(&t);
+  absl::Cleanup cu_ = [&] { ExternIntSet_destroy(&u); };
+  ExternIntSet_rehash(&u, 0);
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(ExternIntSet_contains(&u, &i)) << i;
+  }
+
+  ExternIntSet_clear(&t);
+  EXPECT_TRUE(ExternIntSet_empty(&t));
+  ExternIntSet_reserve(&t, 100);
+  EXPECT_GE(ExternIntSet_capacity(&t), 100);
+}
+
+TEST(Extern, Map) {
+  auto t = ExternNodeMap_new(0);
+  absl::Cleanup c_ = [&] { ExternNodeMap_destroy(&t); };
+  for (int64_t i = 0; i < 1000; ++i) {
+    ExternNodeMap_Entry e = {i, i * i};
+    EXPECT_TRUE(ExternNodeMap_insert(&t, &e).inserted);
+  }
+  for (int64_t i = 0; i < 1000; ++i) {
+    auto it = ExternNodeMap_deferred_insert(&t, &i);
+    ASSERT_FALSE(it.inserted);
+    EXPECT_EQ(ExternNodeMap_Iter_get(&it.iter)->val, i * i);
+  }
+  int64_t k = 1000;
+  auto it = ExternNodeMap_deferred_insert(&t, &k);
+  ASSERT_TRUE(it.inserted);
+  *ExternNodeMap_Iter_get(&it.iter) = {k, -1};
+  EXPECT_EQ(ExternNodeMap_size(&t), 1001);
+}
+
+CWISS_DECLARE_DISTINCT_COUNTER(U64Counter, uint64_t);
+
+TEST(DistinctCounter, ExactWhileSmall) {
+  auto c = U64Counter_new(1 << 20);
+  absl::Cleanup c_ = [&] { U64Counter_destroy(&c); };
+  for (uint64_t i = 0; i < 10000; ++i) {
+    U64Counter_add(&c, &i);
+    U64Counter_add(&c, &i);
+  }
+  EXPECT_TRUE(U64Counter_is_exact(&c));
+  EXPECT_EQ(U64Counter_count(&c), 10000);
+}
+
+TEST(DistinctCounter, ApproximatesPastThreshold) {
+  auto c = U64Counter_new(64 << 10);
+  absl::Cleanup c_ = [&] { U64Counter_destroy(&c); };
+  uint64_t i = 0;
+  while (U64Counter_is_exact(&c)) {
+    EXPECT_EQ(U64Counter_count(&c), i);
+    U64Counter_add(&c, &i);
+    ++i;
+  }
+  // Right after the conversion, the estimate should already be close.
+  EXPECT_NEAR(U64Counter_count(&c), i, 0.05 * i);
+
+  constexpr uint64_t kN = 1000000;
+  for (; i < kN; ++i) {
+    U64Counter_add(&c, &i);
+  }
+  double estimate = U64Counter_count(&c);
+  EXPECT_NEAR(estimate, kN, 0.05 * kN);
+
+  // Duplicates do not change the sketch.
+  for (i = 0; i < kN; ++i) {
+    U64Counter_add(&c, &i);
+  }
+  EXPECT_EQ(U64Counter_count(&c), estimate);
+}
+
+TEST(DistinctCounter, TinyBudget) {
+  // Even a budget smaller than the smallest table converts cleanly.
+  auto c = U64Counter_new(0);
+  absl::Cleanup c_ = [&] { U64Counter_destroy(&c); };
+  for (uint64_t i = 0; i < 1000; ++i) {
+    U64Counter_add(&c, &i);
+  }
+  EXPECT_FALSE(U64Counter_is_exact(&c));
+  EXPECT_GT(U64Counter_count(&c), 0);
+}
+
+size_t CollidingHash(const void*) { return 0; }
+CWISS_DECLARE_NODE_MAP_POLICY(kCollidingNodePolicy, int64_t, int64_t,
+                              (key_hash, CollidingHash));
+CWISS_DECLARE_HASHMAP_WITH(CollidingNodeMap, int64_t, int64_t,
+                           kCollidingNodePolicy);
+
+TEST(NodeTable, PrefetchesCandidates) {
+  EXPECT_TRUE(kCollidingNodePolicy.slot->indirect);
+  EXPECT_FALSE(IntTable_policy()->slot->indirect);
+
+  // Every key has the same H2, so every full slot in a group is a candidate.
+  auto t = CollidingNodeMap_new(0);
+  absl::Cleanup c_ = [&] { CollidingNodeMap_destroy(&t); };
+  for (int64_t i = 0; i < 100; ++i) {
+    CollidingNodeMap_Entry e = {i, -i};
+    EXPECT_TRUE(CollidingNodeMap_insert(&t, &e).inserted);
+  }
+  for (int64_t i = 0; i < 100; ++i) {
+    auto it = CollidingNodeMap_find(&t, &i);
+    ASSERT_NE(CollidingNodeMap_Iter_get(&it), nullptr) << i;
+    EXPECT_EQ(CollidingNodeMap_Iter_get(&it)->val, -i);
+  }
+  int64_t k = 100;
+  EXPECT_FALSE(CollidingNodeMap_contains(&t, &k));
+}
+
+// Returns which group of its probe sequence the element `it` points to is in.
+size_t ProbeGroup(const BadTable& t, const BadTable_Iter& it) {
+  size_t offset =
+      CWISS_ProbeSeq_Start(t.set_.ctrl_, 0, t.set_.capacity_).offset_;
+  size_t index = static_cast<size_t>(it.it_.ctrl_ - t.set_.ctrl_);
+  return ((index - offset) & t.set_.capacity_) / CWISS_Group_kWidth;
+}
+
+TEST(HitCounting, OptimizeLayoutMovesHotElementsForward) {
+  // All elements share a probe sequence, so later insertions go deeper.
+  auto t = BadTable_new(0);
+  absl::Cleanup c_ = [&] { BadTable_destroy(&t); };
+  BadTable_enable_hit_counting(&t);
+  for (int i = 0; i < 100; ++i) {
+    BadTable_insert(&t, &i);
+  }
+  int hot = 99;
+  auto it = BadTable_find(&t, &hot);
+  EXPECT_GT(ProbeGroup(t, it), 0);
+
+  for (int i = 0; i < 50; ++i) {
+    BadTable_find(&t, &hot);
+  }
+  BadTable_optimize_layout(&t);
+
+  it = BadTable_find(&t, &hot);
+  ASSERT_NE(BadTable_Iter_get(&it), nullptr);
+  EXPECT_EQ(ProbeGroup(t, it), 0);
+  // The 51 hits were halved, and the last lookup is the only one since.
+  EXPECT_EQ(t.set_.ext_->hits_[it.it_.ctrl_ - t.set_.ctrl_], 26);
+
+  EXPECT_EQ(BadTable_size(&t), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(BadTable_contains(&t, &i)) << i;
+  }
+}
+
+TEST(HitCounting, CountsSurviveGrowthAndErasure) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  IntTable_enable_hit_counting(&t);
+  int64_t hot = 7;
+  IntTable_insert(&t, &hot);
+  for (int i = 0; i < 3; ++i) {
+    IntTable_find(&t, &hot);
+  }
+  for (int64_t i = 100; i < 1100; ++i) {
+    IntTable_insert(&t, &i);
+  }
+  auto it = IntTable_find(&t, &hot);
+  EXPECT_EQ(t.set_.ext_->hits_[it.it_.ctrl_ - t.set_.ctrl_], 4);
+
+  // A reinserted element starts over.
+  IntTable_erase(&t, &hot);
+  IntTable_insert(&t, &hot);
+  it = IntTable_find(&t, &hot);
+  EXPECT_EQ(t.set_.ext_->hits_[it.it_.ctrl_ - t.set_.ctrl_], 1);
+
+  IntTable_optimize_layout(&t);
+  for (int64_t i = 100; i < 1100; ++i) {
+    EXPECT_TRUE(IntTable_contains(&t, &i)) << i;
+  }
+  IntTable_disable_hit_counting(&t);
+  EXPECT_EQ(t.set_.ext_, nullptr);
+}
+
+CWISS_DECLARE_FLAT_SET_POLICY(kOneChoicePolicy, int64_t,
+                              (key_two_choice, false));
+CWISS_DECLARE_HASHSET_WITH(OneChoiceTable, int64_t, kOneChoicePolicy);
+CWISS_DECLARE_FLAT_SET_POLICY(kTwoChoicePolicy, int64_t,
+                              (key_two_choice, true));
+CWISS_DECLARE_HASHSET_WITH(TwoChoiceTable, int64_t, kTwoChoicePolicy);
+
+TEST(TwoChoice, InsertFindErase) {
+  auto t = TwoChoiceTable_new(0);
+  absl::Cleanup c_ = [&] { TwoChoiceTable_destroy(&t); };
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(TwoChoiceTable_insert(&t, &i).inserted) << i;
+  }
+  for (int64_t i = 0; i < 1000; i += 2) {
+    EXPECT_TRUE(TwoChoiceTable_erase(&t, &i)) << i;
+  }
+  for (int64_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(TwoChoiceTable_contains(&t, &i), i % 2 == 1) << i;
+  }
+
+  // Churn at a fixed size, so that tombstones get dropped in place.
+  std::deque<int64_t> keys;
+  for (int64_t i = 1; i < 1000; i += 2) {
+    keys.push_back(i);
+  }
+  const size_t capacity = TwoChoiceTable_capacity(&t);
+  for (int64_t i = 1000; i < 20000; ++i) {
+    ASSERT_TRUE(TwoChoiceTable_erase(&t, &keys.front())) << keys.front();
+    keys.pop_front();
+    ASSERT_TRUE(TwoChoiceTable_insert(&t, &i).inserted) << i;
+    keys.push_back(i);
+  }
+  EXPECT_EQ(TwoChoiceTable_capacity(&t), capacity);
+  for (int64_t k : keys) {
+    EXPECT_TRUE(TwoChoiceTable_contains(&t, &k)) << k;
+  }
+}
+
+TEST(TwoChoice, ShortensLongestProbe) {
+  // Fill both kinds of table with the same keys, right up to maximum load.
+  const size_t kCapacity = (1 << 16) - 1;
+  auto one = OneChoiceTable_new(kCapacity);
+  absl::Cleanup c1_ = [&] { OneChoiceTable_destroy(&one); };
+  auto two = TwoChoiceTable_new(kCapacity);
+  absl::Cleanup c2_ = [&] { TwoChoiceTable_destroy(&two); };
+  for (int64_t i = 0; i < (int64_t)CWISS_CapacityToGrowth(kCapacity); ++i) {
+    OneChoiceTable_insert(&one, &i);
+    TwoChoiceTable_insert(&two, &i);
+  }
+  ASSERT_EQ(OneChoiceTable_capacity(&one), kCapacity);
+  ASSERT_EQ(TwoChoiceTable_capacity(&two), kCapacity);
+
+  auto one_probes = internal::GetHashtableDebugNumProbesHistogram(
+      OneChoiceTable_policy(), &one.set_);
+  auto two_probes = internal::GetHashtableDebugNumProbesHistogram(
+      TwoChoiceTable_policy(), &two.set_);
+  EXPECT_LT(two_probes.size(), one_probes.size());
+  EXPECT_LT(internal::GetHashtableDebugProbeSummary(TwoChoiceTable_policy(),
+                                                    &two.set_)
+                .mean,
+            internal::GetHashtableDebugProbeSummary(OneChoiceTable_policy(),
+                                                    &one.set_)
+                .mean);
+
+  for (int64_t i = 0; i < (int64_t)CWISS_CapacityToGrowth(kCapacity); ++i) {
+    ASSERT_TRUE(TwoChoiceTable_contains(&two, &i)) << i;
+  }
+  int64_t missing = -1;
+  EXPECT_FALSE(TwoChoiceTable_contains(&two, &missing));
+}
+
+void CountCall(void* ctx) { ++*static_cast<int*>(ctx); }
+
+TEST(GrowthWatch, FiresAtWatermark) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  int calls = 0;
+  IntTable_watch_growth(&t, 4, CountCall, &calls);
+  IntTable_reserve(&t, 100);
+  size_t capacity = IntTable_capacity(&t);
+
+  int64_t i = 0;
+  while (IntTable_growth_left(&t) > 4) {
+    EXPECT_FALSE(IntTable_needs_growth(&t));
+    EXPECT_EQ(calls, 0);
+    Insert(t, i++);
+  }
+  EXPECT_EQ(calls, 1);
+  EXPECT_TRUE(IntTable_needs_growth(&t));
+
+  // Further insertions below the watermark fire again; inserting an element
+  // that is already present uses up no budget, so it does not.
+  Insert(t, i++);
+  EXPECT_EQ(calls, 2);
+  Insert(t, 0);
+  EXPECT_EQ(calls, 2);
+  EXPECT_EQ(IntTable_capacity(&t), capacity);
+
+  // Growing off the insertion path stops the calls until the budget is back
+  // down to the watermark.
+  IntTable_reserve(&t, 2 * IntTable_size(&t));
+  EXPECT_FALSE(IntTable_needs_growth(&t));
+  while (IntTable_growth_left(&t) > 4) Insert(t, i++);
+  EXPECT_EQ(calls, 3);
+
+  IntTable_unwatch_growth(&t);
+  EXPECT_FALSE(IntTable_needs_growth(&t));
+  while (IntTable_growth_left(&t) > 0) Insert(t, i++);
+  EXPECT_EQ(calls, 3);
+  EXPECT_TRUE(IntTable_needs_growth(&t));
+}
+
+TEST(GrowthWatch, FiresWhenSetBelowBudget) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  IntTable_reserve(&t, 100);
+  int64_t i = 0;
+  while (IntTable_growth_left(&t) > 4) Insert(t, i++);
+
+  int calls = 0;
+  IntTable_watch_growth(&t, 8, CountCall, &calls);
+  EXPECT_TRUE(IntTable_needs_growth(&t));
+  EXPECT_EQ(calls, 0);
+  Insert(t, i++);
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(GrowthWatch, NoInlineGrowth) {
+  auto t = IntTable_new(0);
+  absl::Cleanup c_ = [&] { IntTable_destroy(&t); };
+  IntTable_set_inline_growth(&t, false);
+
+  // A table with no backing array has no room at all.
+  EXPECT_EQ(Insert(t, 0).first, nullptr);
+  EXPECT_EQ(LazyInsert(t, 0).first, nullptr);
+  EXPECT_TRUE(IntTable_empty(&t));
+
+  IntTable_reserve(&t, 16);
+  size_t capacity = IntTable_capacity(&t);
+  int64_t i = 0;
+  while (IntTable_growth_left(&t) > 0) {
+    EXPECT_TRUE(Insert(t, i++).second);
+  }
+  size_t size = IntTable_size(&t);
+  auto refused = IntTable_insert(&t, &i);
+  EXPECT_TRUE(refused.needs_growth);
+  EXPECT_FALSE(refused.inserted);
+  EXPECT_EQ(IntTable_Iter_get(&refused.iter), nullptr);
+  refused = IntTable_deferred_insert(&t, &i);
+  EXPECT_TRUE(refused.needs_growth);
+  EXPECT_FALSE(refused.inserted);
+  EXPECT_EQ(IntTable_size(&t), size);
+  EXPECT_EQ(IntTable_capacity(&t), capacity);
+  EXPECT_FALSE(IntTable_contains(&t, &i));
+
+  // Elements that are already present are still found.
+  int64_t present = 3;
+  auto found = IntTable_insert(&t, &present);
+  EXPECT_FALSE(found.needs_growth);
+  EXPECT_FALSE(found.inserted);
+  ASSERT_NE(IntTable_Iter_get(&found.iter), nullptr);
+  EXPECT_EQ(*IntTable_Iter_get(&found.iter), 3);
+
+  IntTable_reserve(&t, 2 * size);
+  EXPECT_TRUE(Insert(t, i).second);
+  EXPECT_TRUE(IntTable_contains(&t, &i));
+
+  IntTable_set_inline_growth(&t, true);
+  capacity = IntTable_capacity(&t);
+  for (int64_t j = i + 1; IntTable_capacity(&t) == capacity; ++j) {
+    ASSERT_TRUE(Insert(t, j).second);
+  }
+}
+TEST(NodeArena, Locate) {
+  size_t offset;
+  EXPECT_EQ(CWISS_NodeArena_Locate(0, &offset), 0);
+  EXPECT_EQ(offset, 0);
+  EXPECT_EQ(CWISS_NodeArena_Locate(63, &offset), 0);
+  EXPECT_EQ(offset, 63);
+  EXPECT_EQ(CWISS_NodeArena_Locate(64, &offset), 1);
+  EXPECT_EQ(offset, 0);
+  EXPECT_EQ(CWISS_NodeArena_Locate(191, &offset), 1);
+  EXPECT_EQ(offset, 127);
+  EXPECT_EQ(CWISS_NodeArena_Locate(192, &offset), 2);
+  EXPECT_EQ(offset, 0);
+  EXPECT_EQ(CWISS_NodeArena_Locate(UINT32_MAX - 1, &offset),
+            CWISS_NodeArena_kMaxChunks - 1);
+  EXPECT_LT(offset, CWISS_NodeArena_ChunkLen(CWISS_NodeArena_kMaxChunks - 1));
+}
+
+CWISS_DECLARE_ARENA_HASHMAP(ArenaU64Map, uint64_t, uint64_t);
+
+TEST(ArenaTable, StressAgainstStdMap) {
+  auto t = ArenaU64Map_new(0);
+  absl::Cleanup c_ = [&] { ArenaU64Map_destroy(&t); };
+  std::unordered_map<uint64_t, ArenaU64Map_Entry*> expected;
+
+  // Elements must keep their addresses through growth, rehashes-in-place, and
+  // the erasure of their neighbors.
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 100000; ++i) {
+    ArenaU64Map_Entry e = {rng() % 2000, rng()};
+    if (rng() % 3 == 0) {
+      EXPECT_EQ(ArenaU64Map_erase(&t, &e.key), expected.erase(e.key) == 1);
+    } else {
+      auto res = ArenaU64Map_insert(&t, &e);
+      auto [it, inserted] =
+          expected.emplace(e.key, ArenaU64Map_Iter_get(&res.iter));
+      EXPECT_EQ(res.inserted, inserted);
+      EXPECT_EQ(ArenaU64Map_Iter_get(&res.iter), it->second);
+      EXPECT_EQ(it->second->key, e.key);
+    }
+  }
+
+  EXPECT_EQ(ArenaU64Map_size(&t), expected.size());
+  size_t count = 0;
+  for (auto it = ArenaU64Map_iter(&t); ArenaU64Map_Iter_get(&it);
+       ArenaU64Map_Iter_next(&it)) {
+    auto e = expected.find(ArenaU64Map_Iter_get(&it)->key);
+    ASSERT_NE(e, expected.end());
+    EXPECT_EQ(ArenaU64Map_Iter_get(&it), e->second);
+    ++count;
+  }
+  EXPECT_EQ(count, expected.size());
+
+  // Nodes are recycled, so the arena never needs more than the peak size.
+  EXPECT_LE(t.set_.arena_.used_, 2000);
+
+  ArenaU64Map_clear(&t);
+  EXPECT_TRUE(ArenaU64Map_empty(&t));
+  for (const auto& [k, v] : expected) {
+    EXPECT_FALSE(ArenaU64Map_contains(&t, &k));
+  }
+}
+
+CWISS_DECLARE_ARENA_HASHSET_WITH(ArenaTrackedTable, Tracked,
+                                 (FlatPolicy<Tracked, HashTracked>()));
+
+TEST(ArenaTable, DestroysElements) {
+  auto token = std::make_shared<int>(0);
+  auto t = ArenaTrackedTable_new(0);
+  absl::Cleanup c_ = [&] { ArenaTrackedTable_destroy(&t); };
+  for (int64_t i = 0; i < 100; ++i) {
+    Tracked v = {i, token};
+    ArenaTrackedTable_insert(&t, &v);
+  }
+  EXPECT_EQ(token.use_count(), 101);
+
+  Tracked k = {7, nullptr};
+  auto it = ArenaTrackedTable_find(&t, &k);
+  ASSERT_NE(ArenaTrackedTable_Iter_get(&it), nullptr);
+  ArenaTrackedTable_erase_at(it);
+  EXPECT_EQ(token.use_count(), 100);
+
+  // The freed node is the next one to be handed out.
+  Tracked v = {1000, token};
+  EXPECT_TRUE(ArenaTrackedTable_insert(&t, &v).inserted);
+  EXPECT_EQ(t.set_.arena_.used_, 100);
+  EXPECT_EQ(token.use_count(), 102);
+
+  ArenaTrackedTable_clear(&t);
+  EXPECT_EQ(token.use_count(), 2);
+  ArenaTrackedTable_insert(&t, &v);
+  ArenaTrackedTable_destroy(&t);
+  EXPECT_EQ(token.use_count(), 2);
+}
+
+struct Login {
+  uint64_t id;
+  uint32_t name;
+  uint32_t session;
+};
+
+CWISS_DECLARE_INDEX(kLoginById, Login, uint64_t, id, true);
+CWISS_DECLARE_INDEX(kLoginByName, Login, uint32_t, name, true);
+CWISS_DECLARE_INDEX(kLoginBySession, Login, uint32_t, session, false);
+CWISS_DECLARE_MULTI_INDEX(Logins, Login, &kLoginById, &kLoginByName,
+                          &kLoginBySession);
+CWISS_DECLARE_MULTI_INDEX_LOOKUP(Logins, id, uint64_t, 0);
+CWISS_DECLARE_MULTI_INDEX_LOOKUP(Logins, name, uint32_t, 1);
+CWISS_DECLARE_MULTI_INDEX_LOOKUP(Logins, session, uint32_t, 2);
+
+TEST(MultiIndex, FindByEachIndex) {
+  auto t = Logins_new(0);
+  absl::Cleanup c_ = [&] { Logins_destroy(&t); };
+  for (uint32_t i = 0; i < 100; ++i) {
+    Login l = {i, 1000 + i, i % 10};
+    auto res = Logins_insert(&t, &l);
+    EXPECT_TRUE(res.inserted);
+    EXPECT_EQ(res.record->id, i);
+  }
+  EXPECT_EQ(Logins_size(&t), 100);
+
+  uint64_t id = 42;
+  uint32_t name = 1042;
+  Login* by_id = Logins_find_by_id(&t, &id);
+  ASSERT_NE(by_id, nullptr);
+  EXPECT_EQ(Logins_find_by_name(&t, &name), by_id);
+  uint32_t session = 2;
+  EXPECT_EQ(Logins_find_by_session(&t, &session)->session, 2);
+
+  id = 100;
+  name = 1;
+  EXPECT_FALSE(Logins_contains_by_id(&t, &id));
+  EXPECT_FALSE(Logins_contains_by_name(&t, &name));
+
+  // A unique conflict on any index rejects the record and returns the one in
+  // the way.
+  Login dup = {500, 1042, 0};
+  auto res = Logins_insert(&t, &dup);
+  EXPECT_FALSE(res.inserted);
+  EXPECT_EQ(res.record, by_id);
+  id = 500;
+  EXPECT_FALSE(Logins_contains_by_id(&t, &id));
+  EXPECT_EQ(Logins_size(&t), 100);
+
+  std::vector<uint64_t> ids;
+  EXPECT_EQ(Logins_visit_by_session(
+                &t, &session,
+                [](void* ctx, Login* l) {
+                  static_cast<std::vector<uint64_t>*>(ctx)->push_back(l->id);
+                },
+                &ids),
+            10);
+  EXPECT_THAT(ids, testing::UnorderedElementsAre(2, 12, 22, 32, 42, 52, 62,
+                                                 72, 82, 92));
+  EXPECT_EQ(Logins_visit_by_session(&t, &session, nullptr, nullptr), 10);
+
+  // Erasing through one index removes the record from all of them.
+  name = 1042;
+  EXPECT_TRUE(Logins_erase_by_name(&t, &name));
+  EXPECT_FALSE(Logins_erase_by_name(&t, &name));
+  id = 42;
+  EXPECT_FALSE(Logins_contains_by_id(&t, &id));
+  EXPECT_EQ(Logins_visit_by_session(&t, &session, nullptr, nullptr), 9);
+  EXPECT_EQ(Logins_size(&t), 99);
+
+  size_t count = 0;
+  for (auto it = Logins_iter(&t); Logins_Iter_get(&it);
+       Logins_Iter_next(&it)) {
+    EXPECT_NE(Logins_Iter_get(&it)->id, 42);
+    ++count;
+  }
+  EXPECT_EQ(count, 99);
+
+  Logins_clear(&t);
+  EXPECT_TRUE(Logins_empty(&t));
+  id = 0;
+  EXPECT_FALSE(Logins_contains_by_id(&t, &id));
+}
+
+TEST(MultiIndex, StressAgainstStdMaps) {
+  auto t = Logins_new(0);
+  absl::Cleanup c_ = [&] { Logins_destroy(&t); };
+  std::unordered_map<uint64_t, Login> by_id;
+  std::unordered_map<uint32_t, uint64_t> by_name;
+  std::unordered_map<uint32_t, size_t> by_session;
+
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 100000; ++i) {
+    Login l = {rng() % 3000, static_cast<uint32_t>(rng() % 3000),
+               static_cast<uint32_t>(rng() % 50)};
+    if (rng() % 3 == 0) {
+      auto it = by_id.find(l.id);
+      EXPECT_EQ(Logins_erase_by_id(&t, &l.id), it != by_id.end());
+      if (it == by_id.end()) continue;
+      by_name.erase(it->second.name);
+      --by_session[it->second.session];
+      by_id.erase(it);
+    } else {
+      bool fits = !by_id.count(l.id) && !by_name.count(l.name);
+      auto res = Logins_insert(&t, &l);
+      ASSERT_EQ(res.inserted, fits);
+      if (!fits) {
+        EXPECT_TRUE(res.record->id == l.id || res.record->name == l.name);
+        continue;
+      }
+      by_id[l.id] = l;
+      by_name[l.name] = l.id;
+      ++by_session[l.session];
+    }
+  }
+
+  EXPECT_EQ(Logins_size(&t), by_id.size());
+  for (const auto& [name, id] : by_name) {
+    Login* l = Logins_find_by_name(&t, &name);
+    ASSERT_NE(l, nullptr);
+    EXPECT_EQ(l->id, id);
+    EXPECT_EQ(Logins_find_by_id(&t, &id), l);
+  }
+  for (const auto& [session, n] : by_session) {
+    EXPECT_EQ(Logins_visit_by_session(&t, &session, nullptr, nullptr), n);
+  }
+}
+
+struct Blob {
+  uint64_t key;
+  uint64_t payload[7];
+};
+CWISS_DECLARE_SPARSE_HASHMAP(SparseBlobMap, uint64_t, Blob);
+
+TEST(SparseTable, StressAgainstStdMap) {
+  auto t = SparseBlobMap_new(0);
+  absl::Cleanup c_ = [&] { SparseBlobMap_destroy(&t); };
+  std::unordered_map<uint64_t, uint64_t> expected;
+
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 100000; ++i) {
+    SparseBlobMap_Entry e = {rng() % 5000, {}};
+    e.val.key = e.key;
+    e.val.payload[6] = rng();
+    if (rng() % 3 == 0) {
+      EXPECT_EQ(SparseBlobMap_erase(&t, &e.key), expected.erase(e.key) == 1);
+    } else {
+      auto res = SparseBlobMap_insert(&t, &e);
+      auto [it, inserted] = expected.emplace(e.key, e.val.payload[6]);
+      EXPECT_EQ(res.inserted, inserted);
+      auto* got = SparseBlobMap_Iter_get(&res.iter);
+      ASSERT_NE(got, nullptr);
+      EXPECT_EQ(got->key, e.key);
+      EXPECT_EQ(got->val.payload[6], it->second);
+    }
+  }
+
+  EXPECT_EQ(SparseBlobMap_size(&t), expected.size());
+  for (const auto& [k, v] : expected) {
+    auto it = SparseBlobMap_find(&t, &k);
+    ASSERT_NE(SparseBlobMap_Iter_get(&it), nullptr);
+    EXPECT_EQ(SparseBlobMap_Iter_get(&it)->val.payload[6], v);
+  }
+  size_t count = 0;
+  for (auto it = SparseBlobMap_iter(&t); SparseBlobMap_Iter_get(&it);
+       SparseBlobMap_Iter_next(&it)) {
+    auto* e = SparseBlobMap_Iter_get(&it);
+    EXPECT_EQ(e->key, e->val.key);
+    EXPECT_TRUE(expected.count(e->key));
+    ++count;
+  }
+  EXPECT_EQ(count, expected.size());
+
+  // Only occupied slots have storage.
+  size_t slots = 0;
+  for (size_t b = 0; b < CWISS_SparseTable_NumBuckets(t.set_.capacity_); ++b) {
+    slots += CWISS_PopCount64(t.set_.buckets_[b].present_);
+  }
+  EXPECT_EQ(slots, expected.size());
+
+  SparseBlobMap_clear(&t);
+  EXPECT_TRUE(SparseBlobMap_empty(&t));
+  for (const auto& [k, v] : expected) {
+    EXPECT_FALSE(SparseBlobMap_contains(&t, &k));
+  }
+}
+
+CWISS_DECLARE_SPARSE_HASHSET_WITH(SparseTrackedTable, Tracked,
+                                  (FlatPolicy<Tracked, HashTracked>()));
+
+TEST(SparseTable, DestroysElements) {
+  auto token = std::make_shared<int>(0);
+  auto t = SparseTrackedTable_new(0);
+  absl::Cleanup c_ = [&] { SparseTrackedTable_destroy(&t); };
+  for (int64_t i = 0; i < 1000; ++i) {
+    Tracked v = {i, token};
+    SparseTrackedTable_insert(&t, &v);
+  }
+  // Elements are moved, not copied, as buckets are reshaped and rehashed.
+  EXPECT_EQ(token.use_count(), 1001);
+
+  for (int64_t i = 0; i < 1000; i += 2) {
+    Tracked k = {i, nullptr};
+    EXPECT_TRUE(SparseTrackedTable_erase(&t, &k));
+  }
+  EXPECT_EQ(token.use_count(), 501);
+  for (int64_t i = 1; i < 1000; i += 2) {
+    Tracked k = {i, nullptr};
+    auto it = SparseTrackedTable_find(&t, &k);
+    ASSERT_NE(SparseTrackedTable_Iter_get(&it), nullptr);
+    EXPECT_EQ(SparseTrackedTable_Iter_get(&it)->value, i);
+  }
+
+  SparseTrackedTable_destroy(&t);
+  EXPECT_EQ(token.use_count(), 1);
+}
+
 }  // namespace
 }  // namespace cwisstable
@@ -15,16 +15,25 @@
 #ifndef CWISSTABLE_DECLARE_H_
 #define CWISSTABLE_DECLARE_H_
 
+#include <stdalign.h>
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "cwisstable/internal/arena_table.h"
 #include "cwisstable/internal/base.h"
+#include "cwisstable/internal/distinct_counter.h"
+#include "cwisstable/internal/frozen_table.h"
+#include "cwisstable/internal/int_table.h"
+#include "cwisstable/internal/mapped_table.h"
+#include "cwisstable/internal/multi_index.h"
 #include "cwisstable/internal/raw_table.h"
+#include "cwisstable/internal/sharded_table.h"
+#include "cwisstable/internal/sparse_table.h"
 #include "cwisstable/policy.h"
 
 /// SwissTable code generation macros.
 ///
-/// This file is the entry-point for users of `cwisstable`. It exports six
+/// This file is the entry-point for users of `cwisstable`. It exports twelve
 /// macros for generating different kinds of tables. Four correspond to Abseil's
 /// four SwissTable containers:
 ///
@@ -45,6 +54,65 @@
 /// `kPolicy` must be a constant global variable referring to an appropriate
 /// property for the element types of the container.
 ///
+/// Node tables can instead allocate their elements from a table-owned arena and
+/// store 32-bit indices rather than pointers in their slots:
+///
+/// - `CWISS_DECLARE_ARENA_HASHSET(Set, Type)`
+/// - `CWISS_DECLARE_ARENA_HASHMAP(Map, Key, Value)`
+///
+/// Tables of large elements that need to save memory more than time can
+/// allocate slots only for the elements they hold:
+///
+/// - `CWISS_DECLARE_SPARSE_HASHSET(Set, Type)`
+/// - `CWISS_DECLARE_SPARSE_HASHMAP(Map, Key, Value)`
+///
+/// Tables keyed by 32- or 64-bit integers can instead use a specialized layout
+/// that compares keys directly with SIMD:
+///
+/// - `CWISS_DECLARE_INT_HASHSET(Set, Key)`
+/// - `CWISS_DECLARE_INT_HASHMAP(Map, Key, Value)`
+///
+/// Sets that only need approximate membership of byte strings can store
+/// fingerprints instead, at a documented false-positive rate:
+///
+/// - `CWISS_DECLARE_FINGERPRINT_SET(Set, Fingerprint)`
+///
+/// Distinct values can be counted exactly while they are few, and estimated
+/// with a fixed amount of memory past a threshold:
+///
+/// - `CWISS_DECLARE_DISTINCT_COUNTER(Counter, Type)`
+///
+/// Any table declared with the first six macros can be wrapped in a concurrent
+/// table made of independently locked shards, with batched operations:
+///
+/// - `CWISS_DECLARE_SHARDED(Sharded, Table)`
+///
+/// A key set that is built once and then only looked up can instead be sealed,
+/// giving lock-free lookups and an atomic counter per key:
+///
+/// - `CWISS_DECLARE_FROZEN_COUNTERS(Counters, Table)`
+///
+/// Records that need to be found by several keys can be stored once, with a
+/// hash index per key:
+///
+/// - `CWISS_DECLARE_INDEX(kIndex, Record, Key, field, unique)`
+/// - `CWISS_DECLARE_MULTI_INDEX(Table, Record, &kIndex...)`
+/// - `CWISS_DECLARE_MULTI_INDEX_LOOKUP(Table, Name, Key, index)`
+///
+/// On POSIX systems, maps of plain-old-data can instead live in a file, so that
+/// they persist across restarts:
+///
+/// - `CWISS_DECLARE_MAPPED_HASHMAP(Map, Key, Value)`
+///
+/// Each of the first six macros has an `_EXTERN` variant, such as
+/// `CWISS_DECLARE_FLAT_HASHSET_EXTERN(Set, Type)`, that only declares the
+/// functions that allocate or free memory (growth on insertion, `dup`,
+/// `reserve`, `rehash`, `clear`, and `destroy`). Exactly one translation unit
+/// must then provide them with `CWISS_DEFINE_HASHSET(Set)` or
+/// `CWISS_DEFINE_HASHMAP(Map)`. Lookups stay inline, but the rehashing code is
+/// emitted once per program rather than once per caller, which matters when a
+/// table type is used from many files.
+///
 /// The generated API is safe: the functions are well-typed and automatically
 /// pass the correct policy pointer. Because the pointer is a constant
 /// expression, it promotes devirtualization when inlining.
@@ -89,6 +157,236 @@ CWISS_BEGIN_EXTERN
   CWISS_DECLARE_NODE_MAP_POLICY(HashMap_##_kPolicy, K_, V_, (_, _)); \
   CWISS_DECLARE_HASHMAP_WITH(HashMap_, K_, V_, HashMap_##_kPolicy)
 
+/// Generates a new hash set type with outline storage in a table-owned arena,
+/// and the default plain-old-data policies.
+///
+/// Like a node table, elements are never moved by a rehash, but each slot is a
+/// 32-bit index into an arena of densely packed nodes rather than a pointer to
+/// its own allocation, which halves the backing array; see
+/// `internal/arena_table.h`. The generated API is a subset of the usual one
+/// described in `set_api.h`: `new`, `destroy`, `clear`, `reserve`, `size`,
+/// `empty`, `capacity`, `iter`, `Iter_get`, `Iter_next`, `insert`, `find`,
+/// `find_hinted`, `contains`, `erase_at`, and `erase`.
+#define CWISS_DECLARE_ARENA_HASHSET(HashSet_, Type_)                \
+  CWISS_DECLARE_FLAT_SET_POLICY(HashSet_##_kPolicy, Type_, (_, _)); \
+  CWISS_DECLARE_ARENA_HASHSET_WITH(HashSet_, Type_, HashSet_##_kPolicy)
+
+/// Generates a new hash map type with outline storage in a table-owned arena,
+/// and the default plain-old-data policies.
+///
+/// See `CWISS_DECLARE_ARENA_HASHSET`.
+#define CWISS_DECLARE_ARENA_HASHMAP(HashMap_, K_, V_)                \
+  CWISS_DECLARE_FLAT_MAP_POLICY(HashMap_##_kPolicy, K_, V_, (_, _)); \
+  CWISS_DECLARE_ARENA_HASHMAP_WITH(HashMap_, K_, V_, HashMap_##_kPolicy)
+
+/// Generates a new arena hash set type using the given policy, whose slot
+/// policy is ignored.
+///
+/// See `CWISS_DECLARE_ARENA_HASHSET`.
+#define CWISS_DECLARE_ARENA_HASHSET_WITH(HashSet_, Type_, kPolicy_)       \
+  typedef Type_ HashSet_##_Entry;                                         \
+  typedef Type_ HashSet_##_Key;                                           \
+  CWISS_DECLARE_ARENA_COMMON_(HashSet_, HashSet_##_Entry, HashSet_##_Key, \
+                              kPolicy_)
+
+/// Generates a new arena hash map type using the given policy, whose slot
+/// policy is ignored.
+///
+/// See `CWISS_DECLARE_ARENA_HASHSET`.
+#define CWISS_DECLARE_ARENA_HASHMAP_WITH(HashMap_, K_, V_, kPolicy_)      \
+  typedef struct {                                                        \
+    K_ key;                                                               \
+    V_ val;                                                               \
+  } HashMap_##_Entry;                                                     \
+  typedef K_ HashMap_##_Key;                                              \
+  CWISS_DECLARE_ARENA_COMMON_(HashMap_, HashMap_##_Entry, HashMap_##_Key, \
+                              kPolicy_)
+
+/// Generates a new hash set type that only allocates slots for the elements it
+/// holds, with the default plain-old-data policies.
+///
+/// Slots are packed into separately allocated arrays of up to 64, located with
+/// a presence bitmap, so an empty slot costs about ten bits instead of a whole
+/// slot, at the price of slower insertion and erasure; see
+/// `internal/sparse_table.h`. Any insertion or erasure invalidates pointers to
+/// elements. The generated API is the same subset as for
+/// `CWISS_DECLARE_ARENA_HASHSET`.
+#define CWISS_DECLARE_SPARSE_HASHSET(HashSet_, Type_)               \
+  CWISS_DECLARE_FLAT_SET_POLICY(HashSet_##_kPolicy, Type_, (_, _)); \
+  CWISS_DECLARE_SPARSE_HASHSET_WITH(HashSet_, Type_, HashSet_##_kPolicy)
+
+/// Generates a new sparse hash map type with the default plain-old-data
+/// policies.
+///
+/// See `CWISS_DECLARE_SPARSE_HASHSET`.
+#define CWISS_DECLARE_SPARSE_HASHMAP(HashMap_, K_, V_)               \
+  CWISS_DECLARE_FLAT_MAP_POLICY(HashMap_##_kPolicy, K_, V_, (_, _)); \
+  CWISS_DECLARE_SPARSE_HASHMAP_WITH(HashMap_, K_, V_, HashMap_##_kPolicy)
+
+/// Generates a new sparse hash set type using the given policy.
+///
+/// See `CWISS_DECLARE_SPARSE_HASHSET`.
+#define CWISS_DECLARE_SPARSE_HASHSET_WITH(HashSet_, Type_, kPolicy_)       \
+  typedef Type_ HashSet_##_Entry;                                          \
+  typedef Type_ HashSet_##_Key;                                            \
+  CWISS_DECLARE_SPARSE_COMMON_(HashSet_, HashSet_##_Entry, HashSet_##_Key, \
+                               kPolicy_)
+
+/// Generates a new sparse hash map type using the given policy.
+///
+/// See `CWISS_DECLARE_SPARSE_HASHSET`.
+#define CWISS_DECLARE_SPARSE_HASHMAP_WITH(HashMap_, K_, V_, kPolicy_)      \
+  typedef struct {                                                         \
+    K_ key;                                                                \
+    V_ val;                                                                \
+  } HashMap_##_Entry;                                                      \
+  typedef K_ HashMap_##_Key;                                               \
+  CWISS_DECLARE_SPARSE_COMMON_(HashMap_, HashMap_##_Entry, HashMap_##_Key, \
+                               kPolicy_)
+
+/// Generates a new hash set type for 32- or 64-bit integer keys.
+///
+/// Unlike the other tables, this one stores its keys contiguously within each
+/// group and compares them directly with SIMD, rather than matching hash tags
+/// and calling an equality policy; see `internal/int_table.h`. The generated
+/// API is the subset of the usual one described in `set_api.h` that does not
+/// involve policies, heterogenous lookup, or checkpointing.
+#define CWISS_DECLARE_INT_HASHSET(HashSet_, K_)               \
+  static const CWISS_IntPolicy HashSet_##_kPolicy = {         \
+      sizeof(K_), 0, 1, &CWISS_IntTable_kAlloc};              \
+  CWISS_DECLARE_INT_COMMON_(HashSet_, K_, HashSet_##_kPolicy) \
+  CWISS_BEGIN                                                 \
+  static inline HashSet_##_Insert HashSet_##_insert(          \
+      HashSet_* self, const HashSet_##_Key* key) {            \
+    CWISS_IntInsert ret = CWISS_IntTable_insert(              \
+        &HashSet_##_kPolicy, &self->set_,                     \
+        CWISS_IntPolicy_LoadKey(&HashSet_##_kPolicy, key));   \
+    return (HashSet_##_Insert){{ret.iter}, ret.inserted};     \
+  }                                                           \
+  CWISS_END                                                   \
+  /* Force a semicolon. */ struct HashSet_##_NeedsTrailingSemicolon_ { int x; }
+
+/// Generates a new hash map type for 32- or 64-bit integer keys.
+///
+/// Like `CWISS_DECLARE_INT_HASHSET`, but with a plain-old-data value attached
+/// to each key. Because keys and values are stored apart, the iterators have
+/// `_Iter_key()` and `_Iter_val()` accessors instead of `_Iter_get()`.
+#define CWISS_DECLARE_INT_HASHMAP(HashMap_, K_, V_)                        \
+  static const CWISS_IntPolicy HashMap_##_kPolicy = {                      \
+      sizeof(K_), sizeof(V_), alignof(V_), &CWISS_IntTable_kAlloc};        \
+  CWISS_DECLARE_INT_COMMON_(HashMap_, K_, HashMap_##_kPolicy)              \
+  CWISS_BEGIN                                                              \
+  typedef V_ HashMap_##_Value;                                             \
+  static inline HashMap_##_Value* HashMap_##_Iter_val(                     \
+      const HashMap_##_Iter* it) {                                         \
+    return (HashMap_##_Value*)CWISS_IntIter_val(&HashMap_##_kPolicy,       \
+                                                &it->it_);                 \
+  }                                                                        \
+  static inline const HashMap_##_Value* HashMap_##_CIter_val(              \
+      const HashMap_##_CIter* it) {                                        \
+    return (const HashMap_##_Value*)CWISS_IntIter_val(&HashMap_##_kPolicy, \
+                                                      &it->it_);           \
+  }                                                                        \
+  static inline HashMap_##_Insert HashMap_##_insert(                       \
+      HashMap_* self, const HashMap_##_Key* key,                           \
+      const HashMap_##_Value* val) {                                       \
+    CWISS_IntInsert ret = CWISS_IntTable_insert(                           \
+        &HashMap_##_kPolicy, &self->set_,                                  \
+        CWISS_IntPolicy_LoadKey(&HashMap_##_kPolicy, key));                \
+    if (ret.inserted) {                                                    \
+      memcpy(CWISS_IntIter_val(&HashMap_##_kPolicy, &ret.iter), val,       \
+             sizeof(V_));                                                  \
+    }                                                                      \
+    return (HashMap_##_Insert){{ret.iter}, ret.inserted};                  \
+  }                                                                        \
+  CWISS_END                                                                \
+  /* Force a semicolon. */ struct HashMap_##_NeedsTrailingSemicolon_ { int x; }
+
+/// Generates a new set type that stores fingerprints of byte strings instead of
+/// the strings themselves.
+///
+/// `Fingerprint_` is `uint32_t` or `uint64_t`; each entry then costs about
+/// that many bytes, whatever the size of the string. The set is an integer set
+/// (see `CWISS_DECLARE_INT_HASHSET`) of fingerprints computed by
+/// `CWISS_Fingerprint64()`, so growing it never touches the original strings.
+///
+/// In exchange, membership is probabilistic: a string that was never inserted
+/// is reported as present if its fingerprint collides with one of the `n`
+/// stored ones, which happens with probability about `n / 2^b` for `b`-bit
+/// fingerprints; see `_false_positive_rate()`. For example, ten billion
+/// 64-bit fingerprints give a rate of about 5e-10, while a million 32-bit ones
+/// give about 2e-4. Insertion is subject to the same error: a string whose
+/// fingerprint collides is reported as already present.
+///
+/// In addition to the integer set API (where the "keys" are fingerprints),
+/// this generates:
+/// - `Fingerprint_ Set_fingerprint(const void* data, size_t len)`
+/// - `bool Set_insert_bytes(Set* self, const void* data, size_t len)`, which
+///   returns whether the fingerprint was newly inserted.
+/// - `bool Set_contains_bytes(const Set* self, const void* data, size_t len)`
+/// - `double Set_false_positive_rate(const Set* self)`
+#define CWISS_DECLARE_FINGERPRINT_SET(HashSet_, Fingerprint_)                  \
+  CWISS_DECLARE_INT_HASHSET(HashSet_, Fingerprint_);                           \
+  CWISS_BEGIN                                                                  \
+  static inline Fingerprint_ HashSet_##_fingerprint(const void* data,          \
+                                                    size_t len) {              \
+    uint64_t fp = CWISS_Fingerprint64(data, len);                              \
+    return (Fingerprint_)(sizeof(Fingerprint_) == 4 ? fp ^ (fp >> 32) : fp);   \
+  }                                                                            \
+  static inline bool HashSet_##_insert_bytes(HashSet_* self, const void* data, \
+                                             size_t len) {                     \
+    Fingerprint_ fp = HashSet_##_fingerprint(data, len);                       \
+    return HashSet_##_insert(self, &fp).inserted;                              \
+  }                                                                            \
+  static inline bool HashSet_##_contains_bytes(const HashSet_* self,           \
+                                               const void* data, size_t len) { \
+    Fingerprint_ fp = HashSet_##_fingerprint(data, len);                       \
+    return HashSet_##_contains(self, &fp);                                     \
+  }                                                                            \
+  static inline double HashSet_##_false_positive_rate(const HashSet_* self) {  \
+    double space = sizeof(Fingerprint_) == 4 ? 4294967296.0                    \
+                                             : 18446744073709551616.0;         \
+    return (double)HashSet_##_size(self) / space;                              \
+  }                                                                            \
+  CWISS_END                                                                    \
+  /* Force a semicolon. */ struct HashSet_##_NeedsTrailingSemicolon2_ { int x; }
+
+/// Generates a new distinct-value counter type for plain-old-data values.
+///
+/// The count is exact until the counter would need more than the `max_bytes`
+/// passed to `new()`, after which it is a HyperLogLog estimate built from the
+/// hashes seen so far; see `internal/distinct_counter.h`. Values are hashed
+/// with `CWISS_Fingerprint64()`, so `add(&v)` is the same as
+/// `add_bytes(&v, sizeof(v))`.
+#define CWISS_DECLARE_DISTINCT_COUNTER(Counter_, Type_)                     \
+  CWISS_BEGIN                                                               \
+  typedef struct {                                                          \
+    CWISS_DistinctCounter counter_;                                         \
+  } Counter_;                                                               \
+  static inline Counter_ Counter_##_new(size_t max_bytes) {                 \
+    return (Counter_){CWISS_DistinctCounter_new(max_bytes)};                \
+  }                                                                         \
+  static inline void Counter_##_destroy(Counter_* self) {                   \
+    CWISS_DistinctCounter_destroy(&self->counter_);                         \
+  }                                                                         \
+  static inline void Counter_##_add(Counter_* self, const Type_* val) {     \
+    CWISS_DistinctCounter_add(&self->counter_,                              \
+                              CWISS_Fingerprint64(val, sizeof(Type_)));     \
+  }                                                                         \
+  static inline void Counter_##_add_bytes(Counter_* self, const void* data, \
+                                          size_t len) {                     \
+    uint64_t hash = CWISS_Fingerprint64(data, len);                         \
+    CWISS_DistinctCounter_add(&self->counter_, hash);                       \
+  }                                                                         \
+  static inline double Counter_##_count(const Counter_* self) {             \
+    return CWISS_DistinctCounter_count(&self->counter_);                    \
+  }                                                                         \
+  static inline bool Counter_##_is_exact(const Counter_* self) {            \
+    return CWISS_DistinctCounter_is_exact(&self->counter_);                 \
+  }                                                                         \
+  CWISS_END                                                                 \
+  /* Force a semicolon. */ struct Counter_##_NeedsTrailingSemicolon_ { int x; }
+
 /// Generates a new hash set type using the given policy.
 ///
 /// See header documentation for examples of generated API.
@@ -108,6 +406,98 @@ CWISS_BEGIN_EXTERN
   typedef K_ HashMap_##_Key;                                   \
   CWISS_DECLARE_COMMON_(HashMap_, HashMap_##_Entry, HashMap_##_Key, kPolicy_)
 
+/// Declares, but does not define, a hash set type with inline storage and the
+/// default plain-old-data policies.
+///
+/// This is like `CWISS_DECLARE_FLAT_HASHSET`, but the functions that can grow,
+/// shrink, copy, or free the table are only declared, with external linkage;
+/// they must be defined in exactly one translation unit with
+/// `CWISS_DEFINE_HASHSET`. See header documentation.
+#define CWISS_DECLARE_FLAT_HASHSET_EXTERN(HashSet_, Type_)          \
+  CWISS_DECLARE_FLAT_SET_POLICY(HashSet_##_kPolicy, Type_, (_, _)); \
+  CWISS_DECLARE_HASHSET_WITH_EXTERN(HashSet_, Type_, HashSet_##_kPolicy)
+
+/// Like `CWISS_DECLARE_NODE_HASHSET`, but see
+/// `CWISS_DECLARE_FLAT_HASHSET_EXTERN`.
+#define CWISS_DECLARE_NODE_HASHSET_EXTERN(HashSet_, Type_)          \
+  CWISS_DECLARE_NODE_SET_POLICY(HashSet_##_kPolicy, Type_, (_, _)); \
+  CWISS_DECLARE_HASHSET_WITH_EXTERN(HashSet_, Type_, HashSet_##_kPolicy)
+
+/// Like `CWISS_DECLARE_FLAT_HASHMAP`, but see
+/// `CWISS_DECLARE_FLAT_HASHSET_EXTERN`.
+#define CWISS_DECLARE_FLAT_HASHMAP_EXTERN(HashMap_, K_, V_)          \
+  CWISS_DECLARE_FLAT_MAP_POLICY(HashMap_##_kPolicy, K_, V_, (_, _)); \
+  CWISS_DECLARE_HASHMAP_WITH_EXTERN(HashMap_, K_, V_, HashMap_##_kPolicy)
+
+/// Like `CWISS_DECLARE_NODE_HASHMAP`, but see
+/// `CWISS_DECLARE_FLAT_HASHSET_EXTERN`.
+#define CWISS_DECLARE_NODE_HASHMAP_EXTERN(HashMap_, K_, V_)          \
+  CWISS_DECLARE_NODE_MAP_POLICY(HashMap_##_kPolicy, K_, V_, (_, _)); \
+  CWISS_DECLARE_HASHMAP_WITH_EXTERN(HashMap_, K_, V_, HashMap_##_kPolicy)
+
+/// Like `CWISS_DECLARE_HASHSET_WITH`, but see
+/// `CWISS_DECLARE_FLAT_HASHSET_EXTERN`.
+#define CWISS_DECLARE_HASHSET_WITH_EXTERN(HashSet_, Type_, kPolicy_)       \
+  typedef Type_ HashSet_##_Entry;                                          \
+  typedef Type_ HashSet_##_Key;                                            \
+  CWISS_DECLARE_COMMON_EXTERN_(HashSet_, HashSet_##_Entry, HashSet_##_Key, \
+                               kPolicy_)
+
+/// Like `CWISS_DECLARE_HASHMAP_WITH`, but see
+/// `CWISS_DECLARE_FLAT_HASHSET_EXTERN`.
+#define CWISS_DECLARE_HASHMAP_WITH_EXTERN(HashMap_, K_, V_, kPolicy_)      \
+  typedef struct {                                                         \
+    K_ key;                                                                \
+    V_ val;                                                                \
+  } HashMap_##_Entry;                                                      \
+  typedef K_ HashMap_##_Key;                                               \
+  CWISS_DECLARE_COMMON_EXTERN_(HashMap_, HashMap_##_Entry, HashMap_##_Key, \
+                               kPolicy_)
+
+/// Defines the functions of a hash set type declared with one of the
+/// `CWISS_DECLARE_*_EXTERN` macros.
+///
+/// This must be used in exactly one translation unit, after the declaration.
+#define CWISS_DEFINE_HASHSET(HashSet_)                                       \
+  CWISS_BEGIN                                                                \
+  CWISS_BEGIN_EXTERN                                                         \
+  CWISS_AbslHash_REQUIRE_SHARED_SEED_                                        \
+  HashSet_ HashSet_##_dup(const HashSet_* that) {                            \
+    return (HashSet_){CWISS_RawTable_dup(HashSet_##_policy(), &that->set_)}; \
+  }                                                                          \
+  void HashSet_##_destroy(HashSet_* self) {                                  \
+    CWISS_RawTable_destroy(HashSet_##_policy(), &self->set_);                \
+  }                                                                          \
+  void HashSet_##_reserve(HashSet_* self, size_t n) {                        \
+    CWISS_RawTable_reserve(HashSet_##_policy(), &self->set_, n);             \
+  }                                                                          \
+  void HashSet_##_rehash(HashSet_* self, size_t n) {                         \
+    CWISS_RawTable_rehash(HashSet_##_policy(), &self->set_, n);              \
+  }                                                                          \
+  void HashSet_##_clear(HashSet_* self) {                                    \
+    CWISS_RawTable_clear(HashSet_##_policy(), &self->set_);                  \
+  }                                                                          \
+  void HashSet_##_begin_apply(HashSet_* self, size_t capacity) {             \
+    CWISS_RawTable_BeginApply(HashSet_##_policy(), &self->set_, capacity);   \
+  }                                                                          \
+  HashSet_##_Insert HashSet_##_InsertNew_(HashSet_* self, size_t hash) {     \
+    const CWISS_Policy* policy = HashSet_##_policy();                        \
+    size_t i = CWISS_RawTable_PrepareInsert(policy, &self->set_, hash);      \
+    if (CWISS_UNLIKELY(i == self->set_.capacity_)) {                         \
+      return (HashSet_##_Insert){{(CWISS_RawIter){0}}, false, true};         \
+    }                                                                        \
+    CWISS_RawTable_PreInsert(policy, &self->set_, i);                        \
+    return (HashSet_##_Insert){                                              \
+        {CWISS_RawTable_citer_at(policy, &self->set_, i)}, true, false};     \
+  }                                                                          \
+  CWISS_END_EXTERN                                                           \
+  CWISS_END                                                                  \
+  /* Force a semicolon. */ struct HashSet_##_NeedsTrailingSemicolon2_ { int x; }
+
+/// Defines the functions of a hash map type declared with one of the
+/// `CWISS_DECLARE_*_EXTERN` macros; see `CWISS_DEFINE_HASHSET`.
+#define CWISS_DEFINE_HASHMAP(HashMap_) CWISS_DEFINE_HASHSET(HashMap_)
+
 /// Declares a heterogenous lookup for an existing SwissTable type.
 ///
 /// This macro will expect to find the following functions:
@@ -149,7 +539,8 @@ CWISS_BEGIN_EXTERN
     CWISS_Insert ret = CWISS_RawTable_deferred_insert(                         \
         HashSet_##_policy(), &HashSet_##_##LookupName_##_kPolicy, &self->set_, \
         key);                                                                  \
-    return (HashSet_##_Insert){{ret.iter}, ret.inserted};                      \
+    CWISS_RawIter_MarkDirty(&ret.iter);                                        \
+    return (HashSet_##_Insert){{ret.iter}, ret.inserted, ret.needs_growth};    \
   }                                                                            \
   static inline HashSet_##_CIter HashSet_##_cfind_hinted_by_##LookupName_(     \
       const HashSet_* self, const Key_* key, size_t hash) {                    \
@@ -159,9 +550,11 @@ CWISS_BEGIN_EXTERN
   }                                                                            \
   static inline HashSet_##_Iter HashSet_##_find_hinted_by_##LookupName_(       \
       HashSet_* self, const Key_* key, size_t hash) {                          \
-    return (HashSet_##_Iter){CWISS_RawTable_find_hinted(                       \
+    CWISS_RawIter it = CWISS_RawTable_find_hinted(                             \
         HashSet_##_policy(), &HashSet_##_##LookupName_##_kPolicy, &self->set_, \
-        key, hash)};                                                           \
+        key, hash);                                                            \
+    CWISS_RawIter_MarkDirty(&it);                                              \
+    return (HashSet_##_Iter){it};                                              \
   }                                                                            \
                                                                                \
   static inline HashSet_##_CIter HashSet_##_cfind_by_##LookupName_(            \
@@ -172,9 +565,11 @@ CWISS_BEGIN_EXTERN
   }                                                                            \
   static inline HashSet_##_Iter HashSet_##_find_by_##LookupName_(              \
       HashSet_* self, const Key_* key) {                                       \
-    return (HashSet_##_Iter){CWISS_RawTable_find(                              \
+    CWISS_RawIter it = CWISS_RawTable_find(                                    \
         HashSet_##_policy(), &HashSet_##_##LookupName_##_kPolicy, &self->set_, \
-        key)};                                                                 \
+        key);                                                                  \
+    CWISS_RawIter_MarkDirty(&it);                                              \
+    return (HashSet_##_Iter){it};                                              \
   }                                                                            \
                                                                                \
   static inline bool HashSet_##_contains_by_##LookupName_(                     \
@@ -197,9 +592,457 @@ CWISS_BEGIN_EXTERN
     int x;                                                                     \
   }
 
+/// Generates a concurrent, sharded version of an existing table type.
+///
+/// `HashSet_` must have been declared by one of the `CWISS_DECLARE_*_HASHSET`
+/// or `CWISS_DECLARE_*_HASHMAP` macros (other than the integer ones). The
+/// resulting type splits its elements across a power-of-two number of
+/// `HashSet_`-like shards, each guarded by its own lock, and is safe to use
+/// from multiple threads, except for `_new()` and `_destroy()`.
+///
+/// Because elements may be erased by other threads at any time, lookups do not
+/// return iterators; instead they call a visitor while the element's shard is
+/// still locked. Visitors must not call back into the table.
+///
+/// The generated API is:
+/// - `Sharded Sharded_new(size_t shard_count, size_t capacity)`
+/// - `void Sharded_destroy(Sharded* self)`
+/// - `size_t Sharded_size(const Sharded* self)`
+/// - `bool Sharded_insert(Sharded* self, const Entry* val)`
+/// - `bool Sharded_contains(Sharded* self, const Key* key)`
+/// - `bool Sharded_find(Sharded* self, const Key* key, Sharded_Visitor visit,
+///   void* ctx)`
+/// - `bool Sharded_erase(Sharded* self, const Key* key)`
+///
+/// Each of these locks a shard once per call. For batches of keys, the
+/// following lock each shard at most once per batch, and prefetch ahead within
+/// it; see `sharded_table.h` for details:
+/// - `size_t Sharded_insert_batch(Sharded* self, const Entry* vals, size_t n,
+///   bool* inserted)`
+/// - `size_t Sharded_find_batch(Sharded* self, const Key* keys, size_t n,
+///   bool* found, Sharded_Visitor visit, void* ctx)`
+/// - `size_t Sharded_erase_batch(Sharded* self, const Key* keys, size_t n)`
+///
+/// `Sharded_Visitor` is `void (*)(void* ctx, size_t i, Entry* elem)`, where `i`
+/// is the index of the key in the batch (zero for `_find()`) and `elem` is null
+/// if it is absent. The output arrays and visitors are optional.
+#define CWISS_DECLARE_SHARDED(Sharded_, HashSet_)                              \
+  CWISS_BEGIN                                                                  \
+  typedef struct {                                                             \
+    CWISS_ShardedTable set_;                                                   \
+  } Sharded_;                                                                  \
+  typedef void (*Sharded_##_Visitor)(void* ctx, size_t i,                      \
+                                     HashSet_##_Entry* elem);                  \
+  typedef struct {                                                             \
+    Sharded_##_Visitor visit;                                                  \
+    void* ctx;                                                                 \
+  } Sharded_##_VisitCtx_;                                                      \
+  static inline void Sharded_##_Visit_(void* ctx, size_t i, void* elem) {      \
+    Sharded_##_VisitCtx_* c = (Sharded_##_VisitCtx_*)ctx;                      \
+    c->visit(c->ctx, i, (HashSet_##_Entry*)elem);                              \
+  }                                                                            \
+                                                                               \
+  static inline Sharded_ Sharded_##_new(size_t shard_count, size_t capacity) { \
+    return (Sharded_){                                                         \
+        CWISS_ShardedTable_new(HashSet_##_policy(), shard_count, capacity)};   \
+  }                                                                            \
+  static inline void Sharded_##_destroy(Sharded_* self) {                      \
+    CWISS_ShardedTable_destroy(HashSet_##_policy(), &self->set_);              \
+  }                                                                            \
+  static inline size_t Sharded_##_size(const Sharded_* self) {                 \
+    return CWISS_ShardedTable_size(HashSet_##_policy(), &self->set_);          \
+  }                                                                            \
+                                                                               \
+  static inline bool Sharded_##_insert(Sharded_* self,                         \
+                                       const HashSet_##_Entry* val) {          \
+    return CWISS_ShardedTable_insert(HashSet_##_policy(), &self->set_, val);   \
+  }                                                                            \
+  static inline bool Sharded_##_find(                                          \
+      Sharded_* self, const HashSet_##_Key* key, Sharded_##_Visitor visit,     \
+      void* ctx) {                                                             \
+    Sharded_##_VisitCtx_ c = {visit, ctx};                                     \
+    return CWISS_ShardedTable_find(HashSet_##_policy(), &self->set_, key,      \
+                                   visit ? Sharded_##_Visit_ : NULL, &c);      \
+  }                                                                            \
+  static inline bool Sharded_##_contains(Sharded_* self,                       \
+                                         const HashSet_##_Key* key) {          \
+    return Sharded_##_find(self, key, NULL, NULL);                             \
+  }                                                                            \
+  static inline bool Sharded_##_erase(Sharded_* self,                          \
+                                      const HashSet_##_Key* key) {             \
+    return CWISS_ShardedTable_erase(HashSet_##_policy(), &self->set_, key);    \
+  }                                                                            \
+                                                                               \
+  static inline size_t Sharded_##_insert_batch(                                \
+      Sharded_* self, const HashSet_##_Entry* vals, size_t n,                  \
+      bool* inserted) {                                                        \
+    return CWISS_ShardedTable_insert_batch(HashSet_##_policy(), &self->set_,   \
+                                           vals, n, inserted);                 \
+  }                                                                            \
+  static inline size_t Sharded_##_find_batch(                                  \
+      Sharded_* self, const HashSet_##_Key* keys, size_t n, bool* found,       \
+      Sharded_##_Visitor visit, void* ctx) {                                   \
+    Sharded_##_VisitCtx_ c = {visit, ctx};                                     \
+    return CWISS_ShardedTable_find_batch(                                      \
+        HashSet_##_policy(), &self->set_, keys, sizeof(HashSet_##_Key), n,     \
+        found, visit ? Sharded_##_Visit_ : NULL, &c);                          \
+  }                                                                            \
+  static inline size_t Sharded_##_erase_batch(                                 \
+      Sharded_* self, const HashSet_##_Key* keys, size_t n) {                  \
+    return CWISS_ShardedTable_erase_batch(HashSet_##_policy(), &self->set_,    \
+                                          keys, sizeof(HashSet_##_Key), n);    \
+  }                                                                            \
+  CWISS_END                                                                    \
+  /* Force a semicolon. */ struct Sharded_##_NeedsTrailingSemicolon_ { int x; }
+
+/// Generates a table of atomic counters keyed by the elements of an existing
+/// table type, which is sealed on construction; see `frozen_table.h`.
+///
+/// `HashSet_` must have been declared by `CWISS_DECLARE_FLAT_HASHSET`,
+/// `CWISS_DECLARE_NODE_HASHSET`, or their map equivalents (including the
+/// `_WITH` and `_EXTERN` variants). Once sealed, keys cannot be added or
+/// removed, and every function other than `_new()` and `_destroy()` is safe to
+/// call from any number of threads without locking.
+///
+/// The generated API is:
+/// - `Counters Counters_new(Table* keys, bool padded)`, which takes the
+///   elements of `keys`, leaving it empty
+/// - `void Counters_destroy(Counters* self)`
+/// - `size_t Counters_size(const Counters* self)`
+/// - `CWISS_Counter* Counters_find(const Counters* self, const Key* key)`,
+///   which returns null if `key` is absent
+/// - `bool Counters_add(const Counters* self, const Key* key, int64_t delta)`,
+///   which returns whether `key` is present
+/// - `Table_CIter Counters_citer(const Counters* self)` and
+///   `CWISS_Counter* Counters_counter_at(const Counters* self,
+///   const Table_CIter* it)`, to visit every key and its counter
+///
+/// A `CWISS_Counter*` stays valid until `_destroy()`, so hot paths can look it
+/// up once and then use `CWISS_Counter_add()`, `CWISS_Counter_load()`,
+/// `CWISS_Counter_store()` and `CWISS_Counter_compare_exchange()` on it.
+#define CWISS_DECLARE_FROZEN_COUNTERS(Counters_, HashSet_)                     \
+  CWISS_BEGIN                                                                  \
+  typedef struct {                                                             \
+    CWISS_FrozenTable set_;                                                    \
+  } Counters_;                                                                 \
+                                                                               \
+  static inline Counters_ Counters_##_new(HashSet_* keys, bool padded) {       \
+    return (Counters_){                                                        \
+        CWISS_FrozenTable_new(HashSet_##_policy(), &keys->set_, padded)};      \
+  }                                                                            \
+  static inline void Counters_##_destroy(Counters_* self) {                    \
+    CWISS_FrozenTable_destroy(HashSet_##_policy(), &self->set_);               \
+  }                                                                            \
+  static inline size_t Counters_##_size(const Counters_* self) {               \
+    return CWISS_RawTable_size(HashSet_##_policy(), &self->set_.table_);       \
+  }                                                                            \
+                                                                               \
+  static inline CWISS_Counter* Counters_##_find(const Counters_* self,         \
+                                                const HashSet_##_Key* key) {   \
+    return CWISS_FrozenTable_find(HashSet_##_policy(), &self->set_, key);      \
+  }                                                                            \
+  static inline bool Counters_##_add(const Counters_* self,                    \
+                                     const HashSet_##_Key* key,                \
+                                     int64_t delta) {                          \
+    CWISS_Counter* c = Counters_##_find(self, key);                            \
+    if (c == NULL) return false;                                               \
+    CWISS_Counter_add(c, delta);                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline HashSet_##_CIter Counters_##_citer(const Counters_* self) {    \
+    return (HashSet_##_CIter){                                                 \
+        CWISS_RawTable_citer(HashSet_##_policy(), &self->set_.table_)};        \
+  }                                                                            \
+  static inline CWISS_Counter* Counters_##_counter_at(                         \
+      const Counters_* self, const HashSet_##_CIter* it) {                     \
+    return CWISS_FrozenTable_counter_at(HashSet_##_policy(), &self->set_,      \
+                                        &it->it_);                             \
+  }                                                                            \
+  CWISS_END                                                                    \
+  /* Force a semicolon. */ struct Counters_##_NeedsTrailingSemicolon_ { int x; }
+
+/// Declares an index on the field `field_`, of type `Key_`, of the record type
+/// `Record_`, as a constant `CWISS_IndexPolicy` named `kIndex_`.
+///
+/// Keys are hashed and compared bytewise. If `unique_` is true, no two records
+/// in a table may have the same key; see `internal/multi_index.h`.
+#define CWISS_DECLARE_INDEX(kIndex_, Record_, Key_, field_, unique_) \
+  CWISS_DECLARE_FLAT_SET_POLICY(kIndex_##_Keys, Key_, (_, _));       \
+  CWISS_DECLARE_INDEX_WITH(kIndex_, Record_, field_,                 \
+                           &kIndex_##_Keys_KeyPolicy, unique_)
+
+/// Like `CWISS_DECLARE_INDEX`, but with a custom key policy, given as a
+/// `const CWISS_KeyPolicy*`, for hashing and comparing the field.
+#define CWISS_DECLARE_INDEX_WITH(kIndex_, Record_, field_, key_policy_, \
+                                 unique_)                               \
+  CWISS_BEGIN                                                           \
+  static inline const void* kIndex_##_Key(const void* record) {         \
+    return &((const Record_*)record)->field_;                           \
+  }                                                                     \
+  static const CWISS_IndexPolicy kIndex_ = {kIndex_##_Key, key_policy_, \
+                                            unique_};                   \
+  CWISS_END                                                             \
+  /* Force a semicolon. */ struct kIndex_##_NeedsTrailingSemicolon_ { int x; }
+
+/// Generates a table type that stores plain-old-data records of type `Record_`
+/// once, and indexes them by each of the indexes declared with
+/// `CWISS_DECLARE_INDEX` and passed by address as the remaining arguments (at
+/// most four). Records never move once inserted. The generated API is:
+///
+/// - `Table Table_new(size_t capacity)` and `void Table_destroy(Table* self)`
+/// - `void Table_clear(Table* self)`
+/// - `size_t Table_size(const Table* self)` and `bool Table_empty(...)`
+/// - `Table_Insert Table_insert(Table* self, const Record* record)`, which
+///   returns `{record, inserted}`. If a unique index already has a record with
+///   one of the new record's keys, nothing is inserted and `record` points to
+///   the existing one.
+/// - `Table_Iter Table_iter(Table* self)`, with
+///   `Record* Table_Iter_get(const Table_Iter*)` (null at the end) and
+///   `Record* Table_Iter_next(Table_Iter*)`.
+///
+/// Lookups through an index are generated by
+/// `CWISS_DECLARE_MULTI_INDEX_LOOKUP`.
+#define CWISS_DECLARE_MULTI_INDEX(Table_, Record_, ...)                       \
+  CWISS_DECLARE_FLAT_SET_POLICY(Table_##_kRecordPolicy, Record_, (_, _));     \
+  CWISS_BEGIN                                                                 \
+  typedef Record_ Table_##_Record;                                            \
+  static const CWISS_IndexPolicy* const Table_##_kIndexes[] = {__VA_ARGS__};  \
+  static const CWISS_MultiPolicy Table_##_kPolicy = {                         \
+      &Table_##_kRecordPolicy, Table_##_kIndexes,                             \
+      sizeof(Table_##_kIndexes) / sizeof(Table_##_kIndexes[0])};              \
+                                                                              \
+  typedef struct {                                                            \
+    CWISS_MultiTable set_;                                                    \
+  } Table_;                                                                   \
+                                                                              \
+  static inline Table_ Table_##_new(size_t capacity) {                        \
+    return (Table_){CWISS_MultiTable_new(&Table_##_kPolicy, capacity)};       \
+  }                                                                           \
+  static inline void Table_##_destroy(Table_* self) {                         \
+    CWISS_MultiTable_destroy(&Table_##_kPolicy, &self->set_);                 \
+  }                                                                           \
+  static inline void Table_##_clear(Table_* self) {                           \
+    CWISS_MultiTable_clear(&Table_##_kPolicy, &self->set_);                   \
+  }                                                                           \
+  static inline size_t Table_##_size(const Table_* self) {                    \
+    return CWISS_MultiTable_size(&Table_##_kPolicy, &self->set_);             \
+  }                                                                           \
+  static inline bool Table_##_empty(const Table_* self) {                     \
+    return CWISS_MultiTable_size(&Table_##_kPolicy, &self->set_) == 0;        \
+  }                                                                           \
+                                                                              \
+  typedef struct {                                                            \
+    Record_* record;                                                          \
+    bool inserted;                                                            \
+  } Table_##_Insert;                                                          \
+  static inline Table_##_Insert Table_##_insert(Table_* self,                 \
+                                                const Record_* record) {      \
+    CWISS_MultiInsert res =                                                   \
+        CWISS_MultiTable_insert(&Table_##_kPolicy, &self->set_, record);      \
+    return (Table_##_Insert){(Record_*)res.record, res.inserted};             \
+  }                                                                           \
+                                                                              \
+  typedef struct {                                                            \
+    CWISS_ArenaIter it_;                                                      \
+  } Table_##_Iter;                                                            \
+  static inline Table_##_Iter Table_##_iter(Table_* self) {                   \
+    return (Table_##_Iter){                                                   \
+        CWISS_MultiTable_iter(&Table_##_kPolicy, &self->set_)};               \
+  }                                                                           \
+  static inline Record_* Table_##_Iter_get(const Table_##_Iter* it) {         \
+    return (Record_*)CWISS_ArenaIter_get(&Table_##_kRecordPolicy, &it->it_);  \
+  }                                                                           \
+  static inline Record_* Table_##_Iter_next(Table_##_Iter* it) {              \
+    return (Record_*)CWISS_ArenaIter_next(&Table_##_kRecordPolicy, &it->it_); \
+  }                                                                           \
+  CWISS_END                                                                   \
+  /* Force a semicolon. */ struct Table_##_NeedsTrailingSemicolon_ { int x; }
+
+/// Generates lookups through the `index_`th index (counting from zero, in the
+/// order passed to `CWISS_DECLARE_MULTI_INDEX`) of `Table_`, whose keys have
+/// type `Key_`:
+///
+/// - `Record* Table_find_by_Name(const Table* self, const Key* key)`, which
+///   returns null if there is no such record, and an arbitrary one of them if
+///   the index is not unique.
+/// - `bool Table_contains_by_Name(const Table* self, const Key* key)`
+/// - `size_t Table_visit_by_Name(const Table* self, const Key* key,
+///   Table_Visitor_Name visit, void* ctx)`, which calls `visit(ctx, record)`
+///   for every record with that key and returns how many there are. `visit`
+///   may be null, and must not modify the table.
+/// - `bool Table_erase_by_Name(Table* self, const Key* key)`, which erases the
+///   record that `find_by_Name()` would return from every index.
+#define CWISS_DECLARE_MULTI_INDEX_LOOKUP(Table_, Name_, Key_, index_)         \
+  CWISS_BEGIN                                                                 \
+  typedef void (*Table_##_Visitor_##Name_)(void* ctx,                         \
+                                           Table_##_Record* record);          \
+  typedef struct {                                                            \
+    Table_##_Visitor_##Name_ visit;                                           \
+    void* ctx;                                                                \
+  } Table_##_VisitCtx_##Name_;                                                \
+  static inline void Table_##_Visit_##Name_(void* ctx, void* record) {        \
+    Table_##_VisitCtx_##Name_* c = (Table_##_VisitCtx_##Name_*)ctx;           \
+    c->visit(c->ctx, (Table_##_Record*)record);                               \
+  }                                                                           \
+                                                                              \
+  static inline Table_##_Record* Table_##_find_by_##Name_(const Table_* self, \
+                                                          const Key_* key) {  \
+    return (Table_##_Record*)CWISS_MultiTable_find(&Table_##_kPolicy,         \
+                                                   &self->set_, index_, key); \
+  }                                                                           \
+  static inline bool Table_##_contains_by_##Name_(const Table_* self,         \
+                                                  const Key_* key) {          \
+    return Table_##_find_by_##Name_(self, key) != NULL;                       \
+  }                                                                           \
+  static inline size_t Table_##_visit_by_##Name_(                             \
+      const Table_* self, const Key_* key, Table_##_Visitor_##Name_ visit,    \
+      void* ctx) {                                                            \
+    Table_##_VisitCtx_##Name_ c = {visit, ctx};                               \
+    return CWISS_MultiTable_find_all(                                         \
+        &Table_##_kPolicy, &self->set_, index_, key,                          \
+        visit ? Table_##_Visit_##Name_ : NULL, &c);                           \
+  }                                                                           \
+  static inline bool Table_##_erase_by_##Name_(Table_* self,                  \
+                                               const Key_* key) {             \
+    return CWISS_MultiTable_erase(&Table_##_kPolicy, &self->set_, index_,     \
+                                  key);                                       \
+  }                                                                           \
+  CWISS_END                                                                   \
+  /* Force a semicolon. */ struct Table_##_NeedsTrailingSemicolon_##Name_ {   \
+    int x;                                                                    \
+  }
+#if CWISS_HAVE_MMAP
+/// Generates a hash map type whose contents live in a memory-mapped file, and
+/// so persist across restarts.
+///
+/// `K_` and `V_` must be plain-old-data; keys are hashed and compared
+/// bytewise. See `mapped_table.h` for the file format and its crash
+/// consistency guarantees. The generated API is:
+///
+/// - `CWISS_MappedStatus Map_open(Map* self, const char* path,
+///   size_t capacity)`, which opens the table at `path`, or creates an empty
+///   one with room for `capacity` elements if there is none. Opening does not
+///   read the table's contents, so it takes constant time.
+/// - `CWISS_MappedStatus Map_recover(Map* self, const char* path,
+///   size_t capacity)`, which is like `Map_open()`, but rebuilds a table that
+///   `Map_open()` reports as `CWISS_kMappedUnclean` instead of failing.
+/// - `bool Map_flush(Map* self)`, which makes all changes durable.
+/// - `void Map_close(Map* self)`, which does not flush.
+/// - `size_t Map_size(const Map* self)` and `size_t Map_capacity(...)`.
+/// - `V* Map_find(const Map* self, const K* key)`, which returns null if the
+///   key is absent, and `bool Map_contains(...)`.
+/// - `Map_Insert Map_insert(Map* self, const K* key, const V* val)`, which
+///   returns `{val, inserted}`. `val` points to the value in the table, and is
+///   null if the table had to grow and could not, if writing to the file
+///   failed, or if the file is corrupt.
+/// - `bool Map_erase(Map* self, const K* key)`, which returns false if the key
+///   is absent or writing to the file failed.
+/// - `Map_Iter Map_iter(Map* self)`, with `Map_Entry* Map_Iter_get(const
+///   Map_Iter*)` (null at the end) and `Map_Entry* Map_Iter_next(Map_Iter*)`,
+///   which advances and returns the new entry.
+///
+/// As with other tables, pointers into the table are invalidated by insertion.
+#define CWISS_DECLARE_MAPPED_HASHMAP(HashMap_, K_, V_)                         \
+  CWISS_BEGIN                                                                  \
+  typedef K_ HashMap_##_Key;                                                   \
+  typedef V_ HashMap_##_Value;                                                 \
+  typedef struct {                                                             \
+    HashMap_##_Key key;                                                        \
+    HashMap_##_Value val;                                                      \
+  } HashMap_##_Entry;                                                          \
+  static const CWISS_MappedPolicy HashMap_##_kPolicy = {                       \
+      sizeof(HashMap_##_Key), offsetof(HashMap_##_Entry, val),                 \
+      sizeof(HashMap_##_Entry), alignof(HashMap_##_Entry)};                    \
+                                                                               \
+  typedef struct {                                                             \
+    CWISS_MappedTable set_;                                                    \
+  } HashMap_;                                                                  \
+                                                                               \
+  static inline CWISS_MappedStatus HashMap_##_open(                            \
+      HashMap_* self, const char* path, size_t capacity) {                     \
+    return CWISS_MappedTable_open(&HashMap_##_kPolicy, &self->set_, path,      \
+                                  capacity);                                   \
+  }                                                                            \
+  static inline CWISS_MappedStatus HashMap_##_recover(                         \
+      HashMap_* self, const char* path, size_t capacity) {                     \
+    return CWISS_MappedTable_recover(&HashMap_##_kPolicy, &self->set_, path,   \
+                                     capacity);                                \
+  }                                                                            \
+  static inline bool HashMap_##_flush(HashMap_* self) {                        \
+    return CWISS_MappedTable_flush(&self->set_);                               \
+  }                                                                            \
+  static inline void HashMap_##_close(HashMap_* self) {                        \
+    CWISS_MappedTable_close(&self->set_);                                      \
+  }                                                                            \
+  static inline size_t HashMap_##_size(const HashMap_* self) {                 \
+    return CWISS_MappedTable_size(&self->set_);                                \
+  }                                                                            \
+  static inline size_t HashMap_##_capacity(const HashMap_* self) {             \
+    return CWISS_MappedTable_capacity(&self->set_);                            \
+  }                                                                            \
+                                                                               \
+  static inline HashMap_##_Value* HashMap_##_find(const HashMap_* self,        \
+                                                  const HashMap_##_Key* key) { \
+    char* slot =                                                               \
+        CWISS_MappedTable_find(&HashMap_##_kPolicy, &self->set_, key);         \
+    if (slot == NULL) return NULL;                                             \
+    return (HashMap_##_Value*)(slot + HashMap_##_kPolicy.val_offset);          \
+  }                                                                            \
+  static inline bool HashMap_##_contains(const HashMap_* self,                 \
+                                         const HashMap_##_Key* key) {          \
+    return HashMap_##_find(self, key) != NULL;                                 \
+  }                                                                            \
+                                                                               \
+  typedef struct {                                                             \
+    HashMap_##_Value* val;                                                     \
+    bool inserted;                                                             \
+  } HashMap_##_Insert;                                                         \
+  static inline HashMap_##_Insert HashMap_##_insert(                           \
+      HashMap_* self, const HashMap_##_Key* key,                               \
+      const HashMap_##_Value* val) {                                           \
+    CWISS_MappedInsert res =                                                   \
+        CWISS_MappedTable_insert(&HashMap_##_kPolicy, &self->set_, key);       \
+    if (res.slot == NULL) return (HashMap_##_Insert){NULL, false};             \
+    HashMap_##_Value* v =                                                      \
+        (HashMap_##_Value*)(res.slot + HashMap_##_kPolicy.val_offset);         \
+    if (res.inserted) memcpy(v, val, sizeof(HashMap_##_Value));                \
+    return (HashMap_##_Insert){v, res.inserted};                               \
+  }                                                                            \
+  static inline bool HashMap_##_erase(HashMap_* self,                          \
+                                      const HashMap_##_Key* key) {             \
+    return CWISS_MappedTable_erase(&HashMap_##_kPolicy, &self->set_, key);     \
+  }                                                                            \
+                                                                               \
+  typedef struct {                                                             \
+    HashMap_* map_;                                                            \
+    size_t index_;                                                             \
+  } HashMap_##_Iter;                                                           \
+  static inline HashMap_##_Iter HashMap_##_iter(HashMap_* self) {              \
+    return (HashMap_##_Iter){self, CWISS_MappedTable_Skip(&self->set_, 0)};    \
+  }                                                                            \
+  static inline HashMap_##_Entry* HashMap_##_Iter_get(                         \
+      const HashMap_##_Iter* it) {                                             \
+    if (it->index_ >= CWISS_MappedTable_capacity(&it->map_->set_)) {           \
+      return NULL;                                                             \
+    }                                                                          \
+    return (HashMap_##_Entry*)(it->map_->set_.slots_ +                         \
+                               it->index_ * HashMap_##_kPolicy.slot_size);     \
+  }                                                                            \
+  static inline HashMap_##_Entry* HashMap_##_Iter_next(HashMap_##_Iter* it) {  \
+    it->index_ = CWISS_MappedTable_Skip(&it->map_->set_, it->index_ + 1);      \
+    return HashMap_##_Iter_get(it);                                            \
+  }                                                                            \
+  CWISS_END                                                                    \
+  /* Force a semicolon. */ struct HashMap_##_NeedsTrailingSemicolon_ { int x; }
+#endif  // CWISS_HAVE_MMAP
+
 // ---- PUBLIC API ENDS HERE! ----
 
-#define CWISS_DECLARE_COMMON_(HashSet_, Type_, Key_, kPolicy_)                 \
+// The lookup and iteration functions, which are always inlined. The functions
+// that can allocate are added by `CWISS_DECLARE_COMMON_`, or only declared by
+// `CWISS_DECLARE_COMMON_EXTERN_` and outlined by `CWISS_DEFINE_HASHSET`.
+#define CWISS_DECLARE_COMMON_HOT_(HashSet_, Type_, Key_, kPolicy_)             \
   CWISS_BEGIN                                                                  \
   static inline const CWISS_Policy* HashSet_##_policy(void) {                  \
     return &kPolicy_;                                                          \
@@ -215,11 +1058,12 @@ CWISS_BEGIN_EXTERN
   static inline HashSet_ HashSet_##_new(size_t bucket_count) {                 \
     return (HashSet_){CWISS_RawTable_new(&kPolicy_, bucket_count)};            \
   }                                                                            \
-  static inline HashSet_ HashSet_##_dup(const HashSet_* that) {                \
-    return (HashSet_){CWISS_RawTable_dup(&kPolicy_, &that->set_)};             \
-  }                                                                            \
-  static inline void HashSet_##_destroy(HashSet_* self) {                      \
-    CWISS_RawTable_destroy(&kPolicy_, &self->set_);                            \
+  static inline void HashSet_##_destroy_deferred(                              \
+      HashSet_* self, void (*executor)(CWISS_DetachedTable, void*),            \
+      void* ctx) {                                                             \
+    CWISS_DetachedTable detached =                                             \
+        CWISS_RawTable_Detach(&kPolicy_, &self->set_);                         \
+    if (detached.capacity_ != 0) executor(detached, ctx);                      \
   }                                                                            \
                                                                                \
   typedef struct {                                                             \
@@ -233,6 +1077,10 @@ CWISS_BEGIN_EXTERN
   }                                                                            \
   static inline Type_* HashSet_##_Iter_next(HashSet_##_Iter* it) {             \
     return (Type_*)CWISS_RawIter_next(&kPolicy_, &it->it_);                    \
+  }                                                                            \
+  static inline HashSet_##_Iter HashSet_##_iter_prefetching(HashSet_* self) {  \
+    return (HashSet_##_Iter){                                                  \
+        CWISS_RawTable_iter_prefetching(&kPolicy_, &self->set_)};              \
   }                                                                            \
                                                                                \
   typedef struct {                                                             \
@@ -241,6 +1089,11 @@ CWISS_BEGIN_EXTERN
   static inline HashSet_##_CIter HashSet_##_citer(const HashSet_* self) {      \
     return (HashSet_##_CIter){CWISS_RawTable_citer(&kPolicy_, &self->set_)};   \
   }                                                                            \
+  static inline HashSet_##_CIter HashSet_##_citer_prefetching(                 \
+      const HashSet_* self) {                                                  \
+    return (HashSet_##_CIter){                                                 \
+        CWISS_RawTable_citer_prefetching(&kPolicy_, &self->set_)};             \
+  }                                                                            \
   static inline const Type_* HashSet_##_CIter_get(                             \
       const HashSet_##_CIter* it) {                                            \
     return (const Type_*)CWISS_RawIter_get(&kPolicy_, &it->it_);               \
@@ -252,13 +1105,6 @@ CWISS_BEGIN_EXTERN
     return (HashSet_##_CIter){it.it_};                                         \
   }                                                                            \
                                                                                \
-  static inline void HashSet_##_reserve(HashSet_* self, size_t n) {            \
-    CWISS_RawTable_reserve(&kPolicy_, &self->set_, n);                         \
-  }                                                                            \
-  static inline void HashSet_##_rehash(HashSet_* self, size_t n) {             \
-    CWISS_RawTable_rehash(&kPolicy_, &self->set_, n);                          \
-  }                                                                            \
-                                                                               \
   static inline bool HashSet_##_empty(const HashSet_* self) {                  \
     return CWISS_RawTable_empty(&kPolicy_, &self->set_);                       \
   }                                                                            \
@@ -268,26 +1114,19 @@ CWISS_BEGIN_EXTERN
   static inline size_t HashSet_##_capacity(const HashSet_* self) {             \
     return CWISS_RawTable_capacity(&kPolicy_, &self->set_);                    \
   }                                                                            \
-                                                                               \
-  static inline void HashSet_##_clear(HashSet_* self) {                        \
-    return CWISS_RawTable_clear(&kPolicy_, &self->set_);                       \
+  static inline size_t HashSet_##_release_unused(HashSet_* self) {             \
+    return CWISS_RawTable_release_unused(&kPolicy_, &self->set_, 0);           \
+  }                                                                            \
+  static inline size_t HashSet_##_release_unused_pages(HashSet_* self,         \
+                                                       size_t page_size) {     \
+    return CWISS_RawTable_release_unused(&kPolicy_, &self->set_, page_size);   \
   }                                                                            \
                                                                                \
   typedef struct {                                                             \
     HashSet_##_Iter iter;                                                      \
     bool inserted;                                                             \
+    bool needs_growth;                                                         \
   } HashSet_##_Insert;                                                         \
-  static inline HashSet_##_Insert HashSet_##_deferred_insert(                  \
-      HashSet_* self, const Key_* key) {                                       \
-    CWISS_Insert ret = CWISS_RawTable_deferred_insert(&kPolicy_, kPolicy_.key, \
-                                                      &self->set_, key);       \
-    return (HashSet_##_Insert){{ret.iter}, ret.inserted};                      \
-  }                                                                            \
-  static inline HashSet_##_Insert HashSet_##_insert(HashSet_* self,            \
-                                                    const Type_* val) {        \
-    CWISS_Insert ret = CWISS_RawTable_insert(&kPolicy_, &self->set_, val);     \
-    return (HashSet_##_Insert){{ret.iter}, ret.inserted};                      \
-  }                                                                            \
                                                                                \
   static inline HashSet_##_CIter HashSet_##_cfind_hinted(                      \
       const HashSet_* self, const Key_* key, size_t hash) {                    \
@@ -296,8 +1135,10 @@ CWISS_BEGIN_EXTERN
   }                                                                            \
   static inline HashSet_##_Iter HashSet_##_find_hinted(                        \
       HashSet_* self, const Key_* key, size_t hash) {                          \
-    return (HashSet_##_Iter){CWISS_RawTable_find_hinted(                       \
-        &kPolicy_, kPolicy_.key, &self->set_, key, hash)};                     \
+    CWISS_RawIter it = CWISS_RawTable_find_hinted(&kPolicy_, kPolicy_.key,     \
+                                                  &self->set_, key, hash);     \
+    CWISS_RawIter_MarkDirty(&it);                                              \
+    return (HashSet_##_Iter){it};                                              \
   }                                                                            \
   static inline HashSet_##_CIter HashSet_##_cfind(const HashSet_* self,        \
                                                   const Key_* key) {           \
@@ -306,8 +1147,10 @@ CWISS_BEGIN_EXTERN
   }                                                                            \
   static inline HashSet_##_Iter HashSet_##_find(HashSet_* self,                \
                                                 const Key_* key) {             \
-    return (HashSet_##_Iter){                                                  \
-        CWISS_RawTable_find(&kPolicy_, kPolicy_.key, &self->set_, key)};       \
+    CWISS_RawIter it =                                                         \
+        CWISS_RawTable_find(&kPolicy_, kPolicy_.key, &self->set_, key);        \
+    CWISS_RawIter_MarkDirty(&it);                                              \
+    return (HashSet_##_Iter){it};                                              \
   }                                                                            \
                                                                                \
   static inline bool HashSet_##_contains(const HashSet_* self,                 \
@@ -322,9 +1165,414 @@ CWISS_BEGIN_EXTERN
     return CWISS_RawTable_erase(&kPolicy_, kPolicy_.key, &self->set_, key);    \
   }                                                                            \
                                                                                \
+  static inline HashSet_##_CIter HashSet_##_crandom(const HashSet_* self,      \
+                                                    uint64_t* rng_state) {     \
+    return (HashSet_##_CIter){                                                 \
+        CWISS_RawTable_random(&kPolicy_, &self->set_, rng_state)};             \
+  }                                                                            \
+  static inline HashSet_##_Iter HashSet_##_random(HashSet_* self,              \
+                                                  uint64_t* rng_state) {       \
+    CWISS_RawIter it =                                                         \
+        CWISS_RawTable_random(&kPolicy_, &self->set_, rng_state);              \
+    CWISS_RawIter_MarkDirty(&it);                                              \
+    return (HashSet_##_Iter){it};                                              \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_enable_dirty_tracking(HashSet_* self) {        \
+    CWISS_RawTable_EnableDirtyTracking(&kPolicy_, &self->set_);                \
+  }                                                                            \
+  static inline void HashSet_##_disable_dirty_tracking(HashSet_* self) {       \
+    CWISS_RawTable_DisableDirtyTracking(&kPolicy_, &self->set_);               \
+  }                                                                            \
+  static inline void HashSet_##_Iter_mark_dirty(const HashSet_##_Iter* it) {   \
+    CWISS_RawIter_MarkDirty(&it->it_);                                         \
+  }                                                                            \
+  static inline bool HashSet_##_next_dirty_group(                              \
+      const HashSet_* self, size_t* cursor, CWISS_DirtyGroup* out) {           \
+    return CWISS_RawTable_NextDirtyGroup(&kPolicy_, &self->set_, cursor, out); \
+  }                                                                            \
+  static inline void HashSet_##_clear_dirty(HashSet_* self) {                  \
+    CWISS_RawTable_ClearDirty(&kPolicy_, &self->set_);                         \
+  }                                                                            \
+  static inline void HashSet_##_apply_dirty_group(                             \
+      HashSet_* self, const CWISS_DirtyGroup* group) {                         \
+    CWISS_RawTable_ApplyDirtyGroup(&kPolicy_, &self->set_, group);             \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_enable_hit_counting(HashSet_* self) {          \
+    CWISS_RawTable_EnableHitCounting(&kPolicy_, &self->set_);                  \
+  }                                                                            \
+  static inline void HashSet_##_disable_hit_counting(HashSet_* self) {         \
+    CWISS_RawTable_DisableHitCounting(&kPolicy_, &self->set_);                 \
+  }                                                                            \
+  static inline void HashSet_##_optimize_layout(HashSet_* self) {              \
+    CWISS_RawTable_OptimizeLayout(&kPolicy_, &self->set_);                     \
+  }                                                                            \
+                                                                               \
+  static inline size_t HashSet_##_growth_left(const HashSet_* self) {          \
+    return CWISS_RawTable_growth_left(&self->set_);                            \
+  }                                                                            \
+  static inline bool HashSet_##_needs_growth(const HashSet_* self) {           \
+    return CWISS_RawTable_NeedsGrowth(&self->set_);                            \
+  }                                                                            \
+  static inline void HashSet_##_watch_growth(                                  \
+      HashSet_* self, size_t low_water, CWISS_GrowthCallback callback,         \
+      void* ctx) {                                                             \
+    CWISS_RawTable_WatchGrowth(&kPolicy_, &self->set_, low_water, callback,    \
+                               ctx);                                           \
+  }                                                                            \
+  static inline void HashSet_##_set_inline_growth(HashSet_* self,              \
+                                                  bool allowed) {              \
+    CWISS_RawTable_SetInlineGrowth(&kPolicy_, &self->set_, allowed);           \
+  }                                                                            \
+  static inline void HashSet_##_unwatch_growth(HashSet_* self) {               \
+    CWISS_RawTable_UnwatchGrowth(&kPolicy_, &self->set_);                      \
+  }                                                                            \
+  CWISS_END
+
+#define CWISS_DECLARE_COMMON_(HashSet_, Type_, Key_, kPolicy_)                 \
+  CWISS_DECLARE_COMMON_HOT_(HashSet_, Type_, Key_, kPolicy_)                   \
+  CWISS_BEGIN                                                                  \
+  static inline HashSet_ HashSet_##_dup(const HashSet_* that) {                \
+    return (HashSet_){CWISS_RawTable_dup(&kPolicy_, &that->set_)};             \
+  }                                                                            \
+  static inline void HashSet_##_destroy(HashSet_* self) {                      \
+    CWISS_RawTable_destroy(&kPolicy_, &self->set_);                            \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_reserve(HashSet_* self, size_t n) {            \
+    CWISS_RawTable_reserve(&kPolicy_, &self->set_, n);                         \
+  }                                                                            \
+  static inline void HashSet_##_rehash(HashSet_* self, size_t n) {             \
+    CWISS_RawTable_rehash(&kPolicy_, &self->set_, n);                          \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_clear(HashSet_* self) {                        \
+    return CWISS_RawTable_clear(&kPolicy_, &self->set_);                       \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_begin_apply(HashSet_* self, size_t capacity) { \
+    CWISS_RawTable_BeginApply(&kPolicy_, &self->set_, capacity);               \
+  }                                                                            \
+                                                                               \
+  static inline HashSet_##_Insert HashSet_##_deferred_insert(                  \
+      HashSet_* self, const Key_* key) {                                       \
+    CWISS_Insert ret = CWISS_RawTable_deferred_insert(&kPolicy_, kPolicy_.key, \
+                                                      &self->set_, key);       \
+    CWISS_RawIter_MarkDirty(&ret.iter);                                        \
+    return (HashSet_##_Insert){{ret.iter}, ret.inserted, ret.needs_growth};    \
+  }                                                                            \
+  static inline HashSet_##_Insert HashSet_##_insert(HashSet_* self,            \
+                                                    const Type_* val) {        \
+    CWISS_Insert ret = CWISS_RawTable_insert(&kPolicy_, &self->set_, val);     \
+    CWISS_RawIter_MarkDirty(&ret.iter);                                        \
+    return (HashSet_##_Insert){{ret.iter}, ret.inserted, ret.needs_growth};    \
+  }                                                                            \
   CWISS_END                                                                    \
   /* Force a semicolon. */ struct HashSet_##_NeedsTrailingSemicolon_ { int x; }
 
+#define CWISS_DECLARE_COMMON_EXTERN_(HashSet_, Type_, Key_, kPolicy_)       \
+  CWISS_DECLARE_COMMON_HOT_(HashSet_, Type_, Key_, kPolicy_)                \
+  CWISS_BEGIN                                                               \
+  CWISS_BEGIN_EXTERN                                                        \
+  HashSet_ HashSet_##_dup(const HashSet_* that);                            \
+  void HashSet_##_destroy(HashSet_* self);                                  \
+  void HashSet_##_reserve(HashSet_* self, size_t n);                        \
+  void HashSet_##_rehash(HashSet_* self, size_t n);                         \
+  void HashSet_##_clear(HashSet_* self);                                    \
+  void HashSet_##_begin_apply(HashSet_* self, size_t capacity);             \
+  HashSet_##_Insert HashSet_##_InsertNew_(HashSet_* self, size_t hash);     \
+  CWISS_END_EXTERN                                                          \
+                                                                            \
+  static inline HashSet_##_Insert HashSet_##_deferred_insert(               \
+      HashSet_* self, const Key_* key) {                                    \
+    size_t hash = kPolicy_.key->hash(key);                                  \
+    CWISS_RawIter it = CWISS_RawTable_find_hinted(&kPolicy_, kPolicy_.key,  \
+                                                  &self->set_, key, hash);  \
+    if (it.slot_ == NULL) return HashSet_##_InsertNew_(self, hash);         \
+    CWISS_RawIter_MarkDirty(&it);                                           \
+    return (HashSet_##_Insert){{it}, false, false};                         \
+  }                                                                         \
+  static inline HashSet_##_Insert HashSet_##_insert(HashSet_* self,         \
+                                                    const Type_* val) {     \
+    const Key_* key = (const Key_*)val;                                     \
+    HashSet_##_Insert ret = HashSet_##_deferred_insert(self, key);          \
+    if (ret.inserted) {                                                     \
+      kPolicy_.obj->copy(CWISS_RawIter_get(&kPolicy_, &ret.iter.it_), val); \
+    }                                                                       \
+    return ret;                                                             \
+  }                                                                         \
+  CWISS_END                                                                 \
+  /* Force a semicolon. */ struct HashSet_##_NeedsTrailingSemicolon_ { int x; }
+
+#define CWISS_DECLARE_INT_COMMON_(HashSet_, K_, kPolicy_)                      \
+  CWISS_BEGIN                                                                  \
+  typedef K_ HashSet_##_Key;                                                   \
+  typedef struct {                                                             \
+    CWISS_IntTable set_;                                                       \
+  } HashSet_;                                                                  \
+                                                                               \
+  static inline HashSet_ HashSet_##_new(size_t bucket_count) {                 \
+    static_assert(sizeof(K_) == 4 || sizeof(K_) == 8,                          \
+                  "integer tables only support 32- and 64-bit keys");          \
+    return (HashSet_){CWISS_IntTable_new(&kPolicy_, bucket_count)};            \
+  }                                                                            \
+  static inline HashSet_ HashSet_##_dup(const HashSet_* that) {                \
+    return (HashSet_){CWISS_IntTable_dup(&kPolicy_, &that->set_)};             \
+  }                                                                            \
+  static inline void HashSet_##_destroy(HashSet_* self) {                      \
+    CWISS_IntTable_destroy(&kPolicy_, &self->set_);                            \
+  }                                                                            \
+                                                                               \
+  typedef struct {                                                             \
+    CWISS_IntIter it_;                                                         \
+  } HashSet_##_Iter;                                                           \
+  static inline HashSet_##_Iter HashSet_##_iter(HashSet_* self) {              \
+    return (HashSet_##_Iter){CWISS_IntTable_iter(&kPolicy_, &self->set_)};     \
+  }                                                                            \
+  static inline const HashSet_##_Key* HashSet_##_Iter_get(                     \
+      const HashSet_##_Iter* it) {                                             \
+    return (const HashSet_##_Key*)CWISS_IntIter_key(&kPolicy_, &it->it_);      \
+  }                                                                            \
+  static inline const HashSet_##_Key* HashSet_##_Iter_key(                     \
+      const HashSet_##_Iter* it) {                                             \
+    return (const HashSet_##_Key*)CWISS_IntIter_key(&kPolicy_, &it->it_);      \
+  }                                                                            \
+  static inline const HashSet_##_Key* HashSet_##_Iter_next(                    \
+      HashSet_##_Iter* it) {                                                   \
+    return (const HashSet_##_Key*)CWISS_IntIter_next(&kPolicy_, &it->it_);     \
+  }                                                                            \
+                                                                               \
+  typedef struct {                                                             \
+    CWISS_IntIter it_;                                                         \
+  } HashSet_##_CIter;                                                          \
+  static inline HashSet_##_CIter HashSet_##_citer(const HashSet_* self) {      \
+    return (HashSet_##_CIter){CWISS_IntTable_iter(&kPolicy_, &self->set_)};    \
+  }                                                                            \
+  static inline const HashSet_##_Key* HashSet_##_CIter_get(                    \
+      const HashSet_##_CIter* it) {                                            \
+    return (const HashSet_##_Key*)CWISS_IntIter_key(&kPolicy_, &it->it_);      \
+  }                                                                            \
+  static inline const HashSet_##_Key* HashSet_##_CIter_key(                    \
+      const HashSet_##_CIter* it) {                                            \
+    return (const HashSet_##_Key*)CWISS_IntIter_key(&kPolicy_, &it->it_);      \
+  }                                                                            \
+  static inline const HashSet_##_Key* HashSet_##_CIter_next(                   \
+      HashSet_##_CIter* it) {                                                  \
+    return (const HashSet_##_Key*)CWISS_IntIter_next(&kPolicy_, &it->it_);     \
+  }                                                                            \
+  static inline HashSet_##_CIter HashSet_##_Iter_const(HashSet_##_Iter it) {   \
+    return (HashSet_##_CIter){it.it_};                                         \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_clear(HashSet_* self) {                        \
+    CWISS_IntTable_clear(&kPolicy_, &self->set_);                              \
+  }                                                                            \
+  static inline void HashSet_##_rehash(HashSet_* self, size_t n) {             \
+    CWISS_IntTable_rehash(&kPolicy_, &self->set_, n);                          \
+  }                                                                            \
+  static inline void HashSet_##_reserve(HashSet_* self, size_t n) {            \
+    CWISS_IntTable_reserve(&kPolicy_, &self->set_, n);                         \
+  }                                                                            \
+  static inline size_t HashSet_##_capacity(const HashSet_* self) {             \
+    return CWISS_IntTable_capacity(&kPolicy_, &self->set_);                    \
+  }                                                                            \
+  static inline bool HashSet_##_empty(const HashSet_* self) {                  \
+    return CWISS_IntTable_empty(&kPolicy_, &self->set_);                       \
+  }                                                                            \
+  static inline size_t HashSet_##_size(const HashSet_* self) {                 \
+    return CWISS_IntTable_size(&kPolicy_, &self->set_);                        \
+  }                                                                            \
+                                                                               \
+  typedef struct {                                                             \
+    HashSet_##_Iter iter;                                                      \
+    bool inserted;                                                             \
+  } HashSet_##_Insert;                                                         \
+                                                                               \
+  static inline HashSet_##_CIter HashSet_##_cfind(const HashSet_* self,        \
+                                                  const HashSet_##_Key* key) { \
+    return (HashSet_##_CIter){CWISS_IntTable_find(                             \
+        &kPolicy_, &self->set_, CWISS_IntPolicy_LoadKey(&kPolicy_, key))};     \
+  }                                                                            \
+  static inline HashSet_##_Iter HashSet_##_find(HashSet_* self,                \
+                                                const HashSet_##_Key* key) {   \
+    return (HashSet_##_Iter){CWISS_IntTable_find(                              \
+        &kPolicy_, &self->set_, CWISS_IntPolicy_LoadKey(&kPolicy_, key))};     \
+  }                                                                            \
+  static inline bool HashSet_##_contains(const HashSet_* self,                 \
+                                         const HashSet_##_Key* key) {          \
+    return CWISS_IntTable_contains(&kPolicy_, &self->set_,                     \
+                                   CWISS_IntPolicy_LoadKey(&kPolicy_, key));   \
+  }                                                                            \
+                                                                               \
+  static inline void HashSet_##_erase_at(HashSet_##_Iter it) {                 \
+    CWISS_IntTable_erase_at(&kPolicy_, it.it_);                                \
+  }                                                                            \
+  static inline bool HashSet_##_erase(HashSet_* self,                          \
+                                      const HashSet_##_Key* key) {             \
+    return CWISS_IntTable_erase(&kPolicy_, &self->set_,                        \
+                                CWISS_IntPolicy_LoadKey(&kPolicy_, key));      \
+  }                                                                            \
+  CWISS_END
+
+#define CWISS_DECLARE_ARENA_COMMON_(HashSet_, Type_, Key_, kPolicy_)         \
+  CWISS_BEGIN                                                                \
+  static inline const CWISS_Policy* HashSet_##_policy(void) {                \
+    return &kPolicy_;                                                        \
+  }                                                                          \
+                                                                             \
+  typedef struct {                                                           \
+    CWISS_ArenaTable set_;                                                   \
+  } HashSet_;                                                                \
+                                                                             \
+  static inline HashSet_ HashSet_##_new(size_t bucket_count) {               \
+    return (HashSet_){CWISS_ArenaTable_new(&kPolicy_, bucket_count)};        \
+  }                                                                          \
+  static inline void HashSet_##_destroy(HashSet_* self) {                    \
+    CWISS_ArenaTable_destroy(&kPolicy_, &self->set_);                        \
+  }                                                                          \
+  static inline void HashSet_##_clear(HashSet_* self) {                      \
+    CWISS_ArenaTable_clear(&kPolicy_, &self->set_);                          \
+  }                                                                          \
+  static inline void HashSet_##_reserve(HashSet_* self, size_t n) {          \
+    CWISS_ArenaTable_reserve(&kPolicy_, &self->set_, n);                     \
+  }                                                                          \
+  static inline size_t HashSet_##_size(const HashSet_* self) {               \
+    return CWISS_ArenaTable_size(&kPolicy_, &self->set_);                    \
+  }                                                                          \
+  static inline bool HashSet_##_empty(const HashSet_* self) {                \
+    return CWISS_ArenaTable_size(&kPolicy_, &self->set_) == 0;               \
+  }                                                                          \
+  static inline size_t HashSet_##_capacity(const HashSet_* self) {           \
+    return CWISS_ArenaTable_capacity(&kPolicy_, &self->set_);                \
+  }                                                                          \
+                                                                             \
+  typedef struct {                                                           \
+    CWISS_ArenaIter it_;                                                     \
+  } HashSet_##_Iter;                                                         \
+  static inline HashSet_##_Iter HashSet_##_iter(HashSet_* self) {            \
+    return (HashSet_##_Iter){CWISS_ArenaTable_iter(&kPolicy_, &self->set_)}; \
+  }                                                                          \
+  static inline Type_* HashSet_##_Iter_get(const HashSet_##_Iter* it) {      \
+    return (Type_*)CWISS_ArenaIter_get(&kPolicy_, &it->it_);                 \
+  }                                                                          \
+  static inline Type_* HashSet_##_Iter_next(HashSet_##_Iter* it) {           \
+    return (Type_*)CWISS_ArenaIter_next(&kPolicy_, &it->it_);                \
+  }                                                                          \
+                                                                             \
+  typedef struct {                                                           \
+    HashSet_##_Iter iter;                                                    \
+    bool inserted;                                                           \
+  } HashSet_##_Insert;                                                       \
+  static inline HashSet_##_Insert HashSet_##_insert(HashSet_* self,          \
+                                                    const Type_* val) {      \
+    CWISS_ArenaInsert ret =                                                  \
+        CWISS_ArenaTable_insert(&kPolicy_, &self->set_, val);                \
+    return (HashSet_##_Insert){{ret.iter}, ret.inserted};                    \
+  }                                                                          \
+                                                                             \
+  static inline HashSet_##_Iter HashSet_##_find_hinted(                      \
+      HashSet_* self, const Key_* key, size_t hash) {                        \
+    return (HashSet_##_Iter){                                                \
+        CWISS_ArenaTable_find_hinted(&kPolicy_, &self->set_, key, hash)};    \
+  }                                                                          \
+  static inline HashSet_##_Iter HashSet_##_find(HashSet_* self,              \
+                                                const Key_* key) {           \
+    return (HashSet_##_Iter){                                                \
+        CWISS_ArenaTable_find(&kPolicy_, &self->set_, key)};                 \
+  }                                                                          \
+  static inline bool HashSet_##_contains(const HashSet_* self,               \
+                                         const Key_* key) {                  \
+    return CWISS_ArenaTable_contains(&kPolicy_, &self->set_, key);           \
+  }                                                                          \
+                                                                             \
+  static inline void HashSet_##_erase_at(HashSet_##_Iter it) {               \
+    CWISS_ArenaTable_erase_at(&kPolicy_, it.it_);                            \
+  }                                                                          \
+  static inline bool HashSet_##_erase(HashSet_* self, const Key_* key) {     \
+    return CWISS_ArenaTable_erase(&kPolicy_, &self->set_, key);              \
+  }                                                                          \
+  CWISS_END
+
+#define CWISS_DECLARE_SPARSE_COMMON_(HashSet_, Type_, Key_, kPolicy_)         \
+  CWISS_BEGIN                                                                 \
+  static inline const CWISS_Policy* HashSet_##_policy(void) {                 \
+    return &kPolicy_;                                                         \
+  }                                                                           \
+                                                                              \
+  typedef struct {                                                            \
+    CWISS_SparseTable set_;                                                   \
+  } HashSet_;                                                                 \
+                                                                              \
+  static inline HashSet_ HashSet_##_new(size_t bucket_count) {                \
+    return (HashSet_){CWISS_SparseTable_new(&kPolicy_, bucket_count)};        \
+  }                                                                           \
+  static inline void HashSet_##_destroy(HashSet_* self) {                     \
+    CWISS_SparseTable_destroy(&kPolicy_, &self->set_);                        \
+  }                                                                           \
+  static inline void HashSet_##_clear(HashSet_* self) {                       \
+    CWISS_SparseTable_clear(&kPolicy_, &self->set_);                          \
+  }                                                                           \
+  static inline void HashSet_##_reserve(HashSet_* self, size_t n) {           \
+    CWISS_SparseTable_reserve(&kPolicy_, &self->set_, n);                     \
+  }                                                                           \
+  static inline size_t HashSet_##_size(const HashSet_* self) {                \
+    return CWISS_SparseTable_size(&kPolicy_, &self->set_);                    \
+  }                                                                           \
+  static inline bool HashSet_##_empty(const HashSet_* self) {                 \
+    return CWISS_SparseTable_size(&kPolicy_, &self->set_) == 0;               \
+  }                                                                           \
+  static inline size_t HashSet_##_capacity(const HashSet_* self) {            \
+    return CWISS_SparseTable_capacity(&kPolicy_, &self->set_);                \
+  }                                                                           \
+                                                                              \
+  typedef struct {                                                            \
+    CWISS_SparseIter it_;                                                     \
+  } HashSet_##_Iter;                                                          \
+  static inline HashSet_##_Iter HashSet_##_iter(HashSet_* self) {             \
+    return (HashSet_##_Iter){CWISS_SparseTable_iter(&kPolicy_, &self->set_)}; \
+  }                                                                           \
+  static inline Type_* HashSet_##_Iter_get(const HashSet_##_Iter* it) {       \
+    return (Type_*)CWISS_SparseIter_get(&kPolicy_, &it->it_);                 \
+  }                                                                           \
+  static inline Type_* HashSet_##_Iter_next(HashSet_##_Iter* it) {            \
+    return (Type_*)CWISS_SparseIter_next(&kPolicy_, &it->it_);                \
+  }                                                                           \
+                                                                              \
+  typedef struct {                                                            \
+    HashSet_##_Iter iter;                                                     \
+    bool inserted;                                                            \
+  } HashSet_##_Insert;                                                        \
+  static inline HashSet_##_Insert HashSet_##_insert(HashSet_* self,           \
+                                                    const Type_* val) {       \
+    CWISS_SparseInsert ret =                                                  \
+        CWISS_SparseTable_insert(&kPolicy_, &self->set_, val);                \
+    return (HashSet_##_Insert){{ret.iter}, ret.inserted};                     \
+  }                                                                           \
+                                                                              \
+  static inline HashSet_##_Iter HashSet_##_find_hinted(                       \
+      HashSet_* self, const Key_* key, size_t hash) {                         \
+    return (HashSet_##_Iter){                                                 \
+        CWISS_SparseTable_find_hinted(&kPolicy_, &self->set_, key, hash)};    \
+  }                                                                           \
+  static inline HashSet_##_Iter HashSet_##_find(HashSet_* self,               \
+                                                const Key_* key) {            \
+    return (HashSet_##_Iter){                                                 \
+        CWISS_SparseTable_find(&kPolicy_, &self->set_, key)};                 \
+  }                                                                           \
+  static inline bool HashSet_##_contains(const HashSet_* self,                \
+                                         const Key_* key) {                   \
+    return CWISS_SparseTable_contains(&kPolicy_, &self->set_, key);           \
+  }                                                                           \
+                                                                              \
+  static inline void HashSet_##_erase_at(HashSet_##_Iter it) {                \
+    CWISS_SparseTable_erase_at(&kPolicy_, it.it_);                            \
+  }                                                                           \
+  static inline bool HashSet_##_erase(HashSet_* self, const Key_* key) {      \
+    return CWISS_SparseTable_erase(&kPolicy_, &self->set_, key);              \
+  }                                                                           \
+  CWISS_END
+
 CWISS_END_EXTERN
 CWISS_END
 
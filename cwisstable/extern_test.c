@@ -0,0 +1,46 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks, from C, that a table declared with one of the `_EXTERN` macros can
+// be hashed in one translation unit and rehashed in another: elements are
+// inserted here, with the inline functions, and the table is grown by the
+// out-of-line functions in extern_test_def.c. This fails if the two
+// translation units hash with different seeds.
+
+#include <stdio.h>
+
+#include "cwisstable/extern_test.h"
+
+int main(void) {
+  if (CWISS_AbslHash_kSeed != ExternSet_DefSeed()) {
+    fprintf(stderr, "translation units hash with different seeds\n");
+    return 1;
+  }
+
+  ExternSet set = ExternSet_new(0);
+  int failures = 0;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    // Growth goes through ExternSet_InsertNew_(), which rehashes there.
+    ExternSet_insert(&set, &i);
+  }
+  ExternSet_rehash(&set, 4096);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    if (!ExternSet_contains(&set, &i)) {
+      fprintf(stderr, "lost %llu\n", (unsigned long long)i);
+      ++failures;
+    }
+  }
+  ExternSet_destroy(&set);
+  return failures != 0;
+}
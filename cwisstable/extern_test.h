@@ -0,0 +1,31 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A table declared with `CWISS_DECLARE_FLAT_HASHSET_EXTERN` and defined in
+// extern_test_def.c, shared between that translation unit and
+// extern_test.c.
+
+#ifndef CWISSTABLE_EXTERN_TEST_H_
+#define CWISSTABLE_EXTERN_TEST_H_
+
+#include <stdint.h>
+
+#include "cwisstable.h"
+
+CWISS_DECLARE_FLAT_HASHSET_EXTERN(ExternSet, uint64_t);
+
+/// Returns the hash seed of extern_test_def.c.
+const void* ExternSet_DefSeed(void);
+
+#endif  // CWISSTABLE_EXTERN_TEST_H_
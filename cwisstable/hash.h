@@ -37,10 +37,15 @@
 ///   - `size_t CWISS_<Hash>_Finish(State)`, digest the state into a final hash
 ///     value.
 ///
-/// Currently available are two hashes: `FxHash`, which is small and fast, and
-/// `AbslHash`, the hash function used by Abseil.
+/// Currently available are three hashes: `FxHash`, which is small and fast,
+/// `AbslHash`, the hash function used by Abseil, and `BufferedHash`, a variant
+/// of `AbslHash` for keys that are hashed a few bytes at a time.
 ///
 /// `AbslHash` is the default hash function.
+///
+/// Additionally, `CWISS_Fingerprint64()` is a one-shot hash that, unlike the
+/// above, is not seeded per process, and so is suitable for fingerprints that
+/// outlive the process computing them.
 
 CWISS_BEGIN
 CWISS_BEGIN_EXTERN
@@ -111,6 +116,150 @@ static inline size_t CWISS_AbslHash_Finish(CWISS_AbslHash_State state) {
   return state;
 }
 
+/// The size of the blocks that `BufferedHash` mixes.
+#define CWISS_BufferedHash_kBlockSize ((size_t)16)
+
+/// `AbslHash` mixes every `Write()` into the state on its own, which costs a
+/// 128-bit multiply per call. Hashing a struct field by field thus pays one
+/// multiply per field, however small the fields are.
+///
+/// `BufferedHash` instead packs writes into a 16-byte block, held as two
+/// words, and mixes a whole block at once with a single multiply, as
+/// `AbslHash`'s bulk hash does. A partial block is mixed at `Finish()`, which
+/// then mixes in the length with a fixed multiplier. Keys of up to 16 bytes
+/// thus cost two multiplies in total, however many fields they have. When the
+/// writes are inlined and their sizes are constants, as they are in a policy's
+/// hash function, the packing folds into a few shifts.
+///
+/// The result depends only on the sequence of bytes written, not on how it is
+/// split into `Write()` calls: writing "ab" has the same hash as writing "a"
+/// and then "b". Like `AbslHash`, it is seeded per process, so it must not be
+/// persisted, and it differs from `AbslHash` for the same bytes.
+///
+/// Prefer `AbslHash` for keys that are mostly long strings; it hashes long
+/// writes several blocks at a time.
+typedef struct {
+  CWISS_AbslHash_State_ state_;
+  /// The bytes of the current block, in little-endian order.
+  uint64_t lo_, hi_;
+  /// The total number of bytes written; the current block holds the last
+  /// `len_ % CWISS_BufferedHash_kBlockSize` of them.
+  size_t len_;
+} CWISS_BufferedHash_State;
+#define CWISS_BufferedHash_kInit \
+  ((CWISS_BufferedHash_State){CWISS_AbslHash_kInit_, 0, 0, 0})
+
+/// Loads `len` bytes, between one and eight, as a little-endian integer.
+static inline uint64_t CWISS_BufferedHash_Load(const char* p, size_t len) {
+  uint64_t v = 0;
+  memcpy(&v, p, len);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/// Mixes the block `lo`, `hi` into `state`, with the given salt.
+static inline void CWISS_BufferedHash_MixBlock(CWISS_AbslHash_State_* state,
+                                               uint64_t lo, uint64_t hi,
+                                               uint64_t salt) {
+  *state = CWISS_AbslHash_LowLevelMix(lo ^ salt, hi ^ *state);
+}
+
+/// Writes `len` bytes, between one and eight, into `state`. They span at most
+/// two words, so this is branchy but straight-line code, which folds into a
+/// few shifts when `len` is a constant; hence it is always inlined.
+CWISS_INLINE_ALWAYS
+static inline void CWISS_BufferedHash_WriteSmall(
+    CWISS_BufferedHash_State* state, const char* p, size_t len) {
+  uint64_t v = CWISS_BufferedHash_Load(p, len);
+  size_t fill = state->len_ % CWISS_BufferedHash_kBlockSize;
+  size_t shift = 8 * (fill % 8);
+  // Where the write ends, relative to the start of the word it begins in.
+  size_t end = fill % 8 + len;
+  state->len_ += len;
+
+  if (fill < 8) {
+    state->lo_ |= v << shift;
+    if (end > 8) state->hi_ = v >> (64 - shift);
+    return;
+  }
+  state->hi_ |= v << shift;
+  if (end < 8) return;
+  CWISS_BufferedHash_MixBlock(&state->state_, state->lo_, state->hi_,
+                              CWISS_AbslHash_kHashSalt[1]);
+  state->lo_ = end > 8 ? v >> (64 - shift) : 0;
+  state->hi_ = 0;
+}
+
+/// Writes `len` bytes, more than eight, into `state`.
+CWISS_INLINE_NEVER
+static void CWISS_BufferedHash_WriteLong(CWISS_BufferedHash_State* state,
+                                         const char* p, size_t len) {
+  const size_t kBlock = CWISS_BufferedHash_kBlockSize;
+  // Fill up the current block a word at a time, then mix whole blocks
+  // straight from `val`, then buffer the rest.
+  while (len > 0 && state->len_ % kBlock != 0) {
+    size_t n = 8 - state->len_ % 8;
+    if (n > len) n = len;
+    CWISS_BufferedHash_WriteSmall(state, p, n);
+    p += n;
+    len -= n;
+  }
+  for (; len >= kBlock; p += kBlock, len -= kBlock) {
+    CWISS_BufferedHash_MixBlock(
+        &state->state_, CWISS_BufferedHash_Load(p, 8),
+        CWISS_BufferedHash_Load(p + 8, 8), CWISS_AbslHash_kHashSalt[1]);
+    state->len_ += kBlock;
+  }
+  while (len > 0) {
+    size_t n = len < 8 ? len : 8;
+    CWISS_BufferedHash_WriteSmall(state, p, n);
+    p += n;
+    len -= n;
+  }
+}
+
+CWISS_INLINE_ALWAYS
+static inline void CWISS_BufferedHash_Write(CWISS_BufferedHash_State* state,
+                                            const void* val, size_t len) {
+  const char* p = (const char*)val;
+  if (CWISS_LIKELY(len <= 8)) {
+    if (len > 0) CWISS_BufferedHash_WriteSmall(state, p, len);
+    return;
+  }
+  CWISS_BufferedHash_WriteLong(state, p, len);
+}
+static inline size_t CWISS_BufferedHash_Finish(
+    CWISS_BufferedHash_State state) {
+  size_t fill = state.len_ % CWISS_BufferedHash_kBlockSize;
+  if (fill != 0) {
+    // Record the number of bytes in the last byte of the block, which a
+    // partial block never uses; otherwise "a" and "a\0" would hash the same.
+    // A different salt keeps the result apart from that of a full block with
+    // the same contents.
+    CWISS_BufferedHash_MixBlock(&state.state_, state.lo_,
+                                state.hi_ | (uint64_t)fill << 56,
+                                CWISS_AbslHash_kHashSalt[2]);
+  }
+  // A block mix multiplies by its high word, so keys whose high words are all
+  // the same are spread only as well as that one multiplier does, and for
+  // some seeds it does badly. Like `AbslHash`, finish with a fixed multiplier.
+  CWISS_AbslHash_Mix(&state.state_, state.len_);
+  return state.state_;
+}
+
+/// Computes a 64-bit fingerprint of `len` bytes at `data`.
+///
+/// The result depends only on the bytes, not on the process or the build, so
+/// fingerprints may be persisted.
+static inline uint64_t CWISS_Fingerprint64(const void* data, size_t len) {
+  // Any value is fine, as long as it never changes.
+  const uint64_t kSeed = UINT64_C(0x3C6EF372FE94F82B);
+  return CWISS_AbslHash_LowLevelHash(data, len, kSeed,
+                                     CWISS_AbslHash_kHashSalt);
+}
+
 CWISS_END_EXTERN
 CWISS_END
 
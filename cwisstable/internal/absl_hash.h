@@ -15,6 +15,7 @@
 #ifndef CWISSTABLE_INTERNAL_ABSL_HASH_H_
 #define CWISSTABLE_INTERNAL_ABSL_HASH_H_
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -132,7 +133,33 @@ static uint64_t CWISS_AbslHash_LowLevelHash(const void* data, size_t len,
 //
 // On other platforms this is still going to be non-deterministic but most
 // probably per-build and not per-process.
-static const void* const CWISS_AbslHash_kSeed = &CWISS_AbslHash_kSeed;
+//
+// A table declared with one of the `_EXTERN` macros may be hashed in one
+// translation unit and rehashed in another, so the seed must then be the same
+// in all of them. Every translation unit therefore defines a weak anchor,
+// which the linker merges into one address.
+//
+// C++ has no weak definitions, so there the anchor is an inline variable
+// instead. Where neither is available, each translation unit keeps its own
+// seed, and `CWISS_DEFINE_HASHSET()` refuses to compile: its tables would lose
+// elements as soon as they were rehashed in another translation unit.
+#if defined(__cplusplus) && __cplusplus >= 201703L
+inline char CWISS_AbslHash_kSeedAnchor;
+  #define CWISS_AbslHash_kSeed ((const void*)&CWISS_AbslHash_kSeedAnchor)
+  #define CWISS_AbslHash_REQUIRE_SHARED_SEED_
+#elif !defined(__cplusplus) && CWISS_HAVE_GCC_ATTRIBUTE(weak)
+__attribute__((weak)) char CWISS_AbslHash_kSeedAnchor;
+  #define CWISS_AbslHash_kSeed ((const void*)&CWISS_AbslHash_kSeedAnchor)
+  #define CWISS_AbslHash_REQUIRE_SHARED_SEED_
+#else
+static const void* const CWISS_AbslHash_kLocalSeed = &CWISS_AbslHash_kLocalSeed;
+  #define CWISS_AbslHash_kSeed CWISS_AbslHash_kLocalSeed
+  // `#error` cannot be expanded from a macro, so this fails a static assertion
+  // instead.
+  #define CWISS_AbslHash_REQUIRE_SHARED_SEED_                               \
+    static_assert(0, "CWISS_DEFINE_HASHSET() needs weak symbols or C++17, " \
+                     "so that every translation unit hashes with one seed");
+#endif
 
 // The salt array used by LowLevelHash. This array is NOT the mechanism used to
 // make absl::Hash non-deterministic between program invocations.  See `Seed()`
@@ -0,0 +1,476 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_ARENA_TABLE_H_
+#define CWISSTABLE_INTERNAL_ARENA_TABLE_H_
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/internal/capacity.h"
+#include "cwisstable/internal/raw_table.h"
+#include "cwisstable/policy.h"
+
+/// A node table whose slots hold 32-bit indices into a table-owned arena,
+/// rather than pointers to separate heap allocations.
+///
+/// Like a node table, elements never move once inserted, so pointers to them
+/// stay valid until they are erased. Unlike one, a slot is four bytes rather
+/// than eight, so the backing array is about half the size and a rehash moves
+/// half as many bytes; elements are packed densely into a few large chunks
+/// instead of one allocation each. A table can hold at most `UINT32_MAX`
+/// elements.
+///
+/// The arena is a sequence of chunks of `2^6`, `2^7`, `2^8`, ... nodes, so the
+/// `i`th node is found with one bit scan, and no chunk is ever reallocated.
+/// Erased nodes go on a free list that is threaded through the nodes
+/// themselves and reused by later insertions.
+///
+/// The table is a `CWISS_RawTable` of indices, but slot policies cannot reach
+/// the arena, so an index cannot be hashed on its own. Instead:
+/// - Lookups pass the raw table a `CWISS_ArenaNeedle`, which carries the arena
+///   along with the key, and a key policy that resolves the candidate index
+///   before calling the element policy's `eq`.
+/// - The raw table never rehashes on its own. Before an insertion that could
+///   make it do so, this table rebuilds the array itself, hashing each element
+///   through the arena; it grows or squashes tombstones under the same rule
+///   as `CWISS_RawTable_rehash_and_grow_if_necessary()`.
+///
+/// The element policy supplies the object, key, and allocator policies; its
+/// slot policy is ignored, and so is `two_choice`.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The base-2 log of the number of nodes in an arena's first chunk.
+#define CWISS_NodeArena_kFirstChunkBits ((uint32_t)6)
+
+/// The number of chunks needed to hold `UINT32_MAX` nodes.
+#define CWISS_NodeArena_kMaxChunks (33 - CWISS_NodeArena_kFirstChunkBits)
+
+/// The null node index, which ends the free list.
+#define CWISS_NodeArena_kNone UINT32_MAX
+
+/// An arena of fixed-size nodes, addressed by 32-bit indices.
+typedef struct {
+  /// The `k`th chunk holds `2^(k + kFirstChunkBits)` nodes; null if it has not
+  /// been allocated yet.
+  char* chunks_[CWISS_NodeArena_kMaxChunks];
+  /// The number of node indices handed out so far, including freed ones.
+  uint32_t used_;
+  /// The most recently freed node, or `kNone`. Each free node starts with the
+  /// index of the next one.
+  uint32_t free_;
+} CWISS_NodeArena;
+
+/// Creates an empty arena.
+static inline CWISS_NodeArena CWISS_NodeArena_new(void) {
+  CWISS_NodeArena self;
+  memset(&self, 0, sizeof(self));
+  self.free_ = CWISS_NodeArena_kNone;
+  return self;
+}
+
+/// Returns the distance between consecutive nodes holding `obj`, which leaves
+/// room for a free list link.
+static inline size_t CWISS_NodeArena_Stride(const CWISS_ObjectPolicy* obj) {
+  size_t size = obj->size < sizeof(uint32_t) ? sizeof(uint32_t) : obj->size;
+  return (size + obj->align - 1) / obj->align * obj->align;
+}
+
+/// Returns the number of nodes in the `k`th chunk.
+static inline size_t CWISS_NodeArena_ChunkLen(size_t k) {
+  return (size_t)1 << (k + CWISS_NodeArena_kFirstChunkBits);
+}
+
+/// Returns the chunk holding the `i`th node, and writes its position within
+/// that chunk to `*offset`.
+static inline size_t CWISS_NodeArena_Locate(uint32_t i, size_t* offset) {
+  uint64_t n = (uint64_t)i + ((uint64_t)1 << CWISS_NodeArena_kFirstChunkBits);
+  uint32_t top = CWISS_BitWidth(n) - 1;
+  *offset = (size_t)(n - ((uint64_t)1 << top));
+  return top - CWISS_NodeArena_kFirstChunkBits;
+}
+
+/// Returns a pointer to the `i`th node, which must have been allocated.
+static inline void* CWISS_NodeArena_get(const CWISS_Policy* policy,
+                                        const CWISS_NodeArena* self,
+                                        uint32_t i) {
+  size_t offset;
+  size_t k = CWISS_NodeArena_Locate(i, &offset);
+  return self->chunks_[k] + offset * CWISS_NodeArena_Stride(policy->obj);
+}
+
+/// Allocates a node, returning its index. Its contents are unspecified.
+static inline uint32_t CWISS_NodeArena_alloc(const CWISS_Policy* policy,
+                                             CWISS_NodeArena* self) {
+  if (self->free_ != CWISS_NodeArena_kNone) {
+    uint32_t i = self->free_;
+    memcpy(&self->free_, CWISS_NodeArena_get(policy, self, i), sizeof(i));
+    return i;
+  }
+
+  CWISS_CHECK(self->used_ != CWISS_NodeArena_kNone, "node arena is full");
+  uint32_t i = self->used_++;
+  size_t offset;
+  size_t k = CWISS_NodeArena_Locate(i, &offset);
+  if (self->chunks_[k] == NULL) {
+    self->chunks_[k] = (char*)policy->alloc->alloc(
+        CWISS_NodeArena_ChunkLen(k) * CWISS_NodeArena_Stride(policy->obj),
+        policy->obj->align);
+  }
+  return i;
+}
+
+/// Returns the `i`th node to the free list. Its element must already have been
+/// destroyed.
+static inline void CWISS_NodeArena_free(const CWISS_Policy* policy,
+                                        CWISS_NodeArena* self, uint32_t i) {
+  memcpy(CWISS_NodeArena_get(policy, self, i), &self->free_, sizeof(i));
+  self->free_ = i;
+}
+
+/// Forgets every node, but keeps the chunks for reuse.
+static inline void CWISS_NodeArena_Reset(CWISS_NodeArena* self) {
+  self->used_ = 0;
+  self->free_ = CWISS_NodeArena_kNone;
+}
+
+/// Frees every chunk. Elements must already have been destroyed.
+static inline void CWISS_NodeArena_destroy(const CWISS_Policy* policy,
+                                           CWISS_NodeArena* self) {
+  for (size_t k = 0; k < CWISS_NodeArena_kMaxChunks; ++k) {
+    if (self->chunks_[k] == NULL) continue;
+    policy->alloc->free(
+        self->chunks_[k],
+        CWISS_NodeArena_ChunkLen(k) * CWISS_NodeArena_Stride(policy->obj),
+        policy->obj->align);
+  }
+  *self = CWISS_NodeArena_new();
+}
+
+/// A key being looked up in an arena table, along with what is needed to
+/// compare it against a slot's index.
+typedef struct {
+  const CWISS_Policy* policy;
+  const CWISS_NodeArena* arena;
+  const void* key;
+} CWISS_ArenaNeedle;
+
+/// Returns the index stored in a slot.
+static inline uint32_t CWISS_ArenaTable_LoadIndex(const void* slot) {
+  uint32_t i;
+  memcpy(&i, slot, sizeof(i));
+  return i;
+}
+
+static inline void CWISS_ArenaTable_IndexCopy(void* dst, const void* src) {
+  memcpy(dst, src, sizeof(uint32_t));
+}
+
+static inline size_t CWISS_ArenaTable_IndexHash(const void* val) {
+  CWISS_CHECK(false, "arena table indices cannot be hashed without the arena");
+  return 0;
+}
+
+static inline bool CWISS_ArenaTable_NeedleEq(const void* needle,
+                                             const void* candidate) {
+  const CWISS_ArenaNeedle* n = (const CWISS_ArenaNeedle*)needle;
+  uint32_t i = CWISS_ArenaTable_LoadIndex(candidate);
+  return n->policy->key->eq(n->key,
+                            CWISS_NodeArena_get(n->policy, n->arena, i));
+}
+
+static inline void CWISS_ArenaTable_IndexInit(void* slot) {}
+
+static inline void CWISS_ArenaTable_IndexTransfer(void* dst, void* src) {
+  memcpy(dst, src, sizeof(uint32_t));
+}
+
+static inline void* CWISS_ArenaTable_IndexGet(void* slot) { return slot; }
+
+static const CWISS_ObjectPolicy CWISS_ArenaTable_kIndexObj = {
+    sizeof(uint32_t), alignof(uint32_t), CWISS_ArenaTable_IndexCopy, NULL};
+
+/// The key policy of the raw table; it compares `CWISS_ArenaNeedle`s against
+/// indices.
+static const CWISS_KeyPolicy CWISS_ArenaTable_kIndexKey = {
+    CWISS_ArenaTable_IndexHash, CWISS_ArenaTable_NeedleEq, false};
+
+static const CWISS_SlotPolicy CWISS_ArenaTable_kIndexSlot = {
+    sizeof(uint32_t),
+    alignof(uint32_t),
+    CWISS_ArenaTable_IndexInit,
+    NULL,
+    CWISS_ArenaTable_IndexTransfer,
+    CWISS_ArenaTable_IndexGet,
+    false,
+};
+
+/// Returns the policy of the raw table of indices behind an arena table whose
+/// elements are described by `policy`.
+static inline CWISS_Policy CWISS_ArenaTable_IndexPolicy(
+    const CWISS_Policy* policy) {
+  CWISS_Policy index = {&CWISS_ArenaTable_kIndexObj,
+                        &CWISS_ArenaTable_kIndexKey, policy->alloc,
+                        &CWISS_ArenaTable_kIndexSlot};
+  return index;
+}
+
+/// An arena table.
+typedef struct {
+  CWISS_RawTable set_;
+  CWISS_NodeArena arena_;
+} CWISS_ArenaTable;
+
+/// An iterator over an arena table.
+typedef struct {
+  CWISS_RawIter it_;
+  CWISS_NodeArena* arena_;
+} CWISS_ArenaIter;
+
+/// Returns the element the iterator points to, or null if it is exhausted.
+static inline void* CWISS_ArenaIter_get(const CWISS_Policy* policy,
+                                        const CWISS_ArenaIter* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  void* slot = CWISS_RawIter_get(&index, &self->it_);
+  if (slot == NULL) return NULL;
+  return CWISS_NodeArena_get(policy, self->arena_,
+                             CWISS_ArenaTable_LoadIndex(slot));
+}
+
+/// Advances the iterator and returns the result of `CWISS_ArenaIter_get()`.
+static inline void* CWISS_ArenaIter_next(const CWISS_Policy* policy,
+                                         CWISS_ArenaIter* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_RawIter_next(&index, &self->it_);
+  return CWISS_ArenaIter_get(policy, self);
+}
+
+/// Creates a new table with the given capacity.
+static inline CWISS_ArenaTable CWISS_ArenaTable_new(const CWISS_Policy* policy,
+                                                    size_t capacity) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_ArenaTable self = {CWISS_RawTable_new(&index, capacity),
+                           CWISS_NodeArena_new()};
+  return self;
+}
+
+/// Destroys every element in the table, without touching the array.
+static inline void CWISS_ArenaTable_DestroyElements(const CWISS_Policy* policy,
+                                                    CWISS_ArenaTable* self) {
+  if (policy->obj->dtor == NULL) return;
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_RawIter it = CWISS_RawTable_iter(&index, &self->set_);
+  for (void* slot = CWISS_RawIter_get(&index, &it); slot != NULL;
+       slot = CWISS_RawIter_next(&index, &it)) {
+    policy->obj->dtor(CWISS_NodeArena_get(policy, &self->arena_,
+                                          CWISS_ArenaTable_LoadIndex(slot)));
+  }
+}
+
+/// Destroys the table, freeing its memory.
+static inline void CWISS_ArenaTable_destroy(const CWISS_Policy* policy,
+                                            CWISS_ArenaTable* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_ArenaTable_DestroyElements(policy, self);
+  CWISS_RawTable_destroy(&index, &self->set_);
+  CWISS_NodeArena_destroy(policy, &self->arena_);
+}
+
+/// Erases every element, keeping the arena's chunks for reuse.
+static inline void CWISS_ArenaTable_clear(const CWISS_Policy* policy,
+                                          CWISS_ArenaTable* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_ArenaTable_DestroyElements(policy, self);
+  CWISS_RawTable_clear(&index, &self->set_);
+  CWISS_NodeArena_Reset(&self->arena_);
+}
+
+/// Hashes the element with index `i`; see `CWISS_ArenaTable_RebuildIndex()`.
+typedef size_t (*CWISS_ArenaHasher)(const void* ctx, uint32_t i);
+
+/// Moves every index in `set`, a raw table of indices, into a new array with
+/// the given capacity, rehashing each one with `hasher`.
+CWISS_INLINE_NEVER
+static void CWISS_ArenaTable_RebuildIndex(const CWISS_Policy* policy,
+                                          CWISS_RawTable* set, size_t capacity,
+                                          CWISS_ArenaHasher hasher,
+                                          const void* ctx) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_RawTable old = *set;
+  *set = CWISS_RawTable_new(&index, capacity);
+  CWISS_DCHECK(set->growth_left_ >= old.size_, "rebuilt table too small");
+
+  CWISS_RawIter it = CWISS_RawTable_iter(&index, &old);
+  for (void* slot = CWISS_RawIter_get(&index, &it); slot != NULL;
+       slot = CWISS_RawIter_next(&index, &it)) {
+    uint32_t i = CWISS_ArenaTable_LoadIndex(slot);
+    size_t dst = CWISS_RawTable_PrepareInsert(&index, set, hasher(ctx, i));
+    memcpy(set->slots_ + dst * sizeof(i), &i, sizeof(i));
+  }
+  CWISS_RawTable_destroy(&index, &old);
+}
+
+/// Returns the capacity to rebuild `set` with to make room for one more
+/// element; see `CWISS_RawTable_rehash_and_grow_if_necessary()`.
+static inline size_t CWISS_ArenaTable_GrowthCapacity(
+    const CWISS_RawTable* set) {
+  size_t capacity = set->capacity_;
+  if (capacity == 0) return 1;
+  if (capacity <= CWISS_Group_kWidth ||
+      set->size_ * UINT64_C(32) > capacity * UINT64_C(25)) {
+    return capacity * 2 + 1;
+  }
+  return capacity;
+}
+
+/// A `CWISS_ArenaHasher` for an arena table; `ctx` is a `CWISS_ArenaNeedle`
+/// with no key.
+static inline size_t CWISS_ArenaTable_HashNode(const void* ctx, uint32_t i) {
+  const CWISS_ArenaNeedle* n = (const CWISS_ArenaNeedle*)ctx;
+  return n->policy->key->hash(CWISS_NodeArena_get(n->policy, n->arena, i));
+}
+
+/// Moves every index into a new array with the given capacity.
+static inline void CWISS_ArenaTable_Rebuild(const CWISS_Policy* policy,
+                                            CWISS_ArenaTable* self,
+                                            size_t capacity) {
+  CWISS_ArenaNeedle ctx = {policy, &self->arena_, NULL};
+  CWISS_ArenaTable_RebuildIndex(policy, &self->set_, capacity,
+                                CWISS_ArenaTable_HashNode, &ctx);
+}
+
+/// Ensures that at least `n` elements can be held without a rehash.
+static inline void CWISS_ArenaTable_reserve(const CWISS_Policy* policy,
+                                            CWISS_ArenaTable* self, size_t n) {
+  if (n <= self->set_.size_ + self->set_.growth_left_) return;
+  CWISS_ArenaTable_Rebuild(
+      policy, self,
+      CWISS_NormalizeCapacity(CWISS_GrowthToLowerboundCapacity(n)));
+}
+
+/// Returns the number of elements in the table.
+static inline size_t CWISS_ArenaTable_size(const CWISS_Policy* policy,
+                                           const CWISS_ArenaTable* self) {
+  return self->set_.size_;
+}
+
+/// Returns the number of slots in the table's array.
+static inline size_t CWISS_ArenaTable_capacity(const CWISS_Policy* policy,
+                                               const CWISS_ArenaTable* self) {
+  return self->set_.capacity_;
+}
+
+/// Returns an iterator over the table.
+static inline CWISS_ArenaIter CWISS_ArenaTable_iter(const CWISS_Policy* policy,
+                                                    CWISS_ArenaTable* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_ArenaIter it = {CWISS_RawTable_iter(&index, &self->set_),
+                        &self->arena_};
+  return it;
+}
+
+/// Finds `key`, whose hash is `hash`, returning an exhausted iterator if it is
+/// not present.
+static inline CWISS_ArenaIter CWISS_ArenaTable_find_hinted(
+    const CWISS_Policy* policy, const CWISS_ArenaTable* self, const void* key,
+    size_t hash) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_ArenaNeedle needle = {policy, &self->arena_, key};
+  CWISS_ArenaIter it = {
+      CWISS_RawTable_find_hinted(&index, &CWISS_ArenaTable_kIndexKey,
+                                 &self->set_, &needle, hash),
+      (CWISS_NodeArena*)&self->arena_};
+  return it;
+}
+
+/// Finds `key`, returning an exhausted iterator if it is not present.
+static inline CWISS_ArenaIter CWISS_ArenaTable_find(
+    const CWISS_Policy* policy, const CWISS_ArenaTable* self, const void* key) {
+  return CWISS_ArenaTable_find_hinted(policy, self, key,
+                                      policy->key->hash(key));
+}
+
+/// Returns whether `key` is present.
+static inline bool CWISS_ArenaTable_contains(const CWISS_Policy* policy,
+                                             const CWISS_ArenaTable* self,
+                                             const void* key) {
+  CWISS_ArenaIter it = CWISS_ArenaTable_find(policy, self, key);
+  return it.it_.slot_ != NULL;
+}
+
+/// The return type of `CWISS_ArenaTable_insert()`.
+typedef struct {
+  CWISS_ArenaIter iter;
+  bool inserted;
+} CWISS_ArenaInsert;
+
+/// Inserts a copy of `val` if no equal element is present.
+static inline CWISS_ArenaInsert CWISS_ArenaTable_insert(
+    const CWISS_Policy* policy, CWISS_ArenaTable* self, const void* val) {
+  size_t hash = policy->key->hash(val);
+  if (CWISS_UNLIKELY(self->set_.growth_left_ == 0)) {
+    // The raw table would rehash on its own if `val` is absent.
+    CWISS_ArenaIter it = CWISS_ArenaTable_find_hinted(policy, self, val, hash);
+    if (it.it_.slot_ != NULL) return (CWISS_ArenaInsert){it, false};
+    CWISS_ArenaTable_Rebuild(policy, self,
+                             CWISS_ArenaTable_GrowthCapacity(&self->set_));
+  }
+
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  CWISS_ArenaNeedle needle = {policy, &self->arena_, val};
+  CWISS_PrepareInsert res = CWISS_RawTable_FindOrPrepareInsertHinted(
+      &index, &CWISS_ArenaTable_kIndexKey, &self->set_, &needle, hash);
+  if (res.inserted) {
+    uint32_t i = CWISS_NodeArena_alloc(policy, &self->arena_);
+    policy->obj->copy(CWISS_NodeArena_get(policy, &self->arena_, i), val);
+    memcpy(self->set_.slots_ + res.index * sizeof(i), &i, sizeof(i));
+  }
+  CWISS_ArenaIter it = {CWISS_RawTable_iter_at(&index, &self->set_, res.index),
+                        &self->arena_};
+  return (CWISS_ArenaInsert){it, res.inserted};
+}
+
+/// Erases the element the given valid iterator points to.
+static inline void CWISS_ArenaTable_erase_at(const CWISS_Policy* policy,
+                                             CWISS_ArenaIter it) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy);
+  uint32_t i = CWISS_ArenaTable_LoadIndex(it.it_.slot_);
+  if (policy->obj->dtor != NULL) {
+    policy->obj->dtor(CWISS_NodeArena_get(policy, it.arena_, i));
+  }
+  CWISS_NodeArena_free(policy, it.arena_, i);
+  CWISS_RawTable_erase_at(&index, it.it_);
+}
+
+/// Erases `key`, if present. Returns whether it was.
+static inline bool CWISS_ArenaTable_erase(const CWISS_Policy* policy,
+                                          CWISS_ArenaTable* self,
+                                          const void* key) {
+  CWISS_ArenaIter it = CWISS_ArenaTable_find(policy, self, key);
+  if (it.it_.slot_ == NULL) return false;
+  CWISS_ArenaTable_erase_at(policy, it);
+  return true;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_ARENA_TABLE_H_
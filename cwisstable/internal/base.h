@@ -29,6 +29,15 @@
 /// - `CWISS_ATOMIC_INC(value)` will atomically increment `value` without
 ///   performing synchronization. This is used as a weak entropy source
 ///   elsewhere.
+/// - `CWISS_ATOMIC_LOAD_RELAXED(value)`, `CWISS_ATOMIC_EXCHANGE_ACQUIRE(value,
+///   x)` and `CWISS_ATOMIC_STORE_RELEASE(value, x)` are the operations needed
+///   to build a lock.
+/// - `CWISS_ATOMIC_STORE_RELAXED(value, x)`,
+///   `CWISS_ATOMIC_FETCH_ADD_RELAXED(value, x)` and
+///   `CWISS_ATOMIC_CAS_RELAXED(value, expected, x)`, together with the relaxed
+///   load, are the operations needed to build a counter. The last is a strong
+///   compare-and-swap that takes `expected` by pointer, and updates it on
+///   failure.
 ///
 /// `extern "C"` support via `CWISS_END_EXTERN` and `CWISS_END_EXTERN`,
 /// which open and close an `extern "C"` block in C++ mode.
@@ -36,6 +45,19 @@
   #include <atomic>
   #define CWISS_ATOMIC_T(Type_) std::atomic<Type_>
   #define CWISS_ATOMIC_INC(val_) (val_).fetch_add(1, std::memory_order_relaxed)
+  #define CWISS_ATOMIC_LOAD_RELAXED(val_) (val_).load(std::memory_order_relaxed)
+  #define CWISS_ATOMIC_EXCHANGE_ACQUIRE(val_, x_) \
+    (val_).exchange((x_), std::memory_order_acquire)
+  #define CWISS_ATOMIC_STORE_RELEASE(val_, x_) \
+    (val_).store((x_), std::memory_order_release)
+  #define CWISS_ATOMIC_STORE_RELAXED(val_, x_) \
+    (val_).store((x_), std::memory_order_relaxed)
+  #define CWISS_ATOMIC_FETCH_ADD_RELAXED(val_, x_) \
+    (val_).fetch_add((x_), std::memory_order_relaxed)
+  #define CWISS_ATOMIC_CAS_RELAXED(val_, expected_, x_) \
+    (val_).compare_exchange_strong(*(expected_), (x_), \
+                                   std::memory_order_relaxed, \
+                                   std::memory_order_relaxed)
 
   #define CWISS_BEGIN_EXTERN extern "C" {
   #define CWISS_END_EXTERN }
@@ -44,6 +66,20 @@
   #define CWISS_ATOMIC_T(Type_) _Atomic(Type_)
   #define CWISS_ATOMIC_INC(val_) \
     atomic_fetch_add_explicit(&(val_), 1, memory_order_relaxed)
+  #define CWISS_ATOMIC_LOAD_RELAXED(val_) \
+    atomic_load_explicit(&(val_), memory_order_relaxed)
+  #define CWISS_ATOMIC_EXCHANGE_ACQUIRE(val_, x_) \
+    atomic_exchange_explicit(&(val_), (x_), memory_order_acquire)
+  #define CWISS_ATOMIC_STORE_RELEASE(val_, x_) \
+    atomic_store_explicit(&(val_), (x_), memory_order_release)
+  #define CWISS_ATOMIC_STORE_RELAXED(val_, x_) \
+    atomic_store_explicit(&(val_), (x_), memory_order_relaxed)
+  #define CWISS_ATOMIC_FETCH_ADD_RELAXED(val_, x_) \
+    atomic_fetch_add_explicit(&(val_), (x_), memory_order_relaxed)
+  #define CWISS_ATOMIC_CAS_RELAXED(val_, expected_, x_) \
+    atomic_compare_exchange_strong_explicit(&(val_), (expected_), (x_), \
+                                            memory_order_relaxed, \
+                                            memory_order_relaxed)
 
   #define CWISS_BEGIN_EXTERN
   #define CWISS_END_EXTERN
@@ -124,6 +160,18 @@
   #endif
 #endif
 
+/// `CWISS_HAVE_AVX2` is nonzero if we have AVX2 support.
+///
+/// `-DCWISS_HAVE_AVX2` can be used to override it; it is otherwise detected
+/// via the usual non-portable feature-detection macros.
+#ifndef CWISS_HAVE_AVX2
+  #ifdef __AVX2__
+    #define CWISS_HAVE_AVX2 1
+  #else
+    #define CWISS_HAVE_AVX2 0
+  #endif
+#endif
+
 #if CWISS_HAVE_SSE2
   #include <emmintrin.h>
 #endif
@@ -135,6 +183,13 @@
   #include <tmmintrin.h>
 #endif
 
+#if CWISS_HAVE_AVX2
+  #if !CWISS_HAVE_SSSE3
+    #error "Bad configuration: AVX2 implies SSSE3!"
+  #endif
+  #include <immintrin.h>
+#endif
+
 /// `CWISS_HAVE_BUILTIN` will, in Clang, detect whether a Clang language
 /// extension is enabled.
 ///
@@ -226,6 +281,51 @@
   #define CWISS_PREFETCH(addr_, locality_) ((void)0)
 #endif
 
+/// `CWISS_HAVE_USDT` is nonzero if tables should emit USDT (userspace
+/// statically-defined tracing) probes, which tools like `bpftrace` and `perf`
+/// can attach to at runtime.
+///
+/// This is off by default; `-DCWISS_HAVE_USDT=1` turns it on, and requires
+/// `<sys/sdt.h>` (from SystemTap). A probe that nothing is attached to is a
+/// single `nop`, plus whatever it takes to have its arguments on hand.
+///
+/// `CWISS_TRACEn(name_, ...)` fires the probe `cwisstable:name_` with `n`
+/// arguments, all of which must be integers or pointers.
+#ifndef CWISS_HAVE_USDT
+  #define CWISS_HAVE_USDT 0
+#endif
+
+#if CWISS_HAVE_USDT
+  #include <sys/sdt.h>
+  #define CWISS_TRACE3(name_, a_, b_, c_) \
+    DTRACE_PROBE3(cwisstable, name_, a_, b_, c_)
+  #define CWISS_TRACE4(name_, a_, b_, c_, d_) \
+    DTRACE_PROBE4(cwisstable, name_, a_, b_, c_, d_)
+  #define CWISS_TRACE5(name_, a_, b_, c_, d_, e_) \
+    DTRACE_PROBE5(cwisstable, name_, a_, b_, c_, d_, e_)
+#else
+  #define CWISS_TRACE3(name_, a_, b_, c_) ((void)(a_), (void)(b_), (void)(c_))
+  #define CWISS_TRACE4(name_, a_, b_, c_, d_) \
+    (CWISS_TRACE3(name_, a_, b_, c_), (void)(d_))
+  #define CWISS_TRACE5(name_, a_, b_, c_, d_, e_) \
+    (CWISS_TRACE4(name_, a_, b_, c_, d_), (void)(e_))
+#endif
+
+/// `CWISS_HAVE_MMAP` is nonzero on systems that expose POSIX.1-2008 (which,
+/// with glibc, a strict `-std=c11` does not), and so have `mmap()` and
+/// `msync()`. `madvise()` is not POSIX; see `CWISS_HAVE_MADVISE`.
+#ifndef CWISS_HAVE_MMAP
+  #if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+  #endif
+  #if defined(__APPLE__) || \
+      (defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L)
+    #define CWISS_HAVE_MMAP 1
+  #else
+    #define CWISS_HAVE_MMAP 0
+  #endif
+#endif
+
 /// `CWISS_HAVE_ASAN` and `CWISS_HAVE_MSAN` detect the presence of some of the
 /// sanitizers.
 #if defined(__SANITIZE_ADDRESS__) || CWISS_HAVE_FEATURE(address_sanitizer)
@@ -106,6 +106,21 @@ static inline uint32_t CWISS_LeadingZeroes64(uint64_t x) {
 #endif
 }
 
+/// Counts the number of one bits in the binary representation of `x`.
+CWISS_INLINE_ALWAYS
+static inline uint32_t CWISS_PopCount64(uint64_t x) {
+#if CWISS_HAVE_CLANG_BUILTIN(__builtin_popcountll) || CWISS_IS_GCC
+  static_assert(sizeof(unsigned long long) == sizeof(x),
+                "__builtin_popcountll does not take 64-bit arg");
+  return (uint32_t)__builtin_popcountll(x);
+#else
+  x -= (x >> 1) & 0x5555555555555555;
+  x = (x & 0x3333333333333333) + ((x >> 2) & 0x3333333333333333);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0F;
+  return (uint32_t)((x * 0x0101010101010101) >> 56);
+#endif
+}
+
 /// Counts the number of trailing zeroes in the binary representation of `x_` in
 /// a type-generic fashion.
 #define CWISS_TrailingZeros(x_) (CWISS_TrailingZeroes64(x_))
@@ -137,6 +152,17 @@ static inline CWISS_U128 CWISS_Mul128(uint64_t a, uint64_t b) {
   return (CWISS_U128){(uint64_t)p, (uint64_t)(p >> 64)};
 }
 
+/// Advances the pseudorandom number generator state `*state`, returning 64
+/// pseudorandom bits.
+///
+/// This is wyrand: it is fast and statistically sound, but in no way
+/// cryptographically secure. Any value is a valid initial state.
+static inline uint64_t CWISS_Random64(uint64_t* state) {
+  *state += UINT64_C(0xa0761d6478bd642f);
+  CWISS_U128 p = CWISS_Mul128(*state, *state ^ UINT64_C(0xe7037ed1a0b428db));
+  return p.hi ^ p.lo;
+}
+
 /// Loads an unaligned u32.
 static inline uint32_t CWISS_Load32(const void* p) {
   uint32_t v;
@@ -219,6 +245,11 @@ static inline uint32_t CWISS_BitMask_LeadingZeros(const CWISS_BitMask* self) {
          self->shift;
 }
 
+/// Returns the number of abstract bits set in `self`.
+static inline uint32_t CWISS_BitMask_Count(const CWISS_BitMask* self) {
+  return CWISS_PopCount64(self->mask);
+}
+
 /// Iterates over the one bits in the mask.
 ///
 /// If the mask is empty, returns `false`; otherwise, returns the index of the
@@ -131,6 +131,22 @@ static inline void CWISS_ResetCtrl(size_t capacity, CWISS_ControlByte* ctrl,
   CWISS_PoisonMemory(slots, slot_size * capacity);
 }
 
+/// Like `CWISS_ResetCtrl()`, but for a `ctrl` that is known to be all zero
+/// bytes, such as freshly `calloc()`ed memory.
+///
+/// With `CWISS_ZERO_EMPTY_CTRL`, this writes only the sentinel, leaving the
+/// pages of a large array untouched.
+static inline void CWISS_ResetZeroedCtrl(size_t capacity,
+                                         CWISS_ControlByte* ctrl,
+                                         const void* slots, size_t slot_size) {
+  if (CWISS_kEmpty != 0) {
+    CWISS_ResetCtrl(capacity, ctrl, slots, slot_size);
+    return;
+  }
+  ctrl[capacity] = CWISS_kSentinel;
+  CWISS_PoisonMemory(slots, slot_size * capacity);
+}
+
 /// Sets `ctrl[i]` to `h`.
 ///
 /// Unlike setting it directly, this function will perform bounds checks and
@@ -217,6 +233,15 @@ static inline size_t CWISS_AllocSize(size_t capacity, size_t slot_size,
   return CWISS_SlotOffset(capacity, slot_align) + capacity * slot_size;
 }
 
+/// Given the capacity of a table, computes the number of aligned
+/// `CWISS_Group_kWidth`-wide groups needed to cover the control bytes for the
+/// "real" slots, plus the sentinel.
+///
+/// Group `g` covers slots `[g * kWidth, min((g + 1) * kWidth, capacity))`.
+static inline size_t CWISS_NumGroups(size_t capacity) {
+  return (capacity + CWISS_Group_kWidth) / CWISS_Group_kWidth;
+}
+
 /// Whether a table is "small". A small table fits entirely into a probing
 /// group, i.e., has a capacity equal to the size of a `CWISS_Group`.
 ///
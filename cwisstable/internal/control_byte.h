@@ -47,13 +47,54 @@ CWISS_BEGIN_EXTERN
 /// These values are specifically tuned for SSE-flavored SIMD; future ports to
 /// other SIMD platforms may require choosing new values. The static_asserts
 /// below detail the source of these choices.
+///
+/// Building with `-DCWISS_ZERO_EMPTY_CTRL=1` selects an alternative encoding,
+/// which flips the high bit of every control byte:
+///
+/// ```
+///    empty: 0 0 0 0 0 0 0 0
+///  deleted: 0 1 1 1 1 1 1 0
+///     full: 1 h h h h h h h
+/// sentinel: 0 1 1 1 1 1 1 1
+/// ```
+///
+/// Since an all-zero control array is then entirely empty, a table whose
+/// backing array comes from `calloc()` or fresh `mmap()` pages only needs to
+/// write its sentinel; the rest of the array is not touched, and so does not
+/// become resident, until elements are inserted. This costs an extra
+/// instruction in some of the group operations below.
+#ifndef CWISS_ZERO_EMPTY_CTRL
+  #define CWISS_ZERO_EMPTY_CTRL 0
+#endif
+
 typedef int8_t CWISS_ControlByte;
-#define CWISS_kEmpty (INT8_C(-128))
-#define CWISS_kDeleted (INT8_C(-2))
-#define CWISS_kSentinel (INT8_C(-1))
+#if CWISS_ZERO_EMPTY_CTRL
+  #define CWISS_kEmpty (INT8_C(0))
+  #define CWISS_kDeleted (INT8_C(126))
+  #define CWISS_kSentinel (INT8_C(127))
+#else
+  #define CWISS_kEmpty (INT8_C(-128))
+  #define CWISS_kDeleted (INT8_C(-2))
+  #define CWISS_kSentinel (INT8_C(-1))
+#endif
 // TODO: Wrap CWISS_ControlByte in a single-field struct to get strict-aliasing
 // benefits.
 
+#if CWISS_ZERO_EMPTY_CTRL
+static_assert(CWISS_kEmpty == 0,
+              "CWISS_kEmpty must be 0 so that zeroed memory is empty");
+static_assert((CWISS_kEmpty | CWISS_kDeleted | CWISS_kSentinel) == 0x7F,
+              "Special markers must have a clear MSB to make checking for "
+              "them efficient");
+static_assert(
+    (~CWISS_kEmpty & ~CWISS_kDeleted & CWISS_kSentinel & 0x7F) != 0,
+    "CWISS_kEmpty and CWISS_kDeleted must share an unset bit that is not "
+    "shared by CWISS_kSentinel to make the scalar test for "
+    "MatchEmptyOrDeleted() efficient");
+static_assert(CWISS_kDeleted == 126,
+              "CWISS_kDeleted must be 126 to make the implementation of "
+              "ConvertSpecialToEmptyAndFullToDeleted efficient");
+#else
 static_assert(
     (CWISS_kEmpty & CWISS_kDeleted & CWISS_kSentinel & 0x80) != 0,
     "Special markers need to have the MSB to make checking for them efficient");
@@ -76,6 +117,7 @@ static_assert(
 static_assert(CWISS_kDeleted == -2,
               "CWISS_kDeleted must be -2 to make the implementation of "
               "ConvertSpecialToEmptyAndFullToDeleted efficient");
+#endif
 
 /// Returns a pointer to a control byte group that can be used by empty tables.
 static inline CWISS_ControlByte* CWISS_EmptyGroup() {
@@ -110,10 +152,27 @@ static inline size_t CWISS_H1(size_t hash, const CWISS_ControlByte* ctrl) {
   return (hash >> 7) ^ CWISS_HashSeed(ctrl);
 }
 
+/// Extracts a second H1 from `hash` for tables that probe from two starting
+/// positions; it takes its low bits from the half of `hash` that `CWISS_H1()`
+/// only uses in its high bits.
+static inline size_t CWISS_H1Alt(size_t hash, const CWISS_ControlByte* ctrl) {
+  const size_t half = sizeof(size_t) * 4;
+  return CWISS_H1((hash >> half) | (hash << half), ctrl);
+}
+
 /// Extracts the H2 portion of a hash: the low 7 bits, which can be used as
 /// control byte.
+///
+/// With `CWISS_ZERO_EMPTY_CTRL`, this includes the high bit that marks a full
+/// control byte.
 typedef uint8_t CWISS_h2_t;
-static inline CWISS_h2_t CWISS_H2(size_t hash) { return hash & 0x7F; }
+static inline CWISS_h2_t CWISS_H2(size_t hash) {
+#if CWISS_ZERO_EMPTY_CTRL
+  return (hash & 0x7F) | 0x80;
+#else
+  return hash & 0x7F;
+#endif
+}
 
 /// Returns whether `c` is empty.
 static inline bool CWISS_IsEmpty(CWISS_ControlByte c) {
@@ -121,7 +180,13 @@ static inline bool CWISS_IsEmpty(CWISS_ControlByte c) {
 }
 
 /// Returns whether `c` is full.
-static inline bool CWISS_IsFull(CWISS_ControlByte c) { return c >= 0; }
+static inline bool CWISS_IsFull(CWISS_ControlByte c) {
+#if CWISS_ZERO_EMPTY_CTRL
+  return c < 0;
+#else
+  return c >= 0;
+#endif
+}
 
 /// Returns whether `c` is deleted.
 static inline bool CWISS_IsDeleted(CWISS_ControlByte c) {
@@ -130,7 +195,11 @@ static inline bool CWISS_IsDeleted(CWISS_ControlByte c) {
 
 /// Returns whether `c` is empty or deleted.
 static inline bool CWISS_IsEmptyOrDeleted(CWISS_ControlByte c) {
+#if CWISS_ZERO_EMPTY_CTRL
+  return (uint8_t)c < (uint8_t)CWISS_kSentinel;
+#else
   return c < CWISS_kSentinel;
+#endif
 }
 
 /// Asserts that `ctrl` points to a full control byte.
@@ -213,7 +282,10 @@ static inline CWISS_BitMask CWISS_Group_Match(const CWISS_Group* self,
 
 // Returns a bitmask representing the positions of empty slots.
 static inline CWISS_BitMask CWISS_Group_MatchEmpty(const CWISS_Group* self) {
-  #if CWISS_HAVE_SSSE3
+  #if CWISS_ZERO_EMPTY_CTRL
+  return CWISS_Group_BitMask(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_setzero_si128(), *self)));
+  #elif CWISS_HAVE_SSSE3
   // This only works because ctrl_t::kEmpty is -128.
   return CWISS_Group_BitMask(_mm_movemask_epi8(_mm_sign_epi8(*self, *self)));
   #else
@@ -224,26 +296,56 @@ static inline CWISS_BitMask CWISS_Group_MatchEmpty(const CWISS_Group* self) {
 // Returns a bitmask representing the positions of empty or deleted slots.
 static inline CWISS_BitMask CWISS_Group_MatchEmptyOrDeleted(
     const CWISS_Group* self) {
+  #if CWISS_ZERO_EMPTY_CTRL
+  // Empty and deleted are exactly the bytes that are at most `kDeleted`, when
+  // viewed as unsigned.
+  CWISS_Group deleted = _mm_set1_epi8((char)CWISS_kDeleted);
+  return CWISS_Group_BitMask(_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_min_epu8(*self, deleted), *self)));
+  #else
   CWISS_Group special = _mm_set1_epi8((uint8_t)CWISS_kSentinel);
   return CWISS_Group_BitMask(
       _mm_movemask_epi8(CWISS_mm_cmpgt_epi8_fixed(special, *self)));
+  #endif
+}
+
+// Returns a bitmask representing the positions of full slots.
+static inline CWISS_BitMask CWISS_Group_MatchFull(const CWISS_Group* self) {
+  #if CWISS_ZERO_EMPTY_CTRL
+  // Only full control bytes have a set sign bit.
+  return CWISS_Group_BitMask(_mm_movemask_epi8(*self));
+  #else
+  // Only full control bytes have a clear sign bit.
+  return CWISS_Group_BitMask(_mm_movemask_epi8(*self) ^ 0xffff);
+  #endif
 }
 
 // Returns the number of trailing empty or deleted elements in the group.
 static inline uint32_t CWISS_Group_CountLeadingEmptyOrDeleted(
     const CWISS_Group* self) {
+  #if CWISS_ZERO_EMPTY_CTRL
+  return CWISS_TrailingZeros(
+      (uint32_t)(CWISS_Group_MatchEmptyOrDeleted(self).mask + 1));
+  #else
   CWISS_Group special = _mm_set1_epi8((uint8_t)CWISS_kSentinel);
   return CWISS_TrailingZeros((uint32_t)(
       _mm_movemask_epi8(CWISS_mm_cmpgt_epi8_fixed(special, *self)) + 1));
+  #endif
 }
 
 static inline void CWISS_Group_ConvertSpecialToEmptyAndFullToDeleted(
     const CWISS_Group* self, CWISS_ControlByte* dst) {
-  CWISS_Group msbs = _mm_set1_epi8((char)-128);
   CWISS_Group x126 = _mm_set1_epi8(126);
-  #if CWISS_HAVE_SSSE3
+  #if CWISS_ZERO_EMPTY_CTRL
+  // Full bytes are negative; they become `kDeleted` and the rest `kEmpty`.
+  CWISS_Group full_mask =
+      CWISS_mm_cmpgt_epi8_fixed(_mm_setzero_si128(), *self);
+  CWISS_Group res = _mm_and_si128(full_mask, x126);
+  #elif CWISS_HAVE_SSSE3
+  CWISS_Group msbs = _mm_set1_epi8((char)-128);
   CWISS_Group res = _mm_or_si128(_mm_shuffle_epi8(x126, *self), msbs);
   #else
+  CWISS_Group msbs = _mm_set1_epi8((char)-128);
   CWISS_Group zero = _mm_setzero_si128();
   CWISS_Group special_mask = CWISS_mm_cmpgt_epi8_fixed(zero, *self);
   CWISS_Group res = _mm_or_si128(msbs, _mm_andnot_si128(special_mask, x126));
@@ -283,21 +385,39 @@ static inline CWISS_BitMask CWISS_Group_Match(const CWISS_Group* self,
   return CWISS_Group_BitMask((x - lsbs) & ~x & msbs);
 }
 
+// With `CWISS_ZERO_EMPTY_CTRL`, the functions below are the same as for the
+// default encoding, with the sign bit of each byte flipped.
+  #if CWISS_ZERO_EMPTY_CTRL
+    #define CWISS_Group_SignBits(x_) (~(x_))
+  #else
+    #define CWISS_Group_SignBits(x_) (x_)
+  #endif
+
 static inline CWISS_BitMask CWISS_Group_MatchEmpty(const CWISS_Group* self) {
   uint64_t msbs = 0x8080808080808080ULL;
-  return CWISS_Group_BitMask((*self & (~*self << 6)) & msbs);
+  return CWISS_Group_BitMask((CWISS_Group_SignBits(*self) & (~*self << 6)) &
+                             msbs);
 }
 
 static inline CWISS_BitMask CWISS_Group_MatchEmptyOrDeleted(
     const CWISS_Group* self) {
   uint64_t msbs = 0x8080808080808080ULL;
-  return CWISS_Group_BitMask((*self & (~*self << 7)) & msbs);
+  return CWISS_Group_BitMask((CWISS_Group_SignBits(*self) & (~*self << 7)) &
+                             msbs);
+}
+
+static inline CWISS_BitMask CWISS_Group_MatchFull(const CWISS_Group* self) {
+  uint64_t msbs = 0x8080808080808080ULL;
+  return CWISS_Group_BitMask(~CWISS_Group_SignBits(*self) & msbs);
 }
 
 static inline uint32_t CWISS_Group_CountLeadingEmptyOrDeleted(
     const CWISS_Group* self) {
   uint64_t gaps = 0x00FEFEFEFEFEFEFEULL;
-  return (CWISS_TrailingZeros(((~*self & (*self >> 7)) | gaps) + 1) + 7) >> 3;
+  return (CWISS_TrailingZeros(
+              ((~*self & (CWISS_Group_SignBits(*self) >> 7)) | gaps) + 1) +
+          7) >>
+         3;
 }
 
 static inline void CWISS_Group_ConvertSpecialToEmptyAndFullToDeleted(
@@ -305,11 +425,36 @@ static inline void CWISS_Group_ConvertSpecialToEmptyAndFullToDeleted(
   uint64_t msbs = 0x8080808080808080ULL;
   uint64_t lsbs = 0x0101010101010101ULL;
   uint64_t x = *self & msbs;
+  #if CWISS_ZERO_EMPTY_CTRL
+  uint64_t res = (x - (x >> 7)) & ~lsbs;
+  #else
   uint64_t res = (~x + (x >> 7)) & ~lsbs;
+  #endif
   memcpy(dst, &res, sizeof(res));
 }
 #endif  // CWISS_HAVE_SSE2
 
+/// Returns whether no probe window containing slot `i` of the control bytes
+/// `ctrl`, of a table with the given capacity, can have been seen full, so
+/// that a lookup would not have probed past it. If so, the slot can be marked
+/// as empty after erasing it; otherwise it must become a tombstone.
+static inline bool CWISS_WasNeverFull(const CWISS_ControlByte* ctrl,
+                                      size_t capacity, size_t i) {
+  const size_t index_before = (i - CWISS_Group_kWidth) & capacity;
+  CWISS_Group g_after = CWISS_Group_new(ctrl + i);
+  CWISS_BitMask empty_after = CWISS_Group_MatchEmpty(&g_after);
+  CWISS_Group g_before = CWISS_Group_new(ctrl + index_before);
+  CWISS_BitMask empty_before = CWISS_Group_MatchEmpty(&g_before);
+
+  // We count how many consecutive non empties we have to the right and to the
+  // left of `i`. If the sum is >= kWidth then there is at least one probe
+  // window that might have seen a full group.
+  return empty_before.mask && empty_after.mask &&
+         (size_t)(CWISS_BitMask_TrailingZeros(&empty_after) +
+                  CWISS_BitMask_LeadingZeros(&empty_before)) <
+             CWISS_Group_kWidth;
+}
+
 CWISS_END_EXTERN
 CWISS_END
 
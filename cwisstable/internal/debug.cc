@@ -32,11 +32,14 @@
 #include <algorithm>
 
 namespace cwisstable::internal {
-size_t GetHashtableDebugNumProbes(const CWISS_Policy* policy,
-                                  const CWISS_RawTable* set, const void* key) {
+namespace {
+// Counts the probes needed to look up `key` along `seq`; `found` records
+// whether it was found along the way.
+size_t NumProbesAlong(const CWISS_Policy* policy, const CWISS_RawTable* set,
+                      const void* key, size_t hash, CWISS_ProbeSeq seq,
+                      bool* found) {
   size_t num_probes = 0;
-  size_t hash = policy->key->hash(key);
-  auto seq = CWISS_ProbeSeq_Start(set->ctrl_, hash, set->capacity_);
+  *found = false;
   while (true) {
     auto g = CWISS_Group_new(set->ctrl_ + seq.offset_);
     auto match = CWISS_Group_Match(&g, CWISS_H2(hash));
@@ -44,7 +47,10 @@ size_t GetHashtableDebugNumProbes(const CWISS_Policy* policy,
     while (CWISS_BitMask_next(&match, &i)) {
       size_t idx = CWISS_ProbeSeq_offset(&seq, i);
       char* slot = set->slots_ + idx * policy->slot->size;
-      if (CWISS_LIKELY(policy->key->eq(slot, key))) return num_probes;
+      if (CWISS_LIKELY(policy->key->eq(slot, key))) {
+        *found = true;
+        return num_probes;
+      }
 
       ++num_probes;
     }
@@ -53,6 +59,25 @@ size_t GetHashtableDebugNumProbes(const CWISS_Policy* policy,
     ++num_probes;
   }
 }
+}  // namespace
+
+size_t GetHashtableDebugNumProbes(const CWISS_Policy* policy,
+                                  const CWISS_RawTable* set, const void* key) {
+  size_t hash = policy->key->hash(key);
+  bool found;
+  size_t num_probes = NumProbesAlong(
+      policy, set, key, hash,
+      CWISS_ProbeSeq_Start(set->ctrl_, hash, set->capacity_), &found);
+  if (found || !policy->key->two_choice || CWISS_IsSmall(set->capacity_)) {
+    return num_probes;
+  }
+  // Two-choice tables probe both sequences side by side, so an element in the
+  // second one costs as many probes as it takes to get there.
+  size_t alt_probes = NumProbesAlong(
+      policy, set, key, hash,
+      CWISS_ProbeSeq_StartAlt(set->ctrl_, hash, set->capacity_), &found);
+  return found ? alt_probes : (std::max)(num_probes, alt_probes);
+}
 
 size_t AllocatedByteSize(const CWISS_Policy* policy,
                          const CWISS_RawTable* set) {
@@ -0,0 +1,232 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_DISTINCT_COUNTER_H_
+#define CWISSTABLE_INTERNAL_DISTINCT_COUNTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/internal/int_table.h"
+
+/// A distinct-value counter that is exact while small and approximate once it
+/// would outgrow a memory budget.
+///
+/// The counter starts out as an integer set (see `int_table.h`) of 64-bit
+/// hashes, so `count()` is exact. When an insertion would grow the set's
+/// backing array past `max_bytes`, the counter becomes a HyperLogLog sketch
+/// instead, which has a constant size and a relative standard error of about
+/// `1.04 / sqrt(m)` for `m` registers.
+///
+/// The conversion happens in place, without allocating and without hashing
+/// anything again. The stored hashes are first compacted to the front of the
+/// backing array, which a table at its maximum load has room for, since each
+/// group stores 8 keys in 72 bytes. The registers then take the rest of the
+/// array; with a capacity of `c` slots, there are `2 * c` of them, one byte
+/// each. Finally, the compacted hashes are fed into the registers.
+///
+/// Hashes must be well-mixed in all 64 bits, since the top bits pick a
+/// register and the rest determine its value.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The integer-table policy for the exact representation: a set of hashes.
+static const CWISS_IntPolicy CWISS_DistinctCounter_kPolicy = {
+    sizeof(uint64_t), 0, 1, &CWISS_IntTable_kAlloc};
+
+/// A distinct-value counter.
+typedef struct {
+  CWISS_IntTable set_;
+  /// The HyperLogLog registers, inside `set_`'s backing array; null while the
+  /// count is exact.
+  uint8_t* registers_;
+  /// The base-2 log of the number of registers.
+  size_t precision_;
+  size_t max_bytes_;
+} CWISS_DistinctCounter;
+
+/// Creates a new counter that stays exact as long as it needs no more than
+/// `max_bytes` of memory.
+static inline CWISS_DistinctCounter CWISS_DistinctCounter_new(
+    size_t max_bytes) {
+  CWISS_DistinctCounter self = {{0}, NULL, 0, max_bytes};
+  return self;
+}
+
+/// Destroys the counter, freeing its memory.
+static inline void CWISS_DistinctCounter_destroy(CWISS_DistinctCounter* self) {
+  CWISS_IntTable_destroy(&CWISS_DistinctCounter_kPolicy, &self->set_);
+}
+
+/// Returns whether `count()` is still exact.
+static inline bool CWISS_DistinctCounter_is_exact(
+    const CWISS_DistinctCounter* self) {
+  return self->registers_ == NULL;
+}
+
+/// Returns the size of the backing array of an exact counter with the given
+/// capacity.
+static inline size_t CWISS_DistinctCounter_AllocSize(size_t capacity) {
+  return capacity / CWISS_IntTable_kWidth *
+         CWISS_IntPolicy_GroupSize(&CWISS_DistinctCounter_kPolicy);
+}
+
+/// Records `hash` in the HyperLogLog registers.
+static inline void CWISS_DistinctCounter_AddToSketch(
+    CWISS_DistinctCounter* self, uint64_t hash) {
+  size_t p = self->precision_;
+  size_t index = (size_t)(hash >> (64 - p));
+  // Setting the lowest of the remaining bits caps the rank at `65 - p`.
+  uint64_t rest = (hash << p) | (UINT64_C(1) << (p - 1));
+  uint8_t rank = (uint8_t)(CWISS_LeadingZeros(rest) + 1);
+  if (rank > self->registers_[index]) self->registers_[index] = rank;
+}
+
+/// Converts an exact counter into a HyperLogLog sketch, in place.
+///
+/// The set must have a nonzero capacity.
+CWISS_INLINE_NEVER
+static void CWISS_DistinctCounter_Approximate(CWISS_DistinctCounter* self) {
+  const CWISS_IntPolicy* policy = &CWISS_DistinctCounter_kPolicy;
+  CWISS_IntTable* set = &self->set_;
+  CWISS_DCHECK(set->capacity_ != 0, "cannot approximate an empty table");
+
+  // Compact the hashes to the front of the array. The write cursor never
+  // passes the group being read, because every group is 8 bytes longer than
+  // the keys it holds.
+  size_t n = 0;
+  for (size_t g = 0; g < set->capacity_ / CWISS_IntTable_kWidth; ++g) {
+    const char* group = CWISS_IntTable_Group(policy, set, g);
+    uint32_t full = (uint8_t)group[0];
+    while (full != 0) {
+      uint32_t i = CWISS_TrailingZeros(full);
+      full &= full - 1;
+      uint64_t hash;
+      memcpy(&hash, group + CWISS_IntTable_kKeyOffset + i * sizeof(hash),
+             sizeof(hash));
+      memcpy(set->groups_ + n * sizeof(hash), &hash, sizeof(hash));
+      ++n;
+    }
+  }
+
+  // There are at most `7/8 * capacity` hashes, which take up `7 * capacity`
+  // bytes out of `9 * capacity`.
+  size_t registers = 2 * set->capacity_;
+  self->precision_ = CWISS_TrailingZeros(registers);
+  self->registers_ = (uint8_t*)set->groups_ +
+                     CWISS_DistinctCounter_AllocSize(set->capacity_) -
+                     registers;
+  CWISS_DCHECK(n * sizeof(uint64_t) <= (size_t)((char*)self->registers_ -
+                                                set->groups_),
+               "hashes overlap registers");
+  memset(self->registers_, 0, registers);
+
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t hash;
+    memcpy(&hash, set->groups_ + i * sizeof(hash), sizeof(hash));
+    CWISS_DistinctCounter_AddToSketch(self, hash);
+  }
+  set->size_ = 0;
+  set->growth_left_ = 0;
+}
+
+/// Adds a value, given its 64-bit hash, to the counter.
+static inline void CWISS_DistinctCounter_add(CWISS_DistinctCounter* self,
+                                             uint64_t hash) {
+  if (CWISS_UNLIKELY(self->registers_ != NULL)) {
+    CWISS_DistinctCounter_AddToSketch(self, hash);
+    return;
+  }
+  CWISS_IntTable* set = &self->set_;
+  if (CWISS_UNLIKELY(set->growth_left_ == 0 && set->capacity_ != 0 &&
+                     CWISS_DistinctCounter_AllocSize(2 * set->capacity_) >
+                         self->max_bytes_ &&
+                     !CWISS_IntTable_contains(&CWISS_DistinctCounter_kPolicy,
+                                              set, hash))) {
+    CWISS_DistinctCounter_Approximate(self);
+    CWISS_DistinctCounter_AddToSketch(self, hash);
+    return;
+  }
+  CWISS_IntTable_insert(&CWISS_DistinctCounter_kPolicy, set, hash);
+}
+
+/// Returns the natural logarithm of `x`, which must be at least 1.
+///
+/// This avoids depending on `libm` for a single call.
+static inline double CWISS_DistinctCounter_Log(double x) {
+  const double kLn2 = 0.69314718055994530942;
+  double result = 0;
+  while (x >= 2) {
+    x /= 2;
+    result += kLn2;
+  }
+  // ln(x) = 2 * atanh((x - 1) / (x + 1)), with |t| <= 1/3 here.
+  double t = (x - 1) / (x + 1);
+  double t2 = t * t;
+  double term = t;
+  for (int k = 1; k < 40; k += 2) {
+    result += 2 * term / k;
+    term *= t2;
+  }
+  return result;
+}
+
+/// Returns the number of distinct values added so far; this is exact as long
+/// as `is_exact()` is.
+static inline double CWISS_DistinctCounter_count(
+    const CWISS_DistinctCounter* self) {
+  if (self->registers_ == NULL) return (double)self->set_.size_;
+
+  size_t m = (size_t)1 << self->precision_;
+  double sum = 0;
+  size_t zeros = 0;
+  for (size_t i = 0; i < m; ++i) {
+    uint8_t r = self->registers_[i];
+    sum += 1.0 / (double)(UINT64_C(1) << r);
+    zeros += r == 0;
+  }
+
+  double alpha;
+  switch (m) {
+    case 16:
+      alpha = 0.673;
+      break;
+    case 32:
+      alpha = 0.697;
+      break;
+    case 64:
+      alpha = 0.709;
+      break;
+    default:
+      alpha = 0.7213 / (1 + 1.079 / (double)m);
+  }
+  double estimate = alpha * (double)m * (double)m / sum;
+
+  // Small-range correction: fall back to linear counting.
+  if (estimate <= 2.5 * (double)m && zeros != 0) {
+    estimate =
+        (double)m * CWISS_DistinctCounter_Log((double)m / (double)zeros);
+  }
+  return estimate;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_DISTINCT_COUNTER_H_
@@ -76,12 +76,20 @@
   CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
 #define CWISS_EXTRACT_key_eq(key_, val_) CWISS_EXTRACT_key_eqZ##key_
 #define CWISS_EXTRACT_key_eqZkey_eq CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
+#define CWISS_EXTRACT_key_two_choice(key_, val_) \
+  CWISS_EXTRACT_key_two_choiceZ##key_
+#define CWISS_EXTRACT_key_two_choiceZkey_two_choice \
+  CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
 #define CWISS_EXTRACT_alloc_alloc(key_, val_) CWISS_EXTRACT_alloc_allocZ##key_
 #define CWISS_EXTRACT_alloc_allocZalloc_alloc \
   CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
 #define CWISS_EXTRACT_alloc_free(key_, val_) CWISS_EXTRACT_alloc_freeZ##key_
 #define CWISS_EXTRACT_alloc_freeZalloc_free \
   CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
+#define CWISS_EXTRACT_alloc_zeroed(key_, val_) \
+  CWISS_EXTRACT_alloc_zeroedZ##key_
+#define CWISS_EXTRACT_alloc_zeroedZalloc_zeroed \
+  CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
 #define CWISS_EXTRACT_slot_size(key_, val_) CWISS_EXTRACT_slot_sizeZ##key_
 #define CWISS_EXTRACT_slot_sizeZslot_size \
   CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
@@ -101,6 +109,10 @@
 #define CWISS_EXTRACT_slot_dtor(key_, val_) CWISS_EXTRACT_slot_dtorZ##key_
 #define CWISS_EXTRACT_slot_dtorZslot_dtor \
   CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
+#define CWISS_EXTRACT_slot_indirect(key_, val_) \
+  CWISS_EXTRACT_slot_indirectZ##key_
+#define CWISS_EXTRACT_slot_indirectZslot_indirect \
+  CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
 #define CWISS_EXTRACT_modifiers(key_, val_) CWISS_EXTRACT_modifiersZ##key_
 #define CWISS_EXTRACT_modifiersZmodifiers \
   CWISS_NOTHING, CWISS_NOTHING, CWISS_NOTHING
@@ -26,11 +26,11 @@ from pathlib import Path
 DEPTH = 64 
 KEYS = [
   'obj_copy', 'obj_dtor',
-  'key_hash', 'key_eq',
-  'alloc_alloc', 'alloc_free',
+  'key_hash', 'key_eq', 'key_two_choice',
+  'alloc_alloc', 'alloc_free', 'alloc_zeroed',
   
   'slot_size', 'slot_align', 'slot_init',
-  'slot_transfer', 'slot_get', 'slot_dtor',
+  'slot_transfer', 'slot_get', 'slot_dtor', 'slot_indirect',
   'modifiers',
 ]
 FILE = Path(__file__).parent / 'extract.h'
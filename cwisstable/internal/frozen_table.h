@@ -0,0 +1,141 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_FROZEN_TABLE_H_
+#define CWISSTABLE_INTERNAL_FROZEN_TABLE_H_
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/raw_table.h"
+#include "cwisstable/policy.h"
+
+/// A table whose key set is sealed, with an atomic counter per key.
+///
+/// A frozen table takes over a fully built `CWISS_RawTable`. From then on no
+/// element is inserted, erased or moved, so a key's slot index never changes,
+/// and lookups only read the table: any number of threads may look keys up
+/// concurrently without a lock. Before sealing, the table's hit counters are
+/// dropped, since those are written to by lookups.
+///
+/// Each slot index has a `CWISS_Counter` in a separate array, so finding a
+/// key's counter is one lookup plus an add; counters of empty slots are never
+/// touched. Counters are either packed, eight to a cache line, or padded to a
+/// cache line each. Packed counters are what most key sets want, since slots
+/// are spread by hash and two hot keys rarely share a line; padding is for a
+/// handful of keys that every thread hammers.
+///
+/// Counter operations are relaxed: they are atomic, but order no other memory
+/// accesses.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// An atomic counter in a frozen table.
+typedef CWISS_ATOMIC_T(int64_t) CWISS_Counter;
+
+/// The assumed size of a cache line.
+#define CWISS_FrozenTable_kCacheLine ((size_t)64)
+
+/// A frozen table.
+typedef struct {
+  CWISS_RawTable table_;
+  /// `table_.capacity_` counters, `stride_` bytes apart.
+  char* counters_;
+  size_t stride_;
+} CWISS_FrozenTable;
+
+/// Seals the elements of `keys` into a new frozen table, with every counter at
+/// zero. `keys` is left empty.
+///
+/// If `padded` is set, each counter gets a cache line to itself.
+static inline CWISS_FrozenTable CWISS_FrozenTable_new(
+    const CWISS_Policy* policy, CWISS_RawTable* keys, bool padded) {
+  CWISS_FrozenTable self = {*keys, NULL, 0};
+  *keys = CWISS_RawTable_new(policy, 0);
+  CWISS_RawTable_DisableHitCounting(policy, &self.table_);
+
+  self.stride_ = padded ? CWISS_FrozenTable_kCacheLine : sizeof(CWISS_Counter);
+  size_t bytes = self.table_.capacity_ * self.stride_;
+  if (bytes != 0) {
+    self.counters_ = (char*)CWISS_AllocAligned(policy->alloc, bytes,
+                                               CWISS_FrozenTable_kCacheLine);
+    memset(self.counters_, 0, bytes);
+  }
+  return self;
+}
+
+/// Destroys the table, its elements and its counters.
+///
+/// This function must not race with any other operation on `self`.
+static inline void CWISS_FrozenTable_destroy(const CWISS_Policy* policy,
+                                             CWISS_FrozenTable* self) {
+  if (self->counters_ != NULL) {
+    CWISS_FreeAligned(policy->alloc, self->counters_,
+                      self->table_.capacity_ * self->stride_,
+                      CWISS_FrozenTable_kCacheLine);
+  }
+  CWISS_RawTable_destroy(policy, &self->table_);
+  *self = (CWISS_FrozenTable){0};
+}
+
+/// Returns the counter of the element `it` points to.
+static inline CWISS_Counter* CWISS_FrozenTable_counter_at(
+    const CWISS_Policy* policy, const CWISS_FrozenTable* self,
+    const CWISS_RawIter* it) {
+  size_t i = (size_t)(it->slot_ - self->table_.slots_) / policy->slot->size;
+  return (CWISS_Counter*)(self->counters_ + i * self->stride_);
+}
+
+/// Returns the counter for `key`, or null if `key` is not in the table.
+static inline CWISS_Counter* CWISS_FrozenTable_find(
+    const CWISS_Policy* policy, const CWISS_FrozenTable* self,
+    const void* key) {
+  CWISS_RawIter it = CWISS_RawTable_find_hinted(
+      policy, policy->key, &self->table_, key, policy->key->hash(key));
+  if (it.slot_ == NULL) return NULL;
+  return CWISS_FrozenTable_counter_at(policy, self, &it);
+}
+
+/// Returns the value of `self`.
+static inline int64_t CWISS_Counter_load(CWISS_Counter* self) {
+  return CWISS_ATOMIC_LOAD_RELAXED(*self);
+}
+
+/// Sets `self` to `value`.
+static inline void CWISS_Counter_store(CWISS_Counter* self, int64_t value) {
+  CWISS_ATOMIC_STORE_RELAXED(*self, value);
+}
+
+/// Adds `delta` to `self`, and returns its previous value.
+static inline int64_t CWISS_Counter_add(CWISS_Counter* self, int64_t delta) {
+  return CWISS_ATOMIC_FETCH_ADD_RELAXED(*self, delta);
+}
+
+/// Sets `self` to `desired` if it is equal to `*expected`, and returns true.
+/// Otherwise, stores its current value in `*expected` and returns false.
+static inline bool CWISS_Counter_compare_exchange(CWISS_Counter* self,
+                                                  int64_t* expected,
+                                                  int64_t desired) {
+  return CWISS_ATOMIC_CAS_RELAXED(*self, expected, desired);
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_FROZEN_TABLE_H_
@@ -0,0 +1,583 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_INT_TABLE_H_
+#define CWISSTABLE_INTERNAL_INT_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/absl_hash.h"
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/policy.h"
+
+/// A hash table specialized for 32- and 64-bit integer keys.
+///
+/// A SwissTable probe matches a 7-bit tag against a group of control bytes,
+/// and then loads each candidate slot and calls `eq` on it. When the key is
+/// itself a small integer, the tag is redundant: the keys can be compared
+/// directly with SIMD, which is what this table does.
+///
+/// The backing array is a sequence of groups of `CWISS_IntTable_kWidth` slots,
+/// each laid out as the following pseudo-struct:
+/// ```
+/// struct CWISS_IntGroup {
+///   // Bit `i` is set iff slot `i` holds a key.
+///   uint8_t full;
+///   // The number of keys whose probe sequence passed over this group because
+///   // it was full, saturating at 255.
+///   uint8_t overflow;
+///   char padding[6];
+///   // The keys, contiguous so that a probe can compare all of them at once.
+///   Key keys[kWidth];
+///   // The values, if any, aligned as required by `Value`.
+///   Value vals[kWidth];
+/// };
+/// ```
+///
+/// The number of groups is a power of two, and probing visits whole groups
+/// along a triangular sequence. A probe stops at the first group with a zero
+/// overflow count, since no key can be stored past it. Unlike with control
+/// bytes, this lets misses stop early even when most groups are full, and
+/// erasure needs no tombstones: it decrements the overflow counts along the
+/// erased key's probe sequence instead.
+///
+/// Keys and values are moved with `memcpy()` and never destroyed, so both must
+/// be plain-old-data.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The number of slots in a group of an integer table.
+#define CWISS_IntTable_kWidth ((size_t)8)
+
+/// Offset of the first key in a group.
+#define CWISS_IntTable_kKeyOffset ((size_t)8)
+
+/// Describes the element types of an integer table.
+typedef struct {
+  /// The size of the key type; must be 4 or 8.
+  size_t key_size;
+  /// The size and alignment of the value type. `val_size` is zero for sets.
+  size_t val_size;
+  size_t val_align;
+  const CWISS_AllocPolicy* alloc;
+} CWISS_IntPolicy;
+
+/// The allocation policy used by integer tables declared via `declare.h`.
+static const CWISS_AllocPolicy CWISS_IntTable_kAlloc = {
+    CWISS_DefaultMalloc,
+    CWISS_DefaultFree,
+};
+
+/// Reads the key pointed to by `key` as an integer.
+static inline uint64_t CWISS_IntPolicy_LoadKey(const CWISS_IntPolicy* policy,
+                                               const void* key) {
+  if (policy->key_size == 4) {
+    uint32_t k;
+    memcpy(&k, key, sizeof(k));
+    return k;
+  }
+  uint64_t k;
+  memcpy(&k, key, sizeof(k));
+  return k;
+}
+
+/// Returns the alignment of a group.
+static inline size_t CWISS_IntPolicy_GroupAlign(const CWISS_IntPolicy* policy) {
+  return policy->val_align > 8 ? policy->val_align : 8;
+}
+
+/// Returns the offset of the first value in a group.
+static inline size_t CWISS_IntPolicy_ValOffset(const CWISS_IntPolicy* policy) {
+  size_t end = CWISS_IntTable_kKeyOffset +
+               CWISS_IntTable_kWidth * policy->key_size;
+  return (end + policy->val_align - 1) & ~(policy->val_align - 1);
+}
+
+/// Returns the distance between consecutive groups in the backing array.
+static inline size_t CWISS_IntPolicy_GroupSize(const CWISS_IntPolicy* policy) {
+  size_t align = CWISS_IntPolicy_GroupAlign(policy);
+  size_t end = CWISS_IntPolicy_ValOffset(policy) +
+               CWISS_IntTable_kWidth * policy->val_size;
+  return (end + align - 1) & ~(align - 1);
+}
+
+/// Hashes an integer key.
+static inline size_t CWISS_IntHash(uint64_t key) {
+  CWISS_AbslHash_State_ state = CWISS_AbslHash_kInit_;
+  CWISS_AbslHash_Mix(&state, key);
+  return (size_t)state;
+}
+
+/// Returns a bitmask of the keys in `keys` equal to `key`, with bit `i` for
+/// the `i`th key.
+///
+/// `keys` points to `CWISS_IntTable_kWidth` keys of `key_size` bytes.
+static inline uint32_t CWISS_IntGroup_Match(const char* keys, size_t key_size,
+                                            uint64_t key) {
+  if (key_size == 4) {
+#if CWISS_HAVE_AVX2
+    __m256i k = _mm256_set1_epi32((int)(uint32_t)key);
+    __m256i v = _mm256_loadu_si256((const __m256i*)keys);
+    return (uint32_t)_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, k)));
+#elif CWISS_HAVE_SSE2
+    __m128i k = _mm_set1_epi32((int)(uint32_t)key);
+    __m128i lo = _mm_loadu_si128((const __m128i*)keys);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(keys + 16));
+    uint32_t m_lo =
+        (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lo, k)));
+    uint32_t m_hi =
+        (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(hi, k)));
+    return m_lo | (m_hi << 4);
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < CWISS_IntTable_kWidth; ++i) {
+      uint32_t k;
+      memcpy(&k, keys + i * sizeof(k), sizeof(k));
+      mask |= (uint32_t)(k == (uint32_t)key) << i;
+    }
+    return mask;
+#endif
+  }
+
+#if CWISS_HAVE_AVX2
+  __m256i k = _mm256_set1_epi64x((long long)key);
+  __m256i lo = _mm256_loadu_si256((const __m256i*)keys);
+  __m256i hi = _mm256_loadu_si256((const __m256i*)(keys + 32));
+  uint32_t m_lo = (uint32_t)_mm256_movemask_pd(
+      _mm256_castsi256_pd(_mm256_cmpeq_epi64(lo, k)));
+  uint32_t m_hi = (uint32_t)_mm256_movemask_pd(
+      _mm256_castsi256_pd(_mm256_cmpeq_epi64(hi, k)));
+  return m_lo | (m_hi << 4);
+#elif CWISS_HAVE_SSE2
+  // SSE2 has no 64-bit compare, so compare 32-bit halves and require both of
+  // them to match.
+  __m128i k = _mm_set1_epi64x((long long)key);
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < CWISS_IntTable_kWidth / 2; ++i) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(keys + i * 16));
+    __m128i eq = _mm_cmpeq_epi32(v, k);
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    mask |= (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << (2 * i);
+  }
+  return mask;
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < CWISS_IntTable_kWidth; ++i) {
+    uint64_t k;
+    memcpy(&k, keys + i * sizeof(k), sizeof(k));
+    mask |= (uint32_t)(k == key) << i;
+  }
+  return mask;
+#endif
+}
+
+/// An integer table.
+typedef struct {
+  char* groups_;
+  size_t size_;
+  size_t capacity_;
+  size_t growth_left_;
+} CWISS_IntTable;
+
+/// An iterator into an integer table.
+///
+/// An iterator is either "at the end" (`index_ == capacity_`) or points at a
+/// full slot. A default-initialized iterator is always at the end.
+typedef struct {
+  CWISS_IntTable* set_;
+  size_t index_;
+} CWISS_IntIter;
+
+/// Returns a pointer to the `i`th group of `self`.
+static inline char* CWISS_IntTable_Group(const CWISS_IntPolicy* policy,
+                                         const CWISS_IntTable* self, size_t i) {
+  return self->groups_ + i * CWISS_IntPolicy_GroupSize(policy);
+}
+
+/// Returns the index of the group a probe for `hash` starts at.
+static inline size_t CWISS_IntTable_ProbeStart(const CWISS_IntTable* self,
+                                               size_t hash) {
+  return hash & (self->capacity_ / CWISS_IntTable_kWidth - 1);
+}
+
+/// Advances a probe sequence over groups; `*i` counts steps taken so far.
+static inline size_t CWISS_IntTable_ProbeNext(const CWISS_IntTable* self,
+                                              size_t group, size_t* i) {
+  ++*i;
+  CWISS_DCHECK(*i <= self->capacity_ / CWISS_IntTable_kWidth, "full table!");
+  return (group + *i) & (self->capacity_ / CWISS_IntTable_kWidth - 1);
+}
+
+/// Given the capacity of an integer table, applies the load factor.
+static inline size_t CWISS_IntTable_CapacityToGrowth(size_t capacity) {
+  return capacity - capacity / 8;
+}
+
+/// Converts `n` into the smallest valid capacity that can hold `n` elements.
+static inline size_t CWISS_IntTable_NormalizeCapacity(size_t n) {
+  size_t capacity = CWISS_IntTable_kWidth;
+  while (CWISS_IntTable_CapacityToGrowth(capacity) < n) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+/// Moves the iterator forward to the next full slot, if the current one is
+/// not full.
+static inline void CWISS_IntIter_SkipEmpty(
+    const CWISS_IntPolicy* policy, CWISS_IntIter* self) {
+  const CWISS_IntTable* t = self->set_;
+  while (self->index_ < t->capacity_) {
+    size_t g = self->index_ / CWISS_IntTable_kWidth;
+    uint32_t i = (uint32_t)(self->index_ % CWISS_IntTable_kWidth);
+    uint32_t full = (uint8_t)CWISS_IntTable_Group(policy, t, g)[0] >> i;
+    if (full != 0) {
+      self->index_ += CWISS_TrailingZeros(full);
+      return;
+    }
+    self->index_ = (g + 1) * CWISS_IntTable_kWidth;
+  }
+}
+
+/// Creates a valid iterator starting at the `index`th slot.
+static inline CWISS_IntIter CWISS_IntTable_iter_at(
+    const CWISS_IntPolicy* policy, const CWISS_IntTable* self, size_t index) {
+  CWISS_IntIter it = {(CWISS_IntTable*)self, index};
+  CWISS_IntIter_SkipEmpty(policy, &it);
+  return it;
+}
+
+/// Creates an iterator for `self`.
+static inline CWISS_IntIter CWISS_IntTable_iter(const CWISS_IntPolicy* policy,
+                                                const CWISS_IntTable* self) {
+  return CWISS_IntTable_iter_at(policy, self, 0);
+}
+
+/// Returns a pointer to the key the iterator points to, or null if the
+/// iterator has been exhausted.
+static inline void* CWISS_IntIter_key(const CWISS_IntPolicy* policy,
+                                      const CWISS_IntIter* self) {
+  if (self->set_ == NULL || self->index_ >= self->set_->capacity_) {
+    return NULL;
+  }
+  char* g = CWISS_IntTable_Group(policy, self->set_,
+                                 self->index_ / CWISS_IntTable_kWidth);
+  return g + CWISS_IntTable_kKeyOffset +
+         (self->index_ % CWISS_IntTable_kWidth) * policy->key_size;
+}
+
+/// Returns a pointer to the value the iterator points to, or null if the
+/// iterator has been exhausted.
+static inline void* CWISS_IntIter_val(const CWISS_IntPolicy* policy,
+                                      const CWISS_IntIter* self) {
+  if (self->set_ == NULL || self->index_ >= self->set_->capacity_) {
+    return NULL;
+  }
+  char* g = CWISS_IntTable_Group(policy, self->set_,
+                                 self->index_ / CWISS_IntTable_kWidth);
+  return g + CWISS_IntPolicy_ValOffset(policy) +
+         (self->index_ % CWISS_IntTable_kWidth) * policy->val_size;
+}
+
+/// Advances the iterator and returns a pointer to the key it now points to,
+/// or null if the iterator has been exhausted.
+static inline void* CWISS_IntIter_next(const CWISS_IntPolicy* policy,
+                                       CWISS_IntIter* self) {
+  if (self->set_ == NULL || self->index_ >= self->set_->capacity_) {
+    return NULL;
+  }
+  ++self->index_;
+  CWISS_IntIter_SkipEmpty(policy, self);
+  return CWISS_IntIter_key(policy, self);
+}
+
+/// Finds the first slot along the probe sequence for `hash` that is not full,
+/// returning its index. Every full group passed over along the way records
+/// the overflow.
+///
+/// The table must have a nonzero capacity.
+static inline size_t CWISS_IntTable_PrepareInsert(const CWISS_IntPolicy* policy,
+                                                  CWISS_IntTable* self,
+                                                  size_t hash) {
+  size_t g = CWISS_IntTable_ProbeStart(self, hash);
+  size_t i = 0;
+  while (true) {
+    uint8_t* meta = (uint8_t*)CWISS_IntTable_Group(policy, self, g);
+    if (meta[0] != 0xff) {
+      return g * CWISS_IntTable_kWidth + CWISS_TrailingZeros(~meta[0]);
+    }
+    if (meta[1] != 0xff) ++meta[1];
+    g = CWISS_IntTable_ProbeNext(self, g, &i);
+  }
+}
+
+/// Writes `key` into slot `index` and marks it as full.
+static inline void CWISS_IntTable_SetKey(const CWISS_IntPolicy* policy,
+                                         CWISS_IntTable* self, size_t index,
+                                         uint64_t key) {
+  char* g = CWISS_IntTable_Group(policy, self, index / CWISS_IntTable_kWidth);
+  uint32_t i = (uint32_t)(index % CWISS_IntTable_kWidth);
+  g[0] = (char)((uint8_t)g[0] | (1u << i));
+  char* dst = g + CWISS_IntTable_kKeyOffset + i * policy->key_size;
+  if (policy->key_size == 4) {
+    uint32_t k = (uint32_t)key;
+    memcpy(dst, &k, sizeof(k));
+  } else {
+    memcpy(dst, &key, sizeof(key));
+  }
+}
+
+/// Grows (or shrinks) the table to the given capacity, triggering a rehash.
+static inline void CWISS_IntTable_Resize(const CWISS_IntPolicy* policy,
+                                         CWISS_IntTable* self,
+                                         size_t new_capacity) {
+  CWISS_IntTable old = *self;
+  size_t group_size = CWISS_IntPolicy_GroupSize(policy);
+  size_t align = CWISS_IntPolicy_GroupAlign(policy);
+
+  size_t alloc_size = new_capacity / CWISS_IntTable_kWidth * group_size;
+  self->groups_ = (char*)policy->alloc->alloc(alloc_size, align);
+  memset(self->groups_, 0, alloc_size);
+  self->capacity_ = new_capacity;
+  self->growth_left_ =
+      CWISS_IntTable_CapacityToGrowth(new_capacity) - old.size_;
+
+  for (CWISS_IntIter it = CWISS_IntTable_iter(policy, &old);
+       CWISS_IntIter_key(policy, &it) != NULL;
+       CWISS_IntIter_next(policy, &it)) {
+    uint64_t key =
+        CWISS_IntPolicy_LoadKey(policy, CWISS_IntIter_key(policy, &it));
+    size_t index =
+        CWISS_IntTable_PrepareInsert(policy, self, CWISS_IntHash(key));
+    CWISS_IntTable_SetKey(policy, self, index, key);
+    CWISS_IntIter dst = {self, index};
+    memcpy(CWISS_IntIter_val(policy, &dst), CWISS_IntIter_val(policy, &it),
+           policy->val_size);
+  }
+
+  if (old.capacity_ != 0) {
+    policy->alloc->free(old.groups_,
+                        old.capacity_ / CWISS_IntTable_kWidth * group_size,
+                        align);
+  }
+}
+
+/// Creates a new empty table with the given capacity.
+static inline CWISS_IntTable CWISS_IntTable_new(const CWISS_IntPolicy* policy,
+                                                size_t capacity) {
+  CWISS_IntTable self = {0};
+  if (capacity != 0) {
+    CWISS_IntTable_Resize(policy, &self,
+                          CWISS_IntTable_NormalizeCapacity(capacity));
+  }
+  return self;
+}
+
+/// Destroys the table, freeing its backing array.
+static inline void CWISS_IntTable_destroy(const CWISS_IntPolicy* policy,
+                                          CWISS_IntTable* self) {
+  if (self->capacity_ != 0) {
+    policy->alloc->free(
+        self->groups_,
+        self->capacity_ / CWISS_IntTable_kWidth *
+            CWISS_IntPolicy_GroupSize(policy),
+        CWISS_IntPolicy_GroupAlign(policy));
+  }
+  *self = (CWISS_IntTable){0};
+}
+
+/// Creates a duplicate of this table.
+static inline CWISS_IntTable CWISS_IntTable_dup(const CWISS_IntPolicy* policy,
+                                                const CWISS_IntTable* self) {
+  CWISS_IntTable copy = {0};
+  if (self->size_ != 0) {
+    // Copy the backing array wholesale; nothing in it depends on its
+    // address.
+    size_t alloc_size = self->capacity_ / CWISS_IntTable_kWidth *
+                        CWISS_IntPolicy_GroupSize(policy);
+    copy = *self;
+    copy.groups_ = (char*)policy->alloc->alloc(
+        alloc_size, CWISS_IntPolicy_GroupAlign(policy));
+    memcpy(copy.groups_, self->groups_, alloc_size);
+  }
+  return copy;
+}
+
+/// Ensures that at least `n` elements can be held without a resize.
+static inline void CWISS_IntTable_reserve(const CWISS_IntPolicy* policy,
+                                          CWISS_IntTable* self, size_t n) {
+  if (n <= self->size_ + self->growth_left_) {
+    return;
+  }
+  CWISS_IntTable_Resize(policy, self, CWISS_IntTable_NormalizeCapacity(n));
+}
+
+/// Triggers a rehash, growing to at least a capacity of `n`.
+static inline void CWISS_IntTable_rehash(const CWISS_IntPolicy* policy,
+                                         CWISS_IntTable* self, size_t n) {
+  if (n == 0 && self->size_ == 0) {
+    CWISS_IntTable_destroy(policy, self);
+    return;
+  }
+  size_t capacity =
+      CWISS_IntTable_NormalizeCapacity(n > self->size_ ? n : self->size_);
+  CWISS_IntTable_Resize(policy, self, capacity);
+}
+
+/// Removes all elements from the table, keeping its capacity.
+static inline void CWISS_IntTable_clear(const CWISS_IntPolicy* policy,
+                                        CWISS_IntTable* self) {
+  size_t group_size = CWISS_IntPolicy_GroupSize(policy);
+  for (size_t g = 0; g < self->capacity_ / CWISS_IntTable_kWidth; ++g) {
+    char* group = self->groups_ + g * group_size;
+    group[0] = 0;
+    group[1] = 0;
+  }
+  self->size_ = 0;
+  self->growth_left_ = CWISS_IntTable_CapacityToGrowth(self->capacity_);
+}
+
+/// Returns the number of elements in the table.
+static inline size_t CWISS_IntTable_size(const CWISS_IntPolicy* policy,
+                                         const CWISS_IntTable* self) {
+  return self->size_;
+}
+
+/// Returns whether the table is empty.
+static inline bool CWISS_IntTable_empty(const CWISS_IntPolicy* policy,
+                                        const CWISS_IntTable* self) {
+  return self->size_ == 0;
+}
+
+/// Returns the number of slots in the table.
+static inline size_t CWISS_IntTable_capacity(const CWISS_IntPolicy* policy,
+                                             const CWISS_IntTable* self) {
+  return self->capacity_;
+}
+
+/// Tries to find `key` in the table. If not found, returns an iterator at the
+/// end.
+static inline CWISS_IntIter CWISS_IntTable_find(const CWISS_IntPolicy* policy,
+                                                const CWISS_IntTable* self,
+                                                uint64_t key) {
+  CWISS_IntIter end = {(CWISS_IntTable*)self, self->capacity_};
+  if (self->capacity_ == 0) return end;
+
+  size_t g = CWISS_IntTable_ProbeStart(self, CWISS_IntHash(key));
+  size_t i = 0;
+  while (true) {
+    const char* group = CWISS_IntTable_Group(policy, self, g);
+    uint32_t full = (uint8_t)group[0];
+    uint32_t match = CWISS_IntGroup_Match(group + CWISS_IntTable_kKeyOffset,
+                                          policy->key_size, key) &
+                     full;
+    if (CWISS_LIKELY(match != 0)) {
+      return (CWISS_IntIter){(CWISS_IntTable*)self,
+                             g * CWISS_IntTable_kWidth +
+                                 CWISS_TrailingZeros(match)};
+    }
+    if (CWISS_LIKELY(group[1] == 0)) return end;
+    g = CWISS_IntTable_ProbeNext(self, g, &i);
+  }
+}
+
+/// Returns whether `key` is in the table.
+static inline bool CWISS_IntTable_contains(const CWISS_IntPolicy* policy,
+                                           const CWISS_IntTable* self,
+                                           uint64_t key) {
+  CWISS_IntIter it = CWISS_IntTable_find(policy, self, key);
+  return CWISS_IntIter_key(policy, &it) != NULL;
+}
+
+/// The return type of `CWISS_IntTable_insert()`.
+typedef struct {
+  CWISS_IntIter iter;
+  bool inserted;
+} CWISS_IntInsert;
+
+/// Inserts `key` into the table if it isn't already present.
+///
+/// Returns an iterator pointing to the element in the map and whether it was
+/// just inserted or was already present. If it was just inserted, the value
+/// slot is uninitialized.
+static inline CWISS_IntInsert CWISS_IntTable_insert(
+    const CWISS_IntPolicy* policy, CWISS_IntTable* self, uint64_t key) {
+  CWISS_IntIter it = CWISS_IntTable_find(policy, self, key);
+  if (CWISS_IntIter_key(policy, &it) != NULL) {
+    return (CWISS_IntInsert){it, false};
+  }
+
+  if (CWISS_UNLIKELY(self->growth_left_ == 0)) {
+    // Without tombstones, running out of growth always means the table is at
+    // its maximum load.
+    CWISS_IntTable_Resize(policy, self,
+                          self->capacity_ == 0 ? CWISS_IntTable_kWidth
+                                               : self->capacity_ * 2);
+  }
+
+  size_t index =
+      CWISS_IntTable_PrepareInsert(policy, self, CWISS_IntHash(key));
+  --self->growth_left_;
+  ++self->size_;
+  CWISS_IntTable_SetKey(policy, self, index, key);
+  return (CWISS_IntInsert){{self, index}, true};
+}
+
+/// Erases the element pointed to by the given valid iterator.
+///
+/// The iterator can still be safely advanced (although not dereferenced until
+/// advanced).
+static inline void CWISS_IntTable_erase_at(const CWISS_IntPolicy* policy,
+                                           CWISS_IntIter it) {
+  CWISS_IntTable* self = it.set_;
+  size_t target = it.index_ / CWISS_IntTable_kWidth;
+  uint8_t* meta = (uint8_t*)CWISS_IntTable_Group(policy, self, target);
+  uint32_t bit = 1u << (it.index_ % CWISS_IntTable_kWidth);
+  CWISS_DCHECK((meta[0] & bit) != 0, "erasing an empty slot");
+
+  // Retract the overflow this key recorded on the way to its group.
+  uint64_t key =
+      CWISS_IntPolicy_LoadKey(policy, CWISS_IntIter_key(policy, &it));
+  size_t g = CWISS_IntTable_ProbeStart(self, CWISS_IntHash(key));
+  size_t i = 0;
+  while (g != target) {
+    uint8_t* passed = (uint8_t*)CWISS_IntTable_Group(policy, self, g);
+    if (passed[1] != 0xff) --passed[1];
+    g = CWISS_IntTable_ProbeNext(self, g, &i);
+  }
+
+  meta[0] = (uint8_t)(meta[0] & ~bit);
+  --self->size_;
+  ++self->growth_left_;
+}
+
+/// Erases `key` if present. Returns true if deletion occurred.
+static inline bool CWISS_IntTable_erase(const CWISS_IntPolicy* policy,
+                                        CWISS_IntTable* self, uint64_t key) {
+  CWISS_IntIter it = CWISS_IntTable_find(policy, self, key);
+  if (CWISS_IntIter_key(policy, &it) == NULL) return false;
+  CWISS_IntTable_erase_at(policy, it);
+  return true;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_INT_TABLE_H_
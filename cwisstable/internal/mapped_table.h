@@ -0,0 +1,607 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_MAPPED_TABLE_H_
+#define CWISSTABLE_INTERNAL_MAPPED_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cwisstable/hash.h"
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/internal/capacity.h"
+#include "cwisstable/internal/control_byte.h"
+#include "cwisstable/internal/probe.h"
+
+/// A SwissTable whose backing array lives in a memory-mapped file.
+///
+/// The file consists of a `CWISS_MappedHeader`, padded out to
+/// `CWISS_MappedTable_kHeaderSize` bytes, followed by a backing array laid out
+/// exactly as described in capacity.h. Opening an existing file maps it and
+/// checks the header; there is no reload step.
+///
+/// Because the array must mean the same thing to every process that maps it:
+/// - Keys and values are plain-old-data, copied with `memcpy()`. Keys are
+///   hashed with `CWISS_Fingerprint64()` and compared with `memcmp()`, so keys
+///   with padding must have it zeroed.
+/// - H1 is not mixed with the address of the control bytes, unlike in
+///   `CWISS_RawTable`.
+/// - The group width, which determines how many control bytes are cloned, is
+///   recorded in the header and must match on open.
+///
+/// Inserts and erases mutate the mapping in place. `CWISS_MappedTable_flush()`
+/// makes the current state durable with `msync()`. The header has a `clean`
+/// flag that is cleared (and synced) before the first write after a flush and
+/// set again by the next flush, so a file that was being written to when the
+/// process died is detected on open instead of being trusted. Such a file can
+/// be salvaged with `CWISS_MappedTable_recover()`, which rebuilds it.
+///
+/// Growth never writes to the current file: it builds the larger table in a
+/// new file next to it, syncs it, and then `rename()`s it over the old one.
+/// The rename is the commit point, so after a crash the path refers either to
+/// the old table or to the complete new one.
+///
+/// This is only available where `CWISS_HAVE_MMAP` is set; see `base.h`.
+
+#if CWISS_HAVE_MMAP
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#if CWISS_HAVE_MMAP
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The number of bytes reserved for the header at the start of the file.
+#define CWISS_MappedTable_kHeaderSize ((size_t)4096)
+
+/// Identifies a file as a mapped table.
+#define CWISS_MappedTable_kMagic UINT64_C(0x4c42545353495743)
+
+/// The version of the file format.
+///
+/// The control bytes are stored as-is, so files written with
+/// `CWISS_ZERO_EMPTY_CTRL` get a version of their own.
+#if CWISS_ZERO_EMPTY_CTRL
+  #define CWISS_MappedTable_kVersion ((uint32_t)0x10001)
+#else
+  #define CWISS_MappedTable_kVersion ((uint32_t)1)
+#endif
+
+/// Describes the element type of a mapped table.
+///
+/// Each slot holds a key of `key_size` bytes at offset zero and a value at
+/// `val_offset`.
+typedef struct {
+  size_t key_size;
+  size_t val_offset;
+  size_t slot_size, slot_align;
+} CWISS_MappedPolicy;
+
+/// The header at the start of a mapped table's file.
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t group_width;
+  uint64_t key_size, slot_size, slot_align;
+  uint64_t capacity, size, growth_left;
+  /// Nonzero iff the file has not been written to since it was last flushed.
+  uint32_t clean;
+} CWISS_MappedHeader;
+
+/// The result of opening a mapped table.
+typedef enum {
+  /// The table was opened or created.
+  CWISS_kMappedOk,
+  /// A system call failed; `errno` says why.
+  CWISS_kMappedIoError,
+  /// The file is not a mapped table with this element type and group width.
+  CWISS_kMappedBadFormat,
+  /// The file was modified and not flushed before it was last closed, so its
+  /// contents cannot be trusted; see `CWISS_MappedTable_recover()`.
+  CWISS_kMappedUnclean,
+} CWISS_MappedStatus;
+
+/// A mapped table.
+typedef struct {
+  /// The mapping, which starts with the header.
+  CWISS_MappedHeader* header_;
+  size_t len_;
+  CWISS_ControlByte* ctrl_;
+  char* slots_;
+  int fd_;
+  /// An owned copy of the path the table was opened at, used when growing.
+  char* path_;
+} CWISS_MappedTable;
+
+/// Returns the size of the file backing a table with the given capacity.
+static inline size_t CWISS_MappedTable_FileSize(
+    const CWISS_MappedPolicy* policy, size_t capacity) {
+  return CWISS_MappedTable_kHeaderSize +
+         CWISS_AllocSize(capacity, policy->slot_size, policy->slot_align);
+}
+
+/// Maps `len` bytes of `fd` and points `self` at them. Returns false on error.
+static inline bool CWISS_MappedTable_Map(const CWISS_MappedPolicy* policy,
+                                         CWISS_MappedTable* self, int fd,
+                                         size_t len, size_t capacity) {
+  void* base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) return false;
+  self->header_ = (CWISS_MappedHeader*)base;
+  self->len_ = len;
+  self->fd_ = fd;
+  self->ctrl_ = (CWISS_ControlByte*)base + CWISS_MappedTable_kHeaderSize;
+  self->slots_ = (char*)self->ctrl_ + CWISS_SlotOffset(capacity,
+                                                       policy->slot_align);
+  return true;
+}
+
+/// Unmaps `self` and closes its file, without flushing it.
+static inline void CWISS_MappedTable_Unmap(CWISS_MappedTable* self) {
+  // Slots may have been poisoned; don't leave that behind for whatever gets
+  // mapped here next.
+  CWISS_UnpoisonMemory(self->header_, self->len_);
+  munmap(self->header_, self->len_);
+  close(self->fd_);
+}
+
+/// Syncs the whole mapping, and the file's metadata, to disk.
+static inline bool CWISS_MappedTable_Sync(CWISS_MappedTable* self) {
+  return msync(self->header_, self->len_, MS_SYNC) == 0 &&
+         fsync(self->fd_) == 0;
+}
+
+/// Returns a `malloc()`'d copy of the first `len` bytes of `path` followed by
+/// `suffix`, or null.
+static inline char* CWISS_MappedTable_CopyPath(const char* path, size_t len,
+                                               const char* suffix) {
+  size_t suffix_len = strlen(suffix);
+  char* copy = (char*)malloc(len + suffix_len + 1);
+  if (copy == NULL) return NULL;
+  memcpy(copy, path, len);
+  memcpy(copy + len, suffix, suffix_len + 1);
+  return copy;
+}
+
+/// Syncs the directory containing `path`, so that a rename into it is durable.
+static inline bool CWISS_MappedTable_SyncDir(const char* path) {
+  const char* slash = strrchr(path, '/');
+  char* dir = slash == NULL ? CWISS_MappedTable_CopyPath(".", 1, "")
+              : CWISS_MappedTable_CopyPath(
+                    path, slash == path ? 1 : (size_t)(slash - path), "");
+  if (dir == NULL) return false;
+  int fd = open(dir, O_RDONLY);
+  free(dir);
+  if (fd < 0) return false;
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+/// Returns the path at which a table at `path` is built before being renamed
+/// into place. The caller must `free()` it.
+static inline char* CWISS_MappedTable_TempPath(const char* path) {
+  return CWISS_MappedTable_CopyPath(path, strlen(path), ".tmp");
+}
+
+/// Creates an empty table with the given (valid) capacity in a new file at
+/// `path`, replacing any file already there. Returns false on error.
+static inline bool CWISS_MappedTable_Create(const CWISS_MappedPolicy* policy,
+                                            CWISS_MappedTable* self,
+                                            const char* path,
+                                            size_t capacity) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  size_t len = CWISS_MappedTable_FileSize(policy, capacity);
+  if (ftruncate(fd, (off_t)len) != 0 ||
+      !CWISS_MappedTable_Map(policy, self, fd, len, capacity)) {
+    int err = errno;
+    close(fd);
+    unlink(path);
+    errno = err;
+    return false;
+  }
+
+  *self->header_ = (CWISS_MappedHeader){
+      .magic = CWISS_MappedTable_kMagic,
+      .version = CWISS_MappedTable_kVersion,
+      .group_width = (uint32_t)CWISS_Group_kWidth,
+      .key_size = policy->key_size,
+      .slot_size = policy->slot_size,
+      .slot_align = policy->slot_align,
+      .capacity = capacity,
+      .size = 0,
+      .growth_left = CWISS_CapacityToGrowth(capacity),
+  };
+  // The file was just extended with `ftruncate()`, so it reads as zeros.
+  CWISS_ResetZeroedCtrl(capacity, self->ctrl_, self->slots_,
+                        policy->slot_size);
+  return true;
+}
+
+/// Closes the table, without flushing it.
+///
+/// Changes since the last flush are still written back eventually by the
+/// kernel, but the file will be reported as unclean when next opened.
+static inline void CWISS_MappedTable_close(CWISS_MappedTable* self) {
+  CWISS_MappedTable_Unmap(self);
+  free(self->path_);
+  *self = (CWISS_MappedTable){0};
+}
+
+/// Makes all changes to the table durable. Returns false on error.
+static inline bool CWISS_MappedTable_flush(CWISS_MappedTable* self) {
+  if (self->header_->clean) return true;
+  if (!CWISS_MappedTable_Sync(self)) return false;
+  self->header_->clean = 1;
+  return msync(self->header_, CWISS_MappedTable_kHeaderSize, MS_SYNC) == 0;
+}
+
+/// Must be called before each write to the table. The first write after a
+/// flush durably marks the file as unclean before it happens.
+///
+/// Returns false if that failed, in which case the write must not happen.
+static inline bool CWISS_MappedTable_BeginWrite(CWISS_MappedTable* self) {
+  if (CWISS_LIKELY(!self->header_->clean)) return true;
+  self->header_->clean = 0;
+  if (msync(self->header_, CWISS_MappedTable_kHeaderSize, MS_SYNC) == 0) {
+    return true;
+  }
+  // The file may still read as clean after a crash, so writing now could
+  // leave it corrupt without anyone noticing. Stay clean in memory, so that
+  // the next write tries again.
+  self->header_->clean = 1;
+  return false;
+}
+
+/// Returns the number of elements in the table.
+static inline size_t CWISS_MappedTable_size(const CWISS_MappedTable* self) {
+  return (size_t)self->header_->size;
+}
+
+/// Returns the number of slots in the table.
+static inline size_t CWISS_MappedTable_capacity(
+    const CWISS_MappedTable* self) {
+  return (size_t)self->header_->capacity;
+}
+
+/// Hashes a key.
+static inline size_t CWISS_MappedTable_Hash(const CWISS_MappedPolicy* policy,
+                                            const void* key) {
+  return (size_t)CWISS_Fingerprint64(key, policy->key_size);
+}
+
+/// Returns the probe sequence for `hash`. Unlike `CWISS_ProbeSeq_Start()`,
+/// this does not depend on where the table is mapped.
+static inline CWISS_ProbeSeq CWISS_MappedTable_Probe(
+    const CWISS_MappedTable* self, size_t hash) {
+  return CWISS_ProbeSeq_new(hash >> 7, CWISS_MappedTable_capacity(self));
+}
+
+/// Returns the slot holding `key`, or null.
+///
+/// The file may have been damaged by something other than this library, so
+/// the probe loops below stop once they have visited every group, rather than
+/// trusting that an empty slot exists.
+static inline char* CWISS_MappedTable_find(const CWISS_MappedPolicy* policy,
+                                           const CWISS_MappedTable* self,
+                                           const void* key) {
+  size_t hash = CWISS_MappedTable_Hash(policy, key);
+  size_t capacity = CWISS_MappedTable_capacity(self);
+  CWISS_ProbeSeq seq = CWISS_MappedTable_Probe(self, hash);
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
+    CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+    uint32_t i;
+    while (CWISS_BitMask_next(&match, &i)) {
+      char* slot =
+          self->slots_ + CWISS_ProbeSeq_offset(&seq, i) * policy->slot_size;
+      if (CWISS_LIKELY(memcmp(slot, key, policy->key_size) == 0)) return slot;
+    }
+    if (CWISS_LIKELY(CWISS_Group_MatchEmpty(&g).mask)) return NULL;
+    CWISS_ProbeSeq_next(&seq);
+    if (CWISS_UNLIKELY(seq.index_ > capacity)) return NULL;
+  }
+}
+
+/// Returns the index of the first empty or deleted slot along `hash`'s probe
+/// sequence, or the capacity if there is none, which only happens if the file
+/// is corrupt.
+static inline size_t CWISS_MappedTable_FindFirstNonFull(
+    const CWISS_MappedTable* self, size_t hash) {
+  size_t capacity = CWISS_MappedTable_capacity(self);
+  CWISS_ProbeSeq seq = CWISS_MappedTable_Probe(self, hash);
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
+    CWISS_BitMask mask = CWISS_Group_MatchEmptyOrDeleted(&g);
+    if (mask.mask) {
+      return CWISS_ProbeSeq_offset(&seq, CWISS_BitMask_TrailingZeros(&mask));
+    }
+    CWISS_ProbeSeq_next(&seq);
+    if (CWISS_UNLIKELY(seq.index_ > capacity)) return capacity;
+  }
+}
+
+/// Moves the contents of `self` into a new file with the given capacity and
+/// atomically replaces `self`'s file with it. On failure, returns false and
+/// leaves `self` untouched.
+CWISS_INLINE_NEVER
+static bool CWISS_MappedTable_Resize(const CWISS_MappedPolicy* policy,
+                                     CWISS_MappedTable* self,
+                                     size_t new_capacity) {
+  char* tmp = CWISS_MappedTable_TempPath(self->path_);
+  if (tmp == NULL) return false;
+  CWISS_MappedTable grown = {0};
+  if (!CWISS_MappedTable_Create(policy, &grown, tmp, new_capacity)) {
+    free(tmp);
+    return false;
+  }
+
+  // The size is recounted, so that this can also rebuild an unclean file.
+  size_t old_capacity = CWISS_MappedTable_capacity(self);
+  size_t size = 0;
+  for (size_t i = 0; i != old_capacity; ++i) {
+    if (!CWISS_IsFull(self->ctrl_[i])) continue;
+    const char* slot = self->slots_ + i * policy->slot_size;
+    size_t hash = CWISS_MappedTable_Hash(policy, slot);
+    size_t new_i = CWISS_MappedTable_FindFirstNonFull(&grown, hash);
+    CWISS_DCHECK(new_i != new_capacity, "no room for element %zu", i);
+    CWISS_SetCtrl(new_i, CWISS_H2(hash), new_capacity, grown.ctrl_,
+                  grown.slots_, policy->slot_size);
+    memcpy(grown.slots_ + new_i * policy->slot_size, slot, policy->slot_size);
+    ++size;
+  }
+  grown.header_->size = size;
+  grown.header_->growth_left = CWISS_CapacityToGrowth(new_capacity) - size;
+  grown.header_->clean = 1;
+
+  if (!CWISS_MappedTable_Sync(&grown) || rename(tmp, self->path_) != 0) {
+    int err = errno;
+    CWISS_MappedTable_Unmap(&grown);
+    unlink(tmp);
+    free(tmp);
+    errno = err;
+    return false;
+  }
+  free(tmp);
+  // The rename has happened; failing to make it durable is no reason to keep
+  // using the old, now unlinked, file.
+  CWISS_MappedTable_SyncDir(self->path_);
+
+  CWISS_MappedTable_Unmap(self);
+  grown.path_ = self->path_;
+  *self = grown;
+  return true;
+}
+
+/// Rebuilds the unclean table `self` in a new file, at its current capacity
+/// unless its control bytes mark more elements as present than that allows.
+/// On failure, returns false and leaves `self` untouched.
+CWISS_INLINE_NEVER
+static bool CWISS_MappedTable_Rebuild(const CWISS_MappedPolicy* policy,
+                                      CWISS_MappedTable* self) {
+  size_t capacity = CWISS_MappedTable_capacity(self);
+  size_t full = 0;
+  for (size_t i = 0; i != capacity; ++i) {
+    full += CWISS_IsFull(self->ctrl_[i]);
+  }
+  if (full > CWISS_CapacityToGrowth(capacity)) {
+    capacity = CWISS_NormalizeCapacity(CWISS_GrowthToLowerboundCapacity(full));
+  }
+  return CWISS_MappedTable_Resize(policy, self, capacity);
+}
+
+/// Implements `CWISS_MappedTable_open()` and, if `recover` is set,
+/// `CWISS_MappedTable_recover()`.
+static inline CWISS_MappedStatus CWISS_MappedTable_OpenOrRecover(
+    const CWISS_MappedPolicy* policy, CWISS_MappedTable* self,
+    const char* path, size_t capacity, bool recover) {
+  *self = (CWISS_MappedTable){0};
+  self->path_ = CWISS_MappedTable_CopyPath(path, strlen(path), "");
+  if (self->path_ == NULL) return CWISS_kMappedIoError;
+
+  int fd = open(path, O_RDWR);
+  if (fd < 0 && errno == ENOENT) {
+    // Build the new file elsewhere, so that a crash can never leave behind a
+    // half-initialized table at `path`.
+    char* tmp = CWISS_MappedTable_TempPath(path);
+    size_t cap = CWISS_NormalizeCapacity(
+        CWISS_GrowthToLowerboundCapacity(capacity ? capacity : 1));
+    if (tmp != NULL && CWISS_MappedTable_Create(policy, self, tmp, cap)) {
+      self->header_->clean = 1;
+      if (CWISS_MappedTable_Sync(self) && rename(tmp, path) == 0 &&
+          CWISS_MappedTable_SyncDir(path)) {
+        free(tmp);
+        return CWISS_kMappedOk;
+      }
+      int err = errno;
+      CWISS_MappedTable_Unmap(self);
+      unlink(tmp);
+      errno = err;
+    }
+    free(tmp);
+    free(self->path_);
+    return CWISS_kMappedIoError;
+  }
+  if (fd < 0) {
+    free(self->path_);
+    return CWISS_kMappedIoError;
+  }
+
+  struct stat st;
+  CWISS_MappedHeader header;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    free(self->path_);
+    errno = err;
+    return CWISS_kMappedIoError;
+  }
+  if ((size_t)st.st_size < sizeof(header) ||
+      pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      header.magic != CWISS_MappedTable_kMagic ||
+      header.version != CWISS_MappedTable_kVersion ||
+      header.group_width != CWISS_Group_kWidth ||
+      header.key_size != policy->key_size ||
+      header.slot_size != policy->slot_size ||
+      header.slot_align != policy->slot_align ||
+      !CWISS_IsValidCapacity((size_t)header.capacity) ||
+      (size_t)st.st_size !=
+          CWISS_MappedTable_FileSize(policy, (size_t)header.capacity)) {
+    close(fd);
+    free(self->path_);
+    return CWISS_kMappedBadFormat;
+  }
+  if (!header.clean && !recover) {
+    close(fd);
+    free(self->path_);
+    return CWISS_kMappedUnclean;
+  }
+  if (!CWISS_MappedTable_Map(policy, self, fd, (size_t)st.st_size,
+                             (size_t)header.capacity)) {
+    int err = errno;
+    close(fd);
+    free(self->path_);
+    errno = err;
+    return CWISS_kMappedIoError;
+  }
+  if (!header.clean && !CWISS_MappedTable_Rebuild(policy, self)) {
+    int err = errno;
+    CWISS_MappedTable_Unmap(self);
+    free(self->path_);
+    errno = err;
+    return CWISS_kMappedIoError;
+  }
+  return CWISS_kMappedOk;
+}
+
+/// Opens the table at `path`, creating it with room for at least `capacity`
+/// elements if it does not exist.
+///
+/// On success, `self` must eventually be passed to
+/// `CWISS_MappedTable_close()`.
+static inline CWISS_MappedStatus CWISS_MappedTable_open(
+    const CWISS_MappedPolicy* policy, CWISS_MappedTable* self,
+    const char* path, size_t capacity) {
+  return CWISS_MappedTable_OpenOrRecover(policy, self, path, capacity, false);
+}
+
+/// Like `CWISS_MappedTable_open()`, but salvages a file that is unclean
+/// instead of returning `CWISS_kMappedUnclean`.
+///
+/// The table is rebuilt into a new file from the elements that its control
+/// bytes mark as present, which replaces the old one just as growth does (see
+/// `CWISS_MappedTable_Resize()`); its size and growth budget are recounted
+/// rather than read from the header. This restores a table that can be
+/// searched and written to, and keeps every element whose writes completed
+/// before the crash. An element whose write was torn by the crash may be
+/// lost, or be kept with a partially written key or value. Recovery reads the
+/// whole file, so unlike opening, it takes time linear in its capacity.
+static inline CWISS_MappedStatus CWISS_MappedTable_recover(
+    const CWISS_MappedPolicy* policy, CWISS_MappedTable* self,
+    const char* path, size_t capacity) {
+  return CWISS_MappedTable_OpenOrRecover(policy, self, path, capacity, true);
+}
+
+/// The return type of `CWISS_MappedTable_insert()`.
+typedef struct {
+  /// The slot holding the key, or null if growing the table or marking it as
+  /// unclean failed, or if the file is corrupt and has no free slot.
+  char* slot;
+  /// True if the key was just inserted; its value is then uninitialized.
+  bool inserted;
+} CWISS_MappedInsert;
+
+/// Inserts `key` if it isn't already present.
+static inline CWISS_MappedInsert CWISS_MappedTable_insert(
+    const CWISS_MappedPolicy* policy, CWISS_MappedTable* self,
+    const void* key) {
+  char* found = CWISS_MappedTable_find(policy, self, key);
+  if (found != NULL) return (CWISS_MappedInsert){found, false};
+
+  size_t hash = CWISS_MappedTable_Hash(policy, key);
+  size_t i = CWISS_MappedTable_FindFirstNonFull(self, hash);
+  if (CWISS_UNLIKELY(self->header_->growth_left == 0 &&
+                     !CWISS_IsDeleted(self->ctrl_[i]))) {
+    // As in `CWISS_RawTable_rehash_and_grow_if_necessary()`, rebuild at the
+    // same size if that reclaims enough tombstones.
+    size_t cap = CWISS_MappedTable_capacity(self);
+    size_t new_cap =
+        CWISS_MappedTable_size(self) <= CWISS_CapacityToGrowth(cap) / 2
+            ? cap
+            : cap * 2 + 1;
+    if (!CWISS_MappedTable_Resize(policy, self, new_cap)) {
+      return (CWISS_MappedInsert){NULL, false};
+    }
+    i = CWISS_MappedTable_FindFirstNonFull(self, hash);
+  }
+  // Only a corrupt file, whose growth budget overstates its free slots, gets
+  // here without one.
+  if (CWISS_UNLIKELY(!CWISS_IsEmptyOrDeleted(self->ctrl_[i]))) {
+    return (CWISS_MappedInsert){NULL, false};
+  }
+
+  if (!CWISS_MappedTable_BeginWrite(self)) {
+    return (CWISS_MappedInsert){NULL, false};
+  }
+  ++self->header_->size;
+  self->header_->growth_left -= CWISS_IsEmpty(self->ctrl_[i]);
+  CWISS_SetCtrl(i, CWISS_H2(hash), CWISS_MappedTable_capacity(self),
+                self->ctrl_, self->slots_, policy->slot_size);
+  char* slot = self->slots_ + i * policy->slot_size;
+  memcpy(slot, key, policy->key_size);
+  return (CWISS_MappedInsert){slot, true};
+}
+
+/// Erases `key`, if present. Returns true if deletion occurred, and false if
+/// `key` was absent or marking the table as unclean failed.
+static inline bool CWISS_MappedTable_erase(const CWISS_MappedPolicy* policy,
+                                           CWISS_MappedTable* self,
+                                           const void* key) {
+  char* slot = CWISS_MappedTable_find(policy, self, key);
+  if (slot == NULL) return false;
+
+  size_t capacity = CWISS_MappedTable_capacity(self);
+  size_t index = (size_t)(slot - self->slots_) / policy->slot_size;
+  bool was_never_full = CWISS_WasNeverFull(self->ctrl_, capacity, index);
+
+  if (!CWISS_MappedTable_BeginWrite(self)) return false;
+  --self->header_->size;
+  self->header_->growth_left += was_never_full;
+  CWISS_SetCtrl(index, was_never_full ? CWISS_kEmpty : CWISS_kDeleted,
+                capacity, self->ctrl_, self->slots_, policy->slot_size);
+  return true;
+}
+
+/// Returns the index of the first full slot at or after `i`, or the capacity
+/// if there is none.
+static inline size_t CWISS_MappedTable_Skip(const CWISS_MappedTable* self,
+                                            size_t i) {
+  size_t capacity = CWISS_MappedTable_capacity(self);
+  while (i < capacity && !CWISS_IsFull(self->ctrl_[i])) ++i;
+  return i;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+#endif  // CWISS_HAVE_MMAP
+
+#endif  // CWISSTABLE_INTERNAL_MAPPED_TABLE_H_
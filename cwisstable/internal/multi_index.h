@@ -0,0 +1,356 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_MULTI_INDEX_H_
+#define CWISSTABLE_INTERNAL_MULTI_INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/arena_table.h"
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/internal/control_byte.h"
+#include "cwisstable/internal/probe.h"
+#include "cwisstable/internal/raw_table.h"
+#include "cwisstable/policy.h"
+
+/// A record store with several hash indexes over it.
+///
+/// Each record is stored once, in a node arena (see `arena_table.h`), so its
+/// address never changes. Each index is a `CWISS_RawTable` of 32-bit record
+/// indices, with its own function for extracting a key from a record and its
+/// own key policy for hashing and comparing those keys. Inserting or erasing a
+/// record updates every index.
+///
+/// An index may be unique, in which case an insertion whose key is already
+/// present in it fails without changing any index, or not, in which case it
+/// can hold any number of records with equal keys. Erasure finds a record in
+/// each index by its record index rather than by key, so records with equal
+/// keys are never compared.
+///
+/// When two indexes share both a key function and a hash function, the hash is
+/// computed once per record rather than once per index.
+///
+/// Records must not be modified in a way that changes any of their keys while
+/// they are in the table.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The maximum number of indexes in a multi-index table.
+#define CWISS_MultiTable_kMaxIndexes ((size_t)4)
+
+/// Describes one index of a multi-index table.
+typedef struct {
+  /// Returns a pointer to the key of `record`.
+  const void* (*key)(const void* record);
+  /// Hashes and compares the keys returned by `key`.
+  const CWISS_KeyPolicy* key_policy;
+  /// Whether at most one record may have any given key.
+  bool unique;
+} CWISS_IndexPolicy;
+
+/// Describes a multi-index table.
+typedef struct {
+  /// The record type; its object and allocator policies are used, and its key
+  /// and slot policies are ignored.
+  const CWISS_Policy* record;
+  /// The indexes, at most `CWISS_MultiTable_kMaxIndexes` of them.
+  const CWISS_IndexPolicy* const* indexes;
+  size_t index_count;
+} CWISS_MultiPolicy;
+
+/// A multi-index table.
+typedef struct {
+  CWISS_NodeArena records_;
+  CWISS_RawTable indexes_[CWISS_MultiTable_kMaxIndexes];
+} CWISS_MultiTable;
+
+/// A key being looked up in one index of a multi-index table.
+typedef struct {
+  const CWISS_Policy* record;
+  const CWISS_IndexPolicy* index;
+  const CWISS_NodeArena* records;
+  const void* key;
+} CWISS_MultiNeedle;
+
+static inline bool CWISS_MultiTable_NeedleEq(const void* needle,
+                                             const void* candidate) {
+  const CWISS_MultiNeedle* n = (const CWISS_MultiNeedle*)needle;
+  const void* record = CWISS_NodeArena_get(
+      n->record, n->records, CWISS_ArenaTable_LoadIndex(candidate));
+  return n->index->key_policy->eq(n->key, n->index->key(record));
+}
+
+/// The key policy passed to the raw tables for lookups; it compares
+/// `CWISS_MultiNeedle`s against record indices.
+static const CWISS_KeyPolicy CWISS_MultiTable_kNeedleKey = {
+    CWISS_ArenaTable_IndexHash, CWISS_MultiTable_NeedleEq, false};
+
+/// A `CWISS_ArenaHasher` for one index; `ctx` is a `CWISS_MultiNeedle` with no
+/// key.
+static inline size_t CWISS_MultiTable_HashRecord(const void* ctx, uint32_t i) {
+  const CWISS_MultiNeedle* n = (const CWISS_MultiNeedle*)ctx;
+  const void* record = CWISS_NodeArena_get(n->record, n->records, i);
+  return n->index->key_policy->hash(n->index->key(record));
+}
+
+/// Creates a new table with room for `capacity` records in each index.
+static inline CWISS_MultiTable CWISS_MultiTable_new(
+    const CWISS_MultiPolicy* policy, size_t capacity) {
+  CWISS_CHECK(policy->index_count > 0 &&
+                  policy->index_count <= CWISS_MultiTable_kMaxIndexes,
+              "a multi-index table needs between 1 and %zu indexes",
+              (size_t)CWISS_MultiTable_kMaxIndexes);
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_MultiTable self;
+  self.records_ = CWISS_NodeArena_new();
+  for (size_t j = 0; j < CWISS_MultiTable_kMaxIndexes; ++j) {
+    self.indexes_[j] = CWISS_RawTable_new(
+        &index, j < policy->index_count ? capacity : 0);
+  }
+  return self;
+}
+
+/// Destroys every record, without touching the indexes.
+static inline void CWISS_MultiTable_DestroyRecords(
+    const CWISS_MultiPolicy* policy, CWISS_MultiTable* self) {
+  if (policy->record->obj->dtor == NULL) return;
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_RawIter it = CWISS_RawTable_iter(&index, &self->indexes_[0]);
+  for (void* slot = CWISS_RawIter_get(&index, &it); slot != NULL;
+       slot = CWISS_RawIter_next(&index, &it)) {
+    policy->record->obj->dtor(CWISS_NodeArena_get(
+        policy->record, &self->records_, CWISS_ArenaTable_LoadIndex(slot)));
+  }
+}
+
+/// Destroys the table, freeing its memory.
+static inline void CWISS_MultiTable_destroy(const CWISS_MultiPolicy* policy,
+                                            CWISS_MultiTable* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_MultiTable_DestroyRecords(policy, self);
+  for (size_t j = 0; j < policy->index_count; ++j) {
+    CWISS_RawTable_destroy(&index, &self->indexes_[j]);
+  }
+  CWISS_NodeArena_destroy(policy->record, &self->records_);
+}
+
+/// Erases every record, keeping the record arena's chunks for reuse.
+static inline void CWISS_MultiTable_clear(const CWISS_MultiPolicy* policy,
+                                          CWISS_MultiTable* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_MultiTable_DestroyRecords(policy, self);
+  for (size_t j = 0; j < policy->index_count; ++j) {
+    CWISS_RawTable_clear(&index, &self->indexes_[j]);
+  }
+  CWISS_NodeArena_Reset(&self->records_);
+}
+
+/// Returns the number of records in the table.
+static inline size_t CWISS_MultiTable_size(const CWISS_MultiPolicy* policy,
+                                           const CWISS_MultiTable* self) {
+  return self->indexes_[0].size_;
+}
+
+/// Computes the hash of each of `record`'s keys into `hashes`, reusing the
+/// hash of an earlier index with the same key and hash functions.
+static inline void CWISS_MultiTable_Hashes(const CWISS_MultiPolicy* policy,
+                                           const void* record,
+                                           size_t* hashes) {
+  for (size_t j = 0; j < policy->index_count; ++j) {
+    const CWISS_IndexPolicy* index = policy->indexes[j];
+    size_t k = 0;
+    while (k < j && (policy->indexes[k]->key != index->key ||
+                     policy->indexes[k]->key_policy->hash !=
+                         index->key_policy->hash)) {
+      ++k;
+    }
+    hashes[j] = k < j ? hashes[k] : index->key_policy->hash(index->key(record));
+  }
+}
+
+/// Finds a record whose key in the `j`th index is `key`, whose hash is `hash`,
+/// returning its record index, or `CWISS_NodeArena_kNone` if there is none.
+static inline uint32_t CWISS_MultiTable_FindId(const CWISS_MultiPolicy* policy,
+                                               const CWISS_MultiTable* self,
+                                               size_t j, const void* key,
+                                               size_t hash) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_MultiNeedle needle = {policy->record, policy->indexes[j],
+                              &self->records_, key};
+  CWISS_RawIter it = CWISS_RawTable_find_hinted(
+      &index, &CWISS_MultiTable_kNeedleKey, &self->indexes_[j], &needle, hash);
+  if (it.slot_ == NULL) return CWISS_NodeArena_kNone;
+  return CWISS_ArenaTable_LoadIndex(it.slot_);
+}
+
+/// Finds a record whose key in the `j`th index is `key`, returning null if
+/// there is none. If the index is not unique, which of the matching records
+/// is returned is unspecified.
+static inline void* CWISS_MultiTable_find(const CWISS_MultiPolicy* policy,
+                                          const CWISS_MultiTable* self,
+                                          size_t j, const void* key) {
+  uint32_t id = CWISS_MultiTable_FindId(
+      policy, self, j, key, policy->indexes[j]->key_policy->hash(key));
+  if (id == CWISS_NodeArena_kNone) return NULL;
+  return CWISS_NodeArena_get(policy->record, &self->records_, id);
+}
+
+/// Calls `visit(ctx, record)` on every record whose key in the `j`th index is
+/// `key`, in an unspecified order. Returns the number of such records.
+///
+/// `visit` may be null; it must not insert into or erase from `self`.
+static inline size_t CWISS_MultiTable_find_all(
+    const CWISS_MultiPolicy* policy, const CWISS_MultiTable* self, size_t j,
+    const void* key, void (*visit)(void* ctx, void* record), void* ctx) {
+  const CWISS_IndexPolicy* index = policy->indexes[j];
+  const CWISS_RawTable* set = &self->indexes_[j];
+  size_t hash = index->key_policy->hash(key);
+  size_t count = 0;
+
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(set->ctrl_, hash, set->capacity_);
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(set->ctrl_ + seq.offset_);
+    CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+    uint32_t i;
+    while (CWISS_BitMask_next(&match, &i)) {
+      size_t idx = CWISS_ProbeSeq_offset(&seq, i);
+      void* record = CWISS_NodeArena_get(
+          policy->record, &self->records_,
+          CWISS_ArenaTable_LoadIndex(set->slots_ + idx * sizeof(uint32_t)));
+      if (!index->key_policy->eq(key, index->key(record))) continue;
+      if (visit != NULL) visit(ctx, record);
+      ++count;
+    }
+    if (CWISS_LIKELY(CWISS_Group_MatchEmpty(&g).mask)) return count;
+    CWISS_ProbeSeq_next(&seq);
+    CWISS_DCHECK(seq.index_ <= set->capacity_, "full table!");
+  }
+}
+
+/// The return type of `CWISS_MultiTable_insert()`.
+typedef struct {
+  /// The inserted record, or the record that a unique index rejected it for.
+  void* record;
+  bool inserted;
+} CWISS_MultiInsert;
+
+/// Inserts a copy of `record` into the table and all of its indexes, unless a
+/// unique index already holds a record with the same key.
+static inline CWISS_MultiInsert CWISS_MultiTable_insert(
+    const CWISS_MultiPolicy* policy, CWISS_MultiTable* self,
+    const void* record) {
+  size_t hashes[CWISS_MultiTable_kMaxIndexes];
+  CWISS_MultiTable_Hashes(policy, record, hashes);
+  for (size_t j = 0; j < policy->index_count; ++j) {
+    const CWISS_IndexPolicy* index = policy->indexes[j];
+    if (!index->unique) continue;
+    uint32_t id = CWISS_MultiTable_FindId(policy, self, j, index->key(record),
+                                          hashes[j]);
+    if (id != CWISS_NodeArena_kNone) {
+      CWISS_MultiInsert res = {
+          CWISS_NodeArena_get(policy->record, &self->records_, id), false};
+      return res;
+    }
+  }
+
+  uint32_t id = CWISS_NodeArena_alloc(policy->record, &self->records_);
+  void* dst = CWISS_NodeArena_get(policy->record, &self->records_, id);
+  policy->record->obj->copy(dst, record);
+
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  for (size_t j = 0; j < policy->index_count; ++j) {
+    CWISS_RawTable* set = &self->indexes_[j];
+    if (CWISS_UNLIKELY(set->growth_left_ == 0)) {
+      // The raw table cannot rehash on its own; see `arena_table.h`.
+      CWISS_MultiNeedle ctx = {policy->record, policy->indexes[j],
+                               &self->records_, NULL};
+      CWISS_ArenaTable_RebuildIndex(policy->record, set,
+                                    CWISS_ArenaTable_GrowthCapacity(set),
+                                    CWISS_MultiTable_HashRecord, &ctx);
+    }
+    size_t i = CWISS_RawTable_PrepareInsert(&index, set, hashes[j]);
+    memcpy(set->slots_ + i * sizeof(id), &id, sizeof(id));
+  }
+  CWISS_MultiInsert res = {dst, true};
+  return res;
+}
+
+/// Removes the record index `id`, whose key in the `j`th index hashes to
+/// `hash`, from that index.
+static inline void CWISS_MultiTable_Unlink(const CWISS_MultiPolicy* policy,
+                                           CWISS_MultiTable* self, size_t j,
+                                           uint32_t id, size_t hash) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_RawTable* set = &self->indexes_[j];
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(set->ctrl_, hash, set->capacity_);
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(set->ctrl_ + seq.offset_);
+    CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+    uint32_t i;
+    while (CWISS_BitMask_next(&match, &i)) {
+      size_t idx = CWISS_ProbeSeq_offset(&seq, i);
+      char* slot = set->slots_ + idx * sizeof(id);
+      if (CWISS_ArenaTable_LoadIndex(slot) != id) continue;
+      CWISS_RawTable_erase_at(&index,
+                              CWISS_RawTable_iter_at(&index, set, idx));
+      return;
+    }
+    CWISS_CHECK(CWISS_Group_MatchEmpty(&g).mask == 0,
+                "record missing from index %zu", j);
+    CWISS_ProbeSeq_next(&seq);
+  }
+}
+
+/// Erases a record whose key in the `j`th index is `key` from the table and
+/// all of its indexes. Returns whether there was one.
+///
+/// If the index is not unique, which of the matching records is erased is
+/// unspecified.
+static inline bool CWISS_MultiTable_erase(const CWISS_MultiPolicy* policy,
+                                          CWISS_MultiTable* self, size_t j,
+                                          const void* key) {
+  uint32_t id = CWISS_MultiTable_FindId(
+      policy, self, j, key, policy->indexes[j]->key_policy->hash(key));
+  if (id == CWISS_NodeArena_kNone) return false;
+
+  void* record = CWISS_NodeArena_get(policy->record, &self->records_, id);
+  size_t hashes[CWISS_MultiTable_kMaxIndexes];
+  CWISS_MultiTable_Hashes(policy, record, hashes);
+  for (size_t k = 0; k < policy->index_count; ++k) {
+    CWISS_MultiTable_Unlink(policy, self, k, id, hashes[k]);
+  }
+  if (policy->record->obj->dtor != NULL) policy->record->obj->dtor(record);
+  CWISS_NodeArena_free(policy->record, &self->records_, id);
+  return true;
+}
+
+/// Returns an iterator over every record in the table, which walks the first
+/// index.
+static inline CWISS_ArenaIter CWISS_MultiTable_iter(
+    const CWISS_MultiPolicy* policy, CWISS_MultiTable* self) {
+  CWISS_Policy index = CWISS_ArenaTable_IndexPolicy(policy->record);
+  CWISS_ArenaIter it = {CWISS_RawTable_iter(&index, &self->indexes_[0]),
+                        &self->records_};
+  return it;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_MULTI_INDEX_H_
@@ -88,13 +88,49 @@ static inline CWISS_ProbeSeq CWISS_ProbeSeq_Start(const CWISS_ControlByte* ctrl,
   return CWISS_ProbeSeq_new(CWISS_H1(hash, ctrl), capacity);
 }
 
+/// Begins the second probing operation on `ctrl` for tables that give each
+/// hash two candidate starting groups; see `CWISS_KeyPolicy::two_choice`.
+static inline CWISS_ProbeSeq CWISS_ProbeSeq_StartAlt(
+    const CWISS_ControlByte* ctrl, size_t hash, size_t capacity) {
+  return CWISS_ProbeSeq_new(CWISS_H1Alt(hash, ctrl), capacity);
+}
+
+/// Returns whichever of the two probe sequences for `hash` reaches a group
+/// with a free slot first; if both reach one at the same step, the group with
+/// more free slots wins, and the sequence from `CWISS_ProbeSeq_Start()` wins a
+/// tie.
+///
+/// The returned sequence is rewound to its start. Small tables fit in a single
+/// group, so they always use the first sequence.
+static inline CWISS_ProbeSeq CWISS_ProbeSeq_StartLessLoaded(
+    const CWISS_ControlByte* ctrl, size_t hash, size_t capacity) {
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(ctrl, hash, capacity);
+  if (CWISS_IsSmall(capacity)) return seq;
+  CWISS_ProbeSeq alt = CWISS_ProbeSeq_StartAlt(ctrl, hash, capacity);
+
+  CWISS_ProbeSeq cur = seq, cur_alt = alt;
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(ctrl + cur.offset_);
+    CWISS_Group g_alt = CWISS_Group_new(ctrl + cur_alt.offset_);
+    CWISS_BitMask avail = CWISS_Group_MatchEmptyOrDeleted(&g);
+    CWISS_BitMask avail_alt = CWISS_Group_MatchEmptyOrDeleted(&g_alt);
+    if (CWISS_BitMask_Count(&avail_alt) > CWISS_BitMask_Count(&avail)) {
+      return alt;
+    }
+    if (avail.mask) return seq;
+    CWISS_ProbeSeq_next(&cur);
+    CWISS_ProbeSeq_next(&cur_alt);
+    CWISS_DCHECK(cur.index_ <= capacity, "full table!");
+  }
+}
+
 // The return value of `CWISS_FindFirstNonFull()`.
 typedef struct {
   size_t offset;
   size_t probe_length;
 } CWISS_FindInfo;
 
-/// Probes an array of control bits using a probe sequence derived from `hash`,
+/// Probes an array of control bits along `seq`, a probe sequence for `hash`,
 /// and returns the offset corresponding to the first deleted or empty slot.
 ///
 /// Behavior when the entire table is full is undefined.
@@ -102,9 +138,9 @@ typedef struct {
 /// NOTE: this function must work with tables having both empty and deleted
 /// slots in the same group. Such tables appear during
 /// `CWISS_RawTable_DropDeletesWithoutResize()`.
-static inline CWISS_FindInfo CWISS_FindFirstNonFull(
-    const CWISS_ControlByte* ctrl, size_t hash, size_t capacity) {
-  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(ctrl, hash, capacity);
+static inline CWISS_FindInfo CWISS_FindFirstNonFullIn(
+    const CWISS_ControlByte* ctrl, CWISS_ProbeSeq seq, size_t hash,
+    size_t capacity) {
   while (true) {
     CWISS_Group g = CWISS_Group_new(ctrl + seq.offset_);
     CWISS_BitMask mask = CWISS_Group_MatchEmptyOrDeleted(&g);
@@ -129,6 +165,16 @@ static inline CWISS_FindInfo CWISS_FindFirstNonFull(
   }
 }
 
+/// Probes an array of control bits using a probe sequence derived from `hash`,
+/// and returns the offset corresponding to the first deleted or empty slot.
+///
+/// See `CWISS_FindFirstNonFullIn()`.
+static inline CWISS_FindInfo CWISS_FindFirstNonFull(
+    const CWISS_ControlByte* ctrl, size_t hash, size_t capacity) {
+  return CWISS_FindFirstNonFullIn(
+      ctrl, CWISS_ProbeSeq_Start(ctrl, hash, capacity), hash, capacity);
+}
+
 CWISS_END_EXTERN
 CWISS_END
 
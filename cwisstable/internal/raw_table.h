@@ -15,6 +15,7 @@
 #ifndef CWISSTABLE_INTERNAL_RAW_TABLE_H_
 #define CWISSTABLE_INTERNAL_RAW_TABLE_H_
 
+#include <stdalign.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -28,6 +29,22 @@
 #include "cwisstable/internal/probe.h"
 #include "cwisstable/policy.h"
 
+#if CWISS_HAVE_MMAP
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+/// `CWISS_HAVE_MADVISE` is nonzero where `madvise(MADV_DONTNEED)` is declared.
+/// It is a BSD extension rather than POSIX, so a strict POSIX mode (such as
+/// `-D_POSIX_C_SOURCE=200809L` with glibc) may hide it even with `mmap()`.
+#ifndef CWISS_HAVE_MADVISE
+  #if CWISS_HAVE_MMAP && defined(MADV_DONTNEED)
+    #define CWISS_HAVE_MADVISE 1
+  #else
+    #define CWISS_HAVE_MADVISE 0
+  #endif
+#endif
+
 /// The SwissTable implementation.
 ///
 /// `CWISS_RawTable` is the core data structure that all SwissTables wrap.
@@ -44,6 +61,38 @@
 CWISS_BEGIN
 CWISS_BEGIN_EXTERN
 
+/// A function called when an insertion brings a table's growth budget down to
+/// its low watermark; see `CWISS_RawTable_WatchGrowth()`.
+typedef void (*CWISS_GrowthCallback)(void* ctx);
+
+/// The state of a table's opt-in features: dirty tracking, hit counting, and
+/// the growth watch.
+///
+/// A table allocates this the first time one of them is turned on, and frees
+/// it once all of them are off again, so that a table that uses none of them
+/// carries a single null pointer.
+typedef struct {
+  /// A bitmap with one bit per group (see `CWISS_NumGroups()`), recording
+  /// which groups have been written to since the last call to
+  /// `CWISS_RawTable_ClearDirty()`.
+  ///
+  /// Null unless `CWISS_RawTable_EnableDirtyTracking()` has been called.
+  uint64_t* dirty_;
+  /// A saturating counter per slot of how many times the element in it has
+  /// been found since it was inserted, with `CWISS_HitsSize()` entries.
+  ///
+  /// Null unless `CWISS_RawTable_EnableHitCounting()` has been called.
+  uint8_t* hits_;
+  /// The value of `growth_left_` at which `callback_` fires; see
+  /// `CWISS_RawTable_WatchGrowth()`.
+  size_t low_water_;
+  /// May be null.
+  CWISS_GrowthCallback callback_;
+  void* ctx_;
+  /// Whether an insertion may resize or rehash the table.
+  bool inline_growth_;
+} CWISS_RawTableExt;
+
 /// A SwissTable.
 ///
 /// This is absl::container_internal::raw_hash_set in Abseil.
@@ -62,8 +111,131 @@ typedef struct {
   /// The number of slots we can still fill before a rehash. See
   /// `CWISS_CapacityToGrowth()`.
   size_t growth_left_;
+  /// The state of the table's opt-in features. Null unless one of them is on;
+  /// hot paths test this once, on a cold branch, and look no further.
+  CWISS_RawTableExt* ext_;
 } CWISS_RawTable;
 
+/// Returns the opt-in feature state of `self`, creating it with every feature
+/// off if there is none.
+static inline CWISS_RawTableExt* CWISS_RawTable_Ext(const CWISS_Policy* policy,
+                                                    CWISS_RawTable* self) {
+  if (self->ext_ == NULL) {
+    self->ext_ = (CWISS_RawTableExt*)policy->alloc->alloc(
+        sizeof(CWISS_RawTableExt), alignof(CWISS_RawTableExt));
+    *self->ext_ = (CWISS_RawTableExt){NULL, NULL, 0, NULL, NULL, true};
+  }
+  return self->ext_;
+}
+
+/// Frees the opt-in feature state of `self` if every feature is off.
+static inline void CWISS_RawTable_ReleaseExt(const CWISS_Policy* policy,
+                                             CWISS_RawTable* self) {
+  const CWISS_RawTableExt* ext = self->ext_;
+  if (ext == NULL || ext->dirty_ != NULL || ext->hits_ != NULL ||
+      ext->low_water_ != 0 || ext->callback_ != NULL || !ext->inline_growth_) {
+    return;
+  }
+  policy->alloc->free(self->ext_, sizeof(CWISS_RawTableExt),
+                      alignof(CWISS_RawTableExt));
+  self->ext_ = NULL;
+}
+
+/// Returns the dirty-group bitmap of `self`, or null if dirty tracking is off.
+static inline uint64_t* CWISS_RawTable_Dirty(const CWISS_RawTable* self) {
+  return self->ext_ == NULL ? NULL : self->ext_->dirty_;
+}
+
+/// Returns the hit counters of `self`, or null if hit counting is off.
+static inline uint8_t* CWISS_RawTable_Hits(const CWISS_RawTable* self) {
+  return self->ext_ == NULL ? NULL : self->ext_->hits_;
+}
+
+/// Returns the number of words in the dirty-group bitmap for a table with the
+/// given capacity.
+static inline size_t CWISS_DirtyWords(size_t capacity) {
+  return (CWISS_NumGroups(capacity) + 63) / 64;
+}
+
+/// Marks the group containing the `i`th slot as dirty, if dirty tracking is
+/// enabled.
+static inline void CWISS_RawTable_MarkDirty(CWISS_RawTable* self, size_t i) {
+  if (CWISS_LIKELY(self->ext_ == NULL)) return;
+  uint64_t* dirty = self->ext_->dirty_;
+  if (dirty == NULL) return;
+  size_t group = i / CWISS_Group_kWidth;
+  dirty[group / 64] |= UINT64_C(1) << (group % 64);
+}
+
+/// Marks every group as dirty, if dirty tracking is enabled.
+static inline void CWISS_RawTable_MarkAllDirty(CWISS_RawTable* self) {
+  uint64_t* dirty = CWISS_RawTable_Dirty(self);
+  if (dirty == NULL) return;
+  memset(dirty, 0xff, CWISS_DirtyWords(self->capacity_) * sizeof(uint64_t));
+}
+
+/// Reallocates the dirty-group bitmap after the capacity of `self` changed from
+/// `old_capacity`, if dirty tracking is enabled.
+///
+/// Every group is marked dirty afterwards, since nothing about the new backing
+/// array can be expressed as a delta of the old one.
+static inline void CWISS_RawTable_ResizeDirty(const CWISS_Policy* policy,
+                                              CWISS_RawTable* self,
+                                              size_t old_capacity) {
+  uint64_t* dirty = CWISS_RawTable_Dirty(self);
+  if (dirty == NULL) return;
+  policy->alloc->free(dirty, CWISS_DirtyWords(old_capacity) * sizeof(uint64_t),
+                      alignof(uint64_t));
+  self->ext_->dirty_ = (uint64_t*)policy->alloc->alloc(
+      CWISS_DirtyWords(self->capacity_) * sizeof(uint64_t), alignof(uint64_t));
+  CWISS_RawTable_MarkAllDirty(self);
+}
+
+/// Returns the number of hit counters for a table with the given capacity.
+///
+/// The extra counter keeps the array non-empty, so that hit counting stays
+/// enabled while the table has no backing array.
+static inline size_t CWISS_HitsSize(size_t capacity) { return capacity + 1; }
+
+/// Records that the element in the `i`th slot was found, if hit counting is
+/// enabled; `self` must have an `ext_`.
+///
+/// This writes through a const table: lookups are only read-only while hit
+/// counting is off. Callers check `ext_` first, on a cold branch; this is
+/// kept free of calls, so that the branch does not force a lookup's caller to
+/// spill its registers.
+static inline void CWISS_RawTable_RecordHit(const CWISS_RawTable* self,
+                                            size_t i) {
+  uint8_t* hits = self->ext_->hits_;
+  if (hits != NULL && hits[i] != UINT8_MAX) ++hits[i];
+}
+
+/// Allocates a zeroed hit-counter array for the given capacity.
+static inline uint8_t* CWISS_RawTable_AllocHits(const CWISS_Policy* policy,
+                                                size_t capacity) {
+  uint8_t* hits = (uint8_t*)policy->alloc->alloc(CWISS_HitsSize(capacity), 1);
+  memset(hits, 0, CWISS_HitsSize(capacity));
+  return hits;
+}
+
+/// Frees a hit-counter array for the given capacity, which may be null.
+static inline void CWISS_RawTable_FreeHits(const CWISS_Policy* policy,
+                                           uint8_t* hits, size_t capacity) {
+  if (hits == NULL) return;
+  policy->alloc->free(hits, CWISS_HitsSize(capacity), 1);
+}
+
+/// Reallocates the hit counters after the capacity of `self` changed from
+/// `old_capacity` without keeping its elements, if hit counting is enabled.
+static inline void CWISS_RawTable_ResizeHits(const CWISS_Policy* policy,
+                                             CWISS_RawTable* self,
+                                             size_t old_capacity) {
+  uint8_t* hits = CWISS_RawTable_Hits(self);
+  if (hits == NULL) return;
+  CWISS_RawTable_FreeHits(policy, hits, old_capacity);
+  self->ext_->hits_ = CWISS_RawTable_AllocHits(policy, self->capacity_);
+}
+
 /// Prints full details about the internal state of `self` to `stderr`.
 static inline void CWISS_RawTable_dump(const CWISS_Policy* policy,
                                        const CWISS_RawTable* self) {
@@ -87,7 +259,7 @@ static inline void CWISS_RawTable_dump(const CWISS_Policy* policy,
         fprintf(stderr, " kDeleted");
         break;
       default:
-        fprintf(stderr, " H2(0x%02x)", self->ctrl_[i]);
+        fprintf(stderr, " H2(0x%02x)", self->ctrl_[i] & 0x7F);
         break;
     }
 
@@ -127,6 +299,9 @@ typedef struct {
   CWISS_RawTable* set_;
   CWISS_ControlByte* ctrl_;
   char* slot_;
+  /// For an iterator from `CWISS_RawTable_iter_prefetching()`, the first
+  /// control byte whose element has not been prefetched yet; null otherwise.
+  CWISS_ControlByte* prefetched_;
 } CWISS_RawIter;
 
 /// Fixes up `ctrl_` to point to a full by advancing it and `slot_` until they
@@ -169,6 +344,49 @@ static inline CWISS_RawIter CWISS_RawTable_iter(const CWISS_Policy* policy,
   return CWISS_RawTable_iter_at(policy, self, 0);
 }
 
+/// Prefetches the elements of the group after the one `self` is in, if that
+/// has not happened yet.
+///
+/// Elements that live in the backing array have already been brought in by
+/// reading the slots; this only prefetches through the pointers in them.
+CWISS_INLINE_NEVER
+static void CWISS_RawIter_PrefetchAhead(const CWISS_Policy* policy,
+                                        CWISS_RawIter* self) {
+  CWISS_ControlByte* end = self->set_->ctrl_ + self->set_->capacity_;
+  CWISS_ControlByte* until = self->ctrl_ + 2 * CWISS_Group_kWidth;
+  if (until > end) until = end;
+  while (self->prefetched_ < until) {
+    CWISS_ControlByte* pos = self->prefetched_;
+    CWISS_Group g = CWISS_Group_new(pos);
+    CWISS_BitMask full = CWISS_Group_MatchFull(&g);
+    uint32_t i;
+    while (CWISS_BitMask_next(&full, &i)) {
+      // Past the sentinel, the group sees cloned control bytes, which do not
+      // correspond to slots.
+      if (pos + i >= end) break;
+      char* slot = self->set_->slots_ +
+                   (size_t)(pos + i - self->set_->ctrl_) * policy->slot->size;
+      CWISS_PREFETCH(policy->slot->get(slot), 3);
+    }
+    self->prefetched_ = pos + CWISS_Group_kWidth;
+  }
+}
+
+/// Creates an iterator for `self` that, while it yields the elements of one
+/// group, prefetches those of the next one.
+///
+/// This is for tables with indirect storage (see `CWISS_SlotPolicy`), where
+/// iteration is otherwise bound by chasing one pointer per element.
+static inline CWISS_RawIter CWISS_RawTable_iter_prefetching(
+    const CWISS_Policy* policy, CWISS_RawTable* self) {
+  CWISS_RawIter iter = CWISS_RawTable_iter(policy, self);
+  if (policy->slot->indirect && iter.ctrl_ != NULL) {
+    iter.prefetched_ = self->ctrl_;
+    CWISS_RawIter_PrefetchAhead(policy, &iter);
+  }
+  return iter;
+}
+
 /// Creates a valid iterator starting at the `index`th slot, accepting a `const`
 /// pointer instead.
 static inline CWISS_RawIter CWISS_RawTable_citer_at(const CWISS_Policy* policy,
@@ -183,6 +401,13 @@ static inline CWISS_RawIter CWISS_RawTable_citer(const CWISS_Policy* policy,
   return CWISS_RawTable_iter(policy, (CWISS_RawTable*)self);
 }
 
+/// Creates a prefetching iterator for `self`, accepting a `const` pointer
+/// instead.
+static inline CWISS_RawIter CWISS_RawTable_citer_prefetching(
+    const CWISS_Policy* policy, const CWISS_RawTable* self) {
+  return CWISS_RawTable_iter_prefetching(policy, (CWISS_RawTable*)self);
+}
+
 /// Returns a pointer into the currently pointed-to slot (*not* to the slot
 /// itself, but rather its contents).
 ///
@@ -207,32 +432,43 @@ static inline void* CWISS_RawIter_next(const CWISS_Policy* policy,
   self->slot_ += policy->slot->size;
 
   CWISS_RawIter_SkipEmptyOrDeleted(policy, self);
+  if (policy->slot->indirect && self->prefetched_ != NULL &&
+      self->ctrl_ != NULL &&
+      self->prefetched_ < self->ctrl_ + 2 * CWISS_Group_kWidth) {
+    CWISS_RawIter_PrefetchAhead(policy, self);
+  }
   return CWISS_RawIter_get(policy, self);
 }
 
+/// Marks the slot the iterator points to as dirty, if its table has dirty
+/// tracking enabled (see `CWISS_RawTable_EnableDirtyTracking()`).
+///
+/// Does nothing if the iterator is exhausted.
+static inline void CWISS_RawIter_MarkDirty(const CWISS_RawIter* self) {
+  if (self->ctrl_ == NULL) return;
+  CWISS_RawTable_MarkDirty(self->set_,
+                           (size_t)(self->ctrl_ - self->set_->ctrl_));
+}
+
+/// Returns whether slot `i` of `self` can be marked as empty after erasing it;
+/// see `CWISS_WasNeverFull()`.
+static inline bool CWISS_RawTable_WasNeverFull(const CWISS_RawTable* self,
+                                               size_t i) {
+  return CWISS_WasNeverFull(self->ctrl_, self->capacity_, i);
+}
+
 /// Erases, but does not destroy, the value pointed to by `it`.
 static inline void CWISS_RawTable_EraseMetaOnly(const CWISS_Policy* policy,
                                                 CWISS_RawIter it) {
   CWISS_DCHECK(CWISS_IsFull(*it.ctrl_), "erasing a dangling iterator");
   --it.set_->size_;
   const size_t index = (size_t)(it.ctrl_ - it.set_->ctrl_);
-  const size_t index_before = (index - CWISS_Group_kWidth) & it.set_->capacity_;
-  CWISS_Group g_after = CWISS_Group_new(it.ctrl_);
-  CWISS_BitMask empty_after = CWISS_Group_MatchEmpty(&g_after);
-  CWISS_Group g_before = CWISS_Group_new(it.set_->ctrl_ + index_before);
-  CWISS_BitMask empty_before = CWISS_Group_MatchEmpty(&g_before);
-
-  // We count how many consecutive non empties we have to the right and to the
-  // left of `it`. If the sum is >= kWidth then there is at least one probe
-  // window that might have seen a full group.
-  bool was_never_full =
-      empty_before.mask && empty_after.mask &&
-      (size_t)(CWISS_BitMask_TrailingZeros(&empty_after) +
-               CWISS_BitMask_LeadingZeros(&empty_before)) < CWISS_Group_kWidth;
+  bool was_never_full = CWISS_RawTable_WasNeverFull(it.set_, index);
 
   CWISS_SetCtrl(index, was_never_full ? CWISS_kEmpty : CWISS_kDeleted,
                 it.set_->capacity_, it.set_->ctrl_, it.set_->slots_,
                 policy->slot->size);
+  CWISS_RawTable_MarkDirty(it.set_, index);
   it.set_->growth_left_ += was_never_full;
   // infoz().RecordErase();
 }
@@ -270,16 +506,28 @@ static inline void CWISS_RawTable_InitializeSlots(const CWISS_Policy* policy,
     infoz() = Sample(sizeof(slot_type));
   }*/
 
-  char* mem =
-      (char*)  // Cast for C++.
-      policy->alloc->alloc(CWISS_AllocSize(self->capacity_, policy->slot->size,
-                                           policy->slot->align),
-                           policy->slot->align);
+  size_t size = CWISS_AllocSize(self->capacity_, policy->slot->size,
+                                policy->slot->align);
+  char* mem = NULL;
+  if (CWISS_ZERO_EMPTY_CTRL && policy->alloc->alloc_zeroed != NULL) {
+    // Zeroed memory is all empty already, and may well be fresh pages that
+    // are not resident yet; writing to them would defeat the point.
+    mem = (char*)policy->alloc->alloc_zeroed(size, policy->slot->align);
+  }
+  bool zeroed = mem != NULL;
+  if (!zeroed) {
+    mem = (char*)policy->alloc->alloc(size, policy->slot->align);
+  }
 
   self->ctrl_ = (CWISS_ControlByte*)mem;
   self->slots_ = mem + CWISS_SlotOffset(self->capacity_, policy->slot->align);
-  CWISS_ResetCtrl(self->capacity_, self->ctrl_, self->slots_,
-                  policy->slot->size);
+  if (zeroed) {
+    CWISS_ResetZeroedCtrl(self->capacity_, self->ctrl_, self->slots_,
+                          policy->slot->size);
+  } else {
+    CWISS_ResetCtrl(self->capacity_, self->ctrl_, self->slots_,
+                    policy->slot->size);
+  }
   CWISS_RawTable_ResetGrowthLeft(policy, self);
 
   // infoz().RecordStorageChanged(size_, capacity_);
@@ -299,6 +547,7 @@ static inline void CWISS_RawTable_DestroySlots(const CWISS_Policy* policy,
     }
   }
 
+  const size_t old_capacity = self->capacity_;
   policy->alloc->free(
       self->ctrl_,
       CWISS_AllocSize(self->capacity_, policy->slot->size, policy->slot->align),
@@ -308,6 +557,28 @@ static inline void CWISS_RawTable_DestroySlots(const CWISS_Policy* policy,
   self->size_ = 0;
   self->capacity_ = 0;
   self->growth_left_ = 0;
+  CWISS_RawTable_ResizeDirty(policy, self, old_capacity);
+  CWISS_RawTable_ResizeHits(policy, self, old_capacity);
+}
+
+/// Returns the probe sequence along which an element with the given hash
+/// should be inserted into the control bytes `ctrl`.
+static inline CWISS_ProbeSeq CWISS_RawTable_InsertSeq(
+    const CWISS_Policy* policy, const CWISS_ControlByte* ctrl, size_t hash,
+    size_t capacity) {
+  if (policy->key->two_choice) {
+    return CWISS_ProbeSeq_StartLessLoaded(ctrl, hash, capacity);
+  }
+  return CWISS_ProbeSeq_Start(ctrl, hash, capacity);
+}
+
+/// Like `CWISS_FindFirstNonFull()`, but follows the probing mode of `policy`.
+static inline CWISS_FindInfo CWISS_RawTable_FindFirstNonFull(
+    const CWISS_Policy* policy, const CWISS_ControlByte* ctrl, size_t hash,
+    size_t capacity) {
+  return CWISS_FindFirstNonFullIn(
+      ctrl, CWISS_RawTable_InsertSeq(policy, ctrl, hash, capacity), hash,
+      capacity);
 }
 
 /// Grows the table to the given capacity, triggering a rehash.
@@ -320,22 +591,27 @@ static inline void CWISS_RawTable_Resize(const CWISS_Policy* policy,
   CWISS_ControlByte* old_ctrl = self->ctrl_;
   char* old_slots = self->slots_;
   const size_t old_capacity = self->capacity_;
+  uint8_t* old_hits = CWISS_RawTable_Hits(self);
   self->capacity_ = new_capacity;
   CWISS_RawTable_InitializeSlots(policy, self);
+  if (old_hits != NULL) {
+    self->ext_->hits_ = CWISS_RawTable_AllocHits(policy, new_capacity);
+  }
 
   size_t total_probe_length = 0;
   for (size_t i = 0; i != old_capacity; ++i) {
     if (CWISS_IsFull(old_ctrl[i])) {
       size_t hash = policy->key->hash(
           policy->slot->get(old_slots + i * policy->slot->size));
-      CWISS_FindInfo target =
-          CWISS_FindFirstNonFull(self->ctrl_, hash, self->capacity_);
+      CWISS_FindInfo target = CWISS_RawTable_FindFirstNonFull(
+          policy, self->ctrl_, hash, self->capacity_);
       size_t new_i = target.offset;
       total_probe_length += target.probe_length;
       CWISS_SetCtrl(new_i, CWISS_H2(hash), self->capacity_, self->ctrl_,
                     self->slots_, policy->slot->size);
       policy->slot->transfer(self->slots_ + new_i * policy->slot->size,
                              old_slots + i * policy->slot->size);
+      if (old_hits != NULL) self->ext_->hits_[new_i] = old_hits[i];
     }
   }
   if (old_capacity) {
@@ -345,50 +621,37 @@ static inline void CWISS_RawTable_Resize(const CWISS_Policy* policy,
         CWISS_AllocSize(old_capacity, policy->slot->size, policy->slot->align),
         policy->slot->align);
   }
+  CWISS_RawTable_ResizeDirty(policy, self, old_capacity);
+  CWISS_RawTable_FreeHits(policy, old_hits, old_capacity);
+  CWISS_TRACE5(resize, policy, self->size_, old_capacity, new_capacity,
+               total_probe_length);
   // infoz().RecordRehash(total_probe_length);
 }
 
-/// Prunes control bits to remove as many tombstones as possible.
+/// Moves every element in a slot marked as `kDeleted` whose hit count (zero,
+/// if hit counting is disabled) is within `[lo, hi]` to the first non-full slot
+/// of its probe sequence; see `CWISS_RawTable_DropDeletesWithoutResize()`.
 ///
-/// See the comment on `CWISS_RawTable_rehash_and_grow_if_necessary()`.
-CWISS_INLINE_NEVER
-static void CWISS_RawTable_DropDeletesWithoutResize(const CWISS_Policy* policy,
-                                                    CWISS_RawTable* self) {
-  CWISS_DCHECK(CWISS_IsValidCapacity(self->capacity_), "invalid capacity: %zu",
-               self->capacity_);
-  CWISS_DCHECK(!CWISS_IsSmall(self->capacity_),
-               "unexpected small capacity: %zu", self->capacity_);
-  // Algorithm:
-  // - mark all DELETED slots as EMPTY
-  // - mark all FULL slots as DELETED
-  // - for each slot marked as DELETED
-  //     hash = Hash(element)
-  //     target = find_first_non_full(hash)
-  //     if target is in the same group
-  //       mark slot as FULL
-  //     else if target is EMPTY
-  //       transfer element to target
-  //       mark slot as EMPTY
-  //       mark target as FULL
-  //     else if target is DELETED
-  //       swap current element with target element
-  //       mark target as FULL
-  //       repeat procedure for current slot with moved from element (target)
-  CWISS_ConvertDeletedToEmptyAndFullToDeleted(self->ctrl_, self->capacity_);
+/// Elements left marked as `kDeleted` count as non-full, so the elements moved
+/// by one call get ahead of those moved by a later call. `slot` is scratch
+/// space for one slot.
+static inline void CWISS_RawTable_PlaceDeleted(const CWISS_Policy* policy,
+                                               CWISS_RawTable* self, void* slot,
+                                               uint8_t lo, uint8_t hi) {
+  uint8_t* counts = CWISS_RawTable_Hits(self);
   size_t total_probe_length = 0;
-  // Unfortunately because we do not know this size statically, we need to take
-  // a trip to the allocator. Alternatively we could use a variable length
-  // alloca...
-  void* slot = policy->alloc->alloc(policy->slot->size, policy->slot->align);
-
   for (size_t i = 0; i != self->capacity_; ++i) {
     if (!CWISS_IsDeleted(self->ctrl_[i])) continue;
+    uint8_t hits = counts == NULL ? 0 : counts[i];
+    if (hits < lo || hits > hi) continue;
 
     char* old_slot = self->slots_ + i * policy->slot->size;
     size_t hash = policy->key->hash(policy->slot->get(old_slot));
 
+    const CWISS_ProbeSeq seq =
+        CWISS_RawTable_InsertSeq(policy, self->ctrl_, hash, self->capacity_);
     const CWISS_FindInfo target =
-        CWISS_FindFirstNonFull(self->ctrl_, hash, self->capacity_);
+        CWISS_FindFirstNonFullIn(self->ctrl_, seq, hash, self->capacity_);
     const size_t new_i = target.offset;
     total_probe_length += target.probe_length;
 
@@ -397,8 +660,7 @@ static void CWISS_RawTable_DropDeletesWithoutResize(const CWISS_Policy* policy,
     // Verify if the old and new i fall within the same group wrt the hash.
     // If they do, we don't need to move the object as it falls already in the
     // best probe we can.
-    const size_t probe_offset =
-        CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_).offset_;
+    const size_t probe_offset = seq.offset_;
 #define CWISS_ProbeIndex(pos_) \
   (((pos_ - probe_offset) & self->capacity_) / CWISS_Group_kWidth)
 
@@ -417,6 +679,10 @@ static void CWISS_RawTable_DropDeletesWithoutResize(const CWISS_Policy* policy,
       policy->slot->transfer(new_slot, old_slot);
       CWISS_SetCtrl(i, CWISS_kEmpty, self->capacity_, self->ctrl_, self->slots_,
                     policy->slot->size);
+      if (counts != NULL) {
+        counts[new_i] = hits;
+        counts[i] = 0;
+      }
     } else {
       CWISS_DCHECK(CWISS_IsDeleted(self->ctrl_[new_i]),
                    "bad ctrl value at %zu: %02x", new_i, self->ctrl_[new_i]);
@@ -428,15 +694,128 @@ static void CWISS_RawTable_DropDeletesWithoutResize(const CWISS_Policy* policy,
       policy->slot->transfer(slot, old_slot);
       policy->slot->transfer(old_slot, new_slot);
       policy->slot->transfer(new_slot, slot);
+      if (counts != NULL) {
+        counts[i] = counts[new_i];
+        counts[new_i] = hits;
+      }
       --i;  // repeat
     }
-#undef CWISS_ProbeSeq_Start_index
+#undef CWISS_ProbeIndex
   }
-  CWISS_RawTable_ResetGrowthLeft(policy, self);
-  policy->alloc->free(slot, policy->slot->size, policy->slot->align);
   // infoz().RecordRehash(total_probe_length);
 }
 
+/// Claims an empty slot of `self`, whose control bytes have just been through
+/// `CWISS_ConvertDeletedToEmptyAndFullToDeleted()`, as scratch space for one
+/// element, and returns its index. There is always one, since the load factor
+/// is below one, and using it avoids a trip to the allocator.
+///
+/// The slot is marked as `kSentinel`, which is neither empty nor deleted, so
+/// no element is placed there until `CWISS_RawTable_ReleaseScratch()`.
+static inline size_t CWISS_RawTable_ClaimScratch(const CWISS_Policy* policy,
+                                                 CWISS_RawTable* self) {
+  size_t i = 0;
+  while (!CWISS_IsEmpty(self->ctrl_[i])) {
+    ++i;
+    CWISS_DCHECK(i < self->capacity_, "no empty slot for scratch space");
+  }
+  CWISS_SetCtrl(i, CWISS_kSentinel, self->capacity_, self->ctrl_, self->slots_,
+                policy->slot->size);
+  CWISS_UnpoisonMemory(self->slots_ + i * policy->slot->size,
+                       policy->slot->size);
+  return i;
+}
+
+/// Returns the scratch slot claimed by `CWISS_RawTable_ClaimScratch()`.
+///
+/// While it was claimed, elements may have been pushed past it, so it is
+/// marked as erased would be; see `CWISS_RawTable_WasNeverFull()`. A tombstone
+/// left there is charged to `growth_left_`, so this must be called after
+/// `CWISS_RawTable_ResetGrowthLeft()`.
+static inline void CWISS_RawTable_ReleaseScratch(const CWISS_Policy* policy,
+                                                 CWISS_RawTable* self,
+                                                 size_t i) {
+  bool was_never_full = CWISS_RawTable_WasNeverFull(self, i);
+  CWISS_SetCtrl(i, was_never_full ? CWISS_kEmpty : CWISS_kDeleted,
+                self->capacity_, self->ctrl_, self->slots_,
+                policy->slot->size);
+  if (!was_never_full && self->growth_left_ != 0) --self->growth_left_;
+}
+
+/// Prunes control bits to remove as many tombstones as possible.
+///
+/// See the comment on `CWISS_RawTable_rehash_and_grow_if_necessary()`.
+CWISS_INLINE_NEVER
+static void CWISS_RawTable_DropDeletesWithoutResize(const CWISS_Policy* policy,
+                                                    CWISS_RawTable* self) {
+  CWISS_DCHECK(CWISS_IsValidCapacity(self->capacity_), "invalid capacity: %zu",
+               self->capacity_);
+  CWISS_DCHECK(!CWISS_IsSmall(self->capacity_),
+               "unexpected small capacity: %zu", self->capacity_);
+  // Algorithm:
+  // - mark all DELETED slots as EMPTY
+  // - mark all FULL slots as DELETED
+  // - for each slot marked as DELETED
+  //     hash = Hash(element)
+  //     target = find_first_non_full(hash)
+  //     if target is in the same group
+  //       mark slot as FULL
+  //     else if target is EMPTY
+  //       transfer element to target
+  //       mark slot as EMPTY
+  //       mark target as FULL
+  //     else if target is DELETED
+  //       swap current element with target element
+  //       mark target as FULL
+  //       repeat procedure for current slot with moved from element (target)
+  CWISS_ConvertDeletedToEmptyAndFullToDeleted(self->ctrl_, self->capacity_);
+  size_t scratch = CWISS_RawTable_ClaimScratch(policy, self);
+  CWISS_RawTable_PlaceDeleted(policy, self,
+                              self->slots_ + scratch * policy->slot->size, 0,
+                              UINT8_MAX);
+  CWISS_RawTable_ResetGrowthLeft(policy, self);
+  CWISS_RawTable_ReleaseScratch(policy, self, scratch);
+  CWISS_RawTable_MarkAllDirty(self);
+  CWISS_TRACE3(drop_deletes, policy, self->size_, self->capacity_);
+}
+
+/// Reorders the elements of `self` in place so that the most frequently found
+/// ones come first along their probe sequences, dropping all tombstones along
+/// the way. Afterwards, every hit count is halved, so that counts favor recent
+/// lookups.
+///
+/// This is `CWISS_RawTable_DropDeletesWithoutResize()`, except that elements
+/// are placed in passes of decreasing `floor(log2(hits))` rather than in slot
+/// order. Since the elements of earlier passes claim the earliest free slots
+/// of their probe sequences, hot elements inserted late move ahead of cold
+/// ones inserted early.
+///
+/// Does nothing unless hit counting is enabled (see
+/// `CWISS_RawTable_EnableHitCounting()`) or if the table is small enough to
+/// be a single group.
+CWISS_INLINE_NEVER
+static void CWISS_RawTable_OptimizeLayout(const CWISS_Policy* policy,
+                                          CWISS_RawTable* self) {
+  uint8_t* hits = CWISS_RawTable_Hits(self);
+  if (hits == NULL || CWISS_IsSmall(self->capacity_)) return;
+
+  CWISS_ConvertDeletedToEmptyAndFullToDeleted(self->ctrl_, self->capacity_);
+  size_t scratch = CWISS_RawTable_ClaimScratch(policy, self);
+  void* slot = self->slots_ + scratch * policy->slot->size;
+  for (uint32_t log = 8; log > 0; --log) {
+    CWISS_RawTable_PlaceDeleted(policy, self, slot, (uint8_t)(1u << (log - 1)),
+                                (uint8_t)((1u << log) - 1));
+  }
+  CWISS_RawTable_PlaceDeleted(policy, self, slot, 0, 0);
+  CWISS_RawTable_ResetGrowthLeft(policy, self);
+  CWISS_RawTable_ReleaseScratch(policy, self, scratch);
+  CWISS_RawTable_MarkAllDirty(self);
+
+  for (size_t i = 0; i < self->capacity_; ++i) {
+    hits[i] >>= 1;
+  }
+}
+
 /// Called whenever the table *might* need to conditionally grow.
 ///
 /// This function is an optimization opportunity to perform a rehash even when
@@ -505,6 +884,47 @@ static inline void CWISS_RawTable_PrefetchHeapBlock(
   CWISS_PREFETCH(self->ctrl_, 1);
 }
 
+/// Issues CPU prefetch instructions for the first group probed for a key with
+/// the given hash, and for its slots; for two-choice policies, this covers
+/// both candidate first groups.
+static inline void CWISS_RawTable_PrefetchHinted(const CWISS_Policy* policy,
+                                                 const CWISS_RawTable* self,
+                                                 size_t hash) {
+  (void)policy, (void)self, (void)hash;
+#if CWISS_HAVE_PREFETCH
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
+  CWISS_PREFETCH(self->ctrl_ + seq.offset_, 3);
+  CWISS_PREFETCH(self->slots_ + seq.offset_ * policy->slot->size, 3);
+  if (policy->key->two_choice) {
+    seq = CWISS_ProbeSeq_StartAlt(self->ctrl_, hash, self->capacity_);
+    CWISS_PREFETCH(self->ctrl_ + seq.offset_, 3);
+    CWISS_PREFETCH(self->slots_ + seq.offset_ * policy->slot->size, 3);
+  }
+#endif
+}
+
+/// Prefetches the values of all the candidates in `match`, for policies whose
+/// values live outside of the backing array.
+///
+/// Without this, each candidate costs a load of its slot followed by a
+/// dependent load of its value inside `eq`, one candidate after another.
+/// Prefetching them all first overlaps those misses. A lone candidate gains
+/// nothing from it, so it is skipped.
+static inline void CWISS_RawTable_PrefetchCandidates(
+    const CWISS_Policy* policy, const CWISS_RawTable* self,
+    const CWISS_ProbeSeq* seq, CWISS_BitMask match) {
+  (void)policy, (void)self, (void)seq, (void)match;
+#if CWISS_HAVE_PREFETCH
+  if (!policy->slot->indirect || (match.mask & (match.mask - 1)) == 0) return;
+  uint32_t i;
+  while (CWISS_BitMask_next(&match, &i)) {
+    char* slot =
+        self->slots_ + CWISS_ProbeSeq_offset(seq, i) * policy->slot->size;
+    CWISS_PREFETCH(policy->slot->get(slot), 3);
+  }
+#endif
+}
+
 /// Issues CPU prefetch instructions for the memory needed to find or insert
 /// a key.
 ///
@@ -516,65 +936,224 @@ static inline void CWISS_RawTable_Prefetch(const CWISS_Policy* policy,
   (void)key;
 #if CWISS_HAVE_PREFETCH
   CWISS_RawTable_PrefetchHeapBlock(policy, self);
-  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, policy->key->hash(key),
-                                            self->capacity_);
-  CWISS_PREFETCH(self->ctrl_ + seq.offset_, 3);
-  CWISS_PREFETCH(self->ctrl_ + seq.offset_ * policy->slot->size, 3);
+  CWISS_RawTable_PrefetchHinted(policy, self, policy->key->hash(key));
 #endif
 }
 
+/// Returns the index of the slot among the candidates in `match`, a mask over
+/// the group at `seq`, that holds `key`, or `capacity_` if there is none.
+CWISS_INLINE_ALWAYS
+static inline size_t CWISS_RawTable_FindInGroup(
+    const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
+    const CWISS_RawTable* self, const void* key, const CWISS_ProbeSeq* seq,
+    CWISS_BitMask match) {
+  uint32_t i;
+  while (CWISS_BitMask_next(&match, &i)) {
+    size_t idx = CWISS_ProbeSeq_offset(seq, i);
+    char* slot = self->slots_ + idx * policy->slot->size;
+    if (CWISS_LIKELY(key_policy->eq(key, policy->slot->get(slot)))) {
+      return idx;
+    }
+  }
+  return self->capacity_;
+}
+
+/// Looks up `key` along `seq` alone, returning the index of its slot, or
+/// `capacity_` if it is absent.
+///
+/// Like `CWISS_RawTable_FindInGroup()`, this is always inlined, so that
+/// constant policies stay constant.
+CWISS_INLINE_ALWAYS
+static inline size_t CWISS_RawTable_FindAlong(const CWISS_Policy* policy,
+                                              const CWISS_KeyPolicy* key_policy,
+                                              const CWISS_RawTable* self,
+                                              const void* key, size_t hash,
+                                              CWISS_ProbeSeq seq) {
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
+    CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+    CWISS_RawTable_PrefetchCandidates(policy, self, &seq, match);
+    size_t idx =
+        CWISS_RawTable_FindInGroup(policy, key_policy, self, key, &seq, match);
+    if (idx != self->capacity_) return idx;
+    if (CWISS_LIKELY(CWISS_Group_MatchEmpty(&g).mask)) return self->capacity_;
+    CWISS_ProbeSeq_next(&seq);
+    CWISS_DCHECK(seq.index_ <= self->capacity_, "full table!");
+  }
+}
+
+/// Looks up `key` in a table whose policy has `two_choice` set, returning the
+/// index of its slot, or `capacity_` if it is absent.
+///
+/// Both first groups are loaded before any keys are compared, so that their
+/// cache misses overlap. Past them, each sequence is followed on its own until
+/// it reaches a group with an empty slot, which is rare.
+///
+/// This is kept out of line so that it does not count against inlining the
+/// single-sequence loops that most tables use.
+CWISS_INLINE_NEVER
+static size_t CWISS_RawTable_FindTwoChoice(
+    const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
+    const CWISS_RawTable* self, const void* key, size_t hash) {
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
+  // Small tables fit in a single group, which the first sequence covers.
+  if (CWISS_IsSmall(self->capacity_)) {
+    return CWISS_RawTable_FindAlong(policy, key_policy, self, key, hash, seq);
+  }
+  CWISS_ProbeSeq alt =
+      CWISS_ProbeSeq_StartAlt(self->ctrl_, hash, self->capacity_);
+
+  CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
+  CWISS_Group g_alt = CWISS_Group_new(self->ctrl_ + alt.offset_);
+  CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+  CWISS_BitMask match_alt = CWISS_Group_Match(&g_alt, CWISS_H2(hash));
+  CWISS_RawTable_PrefetchCandidates(policy, self, &seq, match);
+  CWISS_RawTable_PrefetchCandidates(policy, self, &alt, match_alt);
+
+  size_t idx =
+      CWISS_RawTable_FindInGroup(policy, key_policy, self, key, &seq, match);
+  if (idx != self->capacity_) return idx;
+  idx = CWISS_RawTable_FindInGroup(policy, key_policy, self, key, &alt,
+                                   match_alt);
+  if (idx != self->capacity_) return idx;
+
+  if (CWISS_UNLIKELY(!CWISS_Group_MatchEmpty(&g).mask)) {
+    CWISS_ProbeSeq_next(&seq);
+    idx = CWISS_RawTable_FindAlong(policy, key_policy, self, key, hash, seq);
+    if (idx != self->capacity_) return idx;
+  }
+  if (CWISS_UNLIKELY(!CWISS_Group_MatchEmpty(&g_alt).mask)) {
+    CWISS_ProbeSeq_next(&alt);
+    return CWISS_RawTable_FindAlong(policy, key_policy, self, key, hash, alt);
+  }
+  return self->capacity_;
+}
+
+/// Looks up `key` in a table whose policy has `indirect` set, returning the
+/// index of its slot, or `capacity_` if it is absent.
+///
+/// This differs from the plain probe loop only in prefetching the values of
+/// all candidates in a group before comparing any of them; see
+/// `CWISS_RawTable_PrefetchCandidates()`. Lookups pick it on the policy up
+/// front, so that flat tables keep the plain loop.
+static inline size_t CWISS_RawTable_FindIndirect(
+    const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
+    const CWISS_RawTable* self, const void* key, size_t hash) {
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
+  return CWISS_RawTable_FindAlong(policy, key_policy, self, key, hash, seq);
+}
+
 /// The return type of `CWISS_RawTable_PrepareInsert()`.
 typedef struct {
   size_t index;
   bool inserted;
 } CWISS_PrepareInsert;
 
+/// Updates the opt-in features of `self`, which must have an `ext_`, after an
+/// insertion into the `i`th slot, which was empty if `was_empty`.
+///
+/// This marks the slot's group dirty, resets its hit count, and fires the
+/// growth callback if the insertion has left the growth budget at or below
+/// the low watermark.
+static inline void CWISS_RawTable_NoteInsert(CWISS_RawTable* self, size_t i,
+                                             bool was_empty) {
+  const CWISS_RawTableExt* ext = self->ext_;
+  CWISS_RawTable_MarkDirty(self, i);
+  if (ext->hits_ != NULL) ext->hits_[i] = 0;
+  if (was_empty && ext->callback_ != NULL &&
+      self->growth_left_ <= ext->low_water_) {
+    ext->callback_(ext->ctx_);
+  }
+}
+
 /// Given the hash of a value not currently in the table, finds the next viable
 /// slot index to insert it at.
 ///
-/// If the table does not actually have space, UB.
+/// Returns `self->capacity_` if the table is out of room and inline growth has
+/// been disabled (see `CWISS_RawTable_SetInlineGrowth()`).
 CWISS_INLINE_NEVER
 static size_t CWISS_RawTable_PrepareInsert(const CWISS_Policy* policy,
                                            CWISS_RawTable* self, size_t hash) {
-  CWISS_FindInfo target =
-      CWISS_FindFirstNonFull(self->ctrl_, hash, self->capacity_);
+  CWISS_FindInfo target = CWISS_RawTable_FindFirstNonFull(
+      policy, self->ctrl_, hash, self->capacity_);
   if (CWISS_UNLIKELY(self->growth_left_ == 0 &&
                      !CWISS_IsDeleted(self->ctrl_[target.offset]))) {
+    if (self->ext_ != NULL && !self->ext_->inline_growth_) {
+      return self->capacity_;
+    }
     CWISS_RawTable_rehash_and_grow_if_necessary(policy, self);
-    target = CWISS_FindFirstNonFull(self->ctrl_, hash, self->capacity_);
+    target = CWISS_RawTable_FindFirstNonFull(policy, self->ctrl_, hash,
+                                             self->capacity_);
   }
   ++self->size_;
-  self->growth_left_ -= CWISS_IsEmpty(self->ctrl_[target.offset]);
+  bool was_empty = CWISS_IsEmpty(self->ctrl_[target.offset]);
+  self->growth_left_ -= was_empty;
   CWISS_SetCtrl(target.offset, CWISS_H2(hash), self->capacity_, self->ctrl_,
                 self->slots_, policy->slot->size);
+  if (CWISS_UNLIKELY(self->ext_ != NULL)) {
+    CWISS_RawTable_NoteInsert(self, target.offset, was_empty);
+  }
+  CWISS_TRACE4(prepare_insert, policy, self->size_, self->capacity_,
+               target.probe_length);
   // infoz().RecordInsert(hash, target.probe_length);
   return target.offset;
 }
 
+/// Attempts to find `key` in the table using `hash` as a hint; if it isn't
+/// found, returns where to insert it, instead.
+///
+/// If there is no room for `key` and inline growth is disabled, returns an
+/// index of `self->capacity_` with `inserted` unset.
+///
+/// If `hash` is not actually the hash of `key`, UB.
+static inline CWISS_PrepareInsert CWISS_RawTable_FindOrPrepareInsertHinted(
+    const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
+    CWISS_RawTable* self, const void* key, size_t hash) {
+  if (policy->key->two_choice || policy->slot->indirect) {
+    size_t idx =
+        policy->key->two_choice
+            ? CWISS_RawTable_FindTwoChoice(policy, key_policy, self, key, hash)
+            : CWISS_RawTable_FindIndirect(policy, key_policy, self, key, hash);
+    if (idx != self->capacity_) {
+      if (CWISS_UNLIKELY(self->ext_ != NULL)) {
+        CWISS_RawTable_RecordHit(self, idx);
+      }
+      return (CWISS_PrepareInsert){idx, false};
+    }
+  } else {
+    CWISS_ProbeSeq seq =
+        CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
+    while (true) {
+      CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
+      CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+      uint32_t i;
+      while (CWISS_BitMask_next(&match, &i)) {
+        size_t idx = CWISS_ProbeSeq_offset(&seq, i);
+        char* slot = self->slots_ + idx * policy->slot->size;
+        if (CWISS_LIKELY(key_policy->eq(key, policy->slot->get(slot)))) {
+          if (CWISS_UNLIKELY(self->ext_ != NULL)) {
+            CWISS_RawTable_RecordHit(self, idx);
+          }
+          return (CWISS_PrepareInsert){idx, false};
+        }
+      }
+      if (CWISS_LIKELY(CWISS_Group_MatchEmpty(&g).mask)) break;
+      CWISS_ProbeSeq_next(&seq);
+      CWISS_DCHECK(seq.index_ <= self->capacity_, "full table!");
+    }
+  }
+  size_t i = CWISS_RawTable_PrepareInsert(policy, self, hash);
+  return (CWISS_PrepareInsert){i, i != self->capacity_};
+}
+
 /// Attempts to find `key` in the table; if it isn't found, returns where to
 /// insert it, instead.
 static inline CWISS_PrepareInsert CWISS_RawTable_FindOrPrepareInsert(
     const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
     CWISS_RawTable* self, const void* key) {
   CWISS_RawTable_PrefetchHeapBlock(policy, self);
-  size_t hash = key_policy->hash(key);
-  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
-  while (true) {
-    CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
-    CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
-    uint32_t i;
-    while (CWISS_BitMask_next(&match, &i)) {
-      size_t idx = CWISS_ProbeSeq_offset(&seq, i);
-      char* slot = self->slots_ + idx * policy->slot->size;
-      if (CWISS_LIKELY(key_policy->eq(key, policy->slot->get(slot))))
-        return (CWISS_PrepareInsert){idx, false};
-    }
-    if (CWISS_LIKELY(CWISS_Group_MatchEmpty(&g).mask)) break;
-    CWISS_ProbeSeq_next(&seq);
-    CWISS_DCHECK(seq.index_ <= self->capacity_, "full table!");
-  }
-  return (CWISS_PrepareInsert){CWISS_RawTable_PrepareInsert(policy, self, hash),
-                               true};
+  return CWISS_RawTable_FindOrPrepareInsertHinted(policy, key_policy, self, key,
+                                                  key_policy->hash(key));
 }
 
 /// Prepares a slot to insert an element into.
@@ -635,8 +1214,8 @@ static inline CWISS_RawTable CWISS_RawTable_dup(const CWISS_Policy* policy,
     void* v = CWISS_RawIter_get(policy, &iter);
     size_t hash = policy->key->hash(v);
 
-    CWISS_FindInfo target =
-        CWISS_FindFirstNonFull(copy.ctrl_, hash, copy.capacity_);
+    CWISS_FindInfo target = CWISS_RawTable_FindFirstNonFull(
+        policy, copy.ctrl_, hash, copy.capacity_);
     CWISS_SetCtrl(target.offset, CWISS_H2(hash), copy.capacity_, copy.ctrl_,
                   copy.slots_, policy->slot->size);
     void* slot = CWISS_RawTable_PreInsert(policy, &copy, target.offset);
@@ -648,12 +1227,351 @@ static inline CWISS_RawTable CWISS_RawTable_dup(const CWISS_Policy* policy,
   return copy;
 }
 
+/// Enables dirty-group tracking on `self`.
+///
+/// Once enabled, every write to a control byte, and every slot handed out by
+/// the mutating typed API, marks the group (see `CWISS_NumGroups()`) it belongs
+/// to as dirty. A checkpoint writer can then use
+/// `CWISS_RawTable_NextDirtyGroup()` to emit only the groups that changed
+/// since the previous checkpoint, and `CWISS_RawTable_ApplyDirtyGroup()` to
+/// replay them onto a base snapshot.
+///
+/// Any operation that reallocates the backing array (growth, `rehash()`,
+/// `clear()` of a large table) marks every group as dirty, forcing the next
+/// checkpoint to be a full snapshot. Enabling tracking does the same.
+///
+/// Does nothing if tracking is already enabled.
+static inline void CWISS_RawTable_EnableDirtyTracking(
+    const CWISS_Policy* policy, CWISS_RawTable* self) {
+  CWISS_RawTableExt* ext = CWISS_RawTable_Ext(policy, self);
+  if (ext->dirty_ != NULL) return;
+  ext->dirty_ = (uint64_t*)policy->alloc->alloc(
+      CWISS_DirtyWords(self->capacity_) * sizeof(uint64_t), alignof(uint64_t));
+  CWISS_RawTable_MarkAllDirty(self);
+}
+
+/// Disables dirty-group tracking on `self`, freeing the bitmap.
+static inline void CWISS_RawTable_DisableDirtyTracking(
+    const CWISS_Policy* policy, CWISS_RawTable* self) {
+  uint64_t* dirty = CWISS_RawTable_Dirty(self);
+  if (dirty == NULL) return;
+  policy->alloc->free(dirty,
+                      CWISS_DirtyWords(self->capacity_) * sizeof(uint64_t),
+                      alignof(uint64_t));
+  self->ext_->dirty_ = NULL;
+  CWISS_RawTable_ReleaseExt(policy, self);
+}
+
+/// Enables per-slot hit counting on `self`.
+///
+/// Once enabled, every lookup that finds an element, including an insertion of
+/// an element that is already present, bumps a saturating 8-bit counter for
+/// the slot it is in. `CWISS_RawTable_OptimizeLayout()` uses these counts to
+/// move frequently found elements forward in their probe sequences. This
+/// costs one byte per slot and a store per successful lookup.
+///
+/// That store makes every lookup a write, even through a const table: while
+/// counting is enabled, lookups must not run concurrently with each other.
+///
+/// Does nothing if counting is already enabled.
+static inline void CWISS_RawTable_EnableHitCounting(const CWISS_Policy* policy,
+                                                    CWISS_RawTable* self) {
+  CWISS_RawTableExt* ext = CWISS_RawTable_Ext(policy, self);
+  if (ext->hits_ != NULL) return;
+  ext->hits_ = CWISS_RawTable_AllocHits(policy, self->capacity_);
+}
+
+/// Disables hit counting on `self`, freeing the counters.
+static inline void CWISS_RawTable_DisableHitCounting(
+    const CWISS_Policy* policy, CWISS_RawTable* self) {
+  uint8_t* hits = CWISS_RawTable_Hits(self);
+  if (hits == NULL) return;
+  CWISS_RawTable_FreeHits(policy, hits, self->capacity_);
+  self->ext_->hits_ = NULL;
+  CWISS_RawTable_ReleaseExt(policy, self);
+}
+
+/// Sets a low watermark on the growth budget of `self`.
+///
+/// Whenever an insertion uses up an empty slot and leaves
+/// `CWISS_RawTable_growth_left()` at or below `low_water`, it calls
+/// `callback(ctx)`, just before it returns. This lets an application grow the
+/// table with `CWISS_RawTable_reserve()` at a time of its choosing, such as
+/// an idle point in an event loop, before an insertion has to. The callback
+/// runs inside the insertion, so it must not touch the table; it should only
+/// record that growth is due, since every insertion into an empty slot calls
+/// it again until the table grows. A watermark set at or above the current
+/// budget thus fires on the next such insertion.
+///
+/// `callback` may be null, in which case only `CWISS_RawTable_NeedsGrowth()`
+/// reports the crossing. Growth watches survive resizes and `clear()`, but not
+/// `CWISS_RawTable_Detach()`; they are not copied by `CWISS_RawTable_dup()`.
+static inline void CWISS_RawTable_WatchGrowth(const CWISS_Policy* policy,
+                                              CWISS_RawTable* self,
+                                              size_t low_water,
+                                              CWISS_GrowthCallback callback,
+                                              void* ctx) {
+  CWISS_RawTableExt* ext = CWISS_RawTable_Ext(policy, self);
+  ext->low_water_ = low_water;
+  ext->callback_ = callback;
+  ext->ctx_ = ctx;
+  CWISS_RawTable_ReleaseExt(policy, self);
+}
+
+/// Sets whether insertions into `self` may resize or rehash it.
+///
+/// When they may not, an insertion that would have to resize or rehash the
+/// table, including the first insertion into a table with no backing array,
+/// inserts nothing and sets `needs_growth` in its result. The caller should
+/// then make room with `CWISS_RawTable_reserve()` and retry. Erasing elements
+/// does not help, since the slots they leave behind are reused only by
+/// elements whose probe sequences reach them.
+static inline void CWISS_RawTable_SetInlineGrowth(const CWISS_Policy* policy,
+                                                  CWISS_RawTable* self,
+                                                  bool allowed) {
+  CWISS_RawTable_Ext(policy, self)->inline_growth_ = allowed;
+  CWISS_RawTable_ReleaseExt(policy, self);
+}
+
+/// Removes the growth watch of `self`, restoring the default behavior: no
+/// callback, and inline growth allowed.
+static inline void CWISS_RawTable_UnwatchGrowth(const CWISS_Policy* policy,
+                                                CWISS_RawTable* self) {
+  CWISS_RawTableExt* ext = self->ext_;
+  if (ext == NULL) return;
+  ext->low_water_ = 0;
+  ext->callback_ = NULL;
+  ext->ctx_ = NULL;
+  ext->inline_growth_ = true;
+  CWISS_RawTable_ReleaseExt(policy, self);
+}
+
+/// Returns the number of elements that can be inserted into empty slots of
+/// `self` before it has to grow.
+static inline size_t CWISS_RawTable_growth_left(const CWISS_RawTable* self) {
+  return self->growth_left_;
+}
+
+/// Returns whether the growth budget of `self` is at or below its low
+/// watermark, or zero if it has none.
+static inline bool CWISS_RawTable_NeedsGrowth(const CWISS_RawTable* self) {
+  size_t low_water = self->ext_ != NULL ? self->ext_->low_water_ : 0;
+  return self->growth_left_ <= low_water;
+}
+
+/// Marks every group as clean; this should be called once a checkpoint has
+/// been written out.
+static inline void CWISS_RawTable_ClearDirty(const CWISS_Policy* policy,
+                                             CWISS_RawTable* self) {
+  uint64_t* dirty = CWISS_RawTable_Dirty(self);
+  if (dirty == NULL) return;
+  memset(dirty, 0, CWISS_DirtyWords(self->capacity_) * sizeof(uint64_t));
+}
+
+/// A group of control bytes and their slots, as yielded by
+/// `CWISS_RawTable_NextDirtyGroup()` and consumed by
+/// `CWISS_RawTable_ApplyDirtyGroup()`.
+///
+/// A checkpoint consists of the table's capacity, followed by some number of
+/// these, which can be serialized as `index` followed by `len` control bytes
+/// and `len * policy->slot->size` bytes of slots.
+typedef struct {
+  /// The index of the group; it covers slots starting at
+  /// `index * CWISS_Group_kWidth`.
+  size_t index;
+  /// The number of slots in this group; this is `CWISS_Group_kWidth`, except
+  /// for the last group in the table, or for small tables.
+  size_t len;
+  /// The control bytes for the group.
+  const CWISS_ControlByte* ctrl;
+  /// The slots for the group. The contents of non-full slots are unspecified.
+  const void* slots;
+} CWISS_DirtyGroup;
+
+/// Finds the next dirty group at or after the group `*cursor`, writing it to
+/// `out` and advancing `*cursor` past it.
+///
+/// Returns false once there are no more dirty groups. If tracking is disabled,
+/// every group is reported, producing a full snapshot.
+static inline bool CWISS_RawTable_NextDirtyGroup(const CWISS_Policy* policy,
+                                                 const CWISS_RawTable* self,
+                                                 size_t* cursor,
+                                                 CWISS_DirtyGroup* out) {
+  if (self->capacity_ == 0) return false;
+
+  const size_t groups = CWISS_NumGroups(self->capacity_);
+  const uint64_t* dirty = CWISS_RawTable_Dirty(self);
+  size_t group = *cursor;
+  if (dirty != NULL) {
+    while (group < groups) {
+      uint64_t word = dirty[group / 64] >> (group % 64);
+      if (word != 0) {
+        group += CWISS_TrailingZeros(word);
+        break;
+      }
+      group = (group / 64 + 1) * 64;
+    }
+  }
+  if (group >= groups) return false;
+
+  size_t start = group * CWISS_Group_kWidth;
+  size_t end = start + CWISS_Group_kWidth;
+  if (end > self->capacity_) end = self->capacity_;
+
+  *out = (CWISS_DirtyGroup){
+      .index = group,
+      .len = end - start,
+      .ctrl = self->ctrl_ + start,
+      .slots = self->slots_ + start * policy->slot->size,
+  };
+  *cursor = group + 1;
+  return true;
+}
+
+/// Prepares `self` for having a checkpoint of a table with the given capacity
+/// applied to it.
+///
+/// If `self` does not already have that capacity, its contents are destroyed
+/// and it is reallocated, so that the following checkpoint must be a full one.
+/// Otherwise, this does nothing; `self` is assumed to hold the state as of
+/// the previous checkpoint.
+///
+/// A table that checkpoints are applied to is a byte-for-byte *image* of the
+/// source table's backing array. Because probe sequences are salted with the
+/// address of the backing array (see `CWISS_HashSeed()`), an image must not be
+/// searched or inserted into; it can be iterated, and
+/// `CWISS_RawTable_dup()` will produce an equivalent, searchable table from
+/// it.
+static inline void CWISS_RawTable_BeginApply(const CWISS_Policy* policy,
+                                             CWISS_RawTable* self,
+                                             size_t capacity) {
+  if (self->capacity_ == capacity) return;
+  CWISS_RawTable_DestroySlots(policy, self);
+  if (capacity != 0) {
+    self->capacity_ = capacity;
+    CWISS_RawTable_InitializeSlots(policy, self);
+    CWISS_RawTable_ResizeDirty(policy, self, 0);
+    CWISS_RawTable_ResizeHits(policy, self, 0);
+  }
+}
+
+/// Overwrites a group of `self` with `group`, which was produced by
+/// `CWISS_RawTable_NextDirtyGroup()` on a table of the same type and capacity
+/// (see `CWISS_RawTable_BeginApply()`).
+///
+/// Slots are copied bytewise, so this is only meaningful for flat tables whose
+/// elements are plain old data.
+static inline void CWISS_RawTable_ApplyDirtyGroup(
+    const CWISS_Policy* policy, CWISS_RawTable* self,
+    const CWISS_DirtyGroup* group) {
+  const size_t start = group->index * CWISS_Group_kWidth;
+  CWISS_CHECK(start + group->len <= self->capacity_,
+              "dirty group %zu out of bounds for capacity %zu", group->index,
+              self->capacity_);
+
+  for (size_t i = 0; i < group->len; ++i) {
+    size_t idx = start + i;
+    CWISS_ControlByte old_h = self->ctrl_[idx];
+    CWISS_ControlByte new_h = group->ctrl[i];
+    char* slot = self->slots_ + idx * policy->slot->size;
+
+    if (CWISS_IsFull(old_h) && policy->slot->del != NULL) {
+      policy->slot->del(slot);
+    }
+    self->size_ += (size_t)CWISS_IsFull(new_h) - (size_t)CWISS_IsFull(old_h);
+    // Growth is consumed by every non-empty slot, including tombstones.
+    self->growth_left_ +=
+        (size_t)!CWISS_IsEmpty(old_h) - (size_t)!CWISS_IsEmpty(new_h);
+
+    CWISS_SetCtrl(idx, new_h, self->capacity_, self->ctrl_, self->slots_,
+                  policy->slot->size);
+    if (CWISS_IsFull(new_h)) {
+      memcpy(slot, (const char*)group->slots + i * policy->slot->size,
+             policy->slot->size);
+    }
+  }
+  CWISS_RawTable_MarkDirty(self, start);
+}
+
 /// Destroys this table, destroying its elements and freeing the backing array.
 static inline void CWISS_RawTable_destroy(const CWISS_Policy* policy,
                                           CWISS_RawTable* self) {
+  CWISS_TRACE3(destroy, policy, self->size_, self->capacity_);
+  CWISS_RawTable_DisableDirtyTracking(policy, self);
+  CWISS_RawTable_DisableHitCounting(policy, self);
+  CWISS_RawTable_UnwatchGrowth(policy, self);
   CWISS_RawTable_DestroySlots(policy, self);
 }
 
+/// A backing array detached from a table by `CWISS_RawTable_Detach()`, whose
+/// elements are yet to be destroyed.
+///
+/// This is a plain value: it may be copied into a queue and reaped later, on
+/// any thread, via `CWISS_DetachedTable_reap()`.
+typedef struct {
+  const CWISS_Policy* policy_;
+  CWISS_ControlByte* ctrl_;
+  char* slots_;
+  size_t capacity_;
+  size_t cursor_;
+} CWISS_DetachedTable;
+
+/// Detaches the backing array of `self` in O(1), leaving `self` empty and
+/// ready for reuse.
+///
+/// The returned value owns the elements and the backing array. If `self` had
+/// no backing array, the result is already fully reaped.
+///
+/// Dirty tracking, hit counting, and the growth watch all describe the
+/// detached contents, so all three are turned off: `self` comes back exactly
+/// like a newly created table.
+static inline CWISS_DetachedTable CWISS_RawTable_Detach(
+    const CWISS_Policy* policy, CWISS_RawTable* self) {
+  CWISS_RawTable_DisableDirtyTracking(policy, self);
+  CWISS_RawTable_DisableHitCounting(policy, self);
+  CWISS_RawTable_UnwatchGrowth(policy, self);
+  CWISS_DetachedTable detached = {policy, self->ctrl_, self->slots_,
+                                  self->capacity_, 0};
+  self->ctrl_ = CWISS_EmptyGroup();
+  self->slots_ = NULL;
+  self->size_ = 0;
+  self->capacity_ = 0;
+  self->growth_left_ = 0;
+  return detached;
+}
+
+/// Destroys the elements in the next `budget` slots of `self`, freeing the
+/// backing array once the last slot has been visited.
+///
+/// Returns whether `self` has been fully reaped; once it returns `true`,
+/// further calls are no-ops. Because the work done per call is bounded by
+/// `budget`, a reaper can interleave it with other work, or stop at any time
+/// and resume later.
+static inline bool CWISS_DetachedTable_reap(CWISS_DetachedTable* self,
+                                            size_t budget) {
+  if (self->capacity_ == 0) return true;
+
+  const CWISS_Policy* policy = self->policy_;
+  if (policy->slot->del == NULL) {
+    self->cursor_ = self->capacity_;
+  }
+  while (self->cursor_ != self->capacity_ && budget-- != 0) {
+    size_t i = self->cursor_++;
+    if (CWISS_IsFull(self->ctrl_[i])) {
+      policy->slot->del(self->slots_ + i * policy->slot->size);
+    }
+  }
+  if (self->cursor_ != self->capacity_) return false;
+
+  CWISS_UnpoisonMemory(self->slots_, policy->slot->size * self->capacity_);
+  policy->alloc->free(
+      self->ctrl_,
+      CWISS_AllocSize(self->capacity_, policy->slot->size, policy->slot->align),
+      policy->slot->align);
+  self->capacity_ = 0;
+  return true;
+}
+
 /// Returns whether the table is empty.
 static inline bool CWISS_RawTable_empty(const CWISS_Policy* policy,
                                         const CWISS_RawTable* self) {
@@ -676,6 +1594,7 @@ static inline size_t CWISS_RawTable_capacity(const CWISS_Policy* policy,
 /// Clears the table, erasing every element contained therein.
 static inline void CWISS_RawTable_clear(const CWISS_Policy* policy,
                                         CWISS_RawTable* self) {
+  CWISS_TRACE3(clear, policy, self->size_, self->capacity_);
   // Iterating over this container is O(bucket_count()). When bucket_count()
   // is much greater than size(), iteration becomes prohibitively expensive.
   // For clear() it is more important to reuse the allocated array when the
@@ -700,18 +1619,23 @@ static inline void CWISS_RawTable_clear(const CWISS_Policy* policy,
     CWISS_ResetCtrl(self->capacity_, self->ctrl_, self->slots_,
                     policy->slot->size);
     CWISS_RawTable_ResetGrowthLeft(policy, self);
-  }
+    CWISS_RawTable_MarkAllDirty(self);
+    }
   CWISS_DCHECK(!self->size_, "size was still nonzero");
   // infoz().RecordStorageChanged(0, capacity_);
 }
 
 /// The return type of `CWISS_RawTable_insert()`.
 typedef struct {
-  /// An iterator referring to the relevant element.
+  /// An iterator referring to the relevant element, or a null iterator if
+  /// `needs_growth` is set.
   CWISS_RawIter iter;
   /// True if insertion actually occurred; false if the element was already
-  /// present.
+  /// present or `needs_growth` is set.
   bool inserted;
+  /// True if the insertion was refused because the table is out of room and
+  /// inline growth is disabled; see `CWISS_RawTable_SetInlineGrowth()`.
+  bool needs_growth;
 } CWISS_Insert;
 
 /// "Inserts" `val` into the table if it isn't already present.
@@ -724,7 +1648,8 @@ typedef struct {
 /// do not figure into the hash or equality.
 ///
 /// If this function returns `true` in `inserted`, the caller has *no choice*
-/// but to insert, i.e., they may not change their minds at that point.
+/// but to insert, i.e., they may not change their minds at that point. Like
+/// `CWISS_RawTable_insert()`, it sets `needs_growth` if it is refused room.
 ///
 /// `key_policy` is a possibly heterogenous key policy for comparing `key`'s
 /// type to types in the map. `key_policy` may be `&policy->key`.
@@ -736,15 +1661,18 @@ static inline CWISS_Insert CWISS_RawTable_deferred_insert(
 
   if (res.inserted) {
     CWISS_RawTable_PreInsert(policy, self, res.index);
+  } else if (CWISS_UNLIKELY(res.index == self->capacity_)) {
+    return (CWISS_Insert){(CWISS_RawIter){0}, false, true};
   }
   return (CWISS_Insert){CWISS_RawTable_citer_at(policy, self, res.index),
-                        res.inserted};
+                        res.inserted, false};
 }
 
 /// Inserts `val` (by copy) into the table if it isn't already present.
 ///
 /// Returns an iterator pointing to the element in the map and whether it was
-/// just inserted or was already present.
+/// just inserted or was already present. If inline growth is disabled and the
+/// table is out of room, inserts nothing and sets `needs_growth` instead.
 static inline CWISS_Insert CWISS_RawTable_insert(const CWISS_Policy* policy,
                                                  CWISS_RawTable* self,
                                                  const void* val) {
@@ -754,19 +1682,18 @@ static inline CWISS_Insert CWISS_RawTable_insert(const CWISS_Policy* policy,
   if (res.inserted) {
     void* slot = CWISS_RawTable_PreInsert(policy, self, res.index);
     policy->obj->copy(slot, val);
+  } else if (CWISS_UNLIKELY(res.index == self->capacity_)) {
+    return (CWISS_Insert){(CWISS_RawIter){0}, false, true};
   }
   return (CWISS_Insert){CWISS_RawTable_citer_at(policy, self, res.index),
-                        res.inserted};
+                        res.inserted, false};
 }
 
-/// Tries to find the corresponding entry for `key` using `hash` as a hint.
-/// If not found, returns a null iterator.
+/// Looks up `key` with the plain probe loop, for a flat, single-choice table.
 ///
-/// `key_policy` is a possibly heterogenous key policy for comparing `key`'s
-/// type to types in the map. `key_policy` may be `&policy->key`.
-///
-/// If `hash` is not actually the hash of `key`, UB.
-static inline CWISS_RawIter CWISS_RawTable_find_hinted(
+/// This is split out of `CWISS_RawTable_find_hinted()` so that the checks it
+/// makes first do not count against inlining this loop.
+static inline CWISS_RawIter CWISS_RawTable_FindFlat(
     const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
     const CWISS_RawTable* self, const void* key, size_t hash) {
   CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
@@ -788,6 +1715,33 @@ static inline CWISS_RawIter CWISS_RawTable_find_hinted(
   }
 }
 
+/// Tries to find the corresponding entry for `key` using `hash` as a hint.
+/// If not found, returns a null iterator.
+///
+/// `key_policy` is a possibly heterogenous key policy for comparing `key`'s
+/// type to types in the map. `key_policy` may be `&policy->key`.
+///
+/// If `hash` is not actually the hash of `key`, UB.
+static inline CWISS_RawIter CWISS_RawTable_find_hinted(
+    const CWISS_Policy* policy, const CWISS_KeyPolicy* key_policy,
+    const CWISS_RawTable* self, const void* key, size_t hash) {
+  CWISS_RawIter it;
+  if (policy->key->two_choice || policy->slot->indirect) {
+    size_t idx =
+        policy->key->two_choice
+            ? CWISS_RawTable_FindTwoChoice(policy, key_policy, self, key, hash)
+            : CWISS_RawTable_FindIndirect(policy, key_policy, self, key, hash);
+    if (idx == self->capacity_) return (CWISS_RawIter){0};
+    it = CWISS_RawTable_citer_at(policy, self, idx);
+  } else {
+    it = CWISS_RawTable_FindFlat(policy, key_policy, self, key, hash);
+  }
+  if (CWISS_UNLIKELY(self->ext_ != NULL) && it.ctrl_ != NULL) {
+    CWISS_RawTable_RecordHit(self, (size_t)(it.ctrl_ - self->ctrl_));
+  }
+  return it;
+}
+
 /// Tries to find the corresponding entry for `key`.
 /// If not found, returns a null iterator.
 ///
@@ -850,6 +1804,82 @@ static inline void CWISS_RawTable_rehash(const CWISS_Policy* policy,
   }
 }
 
+/// Returns whether any of the slots `[lo, hi)` of `self` is full.
+static inline bool CWISS_RawTable_AnyFull(const CWISS_RawTable* self,
+                                          size_t lo, size_t hi) {
+  for (size_t i = lo; i < hi; i += CWISS_Group_kWidth) {
+    CWISS_Group g = CWISS_Group_new(self->ctrl_ + i);
+    CWISS_BitMask full = CWISS_Group_MatchFull(&g);
+    if (full.mask && CWISS_BitMask_TrailingZeros(&full) < hi - i) return true;
+  }
+  return false;
+}
+
+/// Hands the memory of slots that hold no element back to the OS, without
+/// moving any element. Returns the number of bytes released.
+///
+/// Lookups never read the slot of a control byte that is not full, so a page
+/// of the slot array that only spans empty and erased slots can be dropped
+/// with `madvise(MADV_DONTNEED)`. An insertion that later lands on it faults
+/// it back in. Runs of such pages are released with one call each.
+///
+/// `page_size` is the granularity to release in, and must be a power of two:
+/// zero means the system page size; tables whose allocator hands out huge
+/// pages should pass the huge page size, since the kernel only drops whole
+/// pages of a huge page mapping.
+///
+/// Erased slots are also turned back from tombstones into empty slots, where
+/// `CWISS_RawTable_WasNeverFull()` shows that no probe can have passed them,
+/// which gives their growth back. Tombstones inside a long run of erased slots
+/// may lie on the probe path of an element past the run, so those remain until
+/// the next rehash.
+///
+/// Where `CWISS_HAVE_MADVISE` is unset, only the tombstones are pruned.
+static inline size_t CWISS_RawTable_release_unused(const CWISS_Policy* policy,
+                                                   CWISS_RawTable* self,
+                                                   size_t page_size) {
+  if (self->capacity_ == 0) return 0;
+  for (size_t i = 0; i < self->capacity_; ++i) {
+    if (!CWISS_IsDeleted(self->ctrl_[i]) ||
+        !CWISS_RawTable_WasNeverFull(self, i)) {
+      continue;
+    }
+    CWISS_SetCtrl(i, CWISS_kEmpty, self->capacity_, self->ctrl_, self->slots_,
+                  policy->slot->size);
+    CWISS_RawTable_MarkDirty(self, i);
+    ++self->growth_left_;
+  }
+
+  size_t released = 0;
+#if CWISS_HAVE_MADVISE
+  if (page_size == 0) page_size = (size_t)sysconf(_SC_PAGESIZE);
+  CWISS_DCHECK((page_size & (page_size - 1)) == 0,
+               "page size is not a power of two: %zu", page_size);
+
+  size_t slot_size = policy->slot->size;
+  uintptr_t begin = (uintptr_t)self->slots_;
+  uintptr_t end = begin + self->capacity_ * slot_size;
+  uintptr_t page = (begin + page_size - 1) & ~(uintptr_t)(page_size - 1);
+  // The start of the current run of releasable pages, if `run != page`.
+  uintptr_t run = page;
+  for (; page + page_size <= end; page += page_size) {
+    size_t lo = (page - begin) / slot_size;
+    size_t hi = (page + page_size - begin + slot_size - 1) / slot_size;
+    if (!CWISS_RawTable_AnyFull(self, lo, hi)) continue;
+    if (run != page && madvise((void*)run, page - run, MADV_DONTNEED) == 0) {
+      released += page - run;
+    }
+    run = page + page_size;
+  }
+  if (run != page && madvise((void*)run, page - run, MADV_DONTNEED) == 0) {
+    released += page - run;
+  }
+#else
+  (void)page_size;
+#endif
+  return released;
+}
+
 /// Returns whether `key` is contained in this table.
 ///
 /// `key_policy` is a possibly heterogenous key policy for comparing `key`'s
@@ -861,6 +1891,48 @@ static inline bool CWISS_RawTable_contains(const CWISS_Policy* policy,
   return CWISS_RawTable_find(policy, key_policy, self, key).slot_ != NULL;
 }
 
+/// Returns an iterator to an element of `self` chosen uniformly at random, or a
+/// null iterator if the table is empty.
+///
+/// `rng_state` is the state of the generator used by `CWISS_Random64()`, and is
+/// advanced by this function.
+///
+/// Sampling proceeds by picking a random group, and then a random position
+/// within it; if that position is full, it is returned, otherwise we retry.
+/// Every full slot is hit with the same probability on each try, so the result
+/// is unbiased, and the expected number of tries is `capacity / size`, which
+/// is O(1) unless the table has been mostly erased without being rehashed.
+static inline CWISS_RawIter CWISS_RawTable_random(const CWISS_Policy* policy,
+                                                  const CWISS_RawTable* self,
+                                                  uint64_t* rng_state) {
+  if (self->size_ == 0) return (CWISS_RawIter){0};
+
+  size_t groups = CWISS_NumGroups(self->capacity_);
+  while (true) {
+    uint64_t r = CWISS_Random64(rng_state);
+    // The low bits pick the position, the rest pick the group.
+    size_t start = (size_t)(r >> 8) & (groups - 1);
+    start *= CWISS_Group_kWidth;
+    uint32_t pos = (uint32_t)(r & (CWISS_Group_kWidth - 1));
+
+    CWISS_Group g = CWISS_Group_new(self->ctrl_ + start);
+    CWISS_BitMask full = CWISS_Group_MatchFull(&g);
+    if (self->capacity_ - start < CWISS_Group_kWidth) {
+      // The tail of the last group consists of the sentinel and cloned control
+      // bytes, which must not be counted twice.
+      uint32_t valid = (uint32_t)(self->capacity_ - start);
+      full.mask &= (UINT64_C(1) << (valid << CWISS_Group_kShift)) - 1;
+    }
+    if (pos >= CWISS_BitMask_Count(&full)) continue;
+
+    uint32_t i = 0;
+    for (uint32_t j = 0; j <= pos; ++j) {
+      CWISS_BitMask_next(&full, &i);
+    }
+    return CWISS_RawTable_citer_at(policy, self, start + i);
+  }
+}
+
 CWISS_END_EXTERN
 CWISS_END
 
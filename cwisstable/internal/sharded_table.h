@@ -0,0 +1,470 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_SHARDED_TABLE_H_
+#define CWISSTABLE_INTERNAL_SHARDED_TABLE_H_
+
+#include <limits.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/internal/raw_table.h"
+#include "cwisstable/policy.h"
+
+/// `CWISS_HAVE_THREAD_YIELD` is nonzero where a contended shard lock can give
+/// up the CPU: `sched_yield()` on POSIX systems and `SwitchToThread()` on
+/// Windows. Elsewhere the lock keeps spinning.
+#ifndef CWISS_HAVE_THREAD_YIELD
+  #if defined(_WIN32)
+    #define CWISS_HAVE_THREAD_YIELD 1
+  #elif defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+    #if defined(__APPLE__) || defined(_POSIX_PRIORITY_SCHEDULING)
+      #define CWISS_HAVE_THREAD_YIELD 1
+    #else
+      #define CWISS_HAVE_THREAD_YIELD 0
+    #endif
+  #else
+    #define CWISS_HAVE_THREAD_YIELD 0
+  #endif
+#endif
+
+#if CWISS_HAVE_THREAD_YIELD
+  #if defined(_WIN32)
+    #include <windows.h>
+  #else
+    #include <sched.h>
+  #endif
+#endif
+
+/// A concurrent hash table made of independently locked `CWISS_RawTable`s.
+///
+/// Each key is assigned to a shard by the top bits of its hash; the bits that
+/// pick a shard are thus (for all practical capacities) disjoint from the ones
+/// used for H1 and H2 within it.
+///
+/// Each shard is guarded by a spinlock, which is only ever held for the
+/// duration of a single operation, or of one shard's part of a batch. Shards
+/// are padded to a cache line so that unrelated locks do not share one. A
+/// waiter backs off exponentially and then yields the CPU, so a preempted
+/// holder is not starved by the threads waiting on it.
+///
+/// Per-key operations lock once per key. The batch operations instead hash the
+/// whole batch up-front, bucket it by shard, and then visit each shard once,
+/// prefetching a few keys ahead of the one being processed. This amortizes the
+/// lock (and the cache line transfer that comes with it) over the sub-batch.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The number of keys a batch operation prefetches ahead.
+#define CWISS_ShardedTable_kPrefetchDistance ((size_t)8)
+
+/// The number of rounds a contended shard lock spins before it starts
+/// yielding the CPU. Round `n` pauses `1 << n` times, so a lock holder that is
+/// not running (e.g., because it was preempted) costs waiters at most a few
+/// hundred pauses before they step aside for it.
+#define CWISS_ShardedTable_kSpinRounds ((uint32_t)7)
+
+/// The assumed size of a cache line.
+#define CWISS_ShardedTable_kCacheLine ((size_t)64)
+
+/// A single shard: a table and the lock that guards it.
+typedef struct {
+  CWISS_ATOMIC_T(bool) lock_;
+  CWISS_RawTable table_;
+} CWISS_Shard;
+
+/// Returns the distance between consecutive shards in the shard array.
+static inline size_t CWISS_Shard_Stride(void) {
+  return (sizeof(CWISS_Shard) + CWISS_ShardedTable_kCacheLine - 1) &
+         ~(CWISS_ShardedTable_kCacheLine - 1);
+}
+
+/// Waits out one round of contention on a shard lock; `round` counts the
+/// rounds waited so far.
+///
+/// The first `CWISS_ShardedTable_kSpinRounds` rounds spin, doubling the number
+/// of pauses each time; after that, each round yields the CPU instead.
+static inline void CWISS_Shard_Backoff(uint32_t* round) {
+  if (*round < CWISS_ShardedTable_kSpinRounds) {
+    for (uint32_t i = 0; i < (UINT32_C(1) << *round); ++i) {
+#if CWISS_HAVE_SSE2
+      _mm_pause();
+#endif
+    }
+    ++*round;
+    return;
+  }
+#if CWISS_HAVE_THREAD_YIELD
+  #if defined(_WIN32)
+  SwitchToThread();
+  #else
+  sched_yield();
+  #endif
+#endif
+}
+
+/// Blocks until `self`'s lock is acquired.
+static inline void CWISS_Shard_Lock(CWISS_Shard* self) {
+  uint32_t round = 0;
+  while (CWISS_ATOMIC_EXCHANGE_ACQUIRE(self->lock_, true)) {
+    while (CWISS_ATOMIC_LOAD_RELAXED(self->lock_)) {
+      CWISS_Shard_Backoff(&round);
+    }
+  }
+}
+
+/// Releases `self`'s lock.
+static inline void CWISS_Shard_Unlock(CWISS_Shard* self) {
+  CWISS_ATOMIC_STORE_RELEASE(self->lock_, false);
+}
+
+/// A sharded table.
+typedef struct {
+  char* shards_;
+  /// The number of shards is `1 << shard_bits_`.
+  size_t shard_bits_;
+} CWISS_ShardedTable;
+
+/// Returns the `i`th shard of `self`.
+static inline CWISS_Shard* CWISS_ShardedTable_shard(
+    const CWISS_ShardedTable* self, size_t i) {
+  return (CWISS_Shard*)(self->shards_ + i * CWISS_Shard_Stride());
+}
+
+/// Returns the index of the shard that `hash` belongs to.
+static inline size_t CWISS_ShardedTable_ShardOf(const CWISS_ShardedTable* self,
+                                                size_t hash) {
+  if (self->shard_bits_ == 0) return 0;
+  return hash >> (sizeof(size_t) * CHAR_BIT - self->shard_bits_);
+}
+
+/// Creates a new table with at least `shard_count` shards (rounded up to a
+/// power of two), with a total initial capacity of `capacity`.
+static inline CWISS_ShardedTable CWISS_ShardedTable_new(
+    const CWISS_Policy* policy, size_t shard_count, size_t capacity) {
+  CWISS_ShardedTable self = {0};
+  while (((size_t)1 << self.shard_bits_) < shard_count) ++self.shard_bits_;
+  size_t n = (size_t)1 << self.shard_bits_;
+
+  self.shards_ = (char*)CWISS_AllocAligned(
+      policy->alloc, n * CWISS_Shard_Stride(), CWISS_ShardedTable_kCacheLine);
+  memset(self.shards_, 0, n * CWISS_Shard_Stride());
+  for (size_t i = 0; i < n; ++i) {
+    CWISS_Shard* shard = CWISS_ShardedTable_shard(&self, i);
+    CWISS_ATOMIC_STORE_RELEASE(shard->lock_, false);
+    shard->table_ = CWISS_RawTable_new(policy, (capacity + n - 1) / n);
+  }
+  return self;
+}
+
+/// Destroys the table and all of its shards.
+///
+/// This function must not race with any other operation on `self`.
+static inline void CWISS_ShardedTable_destroy(const CWISS_Policy* policy,
+                                              CWISS_ShardedTable* self) {
+  size_t n = (size_t)1 << self->shard_bits_;
+  for (size_t i = 0; i < n; ++i) {
+    CWISS_RawTable_destroy(policy, &CWISS_ShardedTable_shard(self, i)->table_);
+  }
+  CWISS_FreeAligned(policy->alloc, self->shards_, n * CWISS_Shard_Stride(),
+                    CWISS_ShardedTable_kCacheLine);
+  *self = (CWISS_ShardedTable){0};
+}
+
+/// Returns the number of elements in the table.
+///
+/// Shards are locked one at a time, so this is not a snapshot if other threads
+/// are modifying the table.
+static inline size_t CWISS_ShardedTable_size(const CWISS_Policy* policy,
+                                             const CWISS_ShardedTable* self) {
+  size_t size = 0;
+  for (size_t i = 0; i < ((size_t)1 << self->shard_bits_); ++i) {
+    CWISS_Shard* shard = CWISS_ShardedTable_shard(self, i);
+    CWISS_Shard_Lock(shard);
+    size += CWISS_RawTable_size(policy, &shard->table_);
+    CWISS_Shard_Unlock(shard);
+  }
+  return size;
+}
+
+/// Inserts `val` (by copy), whose hash is `hash`, into `table` if it isn't
+/// already present. Returns whether insertion occurred.
+static inline bool CWISS_ShardedTable_InsertHinted(const CWISS_Policy* policy,
+                                                   CWISS_RawTable* table,
+                                                   const void* val,
+                                                   size_t hash) {
+  CWISS_PrepareInsert res = CWISS_RawTable_FindOrPrepareInsertHinted(
+      policy, policy->key, table, val, hash);
+  if (res.inserted) {
+    void* slot = CWISS_RawTable_PreInsert(policy, table, res.index);
+    policy->obj->copy(slot, val);
+  }
+  return res.inserted;
+}
+
+/// Inserts `val` (by copy) if it isn't already present. Returns whether
+/// insertion occurred.
+static inline bool CWISS_ShardedTable_insert(const CWISS_Policy* policy,
+                                             CWISS_ShardedTable* self,
+                                             const void* val) {
+  size_t hash = policy->key->hash(val);
+  CWISS_Shard* shard =
+      CWISS_ShardedTable_shard(self, CWISS_ShardedTable_ShardOf(self, hash));
+  CWISS_Shard_Lock(shard);
+  bool inserted = CWISS_ShardedTable_InsertHinted(policy, &shard->table_, val,
+                                                  hash);
+  CWISS_Shard_Unlock(shard);
+  return inserted;
+}
+
+/// Looks up `key`, and calls `visit(ctx, 0, elem)` with a pointer to the
+/// element, or with null if it is not present, while the key's shard is
+/// locked. Returns whether the key was found.
+///
+/// `visit` may be null; it must not access `self`.
+static inline bool CWISS_ShardedTable_find(
+    const CWISS_Policy* policy, CWISS_ShardedTable* self, const void* key,
+    void (*visit)(void* ctx, size_t i, void* elem), void* ctx) {
+  size_t hash = policy->key->hash(key);
+  CWISS_Shard* shard =
+      CWISS_ShardedTable_shard(self, CWISS_ShardedTable_ShardOf(self, hash));
+  CWISS_Shard_Lock(shard);
+  CWISS_RawIter it = CWISS_RawTable_find_hinted(policy, policy->key,
+                                                &shard->table_, key, hash);
+  void* elem = CWISS_RawIter_get(policy, &it);
+  if (visit != NULL) visit(ctx, 0, elem);
+  CWISS_Shard_Unlock(shard);
+  return elem != NULL;
+}
+
+/// Erases `key`, if present. Returns whether deletion occurred.
+static inline bool CWISS_ShardedTable_erase(const CWISS_Policy* policy,
+                                            CWISS_ShardedTable* self,
+                                            const void* key) {
+  size_t hash = policy->key->hash(key);
+  CWISS_Shard* shard =
+      CWISS_ShardedTable_shard(self, CWISS_ShardedTable_ShardOf(self, hash));
+  CWISS_Shard_Lock(shard);
+  CWISS_RawIter it = CWISS_RawTable_find_hinted(policy, policy->key,
+                                                &shard->table_, key, hash);
+  bool erased = it.slot_ != NULL;
+  if (erased) CWISS_RawTable_erase_at(policy, it);
+  CWISS_Shard_Unlock(shard);
+  return erased;
+}
+
+/// Scratch space for a batch operation.
+///
+/// `order` lists the indices of the batch's keys grouped by shard; the keys of
+/// shard `s` are `order[starts[s]]` through `order[starts[s + 1] - 1]`.
+/// `hashes` is indexed by position in the batch.
+typedef struct {
+  size_t* hashes;
+  size_t* order;
+  size_t* starts;
+  size_t bytes;
+} CWISS_ShardedBatch;
+
+/// Hashes the `n` keys at `keys` (which are `stride` bytes apart) and buckets
+/// them by shard.
+static inline CWISS_ShardedBatch CWISS_ShardedBatch_new(
+    const CWISS_Policy* policy, const CWISS_ShardedTable* self,
+    const void* keys, size_t stride, size_t n) {
+  size_t shards = (size_t)1 << self->shard_bits_;
+  CWISS_ShardedBatch batch;
+  batch.bytes = (2 * n + shards + 1) * sizeof(size_t);
+  batch.hashes = (size_t*)policy->alloc->alloc(batch.bytes, alignof(size_t));
+  batch.order = batch.hashes + n;
+  batch.starts = batch.order + n;
+  memset(batch.starts, 0, (shards + 1) * sizeof(size_t));
+
+  // A counting sort: first count the keys in each shard, shifted up by one so
+  // that the prefix sum below yields each shard's start.
+  const char* k = (const char*)keys;
+  for (size_t i = 0; i < n; ++i, k += stride) {
+    batch.hashes[i] = policy->key->hash(k);
+    ++batch.starts[CWISS_ShardedTable_ShardOf(self, batch.hashes[i]) + 1];
+  }
+  for (size_t s = 0; s < shards; ++s) {
+    batch.starts[s + 1] += batch.starts[s];
+  }
+  // Use `starts[s]` as the write cursor for shard `s`; afterwards it has been
+  // advanced to the start of `s + 1`, so shift everything back down by one.
+  for (size_t i = 0; i < n; ++i) {
+    size_t s = CWISS_ShardedTable_ShardOf(self, batch.hashes[i]);
+    batch.order[batch.starts[s]++] = i;
+  }
+  memmove(batch.starts + 1, batch.starts, shards * sizeof(size_t));
+  batch.starts[0] = 0;
+  return batch;
+}
+
+/// Frees the scratch space of `batch`.
+static inline void CWISS_ShardedBatch_destroy(const CWISS_Policy* policy,
+                                              CWISS_ShardedBatch* batch) {
+  policy->alloc->free(batch->hashes, batch->bytes, alignof(size_t));
+}
+
+/// Prefetches the memory needed to look up the `j`th key of shard `s`, if
+/// there is one.
+static inline void CWISS_ShardedBatch_Prefetch(const CWISS_Policy* policy,
+                                               const CWISS_ShardedBatch* batch,
+                                               const CWISS_RawTable* table,
+                                               size_t s, size_t j) {
+  if (j < batch->starts[s + 1]) {
+    CWISS_RawTable_PrefetchHinted(policy, table,
+                                  batch->hashes[batch->order[j]]);
+  }
+}
+
+/// Inserts the `n` values at `vals` (by copy), skipping those already present.
+///
+/// If `inserted` is not null, `inserted[i]` is set to whether `vals[i]` was
+/// inserted. If the batch contains duplicates, the first one (in batch order)
+/// is the one inserted. Returns the number of insertions.
+static inline size_t CWISS_ShardedTable_insert_batch(const CWISS_Policy* policy,
+                                                     CWISS_ShardedTable* self,
+                                                     const void* vals, size_t n,
+                                                     bool* inserted) {
+  if (n == 0) return 0;
+  size_t stride = policy->obj->size;
+  CWISS_ShardedBatch batch =
+      CWISS_ShardedBatch_new(policy, self, vals, stride, n);
+
+  size_t count = 0;
+  for (size_t s = 0; s < ((size_t)1 << self->shard_bits_); ++s) {
+    size_t begin = batch.starts[s], end = batch.starts[s + 1];
+    if (begin == end) continue;
+
+    CWISS_Shard* shard = CWISS_ShardedTable_shard(self, s);
+    CWISS_Shard_Lock(shard);
+    for (size_t j = begin;
+         j < end && j < begin + CWISS_ShardedTable_kPrefetchDistance; ++j) {
+      CWISS_ShardedBatch_Prefetch(policy, &batch, &shard->table_, s, j);
+    }
+    for (size_t j = begin; j < end; ++j) {
+      CWISS_ShardedBatch_Prefetch(policy, &batch, &shard->table_, s,
+                                  j + CWISS_ShardedTable_kPrefetchDistance);
+      size_t i = batch.order[j];
+      bool ok = CWISS_ShardedTable_InsertHinted(
+          policy, &shard->table_, (const char*)vals + i * stride,
+          batch.hashes[i]);
+      count += ok;
+      if (inserted != NULL) inserted[i] = ok;
+    }
+    CWISS_Shard_Unlock(shard);
+  }
+
+  CWISS_ShardedBatch_destroy(policy, &batch);
+  return count;
+}
+
+/// Looks up the `n` keys at `keys`, which are `key_size` bytes apart.
+///
+/// If `found` is not null, `found[i]` is set to whether the `i`th key is
+/// present. If `visit` is not null, it is called as `visit(ctx, i, elem)` for
+/// each key, with a pointer to the matching element or null, while that key's
+/// shard is locked. Keys are visited grouped by shard, not in batch order.
+/// `visit` must not access `self`.
+///
+/// Returns the number of keys found.
+static inline size_t CWISS_ShardedTable_find_batch(
+    const CWISS_Policy* policy, CWISS_ShardedTable* self, const void* keys,
+    size_t key_size, size_t n, bool* found,
+    void (*visit)(void* ctx, size_t i, void* elem), void* ctx) {
+  if (n == 0) return 0;
+  CWISS_ShardedBatch batch =
+      CWISS_ShardedBatch_new(policy, self, keys, key_size, n);
+
+  size_t count = 0;
+  for (size_t s = 0; s < ((size_t)1 << self->shard_bits_); ++s) {
+    size_t begin = batch.starts[s], end = batch.starts[s + 1];
+    if (begin == end) continue;
+
+    CWISS_Shard* shard = CWISS_ShardedTable_shard(self, s);
+    CWISS_Shard_Lock(shard);
+    for (size_t j = begin;
+         j < end && j < begin + CWISS_ShardedTable_kPrefetchDistance; ++j) {
+      CWISS_ShardedBatch_Prefetch(policy, &batch, &shard->table_, s, j);
+    }
+    for (size_t j = begin; j < end; ++j) {
+      CWISS_ShardedBatch_Prefetch(policy, &batch, &shard->table_, s,
+                                  j + CWISS_ShardedTable_kPrefetchDistance);
+      size_t i = batch.order[j];
+      CWISS_RawIter it = CWISS_RawTable_find_hinted(
+          policy, policy->key, &shard->table_,
+          (const char*)keys + i * key_size, batch.hashes[i]);
+      void* elem = CWISS_RawIter_get(policy, &it);
+      count += elem != NULL;
+      if (found != NULL) found[i] = elem != NULL;
+      if (visit != NULL) visit(ctx, i, elem);
+    }
+    CWISS_Shard_Unlock(shard);
+  }
+
+  CWISS_ShardedBatch_destroy(policy, &batch);
+  return count;
+}
+
+/// Erases the `n` keys at `keys`, which are `key_size` bytes apart. Returns
+/// the number of elements erased.
+static inline size_t CWISS_ShardedTable_erase_batch(const CWISS_Policy* policy,
+                                                    CWISS_ShardedTable* self,
+                                                    const void* keys,
+                                                    size_t key_size, size_t n) {
+  if (n == 0) return 0;
+  CWISS_ShardedBatch batch =
+      CWISS_ShardedBatch_new(policy, self, keys, key_size, n);
+
+  size_t count = 0;
+  for (size_t s = 0; s < ((size_t)1 << self->shard_bits_); ++s) {
+    size_t begin = batch.starts[s], end = batch.starts[s + 1];
+    if (begin == end) continue;
+
+    CWISS_Shard* shard = CWISS_ShardedTable_shard(self, s);
+    CWISS_Shard_Lock(shard);
+    for (size_t j = begin;
+         j < end && j < begin + CWISS_ShardedTable_kPrefetchDistance; ++j) {
+      CWISS_ShardedBatch_Prefetch(policy, &batch, &shard->table_, s, j);
+    }
+    for (size_t j = begin; j < end; ++j) {
+      CWISS_ShardedBatch_Prefetch(policy, &batch, &shard->table_, s,
+                                  j + CWISS_ShardedTable_kPrefetchDistance);
+      size_t i = batch.order[j];
+      CWISS_RawIter it = CWISS_RawTable_find_hinted(
+          policy, policy->key, &shard->table_,
+          (const char*)keys + i * key_size, batch.hashes[i]);
+      if (it.slot_ != NULL) {
+        CWISS_RawTable_erase_at(policy, it);
+        ++count;
+      }
+    }
+    CWISS_Shard_Unlock(shard);
+  }
+
+  CWISS_ShardedBatch_destroy(policy, &batch);
+  return count;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_SHARDED_TABLE_H_
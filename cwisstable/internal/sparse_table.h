@@ -0,0 +1,478 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CWISSTABLE_INTERNAL_SPARSE_TABLE_H_
+#define CWISSTABLE_INTERNAL_SPARSE_TABLE_H_
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cwisstable/internal/base.h"
+#include "cwisstable/internal/bits.h"
+#include "cwisstable/internal/capacity.h"
+#include "cwisstable/internal/control_byte.h"
+#include "cwisstable/internal/probe.h"
+#include "cwisstable/policy.h"
+
+/// A table that only allocates slots for the elements it holds.
+///
+/// A flat table spends a whole slot on every empty position, and right after
+/// growing, about half of its positions are empty. This table keeps the usual
+/// control bytes, so probing and SIMD matching are unchanged, but the slots
+/// live in buckets of 64 positions: each bucket has a presence bitmap and a
+/// separate allocation holding only its occupied slots, in position order. The
+/// slot at position `i` is found by counting the bits below `i` in its bucket's
+/// bitmap.
+///
+/// An empty position therefore costs its control byte plus two bits of bucket
+/// header, rather than a full slot; for large slots, this roughly halves the
+/// memory of a freshly grown table.
+///
+/// The price is paid on mutation. Every insertion or erasure reallocates its
+/// bucket's array to the exact new size and moves up to 63 slots with the slot
+/// policy's `transfer`, and so invalidates pointers to every element in that
+/// bucket. Lookups do one extra dependent load and a population count.
+///
+/// Erasure leaves tombstones exactly as a flat table does; when the table runs
+/// out of growth, it is rebuilt at the same capacity if at most 25/32 of its
+/// capacity is in use, and at double the capacity otherwise. The key policy's
+/// `two_choice` is ignored.
+
+CWISS_BEGIN
+CWISS_BEGIN_EXTERN
+
+/// The number of positions covered by one bucket.
+#define CWISS_SparseTable_kBucketWidth ((size_t)64)
+
+/// A bucket of 64 positions of a sparse table.
+typedef struct {
+  /// Bit `j` is set if position `64 * b + j` of bucket `b` is occupied.
+  uint64_t present_;
+  /// The occupied slots, in position order; null if there are none.
+  char* slots_;
+} CWISS_SparseBucket;
+
+/// A sparse table.
+typedef struct {
+  CWISS_ControlByte* ctrl_;
+  /// Lives in the same allocation as `ctrl_`.
+  CWISS_SparseBucket* buckets_;
+  size_t size_;
+  size_t capacity_;
+  size_t growth_left_;
+} CWISS_SparseTable;
+
+/// Returns the number of buckets covering a table of the given capacity.
+static inline size_t CWISS_SparseTable_NumBuckets(size_t capacity) {
+  return (capacity + CWISS_SparseTable_kBucketWidth - 1) /
+         CWISS_SparseTable_kBucketWidth;
+}
+
+/// Returns the size of the allocation holding the control bytes and buckets of
+/// a table of the given capacity.
+static inline size_t CWISS_SparseTable_AllocSize(size_t capacity) {
+  return CWISS_SlotOffset(capacity, alignof(CWISS_SparseBucket)) +
+         CWISS_SparseTable_NumBuckets(capacity) * sizeof(CWISS_SparseBucket);
+}
+
+/// Returns the position of the slot for position `i` within its bucket's
+/// array.
+static inline size_t CWISS_SparseBucket_Rank(const CWISS_SparseBucket* self,
+                                             size_t i) {
+  uint64_t below = ((uint64_t)1 << (i % CWISS_SparseTable_kBucketWidth)) - 1;
+  return CWISS_PopCount64(self->present_ & below);
+}
+
+/// Returns the slot at the occupied position `i`.
+static inline char* CWISS_SparseTable_Slot(const CWISS_Policy* policy,
+                                           const CWISS_SparseTable* self,
+                                           size_t i) {
+  const CWISS_SparseBucket* b =
+      &self->buckets_[i / CWISS_SparseTable_kBucketWidth];
+  return b->slots_ + CWISS_SparseBucket_Rank(b, i) * policy->slot->size;
+}
+
+/// Reallocates `b`'s array to hold `n` slots, moving slots `[0, keep)` to the
+/// front and slots `[keep + drop, ...)` after a gap of `gap` slots.
+///
+/// Exactly one of `gap` and `drop` is one; the other is zero.
+static inline void CWISS_SparseBucket_Reshape(const CWISS_Policy* policy,
+                                              CWISS_SparseBucket* b, size_t n,
+                                              size_t keep, size_t gap,
+                                              size_t drop) {
+  size_t size = policy->slot->size;
+  size_t old_n = n - gap + drop;
+  char* old = b->slots_;
+  b->slots_ = n == 0 ? NULL
+                     : (char*)policy->alloc->alloc(n * size,
+                                                   policy->slot->align);
+  for (size_t j = 0; j < keep; ++j) {
+    policy->slot->transfer(b->slots_ + j * size, old + j * size);
+  }
+  for (size_t j = keep + drop; j < old_n; ++j) {
+    policy->slot->transfer(b->slots_ + (j + gap - drop) * size,
+                           old + j * size);
+  }
+  if (old != NULL) {
+    policy->alloc->free(old, old_n * size, policy->slot->align);
+  }
+}
+
+/// An iterator over a sparse table.
+typedef struct {
+  CWISS_SparseTable* set_;
+  /// The current position, or `set_->capacity_` once exhausted.
+  size_t index_;
+} CWISS_SparseIter;
+
+/// Advances `self` to the first occupied position at or after its current one.
+static inline void CWISS_SparseIter_SkipEmpty(CWISS_SparseIter* self) {
+  const CWISS_SparseTable* set = self->set_;
+  if (self->index_ >= set->capacity_) {
+    self->index_ = set->capacity_;
+    return;
+  }
+  size_t b = self->index_ / CWISS_SparseTable_kBucketWidth;
+  size_t j = self->index_ % CWISS_SparseTable_kBucketWidth;
+  uint64_t bits = set->buckets_[b].present_ & (~(uint64_t)0 << j);
+  while (bits == 0) {
+    if (++b == CWISS_SparseTable_NumBuckets(set->capacity_)) {
+      self->index_ = set->capacity_;
+      return;
+    }
+    bits = set->buckets_[b].present_;
+  }
+  self->index_ = b * CWISS_SparseTable_kBucketWidth + CWISS_TrailingZeros(bits);
+}
+
+/// Returns an iterator pointing at position `i`, which must be occupied.
+static inline CWISS_SparseIter CWISS_SparseTable_iter_at(
+    const CWISS_SparseTable* self, size_t i) {
+  CWISS_SparseIter it = {(CWISS_SparseTable*)self, i};
+  return it;
+}
+
+/// Returns an iterator over the table.
+static inline CWISS_SparseIter CWISS_SparseTable_iter(
+    const CWISS_Policy* policy, CWISS_SparseTable* self) {
+  CWISS_SparseIter it = {self, 0};
+  CWISS_SparseIter_SkipEmpty(&it);
+  return it;
+}
+
+/// Returns the element the iterator points to, or null if it is exhausted.
+///
+/// The pointer is invalidated by any insertion or erasure.
+static inline void* CWISS_SparseIter_get(const CWISS_Policy* policy,
+                                         const CWISS_SparseIter* self) {
+  if (self->index_ >= self->set_->capacity_) return NULL;
+  return policy->slot->get(
+      CWISS_SparseTable_Slot(policy, self->set_, self->index_));
+}
+
+/// Advances the iterator and returns the result of `CWISS_SparseIter_get()`.
+static inline void* CWISS_SparseIter_next(const CWISS_Policy* policy,
+                                          CWISS_SparseIter* self) {
+  ++self->index_;
+  CWISS_SparseIter_SkipEmpty(self);
+  return CWISS_SparseIter_get(policy, self);
+}
+
+/// Allocates the control bytes and buckets for `self->capacity_`, which must be
+/// nonzero.
+static inline void CWISS_SparseTable_InitializeSlots(const CWISS_Policy* policy,
+                                                     CWISS_SparseTable* self) {
+  CWISS_DCHECK(self->capacity_, "capacity should be nonzero");
+  const size_t align = alignof(CWISS_SparseBucket);
+  char* mem = (char*)policy->alloc->alloc(
+      CWISS_SparseTable_AllocSize(self->capacity_), align);
+  self->ctrl_ = (CWISS_ControlByte*)mem;
+  self->buckets_ =
+      (CWISS_SparseBucket*)(mem + CWISS_SlotOffset(self->capacity_, align));
+  CWISS_ResetCtrl(self->capacity_, self->ctrl_, NULL, 0);
+  memset(self->buckets_, 0,
+         CWISS_SparseTable_NumBuckets(self->capacity_) *
+             sizeof(CWISS_SparseBucket));
+  self->growth_left_ = CWISS_CapacityToGrowth(self->capacity_) - self->size_;
+}
+
+/// Destroys every element and frees every bucket's array, leaving the buckets
+/// empty.
+static inline void CWISS_SparseTable_DestroyBuckets(const CWISS_Policy* policy,
+                                                    CWISS_SparseTable* self) {
+  size_t size = policy->slot->size;
+  for (size_t b = 0; b < CWISS_SparseTable_NumBuckets(self->capacity_); ++b) {
+    CWISS_SparseBucket* bucket = &self->buckets_[b];
+    size_t n = CWISS_PopCount64(bucket->present_);
+    if (n == 0) continue;
+    if (policy->slot->del != NULL) {
+      for (size_t j = 0; j < n; ++j) {
+        policy->slot->del(bucket->slots_ + j * size);
+      }
+    }
+    policy->alloc->free(bucket->slots_, n * size, policy->slot->align);
+    bucket->present_ = 0;
+    bucket->slots_ = NULL;
+  }
+}
+
+/// Creates a new table with the given capacity.
+static inline CWISS_SparseTable CWISS_SparseTable_new(
+    const CWISS_Policy* policy, size_t capacity) {
+  CWISS_SparseTable self = {CWISS_EmptyGroup(), NULL, 0, 0, 0};
+  if (capacity != 0) {
+    self.capacity_ = CWISS_NormalizeCapacity(capacity);
+    CWISS_SparseTable_InitializeSlots(policy, &self);
+  }
+  return self;
+}
+
+/// Destroys the table, freeing its memory.
+static inline void CWISS_SparseTable_destroy(const CWISS_Policy* policy,
+                                             CWISS_SparseTable* self) {
+  if (self->capacity_ == 0) return;
+  CWISS_SparseTable_DestroyBuckets(policy, self);
+  policy->alloc->free(self->ctrl_, CWISS_SparseTable_AllocSize(self->capacity_),
+                      alignof(CWISS_SparseBucket));
+  *self = CWISS_SparseTable_new(policy, 0);
+}
+
+/// Erases every element. Like a flat table, large arrays are freed rather than
+/// reused.
+static inline void CWISS_SparseTable_clear(const CWISS_Policy* policy,
+                                           CWISS_SparseTable* self) {
+  if (self->capacity_ > 127) {
+    CWISS_SparseTable_destroy(policy, self);
+  } else if (self->capacity_) {
+    CWISS_SparseTable_DestroyBuckets(policy, self);
+    self->size_ = 0;
+    CWISS_ResetCtrl(self->capacity_, self->ctrl_, NULL, 0);
+    self->growth_left_ = CWISS_CapacityToGrowth(self->capacity_);
+  }
+}
+
+/// Moves every element into a new array with the given capacity.
+///
+/// Each element's new position is found first, so that each new bucket's
+/// array can be allocated once at its final size; each old bucket's array is
+/// freed as soon as it has been emptied.
+CWISS_INLINE_NEVER
+static void CWISS_SparseTable_Resize(const CWISS_Policy* policy,
+                                     CWISS_SparseTable* self,
+                                     size_t new_capacity) {
+  CWISS_DCHECK(CWISS_IsValidCapacity(new_capacity), "invalid capacity: %zu",
+               new_capacity);
+  CWISS_SparseTable old = *self;
+  self->capacity_ = new_capacity;
+  CWISS_SparseTable_InitializeSlots(policy, self);
+
+  size_t size = policy->slot->size;
+  size_t* targets = NULL;
+  if (old.size_ != 0) {
+    targets = (size_t*)policy->alloc->alloc(old.size_ * sizeof(size_t),
+                                           alignof(size_t));
+  }
+
+  size_t k = 0;
+  for (size_t b = 0; b < CWISS_SparseTable_NumBuckets(old.capacity_); ++b) {
+    const CWISS_SparseBucket* bucket = &old.buckets_[b];
+    size_t n = CWISS_PopCount64(bucket->present_);
+    for (size_t j = 0; j < n; ++j) {
+      size_t hash =
+          policy->key->hash(policy->slot->get(bucket->slots_ + j * size));
+      size_t i =
+          CWISS_FindFirstNonFull(self->ctrl_, hash, self->capacity_).offset;
+      CWISS_SetCtrl(i, CWISS_H2(hash), self->capacity_, self->ctrl_, NULL, 0);
+      self->buckets_[i / CWISS_SparseTable_kBucketWidth].present_ |=
+          (uint64_t)1 << (i % CWISS_SparseTable_kBucketWidth);
+      targets[k++] = i;
+    }
+  }
+
+  for (size_t b = 0; b < CWISS_SparseTable_NumBuckets(new_capacity); ++b) {
+    CWISS_SparseBucket* bucket = &self->buckets_[b];
+    size_t n = CWISS_PopCount64(bucket->present_);
+    if (n != 0) {
+      bucket->slots_ =
+          (char*)policy->alloc->alloc(n * size, policy->slot->align);
+    }
+  }
+
+  k = 0;
+  for (size_t b = 0; b < CWISS_SparseTable_NumBuckets(old.capacity_); ++b) {
+    CWISS_SparseBucket* bucket = &old.buckets_[b];
+    size_t n = CWISS_PopCount64(bucket->present_);
+    if (n == 0) continue;
+    for (size_t j = 0; j < n; ++j) {
+      policy->slot->transfer(CWISS_SparseTable_Slot(policy, self, targets[k++]),
+                             bucket->slots_ + j * size);
+    }
+    policy->alloc->free(bucket->slots_, n * size, policy->slot->align);
+  }
+
+  if (targets != NULL) {
+    policy->alloc->free(targets, old.size_ * sizeof(size_t), alignof(size_t));
+  }
+  if (old.capacity_ != 0) {
+    policy->alloc->free(old.ctrl_, CWISS_SparseTable_AllocSize(old.capacity_),
+                        alignof(CWISS_SparseBucket));
+  }
+}
+
+/// Ensures that at least `n` elements can be held without a rehash.
+static inline void CWISS_SparseTable_reserve(const CWISS_Policy* policy,
+                                             CWISS_SparseTable* self,
+                                             size_t n) {
+  if (n <= self->size_ + self->growth_left_) return;
+  CWISS_SparseTable_Resize(
+      policy, self,
+      CWISS_NormalizeCapacity(CWISS_GrowthToLowerboundCapacity(n)));
+}
+
+/// Returns the number of elements in the table.
+static inline size_t CWISS_SparseTable_size(const CWISS_Policy* policy,
+                                            const CWISS_SparseTable* self) {
+  return self->size_;
+}
+
+/// Returns the number of positions in the table.
+static inline size_t CWISS_SparseTable_capacity(
+    const CWISS_Policy* policy, const CWISS_SparseTable* self) {
+  return self->capacity_;
+}
+
+/// Finds `key`, whose hash is `hash`, returning an exhausted iterator if it is
+/// not present.
+static inline CWISS_SparseIter CWISS_SparseTable_find_hinted(
+    const CWISS_Policy* policy, const CWISS_SparseTable* self, const void* key,
+    size_t hash) {
+  CWISS_ProbeSeq seq = CWISS_ProbeSeq_Start(self->ctrl_, hash, self->capacity_);
+  while (true) {
+    CWISS_Group g = CWISS_Group_new(self->ctrl_ + seq.offset_);
+    CWISS_BitMask match = CWISS_Group_Match(&g, CWISS_H2(hash));
+    uint32_t i;
+    while (CWISS_BitMask_next(&match, &i)) {
+      size_t idx = CWISS_ProbeSeq_offset(&seq, i);
+      char* slot = CWISS_SparseTable_Slot(policy, self, idx);
+      if (CWISS_LIKELY(policy->key->eq(key, policy->slot->get(slot)))) {
+        return CWISS_SparseTable_iter_at(self, idx);
+      }
+    }
+    if (CWISS_LIKELY(CWISS_Group_MatchEmpty(&g).mask)) {
+      return CWISS_SparseTable_iter_at(self, self->capacity_);
+    }
+    CWISS_ProbeSeq_next(&seq);
+    CWISS_DCHECK(seq.index_ <= self->capacity_, "full table!");
+  }
+}
+
+/// Finds `key`, returning an exhausted iterator if it is not present.
+static inline CWISS_SparseIter CWISS_SparseTable_find(
+    const CWISS_Policy* policy, const CWISS_SparseTable* self,
+    const void* key) {
+  return CWISS_SparseTable_find_hinted(policy, self, key,
+                                       policy->key->hash(key));
+}
+
+/// Returns whether `key` is present.
+static inline bool CWISS_SparseTable_contains(const CWISS_Policy* policy,
+                                              const CWISS_SparseTable* self,
+                                              const void* key) {
+  CWISS_SparseIter it = CWISS_SparseTable_find(policy, self, key);
+  return it.index_ != self->capacity_;
+}
+
+/// The return type of `CWISS_SparseTable_insert()`.
+typedef struct {
+  CWISS_SparseIter iter;
+  bool inserted;
+} CWISS_SparseInsert;
+
+/// Inserts a copy of `val` if no equal element is present.
+static inline CWISS_SparseInsert CWISS_SparseTable_insert(
+    const CWISS_Policy* policy, CWISS_SparseTable* self, const void* val) {
+  size_t hash = policy->key->hash(val);
+  CWISS_SparseIter it = CWISS_SparseTable_find_hinted(policy, self, val, hash);
+  if (it.index_ != self->capacity_) return (CWISS_SparseInsert){it, false};
+
+  if (CWISS_UNLIKELY(self->growth_left_ == 0)) {
+    size_t capacity = self->capacity_;
+    if (capacity == 0) {
+      capacity = 1;
+    } else if (capacity <= CWISS_Group_kWidth ||
+               self->size_ * UINT64_C(32) > capacity * UINT64_C(25)) {
+      capacity = capacity * 2 + 1;
+    }
+    CWISS_SparseTable_Resize(policy, self, capacity);
+  }
+
+  CWISS_FindInfo target =
+      CWISS_FindFirstNonFull(self->ctrl_, hash, self->capacity_);
+  size_t i = target.offset;
+  self->growth_left_ -= CWISS_IsEmpty(self->ctrl_[i]);
+  ++self->size_;
+  CWISS_SetCtrl(i, CWISS_H2(hash), self->capacity_, self->ctrl_, NULL, 0);
+
+  CWISS_SparseBucket* b = &self->buckets_[i / CWISS_SparseTable_kBucketWidth];
+  size_t rank = CWISS_SparseBucket_Rank(b, i);
+  CWISS_SparseBucket_Reshape(policy, b, CWISS_PopCount64(b->present_) + 1,
+                             rank, 1, 0);
+  b->present_ |= (uint64_t)1 << (i % CWISS_SparseTable_kBucketWidth);
+
+  char* slot = b->slots_ + rank * policy->slot->size;
+  policy->slot->init(slot);
+  policy->obj->copy(policy->slot->get(slot), val);
+  return (CWISS_SparseInsert){CWISS_SparseTable_iter_at(self, i), true};
+}
+
+/// Erases the element the given valid iterator points to.
+static inline void CWISS_SparseTable_erase_at(const CWISS_Policy* policy,
+                                              CWISS_SparseIter it) {
+  CWISS_SparseTable* self = it.set_;
+  size_t i = it.index_;
+  CWISS_AssertIsFull(self->ctrl_ + i);
+
+  CWISS_SparseBucket* b = &self->buckets_[i / CWISS_SparseTable_kBucketWidth];
+  size_t rank = CWISS_SparseBucket_Rank(b, i);
+  if (policy->slot->del != NULL) {
+    policy->slot->del(b->slots_ + rank * policy->slot->size);
+  }
+  CWISS_SparseBucket_Reshape(policy, b, CWISS_PopCount64(b->present_) - 1,
+                             rank, 0, 1);
+  b->present_ &= ~((uint64_t)1 << (i % CWISS_SparseTable_kBucketWidth));
+
+  --self->size_;
+  bool was_never_full = CWISS_WasNeverFull(self->ctrl_, self->capacity_, i);
+  CWISS_SetCtrl(i, was_never_full ? CWISS_kEmpty : CWISS_kDeleted,
+                self->capacity_, self->ctrl_, NULL, 0);
+  self->growth_left_ += was_never_full;
+}
+
+/// Erases `key`, if present. Returns whether it was.
+static inline bool CWISS_SparseTable_erase(const CWISS_Policy* policy,
+                                           CWISS_SparseTable* self,
+                                           const void* key) {
+  CWISS_SparseIter it = CWISS_SparseTable_find(policy, self, key);
+  if (it.index_ == self->capacity_) return false;
+  CWISS_SparseTable_erase_at(policy, it);
+  return true;
+}
+
+CWISS_END_EXTERN
+CWISS_END
+
+#endif  // CWISSTABLE_INTERNAL_SPARSE_TABLE_H_
@@ -51,6 +51,17 @@ static inline MyMap MyMap_dup(const MyMap* self);
 /// Destroys this map.
 static inline void MyMap_destroy(const MyMap* self);
 
+/// Empties this map in O(1), handing its elements off to be destroyed later.
+///
+/// The backing array is detached, leaving `self` empty and ready for reuse,
+/// with any optional tracking (dirty bits, hit counts, growth watch) turned
+/// off. Unless the map had no backing array, the detached array is passed to
+/// `executor` along with `ctx`; the elements stay alive until the executor
+/// reaps them by calling `CWISS_DetachedTable_reap()` until that returns
+/// `true`, e.g. a few thousand slots at a time on a background thread.
+static inline void MyMap_destroy_deferred(
+    MyMap* self, void (*executor)(CWISS_DetachedTable, void*), void* ctx);
+
 /// Dumps the internal contents of the table to stderr; intended only for
 /// debugging.
 ///
@@ -76,6 +87,20 @@ static inline size_t MyMap_size(const MyMap* self);
 /// in the table before a resize is triggered.
 static inline size_t MyMap_capacity(const MyMap* self);
 
+/// Returns the memory of slot pages that hold no elements to the OS, without
+/// rehashing or moving anything, and returns the number of bytes released.
+///
+/// This is meant for after a mass erasure: the table keeps its capacity, but
+/// its resident size drops to roughly that of the remaining elements. Where
+/// it can prove it safe, it also turns erased slots back into empty ones.
+/// Only available in full on POSIX systems; elsewhere, nothing is released.
+static inline size_t MyMap_release_unused(MyMap* self);
+
+/// Like `MyMap_release_unused()`, but releases memory in units of
+/// `page_size`, a power of two, such as the huge page size for a table whose
+/// allocator hands out huge pages.
+static inline size_t MyMap_release_unused_pages(MyMap* self, size_t page_size);
+
 /// Erases every element in the map.
 static inline void MyMap_clear(MyMap* self);
 
@@ -87,6 +112,13 @@ typedef struct {
 /// Creates a new non-mutating iterator fro this table.
 static inline MyMap_CIter MyMap_citer(const MyMap* self);
 
+/// Creates a new non-mutating iterator for this table that, while it is in one
+/// group of slots, prefetches the elements of the next.
+///
+/// This only differs from `MyMap_citer()` for node tables, whose iteration is
+/// otherwise bound by chasing a pointer per element.
+static inline MyMap_CIter MyMap_citer_prefetching(const MyMap* self);
+
 /// Returns a pointer to the element this iterator is at; returns `NULL` if
 /// this iterator has reached the end of the table.
 static inline const MyMap_Entry* MyMap_CIter_get(const MyMap_CIter* it);
@@ -105,6 +137,10 @@ typedef struct {
 /// Creates a new mutating iterator fro this table.
 static inline MyMap_Iter MyMap_iter(const MyMap* self);
 
+/// Creates a new mutating iterator that prefetches like
+/// `MyMap_citer_prefetching()`.
+static inline MyMap_Iter MyMap_iter_prefetching(MyMap* self);
+
 /// Returns a pointer to the element this iterator is at; returns `NULL` if
 /// this iterator has reached the end of the table.
 static inline MyMap_Entry* MyMap_Iter_get(const MyMap_Iter* it);
@@ -150,16 +186,24 @@ static inline MyMap_Iter MyMap_find_hinted(MyMap* self, const K* key,
                                            size_t hash);
 
 /// The return type of `MyMap_insert()`.
+///
+/// If the insertion was refused because the map is out of room and inline
+/// growth is disabled (see `MyMap_set_inline_growth()`), `needs_growth` is set,
+/// `inserted` is unset and `iter` is null. Otherwise, `inserted` tells a new
+/// element from one that was already present, and `iter` points to it.
 typedef struct {
   MyMap_Iter iter;
   bool inserted;
+  bool needs_growth;
 } MyMap_Insert;
 
 /// Inserts `val` into the map if it isn't already present, initializing it by
 /// copy.
 ///
 /// Returns an iterator pointing to the element in the map and whether it was
-/// just inserted or was already present.
+/// just inserted or was already present. If inline growth is disabled (see
+/// `MyMap_set_inline_growth()`) and the map is out of room, inserts nothing and
+/// sets `needs_growth` instead.
 static inline MyMap_Insert MyMap_insert(MyMap* self, const MyMap_Entry* val);
 
 /// "Inserts" `val` into the table if it isn't already present.
@@ -189,6 +233,120 @@ static inline bool MyMap_erase(MyMap* self, const K* key);
 /// advanced (although not dereferenced until advanced).
 static inline void MyMap_erase_at(MyMap_Iter it);
 
+/// Returns an iterator to an element of the map chosen uniformly at random, or
+/// an end iterator if the map is empty.
+///
+/// `rng_state` is the state of the pseudorandom generator, and is advanced by
+/// this call; any value is a valid initial state. This takes expected constant
+/// time, unless most of the map has been erased without rehashing it.
+static inline MyMap_Iter MyMap_random(MyMap* self, uint64_t* rng_state);
+static inline MyMap_CIter MyMap_crandom(const MyMap* self,
+                                        uint64_t* rng_state);
+
+/// Enables dirty-group tracking.
+///
+/// Once enabled, every insertion and erasure, and every element returned by a
+/// mutating lookup (`MyMap_find()`, `MyMap_insert()`, and friends), marks the
+/// group of slots it lives in as dirty. Together with
+/// `MyMap_next_dirty_group()` and `MyMap_apply_dirty_group()`, this allows
+/// writing incremental checkpoints that only contain the groups that changed
+/// since the last one.
+///
+/// Anything that reallocates the backing array, such as growth, marks every
+/// group as dirty, so the next checkpoint is a full snapshot. Enabling tracking
+/// does the same.
+static inline void MyMap_enable_dirty_tracking(MyMap* self);
+
+/// Disables dirty-group tracking.
+static inline void MyMap_disable_dirty_tracking(MyMap* self);
+
+/// Marks the element `it` points to as dirty.
+///
+/// Elements modified through an iterator obtained from `MyMap_iter()` must be
+/// reported with this function.
+static inline void MyMap_Iter_mark_dirty(const MyMap_Iter* it);
+
+/// Finds the next dirty group at or after `*cursor`, which should start at
+/// zero, and advances `*cursor` past it.
+///
+/// Returns `false` once all dirty groups have been visited. If dirty tracking
+/// is not enabled, every group is visited.
+static inline bool MyMap_next_dirty_group(const MyMap* self, size_t* cursor,
+                                          CWISS_DirtyGroup* out);
+
+/// Marks every group as clean; call this once a checkpoint has been written.
+static inline void MyMap_clear_dirty(MyMap* self);
+
+/// Prepares this map to have a checkpoint taken from a map with the given
+/// capacity applied to it.
+///
+/// If the capacity differs, the contents of the map are discarded; the
+/// checkpoint must then be a full snapshot.
+///
+/// The map becomes an image of the checkpointed map's backing array, which
+/// can be iterated but not searched or inserted into, since probe sequences
+/// depend on the address of the backing array. Use `MyMap_dup()` to turn it
+/// into a map that can be searched.
+static inline void MyMap_begin_apply(MyMap* self, size_t capacity);
+
+/// Overwrites a group of slots with one produced by `MyMap_next_dirty_group()`.
+///
+/// Slots are copied bytewise, so this is only meaningful for flat maps of
+/// plain old data.
+static inline void MyMap_apply_dirty_group(MyMap* self,
+                                           const CWISS_DirtyGroup* group);
+
+/// Enables per-element hit counting.
+///
+/// Once enabled, every lookup that finds an element (including an insertion
+/// that finds it already present) bumps a saturating 8-bit counter kept
+/// alongside it, at the cost of one byte per slot.
+///
+/// Lookups then write to the table even though they take it by const pointer,
+/// so they are no longer safe to run concurrently from several threads.
+static inline void MyMap_enable_hit_counting(MyMap* self);
+
+/// Disables hit counting, discarding the counts.
+static inline void MyMap_disable_hit_counting(MyMap* self);
+
+/// Reorders the map in place so that the most frequently found elements come
+/// first along their probe sequences, and then halves every hit count.
+///
+/// Like growth, this invalidates all iterators. Does nothing unless hit
+/// counting is enabled.
+static inline void MyMap_optimize_layout(MyMap* self);
+
+/// Returns the number of elements that can be inserted into empty slots before
+/// the map has to grow.
+static inline size_t MyMap_growth_left(const MyMap* self);
+
+/// Returns whether `MyMap_growth_left()` is at or below the low watermark set
+/// with `MyMap_watch_growth()`, or zero if there is none.
+static inline bool MyMap_needs_growth(const MyMap* self);
+
+/// Sets a low watermark on `MyMap_growth_left()`.
+///
+/// Whenever an insertion uses up an empty slot and leaves the growth budget
+/// at or below `low_water`, it calls `callback(ctx)` before returning, so that
+/// the application can grow the map with `MyMap_reserve()` at a time of its
+/// choosing rather than in the middle of an insertion. The callback must not
+/// touch the map, and may be called again by every such insertion until the
+/// map grows. `callback` may be null, in which case only `MyMap_needs_growth()`
+/// reports the crossing.
+static inline void MyMap_watch_growth(MyMap* self, size_t low_water,
+                                      CWISS_GrowthCallback callback, void* ctx);
+
+/// Sets whether insertions may resize or rehash the map; they may by default.
+///
+/// When they may not, an insertion that would have to inserts nothing and
+/// returns a result with `needs_growth` set; the caller should then grow the
+/// map with `MyMap_reserve()` and retry. A map with no backing array must be
+/// reserved before anything can be inserted into it.
+static inline void MyMap_set_inline_growth(MyMap* self, bool allowed);
+
+/// Removes the low watermark and allows inline growth again.
+static inline void MyMap_unwatch_growth(MyMap* self);
+
 // CWISS_DECLARE_LOOKUP(MyMap, View) expands to:
 
 /// Returns the policy used with this lookup extension.
@@ -135,6 +135,19 @@ typedef struct {
   /// in C++ parlance, `needle` could be a `std::string_view`, while `candidate`
   /// could be a `std::string`.
   bool (*eq)(const void* needle, const void* candidate);
+
+  /// Whether each key gets two candidate probe sequences, starting from groups
+  /// picked by independent bits of its hash, rather than one.
+  ///
+  /// Insertions go into whichever sequence reaches a free slot sooner, and
+  /// lookups load both first groups up front before continuing along each
+  /// sequence. This costs an extra load per lookup, which overlaps with
+  /// the first, but keeps the longest probe sequences much shorter near
+  /// maximum load.
+  ///
+  /// Only the table's own key policy is consulted; this is ignored on the
+  /// heterogenous key policies passed to lookups.
+  bool two_choice;
 } CWISS_KeyPolicy;
 
 /// A policy for allocation.
@@ -152,8 +165,42 @@ typedef struct {
   /// This function is passed the same size/alignment as was passed to `alloc`,
   /// allowing for sized-delete optimizations.
   void (*free)(void* array, size_t size, size_t align);
+
+  /// Allocates zero-filled memory that `free` can deallocate, or returns null
+  /// if that is no cheaper than `alloc` followed by `memset`.
+  ///
+  /// This may itself be null. Tables only use it when built with
+  /// `CWISS_ZERO_EMPTY_CTRL`, for backing arrays whose pages should not be
+  /// touched until they are needed; see `control_byte.h`.
+  void* (*alloc_zeroed)(size_t size, size_t align);
 } CWISS_AllocPolicy;
 
+/// Allocates `size` bytes aligned to `align` through `alloc`.
+///
+/// Allocators only have to honor the alignment of ordinary types (the default
+/// one is plain `malloc()`), so this over-allocates and aligns by hand,
+/// stashing the adjustment in the byte just before the result. `align` must be
+/// a power of two no greater than 128.
+///
+/// The result must be freed with `CWISS_FreeAligned()`.
+static inline void* CWISS_AllocAligned(const CWISS_AllocPolicy* alloc,
+                                       size_t size, size_t align) {
+  CWISS_DCHECK(align != 0 && (align & (align - 1)) == 0 && align <= 128,
+               "bad alignment: %zu", align);
+  char* base = (char*)alloc->alloc(size + align, align);
+  char* p = (char*)(((uintptr_t)base + align) & ~(uintptr_t)(align - 1));
+  p[-1] = (char)(p - base);
+  return p;
+}
+
+/// Frees memory allocated by `CWISS_AllocAligned()` with the same `size` and
+/// `align`.
+static inline void CWISS_FreeAligned(const CWISS_AllocPolicy* alloc, void* p,
+                                     size_t size, size_t align) {
+  char* base = (char*)p - ((unsigned char*)p)[-1];
+  alloc->free(base, size + align, align);
+}
+
 /// A policy for allocating space for slots.
 ///
 /// This allows us to distinguish between inline storage (more cache-friendly)
@@ -191,6 +238,13 @@ typedef struct {
   ///
   /// This function does not need to tolerate nulls.
   void* (*get)(void* slot);
+
+  /// Whether `get` follows a pointer stored in the slot, i.e., whether values
+  /// live outside of the backing array.
+  ///
+  /// This is only a performance hint: lookups use it to prefetch every
+  /// candidate value before comparing against the first one.
+  bool indirect;
 } CWISS_SlotPolicy;
 
 /// A hash table policy.
@@ -272,6 +326,18 @@ typedef struct {
     if (CWISS_EXTRACT(obj_dtor, NULL, __VA_ARGS__) != NULL) {            \
       CWISS_EXTRACT(obj_dtor, (void (*)(void*))NULL, __VA_ARGS__)(slot); \
     }                                                                    \
+  }                                                                      \
+  CWISS_EXTRACT_RAW(modifiers, static, __VA_ARGS__)                      \
+  inline void* kPolicy_##_DefaultAllocZeroed(size_t size,                \
+                                             size_t align) {             \
+    /* Small arrays are cheaper to zero by hand, and only a custom */    \
+    /* allocator's own `free` may free its memory. */                    \
+    if (size < CWISS_kDefaultCallocMinSize ||                            \
+        CWISS_EXTRACT(alloc_alloc, CWISS_DefaultMalloc, __VA_ARGS__) !=  \
+            CWISS_DefaultMalloc) {                                       \
+      return NULL;                                                       \
+    }                                                                    \
+    return CWISS_DefaultCalloc(size, align);                             \
   }                                                                      \
                                                                          \
   CWISS_EXTRACT_RAW(modifiers, static, __VA_ARGS__)                      \
@@ -285,11 +351,14 @@ typedef struct {
   const CWISS_KeyPolicy kPolicy_##_KeyPolicy = {                         \
       CWISS_EXTRACT(key_hash, kPolicy_##_DefaultHash, __VA_ARGS__),      \
       CWISS_EXTRACT(key_eq, kPolicy_##_DefaultEq, __VA_ARGS__),          \
+      CWISS_EXTRACT(key_two_choice, false, __VA_ARGS__),                 \
   };                                                                     \
   CWISS_EXTRACT_RAW(modifiers, static, __VA_ARGS__)                      \
   const CWISS_AllocPolicy kPolicy_##_AllocPolicy = {                     \
       CWISS_EXTRACT(alloc_alloc, CWISS_DefaultMalloc, __VA_ARGS__),      \
       CWISS_EXTRACT(alloc_free, CWISS_DefaultFree, __VA_ARGS__),         \
+      CWISS_EXTRACT(alloc_zeroed, kPolicy_##_DefaultAllocZeroed,         \
+                    __VA_ARGS__),                                        \
   };                                                                     \
   CWISS_EXTRACT_RAW(modifiers, static, __VA_ARGS__)                      \
   const CWISS_SlotPolicy kPolicy_##_SlotPolicy = {                       \
@@ -300,6 +369,7 @@ typedef struct {
       CWISS_EXTRACT(slot_transfer, kPolicy_##_DefaultSlotTransfer,       \
                     __VA_ARGS__),                                        \
       CWISS_EXTRACT(slot_get, kPolicy_##_DefaultSlotGet, __VA_ARGS__),   \
+      CWISS_EXTRACT(slot_indirect, false, __VA_ARGS__),                  \
   };                                                                     \
   CWISS_END                                                              \
   CWISS_EXTRACT_RAW(modifiers, static, __VA_ARGS__)                      \
@@ -338,13 +408,26 @@ typedef struct {
       (slot_init, kPolicy_##_NodeSlotInit),                 \
       (slot_dtor, kPolicy_##_NodeSlotDtor),                 \
       (slot_transfer, kPolicy_##_NodeSlotTransfer),         \
-      (slot_get, kPolicy_##_NodeSlotGet)
+      (slot_get, kPolicy_##_NodeSlotGet),                   \
+      (slot_indirect, true)
 
 static inline void* CWISS_DefaultMalloc(size_t size, size_t align) {
   void* p = malloc(size);  // TODO: Check alignment.
   CWISS_CHECK(p != NULL, "malloc() returned null");
   return p;
 }
+/// The smallest allocation that default policies zero with `calloc()`.
+///
+/// Smaller allocations may reuse freed memory, which `calloc()` must then zero
+/// in full, slots included. This is glibc's upper bound for its `mmap()`
+/// threshold, above which `calloc()` hands out fresh pages for free.
+#define CWISS_kDefaultCallocMinSize ((size_t)32 << 20)
+
+static inline void* CWISS_DefaultCalloc(size_t size, size_t align) {
+  void* p = calloc(1, size);  // TODO: Check alignment.
+  CWISS_CHECK(p != NULL, "calloc() returned null");
+  return p;
+}
 static inline void CWISS_DefaultFree(void* array, size_t size, size_t align) {
   free(array);
 }
@@ -45,6 +45,17 @@ static inline MySet MySet_dup(const MySet* self);
 /// Destroys this set.
 static inline void MySet_destroy(const MySet* self);
 
+/// Empties this set in O(1), handing its elements off to be destroyed later.
+///
+/// The backing array is detached, leaving `self` empty and ready for reuse,
+/// with any optional tracking (dirty bits, hit counts, growth watch) turned
+/// off. Unless the set had no backing array, the detached array is passed to
+/// `executor` along with `ctx`; the elements stay alive until the executor
+/// reaps them by calling `CWISS_DetachedTable_reap()` until that returns
+/// `true`, e.g. a few thousand slots at a time on a background thread.
+static inline void MySet_destroy_deferred(
+    MySet* self, void (*executor)(CWISS_DetachedTable, void*), void* ctx);
+
 /// Dumps the internal contents of the table to stderr; intended only for
 /// debugging.
 ///
@@ -70,6 +81,20 @@ static inline size_t MySet_size(const MySet* self);
 /// in the table before a resize is triggered.
 static inline size_t MySet_capacity(const MySet* self);
 
+/// Returns the memory of slot pages that hold no elements to the OS, without
+/// rehashing or moving anything, and returns the number of bytes released.
+///
+/// This is meant for after a mass erasure: the table keeps its capacity, but
+/// its resident size drops to roughly that of the remaining elements. Where
+/// it can prove it safe, it also turns erased slots back into empty ones.
+/// Only available in full on POSIX systems; elsewhere, nothing is released.
+static inline size_t MySet_release_unused(MySet* self);
+
+/// Like `MySet_release_unused()`, but releases memory in units of
+/// `page_size`, a power of two, such as the huge page size for a table whose
+/// allocator hands out huge pages.
+static inline size_t MySet_release_unused_pages(MySet* self, size_t page_size);
+
 /// Erases every element in the set.
 static inline void MySet_clear(MySet* self);
 
@@ -81,6 +106,13 @@ typedef struct {
 /// Creates a new non-mutating iterator fro this table.
 static inline MySet_CIter MySet_citer(const MySet* self);
 
+/// Creates a new non-mutating iterator for this table that, while it is in one
+/// group of slots, prefetches the elements of the next.
+///
+/// This only differs from `MySet_citer()` for node tables, whose iteration is
+/// otherwise bound by chasing a pointer per element.
+static inline MySet_CIter MySet_citer_prefetching(const MySet* self);
+
 /// Returns a pointer to the element this iterator is at; returns `NULL` if
 /// this iterator has reached the end of the table.
 static inline const T* MySet_CIter_get(const MySet_CIter* it);
@@ -99,6 +131,10 @@ typedef struct {
 /// Creates a new mutating iterator fro this table.
 static inline MySet_Iter MySet_iter(const MySet* self);
 
+/// Creates a new mutating iterator that prefetches like
+/// `MySet_citer_prefetching()`.
+static inline MySet_Iter MySet_iter_prefetching(MySet* self);
+
 /// Returns a pointer to the element this iterator is at; returns `NULL` if
 /// this iterator has reached the end of the table.
 static inline T* MySet_Iter_get(const MySet_Iter* it);
@@ -144,16 +180,24 @@ static inline MySet_Iter MySet_find_hinted(MySet* self, const T* key,
                                            size_t hash);
 
 /// The return type of `MySet_insert()`.
+///
+/// If the insertion was refused because the set is out of room and inline
+/// growth is disabled (see `MySet_set_inline_growth()`), `needs_growth` is set,
+/// `inserted` is unset and `iter` is null. Otherwise, `inserted` tells a new
+/// element from one that was already present, and `iter` points to it.
 typedef struct {
   MySet_Iter iter;
   bool inserted;
+  bool needs_growth;
 } MySet_Insert;
 
 /// Inserts `val` into the map if it isn't already present, initializing it by
 /// copy.
 ///
 /// Returns an iterator pointing to the element in the map and whether it was
-/// just inserted or was already present.
+/// just inserted or was already present. If inline growth is disabled (see
+/// `MySet_set_inline_growth()`) and the set is out of room, inserts nothing and
+/// sets `needs_growth` instead.
 static inline MySet_Insert MySet_insert(MySet* self, const T* val);
 
 /// "Inserts" `key` into the table if it isn't already present.
@@ -183,6 +227,120 @@ static inline bool MySet_erase(MySet* self, const T* key);
 /// advanced (although not dereferenced until advanced).
 static inline void MySet_erase_at(MySet_Iter it);
 
+/// Returns an iterator to an element of the set chosen uniformly at random, or
+/// an end iterator if the set is empty.
+///
+/// `rng_state` is the state of the pseudorandom generator, and is advanced by
+/// this call; any value is a valid initial state. This takes expected constant
+/// time, unless most of the set has been erased without rehashing it.
+static inline MySet_Iter MySet_random(MySet* self, uint64_t* rng_state);
+static inline MySet_CIter MySet_crandom(const MySet* self,
+                                        uint64_t* rng_state);
+
+/// Enables dirty-group tracking.
+///
+/// Once enabled, every insertion and erasure, and every element returned by a
+/// mutating lookup (`MySet_find()`, `MySet_insert()`, and friends), marks the
+/// group of slots it lives in as dirty. Together with
+/// `MySet_next_dirty_group()` and `MySet_apply_dirty_group()`, this allows
+/// writing incremental checkpoints that only contain the groups that changed
+/// since the last one.
+///
+/// Anything that reallocates the backing array, such as growth, marks every
+/// group as dirty, so the next checkpoint is a full snapshot. Enabling tracking
+/// does the same.
+static inline void MySet_enable_dirty_tracking(MySet* self);
+
+/// Disables dirty-group tracking.
+static inline void MySet_disable_dirty_tracking(MySet* self);
+
+/// Marks the element `it` points to as dirty.
+///
+/// Elements modified through an iterator obtained from `MySet_iter()` must be
+/// reported with this function.
+static inline void MySet_Iter_mark_dirty(const MySet_Iter* it);
+
+/// Finds the next dirty group at or after `*cursor`, which should start at
+/// zero, and advances `*cursor` past it.
+///
+/// Returns `false` once all dirty groups have been visited. If dirty tracking
+/// is not enabled, every group is visited.
+static inline bool MySet_next_dirty_group(const MySet* self, size_t* cursor,
+                                          CWISS_DirtyGroup* out);
+
+/// Marks every group as clean; call this once a checkpoint has been written.
+static inline void MySet_clear_dirty(MySet* self);
+
+/// Prepares this set to have a checkpoint taken from a set with the given
+/// capacity applied to it.
+///
+/// If the capacity differs, the contents of the set are discarded; the
+/// checkpoint must then be a full snapshot.
+///
+/// The set becomes an image of the checkpointed set's backing array, which
+/// can be iterated but not searched or inserted into, since probe sequences
+/// depend on the address of the backing array. Use `MySet_dup()` to turn it
+/// into a set that can be searched.
+static inline void MySet_begin_apply(MySet* self, size_t capacity);
+
+/// Overwrites a group of slots with one produced by `MySet_next_dirty_group()`.
+///
+/// Slots are copied bytewise, so this is only meaningful for flat sets of
+/// plain old data.
+static inline void MySet_apply_dirty_group(MySet* self,
+                                           const CWISS_DirtyGroup* group);
+
+/// Enables per-element hit counting.
+///
+/// Once enabled, every lookup that finds an element (including an insertion
+/// that finds it already present) bumps a saturating 8-bit counter kept
+/// alongside it, at the cost of one byte per slot.
+///
+/// Lookups then write to the table even though they take it by const pointer,
+/// so they are no longer safe to run concurrently from several threads.
+static inline void MySet_enable_hit_counting(MySet* self);
+
+/// Disables hit counting, discarding the counts.
+static inline void MySet_disable_hit_counting(MySet* self);
+
+/// Reorders the set in place so that the most frequently found elements come
+/// first along their probe sequences, and then halves every hit count.
+///
+/// Like growth, this invalidates all iterators. Does nothing unless hit
+/// counting is enabled.
+static inline void MySet_optimize_layout(MySet* self);
+
+/// Returns the number of elements that can be inserted into empty slots before
+/// the set has to grow.
+static inline size_t MySet_growth_left(const MySet* self);
+
+/// Returns whether `MySet_growth_left()` is at or below the low watermark set
+/// with `MySet_watch_growth()`, or zero if there is none.
+static inline bool MySet_needs_growth(const MySet* self);
+
+/// Sets a low watermark on `MySet_growth_left()`.
+///
+/// Whenever an insertion uses up an empty slot and leaves the growth budget
+/// at or below `low_water`, it calls `callback(ctx)` before returning, so that
+/// the application can grow the set with `MySet_reserve()` at a time of its
+/// choosing rather than in the middle of an insertion. The callback must not
+/// touch the set, and may be called again by every such insertion until the
+/// set grows. `callback` may be null, in which case only `MySet_needs_growth()`
+/// reports the crossing.
+static inline void MySet_watch_growth(MySet* self, size_t low_water,
+                                      CWISS_GrowthCallback callback, void* ctx);
+
+/// Sets whether insertions may resize or rehash the set; they may by default.
+///
+/// When they may not, an insertion that would have to inserts nothing and
+/// returns a result with `needs_growth` set; the caller should then grow the
+/// set with `MySet_reserve()` and retry. A set with no backing array must be
+/// reserved before anything can be inserted into it.
+static inline void MySet_set_inline_growth(MySet* self, bool allowed);
+
+/// Removes the low watermark and allows inline growth again.
+static inline void MySet_unwatch_growth(MySet* self);
+
 // CWISS_DECLARE_LOOKUP(MySet, View) expands to:
 
 /// Returns the policy used with this lookup extension.